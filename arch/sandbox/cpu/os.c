@@ -3,6 +3,8 @@
  * SPDX-License-Identifier:	GPL-2.0+
  */
 
+#define _GNU_SOURCE		/* for fallocate() */
+
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -63,6 +65,29 @@ off_t os_lseek(int fd, off_t offset, int whence)
 	return lseek(fd, offset, whence);
 }
 
+int os_punch_hole(int fd, off_t offset, off_t len)
+{
+	char zeroes[4096];
+	ssize_t done;
+
+	if (!fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+		       len))
+		return 0;
+
+	memset(zeroes, '\0', sizeof(zeroes));
+	if (lseek(fd, offset, SEEK_SET) == -1)
+		return -1;
+	while (len) {
+		done = write(fd, zeroes, len < sizeof(zeroes) ? len :
+			     sizeof(zeroes));
+		if (done <= 0)
+			return -1;
+		len -= done;
+	}
+
+	return 0;
+}
+
 int os_open(const char *pathname, int os_flags)
 {
 	int flags;
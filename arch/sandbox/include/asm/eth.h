@@ -14,4 +14,39 @@ void sandbox_eth_disable_response(int index, bool disable);
 
 void sandbox_eth_skip_timeout(void);
 
+int sandbox_eth_arp_requests(void);
+
+int sandbox_eth_starts(void);
+
+void sandbox_eth_set_rx_batch(int max);
+
+int sandbox_eth_rx_held(void);
+
+int sandbox_eth_rx_held_max(void);
+
+void sandbox_eth_tftp_set_file(const void *data, int size, int rtt_ms);
+
+void sandbox_eth_tftp_set_name(const char *name);
+
+void sandbox_eth_tftp_drop_block(int block);
+
+void sandbox_eth_tftp_set_max_window(int window);
+
+int sandbox_eth_tftp_window(void);
+
+int sandbox_eth_tftp_acks(void);
+
+int sandbox_eth_tftp_requests(void);
+
+void sandbox_eth_http_set_file(const void *data, int size, bool send_len);
+
+int sandbox_eth_http_requests(void);
+
+void sandbox_eth_fastboot_start(const char *const *cmds, const void *data,
+				int size, int corrupt);
+
+const char *sandbox_eth_fastboot_response(int index);
+
+int sandbox_eth_fastboot_resends(void);
+
 #endif /* __ETH_H */
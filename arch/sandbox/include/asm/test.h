@@ -19,6 +19,9 @@
 
 #define SANDBOX_CLK_RATE		32768
 
+/* Operating-condition polls which find an MMC card still powering up */
+#define SANDBOX_MMC_POWERUP_POLLS	3
+
 /* System controller driver data */
 enum {
 	SYSCON0		= 32,
@@ -79,4 +82,36 @@ long sandbox_i2c_rtc_get_set_base_time(struct udevice *dev, long base_time);
 
 int sandbox_usb_keyb_add_string(struct udevice *dev, const char *str);
 
+/**
+ * sandbox_usb_hub_get_resets() - get the port resets done on a USB bus
+ *
+ * This covers the emulated hubs on the bus since they were probed.
+ *
+ * @bus:		USB controller to check
+ * @overlapsp:		returns the number of resets started while another
+ *			port on the same controller was still being reset
+ * @return number of port resets started, or -ve on error
+ */
+int sandbox_usb_hub_get_resets(struct udevice *bus, int *overlapsp);
+
+/**
+ * sandbox_mmc_get_cmd_count() - get the number of times a command was sent
+ *
+ * @dev:		sandbox MMC device to check
+ * @cmdidx:		command index (MMC_CMD_...)
+ * @return number of times the command was sent since the device was probed
+ */
+int sandbox_mmc_get_cmd_count(struct udevice *dev, uint cmdidx);
+
+/**
+ * sandbox_mmc_set_fail_tuning() - make every tuning sample point fail
+ *
+ * This also stops data getting through in the modes which need tuning, so
+ * the card should be initialised again afterwards.
+ *
+ * @dev:		sandbox MMC device to update
+ * @fail:		true to make tuning fail, false to make it work
+ */
+void sandbox_mmc_set_fail_tuning(struct udevice *dev, bool fail);
+
 #endif
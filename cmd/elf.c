@@ -185,6 +185,7 @@ int do_bootelf(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	 * pass address parameter as argv[0] (aka command name),
 	 * and all remaining args
 	 */
+	eth_halt_before_boot();
 	rc = do_bootelf_exec((void *)addr, argc, argv);
 	if (rc != 0)
 		rcode = 1;
@@ -371,6 +372,7 @@ int do_bootvx(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 
 	printf("## Starting vxWorks at 0x%08lx ...\n", addr);
 
+	eth_halt_before_boot();
 	dcache_disable();
 #ifdef CONFIG_X86
 	/* VxWorks on x86 uses stack to pass parameters */
@@ -11,18 +11,28 @@
 #include <command.h>
 #include <console.h>
 #include <g_dnl.h>
+#include <net.h>
 #include <usb.h>
 
-static int do_fastboot(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
+static int do_fastboot_udp(void)
 {
+#ifdef CONFIG_UDP_FUNCTION_FASTBOOT
+	if (net_loop(FASTBOOT) < 0)
+		return CMD_RET_FAILURE;
+
+	return CMD_RET_SUCCESS;
+#else
+	puts("UDP fastboot not enabled\n");
+	return CMD_RET_FAILURE;
+#endif
+}
+
+static int do_fastboot_usb(const char *usb_controller)
+{
+#ifdef CONFIG_USB_FUNCTION_FASTBOOT
 	int controller_index;
-	char *usb_controller;
 	int ret;
 
-	if (argc < 2)
-		return CMD_RET_USAGE;
-
-	usb_controller = argv[1];
 	controller_index = simple_strtoul(usb_controller, NULL, 0);
 
 	ret = board_usb_init(controller_index, USB_INIT_DEVICE);
@@ -59,11 +69,28 @@ exit:
 	board_usb_cleanup(controller_index, USB_INIT_DEVICE);
 
 	return ret;
+#else
+	puts("USB fastboot not enabled\n");
+	return CMD_RET_FAILURE;
+#endif
+}
+
+static int do_fastboot(cmd_tbl_t *cmdtp, int flag, int argc, char *const argv[])
+{
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	if (!strcmp(argv[1], "udp"))
+		return do_fastboot_udp();
+
+	return do_fastboot_usb(argv[1]);
 }
 
 U_BOOT_CMD(
 	fastboot, 2, 1, do_fastboot,
-	"use USB Fastboot protocol",
+	"use USB or UDP Fastboot protocol",
 	"<USB_controller>\n"
-	"    - run as a fastboot usb device"
+	"    - run as a fastboot usb device\n"
+	"fastboot udp\n"
+	"    - run as a fastboot server on UDP port 5554 until \"continue\""
 );
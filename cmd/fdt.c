@@ -10,6 +10,7 @@
 
 #include <common.h>
 #include <command.h>
+#include <malloc.h>
 #include <linux/ctype.h>
 #include <linux/types.h>
 #include <asm/global_data.h>
@@ -21,6 +22,7 @@
 #define MAX_LEVEL	32		/* how deeply nested we will go */
 #define SCRATCHPAD	1024		/* bytes of scratchpad memory */
 #define CMD_FDT_MAX_DUMP 64
+#define FDT_APPLY_LOG_SIZE 0x4000	/* edit log for several overlays */
 
 /*
  * Global data (for the gd->bd)
@@ -645,27 +647,62 @@ static int do_fdt(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 
 	}
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
-	/* apply an overlay */
+	/* apply one or more overlays */
 	else if (strncmp(argv[1], "ap", 2) == 0) {
+		void *blobs[CONFIG_SYS_MAXARGS];
 		unsigned long addr;
 		struct fdt_header *blob;
+		void *buf;
+		int count, size;
 		int ret;
 
-		if (argc != 3)
+		if (argc < 3)
 			return CMD_RET_USAGE;
 
 		if (!working_fdt)
 			return CMD_RET_FAILURE;
 
-		addr = simple_strtoul(argv[2], NULL, 16);
-		blob = map_sysmem(addr, 0);
-		if (!fdt_valid(&blob))
-			return CMD_RET_FAILURE;
+		for (count = 0; count < argc - 2; count++) {
+			addr = simple_strtoul(argv[count + 2], NULL, 16);
+			blob = map_sysmem(addr, 0);
+			if (!fdt_valid(&blob))
+				return CMD_RET_FAILURE;
+			blobs[count] = blob;
+		}
 
-		ret = fdt_overlay_apply(working_fdt, blob);
-		if (ret) {
-			printf("fdt_overlay_apply(): %s\n", fdt_strerror(ret));
-			return CMD_RET_FAILURE;
+		if (count == 1) {
+			ret = fdt_overlay_apply(working_fdt, blobs[0]);
+			if (ret) {
+				printf("fdt_overlay_apply(): %s\n",
+				       fdt_strerror(ret));
+				return CMD_RET_FAILURE;
+			}
+		} else {
+			/*
+			 * Half the buffer is the edit log and half the index,
+			 * with room to double as the overlays add nodes
+			 */
+			size = fdt_index_size(working_fdt);
+			if (size < 0) {
+				printf("fdt_index_size(): %s\n",
+				       fdt_strerror(size));
+				return CMD_RET_FAILURE;
+			}
+			size = 2 * max(2 * size, FDT_APPLY_LOG_SIZE);
+			buf = malloc(size);
+			if (!buf) {
+				printf("Out of memory for %d overlays\n",
+				       count);
+				return CMD_RET_FAILURE;
+			}
+			ret = fdt_overlay_apply_list(working_fdt, blobs, count,
+						     buf, size);
+			free(buf);
+			if (ret) {
+				printf("fdt_overlay_apply_list(): %s\n",
+				       fdt_strerror(ret));
+				return CMD_RET_FAILURE;
+			}
 		}
 	}
 #endif
@@ -1065,7 +1102,7 @@ static int fdt_print(const char *pathp, char *prop, int depth)
 static char fdt_help_text[] =
 	"addr [-c]  <addr> [<length>]   - Set the [control] fdt location to <addr>\n"
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
-	"fdt apply <addr>                    - Apply overlay to the DT\n"
+	"fdt apply <addr> [<addr>...]        - Apply overlay(s) to the DT, in order\n"
 #endif
 #ifdef CONFIG_OF_BOARD_SETUP
 	"fdt boardsetup                      - Do board-specific set up\n"
@@ -0,0 +1,100 @@
+/*
+ * Show malloc() statistics and find leaks
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <malloc_track.h>
+
+static int do_malloc_info(cmd_tbl_t *cmdtp, int flag, int argc,
+			  char * const argv[])
+{
+	malloc_track_show_info();
+
+	return 0;
+}
+
+static int do_malloc_sites(cmd_tbl_t *cmdtp, int flag, int argc,
+			   char * const argv[])
+{
+	malloc_track_show_sites();
+
+	return 0;
+}
+
+static int do_malloc_live(cmd_tbl_t *cmdtp, int flag, int argc,
+			  char * const argv[])
+{
+	malloc_track_show_live(0);
+
+	return 0;
+}
+
+static int do_malloc_reset(cmd_tbl_t *cmdtp, int flag, int argc,
+			   char * const argv[])
+{
+	printf("peak reset to %lu bytes\n", malloc_track_reset_peak());
+
+	return 0;
+}
+
+static int do_malloc_leak(cmd_tbl_t *cmdtp, int flag, int argc,
+			  char * const argv[])
+{
+	ulong start, ticks = 0;
+	int repeatable;
+	uint seq;
+	int ret;
+
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	start = malloc_track_reset_peak();
+	seq = malloc_track_seq();
+	ret = cmd_process(0, argc - 1, argv + 1, &repeatable, &ticks);
+
+	printf("peak %lu bytes above the start\n",
+	       malloc_track_peak() - start);
+	if (malloc_track_show_live(seq))
+		printf("allocations above are still live\n");
+
+	return ret;
+}
+
+static cmd_tbl_t cmd_malloc_sub[] = {
+	U_BOOT_CMD_MKENT(info, 1, 1, do_malloc_info, "", ""),
+	U_BOOT_CMD_MKENT(sites, 1, 1, do_malloc_sites, "", ""),
+	U_BOOT_CMD_MKENT(live, 1, 1, do_malloc_live, "", ""),
+	U_BOOT_CMD_MKENT(reset, 1, 0, do_malloc_reset, "", ""),
+	U_BOOT_CMD_MKENT(leak, CONFIG_SYS_MAXARGS, 0, do_malloc_leak, "", ""),
+};
+
+static int do_malloc(cmd_tbl_t *cmdtp, int flag, int argc,
+		     char * const argv[])
+{
+	cmd_tbl_t *c;
+
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	/* Strip off leading 'malloc' command argument */
+	argc--;
+	argv++;
+
+	c = find_cmd_tbl(argv[0], cmd_malloc_sub, ARRAY_SIZE(cmd_malloc_sub));
+	if (c)
+		return c->cmd(cmdtp, flag, argc, argv);
+
+	return CMD_RET_USAGE;
+}
+
+U_BOOT_CMD(malloc, CONFIG_SYS_MAXARGS, 1, do_malloc,
+	"malloc() statistics",
+	"info                  - show heap usage and totals\n"
+	"malloc sites                 - show calls, bytes and live bytes by call site\n"
+	"malloc live                  - list allocations which are not freed\n"
+	"malloc reset                 - start a new peak usage measurement\n"
+	"malloc leak command [args..] - run a command and list what it leaves allocated"
+);
@@ -110,6 +110,21 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+static int do_wget(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	return netboot_common(WGET, cmdtp, argc, argv);
+}
+
+U_BOOT_CMD(
+	wget,	3,	1,	do_wget,
+	"boot image via network using HTTP",
+	"[loadAddress] [[hostIPaddr:]path]\n"
+	"The HTTP server port is taken from the 'httpdstp' variable\n"
+	"(default 80)."
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -281,6 +296,51 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_NET_PERSISTENT_LINK)
+static int do_eth(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	if (argc != 2 || strcmp(argv[1], "stop"))
+		return CMD_RET_USAGE;
+
+	eth_halt();
+
+	return CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	eth,	2,	1,	do_eth,
+	"control the network device",
+	"stop\n"
+	"    - halt the network device left running by earlier commands"
+);
+#endif
+
+#if defined(CONFIG_CMD_ARP)
+static int do_arp(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	if (argc == 1) {
+		arp_cache_show();
+		return CMD_RET_SUCCESS;
+	}
+
+	if (argc == 2 && !strcmp(argv[1], "flush")) {
+		arp_cache_flush();
+		return CMD_RET_SUCCESS;
+	}
+
+	return CMD_RET_USAGE;
+}
+
+U_BOOT_CMD(
+	arp,	2,	1,	do_arp,
+	"show or flush the ARP cache",
+	"\n"
+	"    - show the MAC addresses of hosts on the local network\n"
+	"arp flush\n"
+	"    - forget them all"
+);
+#endif
+
 #if defined(CONFIG_CMD_CDP)
 
 static void cdp_update_env(void)
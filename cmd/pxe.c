@@ -14,6 +14,8 @@
 #include <errno.h>
 #include <linux/list.h>
 #include <fs.h>
+#include <net.h>
+#include <net/tftp.h>
 #include <asm/io.h>
 
 #include "menu.h"
@@ -224,29 +226,17 @@ static int get_relfile(cmd_tbl_t *cmdtp, const char *file_path,
 }
 
 /*
- * Retrieve the file at 'file_path' to the locate given by 'file_addr'. If
- * 'bootfile' was specified in the environment, the path to bootfile will be
- * prepended to 'file_path' and the resulting path will be used.
+ * The file just retrieved to 'file_addr' comes without a NUL byte at the
+ * end, so find out its size and add the NUL byte.
  *
  * Returns 1 on success, or < 0 for error.
  */
-static int get_pxe_file(cmd_tbl_t *cmdtp, const char *file_path,
-	unsigned long file_addr)
+static int terminate_pxe_file(unsigned long file_addr)
 {
 	unsigned long config_file_size;
 	char *tftp_filesize;
-	int err;
 	char *buf;
 
-	err = get_relfile(cmdtp, file_path, file_addr);
-
-	if (err < 0)
-		return err;
-
-	/*
-	 * the file comes without a NUL byte at the end, so find out its size
-	 * and add the NUL byte.
-	 */
 	tftp_filesize = from_env("filesize");
 
 	if (!tftp_filesize)
@@ -262,40 +252,79 @@ static int get_pxe_file(cmd_tbl_t *cmdtp, const char *file_path,
 	return 1;
 }
 
+/*
+ * Retrieve the file at 'file_path' to the locate given by 'file_addr'. If
+ * 'bootfile' was specified in the environment, the path to bootfile will be
+ * prepended to 'file_path' and the resulting path will be used.
+ *
+ * Returns 1 on success, or < 0 for error.
+ */
+static int get_pxe_file(cmd_tbl_t *cmdtp, const char *file_path,
+	unsigned long file_addr)
+{
+	int err;
+
+	err = get_relfile(cmdtp, file_path, file_addr);
+
+	if (err < 0)
+		return err;
+
+	return terminate_pxe_file(file_addr);
+}
+
 #ifdef CONFIG_CMD_NET
 
 #define PXELINUX_DIR "pxelinux.cfg/"
 
 /*
- * Retrieves a file in the 'pxelinux.cfg' folder. Since this uses get_pxe_file
- * to do the hard work, the location of the 'pxelinux.cfg' folder is generated
- * from the bootfile path, as described above.
+ * Paths of the config files to try, most specific first.
+ */
+struct pxe_paths {
+	char path[TFTP_PROBE_MAX][MAX_TFTP_PATH_LEN + 1];
+	int count;
+};
+
+/*
+ * Adds a file in the 'pxelinux.cfg' folder to the paths to try. The location
+ * of the 'pxelinux.cfg' folder is generated from the bootfile path, as
+ * described above.
  *
  * Returns 1 on success or < 0 on error.
  */
-static int get_pxelinux_path(cmd_tbl_t *cmdtp, const char *file,
-	unsigned long pxefile_addr_r)
+static int add_pxelinux_path(struct pxe_paths *paths, const char *file)
 {
-	size_t base_len = strlen(PXELINUX_DIR);
-	char path[MAX_TFTP_PATH_LEN+1];
+	char *path;
+	int err;
 
-	if (base_len + strlen(file) > MAX_TFTP_PATH_LEN) {
-		printf("path (%s%s) too long, skipping\n",
-				PXELINUX_DIR, file);
+	if (paths->count == TFTP_PROBE_MAX)
+		return -ENOSPC;
+
+	path = paths->path[paths->count];
+	err = get_bootfile_path(PXELINUX_DIR, path, MAX_TFTP_PATH_LEN);
+
+	if (err < 0)
+		return err;
+
+	if (strlen(path) + strlen(PXELINUX_DIR) + strlen(file) >
+	    MAX_TFTP_PATH_LEN) {
+		printf("path (%s%s%s) too long, skipping\n",
+				path, PXELINUX_DIR, file);
 		return -ENAMETOOLONG;
 	}
 
-	sprintf(path, PXELINUX_DIR "%s", file);
+	strcat(path, PXELINUX_DIR);
+	strcat(path, file);
+	paths->count++;
 
-	return get_pxe_file(cmdtp, path, pxefile_addr_r);
+	return 1;
 }
 
 /*
- * Looks for a pxe file with a name based on the pxeuuid environment variable.
+ * Adds a pxe file with a name based on the pxeuuid environment variable.
  *
  * Returns 1 on success or < 0 on error.
  */
-static int pxe_uuid_path(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
+static int pxe_uuid_path(struct pxe_paths *paths)
 {
 	char *uuid_str;
 
@@ -304,16 +333,16 @@ static int pxe_uuid_path(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
 	if (!uuid_str)
 		return -ENOENT;
 
-	return get_pxelinux_path(cmdtp, uuid_str, pxefile_addr_r);
+	return add_pxelinux_path(paths, uuid_str);
 }
 
 /*
- * Looks for a pxe file with a name based on the 'ethaddr' environment
+ * Adds a pxe file with a name based on the 'ethaddr' environment
  * variable.
  *
  * Returns 1 on success or < 0 on error.
  */
-static int pxe_mac_path(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
+static int pxe_mac_path(struct pxe_paths *paths)
 {
 	char mac_str[21];
 	int err;
@@ -323,33 +352,25 @@ static int pxe_mac_path(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
 	if (err < 0)
 		return err;
 
-	return get_pxelinux_path(cmdtp, mac_str, pxefile_addr_r);
+	return add_pxelinux_path(paths, mac_str);
 }
 
 /*
- * Looks for pxe files with names based on our IP address. See pxelinux
+ * Adds pxe files with names based on our IP address. See pxelinux
  * documentation for details on what these file names look like.  We match
  * that exactly.
- *
- * Returns 1 on success or < 0 on error.
  */
-static int pxe_ipaddr_paths(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
+static void pxe_ipaddr_paths(struct pxe_paths *paths)
 {
 	char ip_addr[9];
-	int mask_pos, err;
+	int mask_pos;
 
 	sprintf(ip_addr, "%08X", ntohl(net_ip.s_addr));
 
 	for (mask_pos = 7; mask_pos >= 0;  mask_pos--) {
-		err = get_pxelinux_path(cmdtp, ip_addr, pxefile_addr_r);
-
-		if (err > 0)
-			return err;
-
+		add_pxelinux_path(paths, ip_addr);
 		ip_addr[mask_pos] = '\0';
 	}
-
-	return -ENOENT;
 }
 
 /*
@@ -362,6 +383,10 @@ static int pxe_ipaddr_paths(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
  * MAC addr comes from ethaddr env variable, if defined
  * IP
  *
+ * All the paths are asked for at once, and the first one that the server
+ * has is used, so that a slow server costs one round trip rather than one
+ * per missing file.
+ *
  * see http://syslinux.zytor.com/wiki/index.php/PXELINUX
  *
  * Returns 0 on success or 1 on error.
@@ -369,9 +394,11 @@ static int pxe_ipaddr_paths(cmd_tbl_t *cmdtp, unsigned long pxefile_addr_r)
 static int
 do_pxe_get(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
+	const char *names[TFTP_PROBE_MAX];
+	struct pxe_paths paths;
 	char *pxefile_addr_str;
 	unsigned long pxefile_addr_r;
-	int err, i = 0;
+	int err, i;
 
 	do_getfile = do_get_tftp;
 
@@ -388,25 +415,21 @@ do_pxe_get(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 	if (err < 0)
 		return 1;
 
-	/*
-	 * Keep trying paths until we successfully get a file we're looking
-	 * for.
-	 */
-	if (pxe_uuid_path(cmdtp, pxefile_addr_r) > 0 ||
-	    pxe_mac_path(cmdtp, pxefile_addr_r) > 0 ||
-	    pxe_ipaddr_paths(cmdtp, pxefile_addr_r) > 0) {
-		printf("Config file found\n");
+	paths.count = 0;
+	pxe_uuid_path(&paths);
+	pxe_mac_path(&paths);
+	pxe_ipaddr_paths(&paths);
+	for (i = 0; pxe_default_paths[i]; i++)
+		add_pxelinux_path(&paths, pxe_default_paths[i]);
 
-		return 0;
-	}
+	for (i = 0; i < paths.count; i++)
+		names[i] = paths.path[i];
 
-	while (pxe_default_paths[i]) {
-		if (get_pxelinux_path(cmdtp, pxe_default_paths[i],
-				      pxefile_addr_r) > 0) {
-			printf("Config file found\n");
-			return 0;
-		}
-		i++;
+	i = tftp_probe(names, paths.count, pxefile_addr_r);
+	if (i >= 0 && terminate_pxe_file(pxefile_addr_r) > 0) {
+		printf("Config file found: %s\n", names[i]);
+
+		return 0;
 	}
 
 	printf("Config file not found\n");
@@ -12,6 +12,7 @@
 #include <console.h>
 #include <fdtdec.h>
 #include <menu.h>
+#include <mmc.h>
 #include <post.h>
 #include <u-boot/sha256.h>
 
@@ -95,6 +96,9 @@ static int passwd_abort(uint64_t etime)
 			if (slow_equals(sha, sha_env, SHA256_SUM_LEN))
 				abort = 1;
 		}
+#ifdef CONFIG_MMC_BACKGROUND_INIT
+		mmc_do_init_poll();
+#endif
 	} while (!abort && get_ticks() <= etime);
 
 	return abort;
@@ -172,6 +176,9 @@ static int passwd_abort(uint64_t etime)
 				abort = 1;
 			}
 		}
+#ifdef CONFIG_MMC_BACKGROUND_INIT
+		mmc_do_init_poll();
+#endif
 	} while (!abort && get_ticks() <= etime);
 
 	return abort;
@@ -243,6 +250,9 @@ static int __abortboot(int bootdelay)
 # endif
 				break;
 			}
+#ifdef CONFIG_MMC_BACKGROUND_INIT
+			mmc_do_init_poll();
+#endif
 			udelay(10000);
 		} while (!abort && get_timer(ts) < 1000);
 
@@ -307,6 +307,13 @@ static int initr_of_live(void)
 }
 #endif
 
+#ifdef CONFIG_OF_LIBFDT_INDEX
+static int initr_fdt_index(void)
+{
+	return fdtdec_setup_index();
+}
+#endif
+
 #ifdef CONFIG_DM
 static int initr_dm(void)
 {
@@ -787,6 +794,9 @@ static init_fnc_t init_sequence_r[] = {
 #ifdef CONFIG_OF_LIVE
 	initr_of_live,
 #endif
+#ifdef CONFIG_OF_LIBFDT_INDEX
+	initr_fdt_index,
+#endif
 #ifdef CONFIG_DM
 	initr_dm,
 #endif
@@ -82,6 +82,7 @@ int run_usb_dnl_gadget(int usbctrl_index, char *usb_dnl_gadget)
 
 		WATCHDOG_RESET();
 		usb_gadget_handle_interrupts(usbctrl_index);
+		dfu_write_poll();
 	}
 exit:
 	g_dnl_unregister();
@@ -1,3 +1,8 @@
+#if CONFIG_IS_ENABLED(SYS_MALLOC_TRACK)
+/* The public functions are wrappers in malloc_track.c */
+#define USE_DL_PREFIX
+#endif
+
 #include <common.h>
 
 #if defined(CONFIG_UNIT_TEST)
@@ -155,7 +155,10 @@ static inline int write_env(struct mmc *mmc, unsigned long size,
 	blk_start	= ALIGN(offset, mmc->write_bl_len) / mmc->write_bl_len;
 	blk_cnt		= ALIGN(size, mmc->write_bl_len) / mmc->write_bl_len;
 
+	/* Ask the card not to tear the environment if power fails */
+	mmc->reliable_write = 1;
 	n = blk_dwrite(desc, blk_start, blk_cnt, (u_char *)buffer);
+	mmc->reliable_write = 0;
 
 	return (n == blk_cnt) ? 0 : -1;
 }
@@ -0,0 +1,107 @@
+/*
+ * Parts of fastboot shared by the USB and UDP transports
+ *
+ * (C) Copyright 2014 Linaro, Ltd.
+ * Rob Herring <robh@kernel.org>
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <fastboot.h>
+#include <malloc.h>
+#include <version.h>
+
+#define FASTBOOT_VERSION		"0.4"
+
+char *fb_response_str;
+static void (*fb_progress)(void);
+static unsigned int fb_max_download_size;
+
+void fastboot_fail(const char *reason)
+{
+	strncpy(fb_response_str, "FAIL\0", 5);
+	strncat(fb_response_str, reason, FASTBOOT_RESPONSE_LEN - 4 - 1);
+}
+
+void fastboot_okay(const char *reason)
+{
+	strncpy(fb_response_str, "OKAY\0", 5);
+	strncat(fb_response_str, reason, FASTBOOT_RESPONSE_LEN - 4 - 1);
+}
+
+void fastboot_progress(void)
+{
+	if (fb_progress)
+		fb_progress();
+}
+
+void fastboot_set_progress_callback(void (*progress)(void))
+{
+	fb_progress = progress;
+}
+
+void fastboot_set_max_download_size(unsigned int size)
+{
+	fb_max_download_size = size;
+}
+
+static int strcmp_l1(const char *s1, const char *s2)
+{
+	if (!s1 || !s2)
+		return -1;
+	return strncmp(s1, s2, strlen(s1));
+}
+
+void fastboot_getvar(const char *cmd)
+{
+	size_t chars_left;
+	const char *s;
+
+	strcpy(fb_response_str, "OKAY");
+	chars_left = FASTBOOT_RESPONSE_LEN - strlen(fb_response_str) - 1;
+
+	if (!strcmp_l1("version", cmd)) {
+		strncat(fb_response_str, FASTBOOT_VERSION, chars_left);
+	} else if (!strcmp_l1("bootloader-version", cmd)) {
+		strncat(fb_response_str, U_BOOT_VERSION, chars_left);
+	} else if (!strcmp_l1("downloadsize", cmd) ||
+		!strcmp_l1("max-download-size", cmd)) {
+		char str_num[12];
+
+		sprintf(str_num, "0x%08x", fb_max_download_size ?
+			fb_max_download_size : CONFIG_FASTBOOT_BUF_SIZE);
+		strncat(fb_response_str, str_num, chars_left);
+	} else if (!strcmp_l1("serialno", cmd)) {
+		s = getenv("serial#");
+		if (s)
+			strncat(fb_response_str, s, chars_left);
+		else
+			fastboot_fail("Value not set");
+	} else {
+		char *envstr;
+
+		envstr = malloc(strlen("fastboot.") + strlen(cmd) + 1);
+		if (!envstr) {
+			fastboot_fail("malloc error");
+			return;
+		}
+
+		sprintf(envstr, "fastboot.%s", cmd);
+		s = getenv(envstr);
+		if (s) {
+			strncat(fb_response_str, s, chars_left);
+		} else {
+			printf("WARNING: unknown variable: %s\n", cmd);
+			fastboot_fail("Variable not implemented");
+		}
+
+		free(envstr);
+	}
+}
+
+int __weak fb_set_reboot_flag(void)
+{
+	return -ENOSYS;
+}
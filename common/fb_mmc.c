@@ -31,8 +31,12 @@
 
 #define BOOT_PARTITION_NAME "boot"
 
+/* Blocks written at a time by write_raw_image(), between progress calls */
+#define FB_MMC_RAW_CHUNK_BLKS	0x8000
+
 struct fb_mmc_sparse {
 	struct blk_desc	*dev_desc;
+	bool		trim;		/* Erase single blocks with TRIM */
 };
 
 static int part_get_info_by_name_or_alias(struct blk_desc *dev_desc,
@@ -72,12 +76,51 @@ static lbaint_t fb_mmc_sparse_reserve(struct sparse_storage *info,
 	return blkcnt;
 }
 
+static lbaint_t fb_mmc_sparse_erase(struct sparse_storage *info,
+		lbaint_t blk, lbaint_t blkcnt)
+{
+	struct fb_mmc_sparse *sparse = info->priv;
+	lbaint_t blks;
+
+	if (sparse->trim)
+		blks = mmc_trim(sparse->dev_desc, blk, blkcnt);
+	else
+		blks = blk_derase(sparse->dev_desc, blk, blkcnt);
+	if (blks != blkcnt)
+		return 0;
+
+	return blkcnt;
+}
+
+static void fb_mmc_sparse_init(struct sparse_storage *sparse,
+			       struct fb_mmc_sparse *sparse_priv,
+			       struct blk_desc *dev_desc,
+			       disk_partition_t *info)
+{
+	struct mmc *mmc = find_mmc_device(dev_desc->devnum);
+
+	sparse_priv->dev_desc = dev_desc;
+	/* Only the sparse writer uses TRIM, to erase around written blocks */
+	sparse_priv->trim = mmc && mmc->can_trim;
+
+	sparse->blksz = info->blksz;
+	sparse->start = info->start;
+	sparse->size = info->size;
+	sparse->write = fb_mmc_sparse_write;
+	sparse->reserve = fb_mmc_sparse_reserve;
+	sparse->erase = fb_mmc_sparse_erase;
+	sparse->erase_grp = sparse_priv->trim ? 1 : dev_desc->erase_grp;
+	sparse->erase_val = dev_desc->erase_val;
+	sparse->priv = sparse_priv;
+}
+
 static void write_raw_image(struct blk_desc *dev_desc, disk_partition_t *info,
 		const char *part_name, void *buffer,
 		unsigned int download_bytes)
 {
 	lbaint_t blkcnt;
 	lbaint_t blks;
+	lbaint_t done;
 
 	/* determine number of blocks to write */
 	blkcnt = ((download_bytes + (info->blksz - 1)) & ~(info->blksz - 1));
@@ -91,11 +134,16 @@ static void write_raw_image(struct blk_desc *dev_desc, disk_partition_t *info,
 
 	puts("Flashing Raw Image\n");
 
-	blks = blk_dwrite(dev_desc, info->start, blkcnt, buffer);
-	if (blks != blkcnt) {
-		error("failed writing to device %d\n", dev_desc->devnum);
-		fastboot_fail("failed writing to device");
-		return;
+	for (done = 0; done < blkcnt; done += blks) {
+		blks = min(blkcnt - done, (lbaint_t)FB_MMC_RAW_CHUNK_BLKS);
+		if (blk_dwrite(dev_desc, info->start + done, blks,
+			       buffer + done * info->blksz) != blks) {
+			error("failed writing to device %d\n",
+			      dev_desc->devnum);
+			fastboot_fail("failed writing to device");
+			return;
+		}
+		fastboot_progress();
 	}
 
 	printf("........ wrote " LBAFU " bytes to '%s'\n", blkcnt * info->blksz,
@@ -162,7 +210,7 @@ static int fb_mmc_update_zimage(struct blk_desc *dev_desc,
 				void *download_buffer,
 				unsigned int download_bytes)
 {
-	u32 hdr_addr;				/* boot image header address */
+	ulong hdr_addr;				/* boot image header address */
 	struct andr_img_hdr *hdr;		/* boot image header */
 	lbaint_t hdr_sectors;			/* boot image header sectors */
 	u8 *ramdisk_buffer;
@@ -185,7 +233,7 @@ static int fb_mmc_update_zimage(struct blk_desc *dev_desc,
 	}
 
 	/* Put boot image header in fastboot buffer after downloaded zImage */
-	hdr_addr = (u32)download_buffer + ALIGN(download_bytes, PAGE_SIZE);
+	hdr_addr = (ulong)download_buffer + ALIGN(download_bytes, PAGE_SIZE);
 	hdr = (struct andr_img_hdr *)hdr_addr;
 
 	/* Read boot image header */
@@ -331,18 +379,11 @@ void fb_mmc_flash_write(const char *cmd, void *download_buffer,
 		struct fb_mmc_sparse sparse_priv;
 		struct sparse_storage sparse;
 
-		sparse_priv.dev_desc = dev_desc;
-
-		sparse.blksz = info.blksz;
-		sparse.start = info.start;
-		sparse.size = info.size;
-		sparse.write = fb_mmc_sparse_write;
-		sparse.reserve = fb_mmc_sparse_reserve;
+		fb_mmc_sparse_init(&sparse, &sparse_priv, dev_desc, &info);
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
 		       sparse.start);
 
-		sparse.priv = &sparse_priv;
 		write_sparse_image(&sparse, cmd, download_buffer,
 				   download_bytes);
 	} else {
@@ -351,6 +392,40 @@ void fb_mmc_flash_write(const char *cmd, void *download_buffer,
 	}
 }
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+struct sparse_stream *fb_mmc_stream_start(const char *cmd, void *buf,
+					  unsigned int buf_size)
+{
+	static struct fb_mmc_sparse sparse_priv;
+	static struct sparse_storage sparse;
+	static struct sparse_stream stream;
+	struct blk_desc *dev_desc;
+	disk_partition_t info;
+
+	dev_desc = blk_get_dev("mmc", CONFIG_FASTBOOT_FLASH_MMC_DEV);
+	if (!dev_desc || dev_desc->type == DEV_TYPE_UNKNOWN) {
+		error("invalid mmc device\n");
+		fastboot_fail("invalid mmc device");
+		return NULL;
+	}
+
+	if (part_get_info_by_name_or_alias(dev_desc, cmd, &info) < 0) {
+		error("cannot find partition: '%s'\n", cmd);
+		fastboot_fail("cannot find partition");
+		return NULL;
+	}
+
+	fb_mmc_sparse_init(&sparse, &sparse_priv, dev_desc, &info);
+
+	printf("Streaming sparse image to offset " LBAFU "\n", sparse.start);
+
+	sparse_stream_start(&stream, &sparse, cmd, buf,
+			    buf_size - buf_size % info.blksz);
+
+	return &stream;
+}
+#endif
+
 void fb_mmc_erase(const char *cmd)
 {
 	int ret;
@@ -11,6 +11,7 @@
 #include <fastboot.h>
 #include <image-sparse.h>
 
+#include <linux/math64.h>
 #include <linux/mtd/mtd.h>
 #include <jffs2/jffs2.h>
 #include <nand.h>
@@ -129,20 +130,42 @@ static lbaint_t fb_nand_sparse_write(struct sparse_storage *info,
 static lbaint_t fb_nand_sparse_reserve(struct sparse_storage *info,
 		lbaint_t blk, lbaint_t blkcnt)
 {
-	int bad_blocks = 0;
+	struct fb_nand_sparse *sparse = info->priv;
+	struct mtd_info *mtd = sparse->mtd;
+	loff_t offset = (loff_t)blk * info->blksz;
+	loff_t end = sparse->part->offset + sparse->part->size;
+	loff_t left = (loff_t)blkcnt * info->blksz;
+	loff_t block, len;
 
-/*
- * TODO - implement a function to determine the total number
- * of blocks which must be used in order to reserve the specified
- * number ("blkcnt") of "good-blocks", starting at "blk"...
- * ( possibly something like the "check_skip_len()" function )
- */
+	/*
+	 * Skip the bad blocks in the space, as nand_write_skip_bad() does, so
+	 * the return value is 'blkcnt' ("good-blocks") plus the pages in the
+	 * "bad-blocks" encountered within this space...
+	 */
+	while (left > 0 && offset < end) {
+		block = offset & ~(loff_t)(mtd->erasesize - 1);
+		len = block + mtd->erasesize - offset;
+		if (nand_block_isbad(mtd, block)) {
+			printf("Skipping bad block 0x%08llx\n", block);
+		} else {
+			len = min(len, left);
+			left -= len;
+		}
+		offset += len;
+	}
 
+	return div_u64(offset + left, info->blksz) - blk;
+}
+
+static lbaint_t fb_nand_sparse_erase(struct sparse_storage *info,
+		lbaint_t blk, lbaint_t blkcnt)
+{
 	/*
-	 * the return value must be 'blkcnt' ("good-blocks") plus the
-	 * number of "bad-blocks" encountered within this space...
+	 * NAND pages cannot be written without erasing them first, so the
+	 * partition is already erased and the blocks only need skipping, along
+	 * with any bad blocks among them
 	 */
-	return blkcnt + bad_blocks;
+	return fb_nand_sparse_reserve(info, blk, blkcnt);
 }
 
 void fb_nand_flash_write(const char *cmd, void *download_buffer,
@@ -175,6 +198,9 @@ void fb_nand_flash_write(const char *cmd, void *download_buffer,
 		sparse.size = part->size / sparse.blksz;
 		sparse.write = fb_nand_sparse_write;
 		sparse.reserve = fb_nand_sparse_reserve;
+		sparse.erase = fb_nand_sparse_erase;
+		sparse.erase_grp = 1;
+		sparse.erase_val = 0xff;
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
 		       sparse.start);
@@ -14,6 +14,7 @@
 #include <errno.h>
 #include <image.h>
 #include <libfdt.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <asm/io.h>
 
@@ -458,14 +459,52 @@ __weak int ft_verify_fdt(void *fdt)
 	return 1;
 }
 
+/* Size of the log used to batch the fixups in image_setup_libfdt() */
+#define FDT_TXN_LOG_SIZE	0x4000
+
+/*
+ * Record property edits in a log instead of moving the blob for each one.
+ * Returns the log, or NULL to edit the blob directly.
+ */
+static void *image_fdt_txn_begin(struct fdt_txn *txn, void *blob)
+{
+	void *log;
+
+	if (!IS_ENABLED(CONFIG_OF_LIBFDT_TXN))
+		return NULL;
+
+	log = malloc(FDT_TXN_LOG_SIZE);
+	if (log && fdt_txn_begin(txn, blob, log, FDT_TXN_LOG_SIZE)) {
+		free(log);
+		log = NULL;
+	}
+
+	return log;
+}
+
+static int image_fdt_txn_end(struct fdt_txn *txn, void *log)
+{
+	int ret;
+
+	if (!log)
+		return 0;
+	ret = fdt_txn_commit(txn);
+	free(log);
+
+	return ret;
+}
+
 int image_setup_libfdt(bootm_headers_t *images, void *blob,
 		       int of_size, struct lmb *lmb)
 {
 	ulong *initrd_start = &images->initrd_start;
 	ulong *initrd_end = &images->initrd_end;
+	struct fdt_txn txn;
+	void *txn_log;
 	int ret = -EPERM;
 	int fdt_ret;
 
+	txn_log = image_fdt_txn_begin(&txn, blob);
 	if (fdt_root(blob) < 0) {
 		printf("ERROR: root node setup failed\n");
 		goto err;
@@ -497,6 +536,13 @@ int image_setup_libfdt(bootm_headers_t *images, void *blob,
 		}
 	}
 
+	fdt_ret = image_fdt_txn_end(&txn, txn_log);
+	txn_log = NULL;
+	if (fdt_ret) {
+		printf("ERROR: fdt fixup failed: %s\n", fdt_strerror(fdt_ret));
+		goto err;
+	}
+
 	/* Delete the old LMB reservation */
 	if (lmb)
 		lmb_free(lmb, (phys_addr_t)(u32)(uintptr_t)blob,
@@ -526,6 +572,7 @@ int image_setup_libfdt(bootm_headers_t *images, void *blob,
 
 	return 0;
 err:
+	image_fdt_txn_end(&txn, txn_log);
 	printf(" - must RESET the board to recover.\n\n");
 
 	return ret;
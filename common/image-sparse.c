@@ -49,39 +49,188 @@
 #define CONFIG_FASTBOOT_FLASH_FILLBUF_SIZE (1024 * 512)
 #endif
 
-void write_sparse_image(
-		struct sparse_storage *info, const char *part_name,
-		void *data, unsigned sz)
+/* Report a failure and ignore the rest of the image */
+static int sparse_stream_fail(struct sparse_stream *ss, const char *reason)
 {
-	lbaint_t blk;
-	lbaint_t blkcnt;
+	fastboot_fail(reason);
+	ss->state = SPARSE_STATE_ERROR;
+
+	return -1;
+}
+
+/* Gather @want bytes at @dest, returning the number of bytes used */
+static unsigned int sparse_collect(struct sparse_stream *ss, void *dest,
+				   unsigned int want, const void *data,
+				   unsigned int len)
+{
+	unsigned int n = min(len, want - ss->hdr_got);
+
+	memcpy(dest + ss->hdr_got, data, n);
+	ss->hdr_got += n;
+
+	return n;
+}
+
+static int sparse_write_blocks(struct sparse_stream *ss, lbaint_t blkcnt,
+			       const void *data)
+{
+	struct sparse_storage *info = ss->info;
 	lbaint_t blks;
-	uint32_t bytes_written = 0;
-	unsigned int chunk;
-	unsigned int offset;
-	unsigned int chunk_data_sz;
-	uint32_t *fill_buf = NULL;
-	uint32_t fill_val;
-	sparse_header_t *sparse_header;
-	chunk_header_t *chunk_header;
-	uint32_t total_blocks = 0;
+
+	blks = info->write(info, ss->blk, blkcnt, data);
+	/* blks might be > blkcnt (eg. NAND bad-blocks) */
+	if (blks < blkcnt) {
+		printf("%s: %s" LBAFU " [" LBAFU "]\n",
+		       __func__, "Write failed, block #", ss->blk, blks);
+		return sparse_stream_fail(ss, "flash write failure");
+	}
+	ss->blk += blks;
+	ss->bytes_written += blkcnt * info->blksz;
+
+	return 0;
+}
+
+/* Write the raw data gathered in the buffer */
+static int sparse_flush(struct sparse_stream *ss)
+{
+	int ret;
+
+	if (!ss->buf_fill)
+		return 0;
+	ret = sparse_write_blocks(ss, ss->buf_fill / ss->info->blksz, ss->buf);
+	ss->buf_fill = 0;
+
+	return ret;
+}
+
+/*
+ * Split the next @blkcnt blocks into @head blocks before the first whole
+ * erase group and @mid blocks of whole groups, if they can be erased
+ */
+static void sparse_erase_range(struct sparse_stream *ss, lbaint_t blkcnt,
+			       lbaint_t *head, lbaint_t *mid)
+{
+	struct sparse_storage *info = ss->info;
+	unsigned int rem;
+
+	*head = blkcnt;
+	*mid = 0;
+	if (!info->erase || !info->erase_grp ||
+	    ss->blk + blkcnt > info->start + info->size)
+		return;
+
+	div_u64_rem(ss->blk, info->erase_grp, &rem);
+	*head = rem ? min(blkcnt, info->erase_grp - rem) : 0;
+	div_u64_rem(blkcnt - *head, info->erase_grp, &rem);
+	*mid = blkcnt - *head - rem;
+}
+
+static int sparse_erase_blocks(struct sparse_stream *ss, lbaint_t blkcnt)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t blks;
+
+	blks = info->erase(info, ss->blk, blkcnt);
+	if (blks < blkcnt) {
+		printf("%s: Erase failed, block #" LBAFU "\n", __func__,
+		       ss->blk);
+		return -1;
+	}
+	ss->blk += blks;
+	ss->blks_erased += blkcnt;
+
+	return 0;
+}
+
+static int sparse_fill_blocks(struct sparse_stream *ss,
+			      const uint32_t *fill_buf,
+			      lbaint_t fill_buf_num_blks, lbaint_t blkcnt)
+{
+	lbaint_t i, j;
+	int ret;
+
+	for (i = 0; i < blkcnt; i += j) {
+		j = min(blkcnt - i, fill_buf_num_blks);
+		ret = sparse_write_blocks(ss, j, fill_buf);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int sparse_fill(struct sparse_stream *ss)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t blkcnt, head, mid;
+	lbaint_t i;
+	uint32_t *fill_buf;
 	int fill_buf_num_blks;
-	int i;
-	int j;
+	int ret;
+
+	blkcnt = ss->header.blk_sz * ss->chunk.chunk_sz / info->blksz;
+	head = blkcnt;
+	mid = 0;
+	/* Erasing is quicker, when it leaves the same data */
+	if (info->erase_val >= 0 &&
+	    ss->fill_val == info->erase_val * 0x01010101U)
+		sparse_erase_range(ss, blkcnt, &head, &mid);
 
 	fill_buf_num_blks = CONFIG_FASTBOOT_FLASH_FILLBUF_SIZE / info->blksz;
+	fill_buf = (uint32_t *)
+		   memalign(ARCH_DMA_MINALIGN,
+			    ROUNDUP(info->blksz * fill_buf_num_blks,
+				    ARCH_DMA_MINALIGN));
+	if (!fill_buf)
+		return sparse_stream_fail(ss,
+					  "Malloc failed for: CHUNK_TYPE_FILL");
 
-	/* Read and skip over sparse image header */
-	sparse_header = (sparse_header_t *)data;
+	for (i = 0; i < info->blksz * fill_buf_num_blks / sizeof(uint32_t); i++)
+		fill_buf[i] = ss->fill_val;
 
-	data += sparse_header->file_hdr_sz;
-	if (sparse_header->file_hdr_sz > sizeof(sparse_header_t)) {
-		/*
-		 * Skip the remaining bytes in a header that is longer than
-		 * we expected.
-		 */
-		data += (sparse_header->file_hdr_sz - sizeof(sparse_header_t));
-	}
+	ret = sparse_fill_blocks(ss, fill_buf, fill_buf_num_blks, head);
+	if (!ret && mid && sparse_erase_blocks(ss, mid))
+		ret = sparse_fill_blocks(ss, fill_buf, fill_buf_num_blks, mid);
+	if (!ret)
+		ret = sparse_fill_blocks(ss, fill_buf, fill_buf_num_blks,
+					 blkcnt - head - mid);
+	free(fill_buf);
+
+	return ret;
+}
+
+static void sparse_dont_care(struct sparse_stream *ss, lbaint_t blkcnt)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t head = blkcnt, mid = 0;
+
+	/*
+	 * When a host splits a large image into pieces, each piece has the
+	 * others as don't-care blocks, so only discard them if asked to
+	 */
+	if (IS_ENABLED(CONFIG_FASTBOOT_SPARSE_DISCARD))
+		sparse_erase_range(ss, blkcnt, &head, &mid);
+
+	ss->blk += info->reserve(info, ss->blk, head);
+	if (mid && sparse_erase_blocks(ss, mid))
+		ss->blk += info->reserve(info, ss->blk, mid);
+	if (blkcnt - head - mid)
+		ss->blk += info->reserve(info, ss->blk, blkcnt - head - mid);
+}
+
+static void sparse_next_chunk(struct sparse_stream *ss)
+{
+	ss->hdr_got = 0;
+	if (ss->chunk_num < ss->header.total_chunks)
+		ss->state = SPARSE_STATE_CHUNK_HEADER;
+	else
+		ss->state = SPARSE_STATE_DONE;
+}
+
+static int sparse_header_done(struct sparse_stream *ss)
+{
+	sparse_header_t *sparse_header = &ss->header;
+	unsigned int offset;
 
 	debug("=== Sparse Image Header ===\n");
 	debug("magic: 0x%x\n", sparse_header->magic);
@@ -97,168 +246,260 @@ void write_sparse_image(
 	 * Verify that the sparse block size is a multiple of our
 	 * storage backend block size
 	 */
-	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
+	div_u64_rem(sparse_header->blk_sz, ss->info->blksz, &offset);
 	if (offset) {
 		printf("%s: Sparse image block size issue [%u]\n",
 		       __func__, sparse_header->blk_sz);
-		fastboot_fail("sparse image block size issue");
-		return;
+		return sparse_stream_fail(ss, "sparse image block size issue");
 	}
 
+	/*
+	 * Skip the remaining bytes in a header that is longer than we
+	 * expected.
+	 */
+	if (sparse_header->file_hdr_sz > sizeof(sparse_header_t))
+		ss->skip = sparse_header->file_hdr_sz - sizeof(sparse_header_t);
+
 	puts("Flashing Sparse Image\n");
+	sparse_next_chunk(ss);
 
-	/* Start processing chunks */
-	blk = info->start;
-	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++) {
-		/* Read and skip over chunk header */
-		chunk_header = (chunk_header_t *)data;
-		data += sizeof(chunk_header_t);
-
-		if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
-			debug("=== Chunk Header ===\n");
-			debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
-			debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
-			debug("total_size: 0x%x\n", chunk_header->total_sz);
-		}
+	return 0;
+}
 
-		if (sparse_header->chunk_hdr_sz > sizeof(chunk_header_t)) {
-			/*
-			 * Skip the remaining bytes in a header that is longer
-			 * than we expected.
-			 */
-			data += (sparse_header->chunk_hdr_sz -
-				 sizeof(chunk_header_t));
-		}
+static int sparse_chunk_done(struct sparse_stream *ss)
+{
+	int ret = 0;
+
+	if (ss->chunk.chunk_type == CHUNK_TYPE_RAW)
+		ret = sparse_flush(ss);
+	else if (ss->chunk.chunk_type == CHUNK_TYPE_FILL)
+		ret = sparse_fill(ss);
+	if (ret)
+		return ret;
+
+	ss->chunk_num++;
+	sparse_next_chunk(ss);
+
+	return 0;
+}
+
+static int sparse_chunk_start(struct sparse_stream *ss)
+{
+	struct sparse_storage *info = ss->info;
+	sparse_header_t *sparse_header = &ss->header;
+	chunk_header_t *chunk_header = &ss->chunk;
+	unsigned int chunk_data_sz;
+	lbaint_t blkcnt;
+
+	fastboot_progress();
+
+	if (chunk_header->chunk_type != CHUNK_TYPE_RAW) {
+		debug("=== Chunk Header ===\n");
+		debug("chunk_type: 0x%x\n", chunk_header->chunk_type);
+		debug("chunk_data_sz: 0x%x\n", chunk_header->chunk_sz);
+		debug("total_size: 0x%x\n", chunk_header->total_sz);
+	}
 
-		chunk_data_sz = sparse_header->blk_sz * chunk_header->chunk_sz;
-		blkcnt = chunk_data_sz / info->blksz;
-		switch (chunk_header->chunk_type) {
-		case CHUNK_TYPE_RAW:
+	/*
+	 * Skip the remaining bytes in a header that is longer than we
+	 * expected.
+	 */
+	if (sparse_header->chunk_hdr_sz > sizeof(chunk_header_t))
+		ss->skip = sparse_header->chunk_hdr_sz - sizeof(chunk_header_t);
+
+	chunk_data_sz = sparse_header->blk_sz * chunk_header->chunk_sz;
+	blkcnt = chunk_data_sz / info->blksz;
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_RAW:
+	case CHUNK_TYPE_FILL:
+		if (chunk_header->chunk_type == CHUNK_TYPE_RAW) {
 			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + chunk_data_sz)) {
-				fastboot_fail(
+			    sparse_header->chunk_hdr_sz + chunk_data_sz)
+				return sparse_stream_fail(ss,
 					"Bogus chunk size for chunk type Raw");
-				return;
-			}
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				fastboot_fail(
-				    "Request would exceed partition size!");
-				return;
-			}
-
-			blks = info->write(info, blk, blkcnt, data);
-			/* blks might be > blkcnt (eg. NAND bad-blocks) */
-			if (blks < blkcnt) {
-				printf("%s: %s" LBAFU " [" LBAFU "]\n",
-				       __func__, "Write failed, block #",
-				       blk, blks);
-				fastboot_fail(
-					      "flash write failure");
-				return;
-			}
-			blk += blks;
-			bytes_written += blkcnt * info->blksz;
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
-			break;
-
-		case CHUNK_TYPE_FILL:
+			ss->data_left = chunk_data_sz;
+		} else {
 			if (chunk_header->total_sz !=
-			    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
-				fastboot_fail(
+			    sparse_header->chunk_hdr_sz + sizeof(uint32_t))
+				return sparse_stream_fail(ss,
 					"Bogus chunk size for chunk type FILL");
-				return;
-			}
-
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				fastboot_fail(
-					"Malloc failed for: CHUNK_TYPE_FILL");
-				return;
-			}
-
-			fill_val = *(uint32_t *)data;
-			data = (char *)data + sizeof(uint32_t);
-
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
-
-			if (blk + blkcnt > info->start + info->size) {
-				printf(
-				    "%s: Request would exceed partition size!\n",
-				    __func__);
-				fastboot_fail(
-				    "Request would exceed partition size!");
-				return;
-			}
-
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					fastboot_fail(
-						      "flash write failure");
-					free(fill_buf);
-					return;
-				}
-				blk += blks;
-				i += j;
-			}
-			bytes_written += blkcnt * info->blksz;
-			total_blocks += chunk_data_sz / sparse_header->blk_sz;
-			free(fill_buf);
-			break;
-
-		case CHUNK_TYPE_DONT_CARE:
-			blk += info->reserve(info, blk, blkcnt);
-			total_blocks += chunk_header->chunk_sz;
-			break;
-
-		case CHUNK_TYPE_CRC32:
-			if (chunk_header->total_sz !=
-			    sparse_header->chunk_hdr_sz) {
-				fastboot_fail(
-					"Bogus chunk size for chunk type Dont Care");
-				return;
-			}
-			total_blocks += chunk_header->chunk_sz;
-			data += chunk_data_sz;
-			break;
-
-		default:
-			printf("%s: Unknown chunk type: %x\n", __func__,
-			       chunk_header->chunk_type);
-			fastboot_fail("Unknown chunk type");
-			return;
+			ss->data_left = sizeof(uint32_t);
+		}
+
+		if (ss->blk + blkcnt > info->start + info->size) {
+			printf("%s: Request would exceed partition size!\n",
+			       __func__);
+			return sparse_stream_fail(ss,
+					"Request would exceed partition size!");
+		}
+		break;
+
+	case CHUNK_TYPE_DONT_CARE:
+		sparse_dont_care(ss, blkcnt);
+		ss->data_left = 0;
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		if (chunk_header->total_sz != sparse_header->chunk_hdr_sz)
+			return sparse_stream_fail(ss,
+				"Bogus chunk size for chunk type Dont Care");
+		ss->data_left = chunk_data_sz;
+		break;
+
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk_header->chunk_type);
+		return sparse_stream_fail(ss, "Unknown chunk type");
+	}
+	ss->total_blocks += chunk_header->chunk_sz;
+
+	ss->hdr_got = 0;
+	ss->state = SPARSE_STATE_CHUNK_DATA;
+	if (!ss->data_left)
+		return sparse_chunk_done(ss);
+
+	return 0;
+}
+
+/* Write raw chunk data, returning the number of bytes used or -1 on error */
+static int sparse_raw_data(struct sparse_stream *ss, const void *data,
+			   unsigned int len)
+{
+	unsigned int blksz = ss->info->blksz;
+	unsigned int n = min(len, ss->data_left);
+
+	/*
+	 * Write whole blocks straight from the data when there is enough of
+	 * it, rather than copying it to the buffer first
+	 */
+	if (!ss->buf_fill && (n == ss->data_left || n >= ss->buf_size)) {
+		n -= n % blksz;
+		if (n && sparse_write_blocks(ss, n / blksz, data))
+			return -1;
+	} else {
+		n = min(n, ss->buf_size - ss->buf_fill);
+		memcpy(ss->buf + ss->buf_fill, data, n);
+		ss->buf_fill += n;
+		if (ss->buf_fill == ss->buf_size && sparse_flush(ss))
+			return -1;
+	}
+	ss->data_left -= n;
+
+	return n;
+}
+
+static int sparse_chunk_data(struct sparse_stream *ss, const void *data,
+			     unsigned int len)
+{
+	int n;
+
+	switch (ss->chunk.chunk_type) {
+	case CHUNK_TYPE_RAW:
+		n = sparse_raw_data(ss, data, len);
+		if (n < 0)
+			return n;
+		break;
+	case CHUNK_TYPE_FILL:
+		n = sparse_collect(ss, &ss->fill_val, sizeof(uint32_t), data,
+				   len);
+		ss->data_left -= n;
+		break;
+	default:
+		n = min(len, ss->data_left);
+		ss->data_left -= n;
+		break;
+	}
+
+	if (!ss->data_left && sparse_chunk_done(ss))
+		return -1;
+
+	return n;
+}
+
+void sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			 const char *part_name, void *buf,
+			 unsigned int buf_size)
+{
+	memset(ss, '\0', sizeof(*ss));
+	ss->info = info;
+	ss->part_name = part_name;
+	ss->state = SPARSE_STATE_HEADER;
+	ss->blk = info->start;
+	ss->buf = buf;
+	ss->buf_size = buf ? buf_size : 0;
+}
+
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			unsigned int len)
+{
+	int n;
+
+	while (len && ss->state != SPARSE_STATE_DONE) {
+		if (ss->state == SPARSE_STATE_ERROR)
+			return -1;
+
+		if (ss->skip) {
+			n = min(len, ss->skip);
+			ss->skip -= n;
+		} else if (ss->state == SPARSE_STATE_HEADER) {
+			n = sparse_collect(ss, &ss->header,
+					   sizeof(sparse_header_t), data, len);
+			if (ss->hdr_got == sizeof(sparse_header_t) &&
+			    sparse_header_done(ss))
+				return -1;
+		} else if (ss->state == SPARSE_STATE_CHUNK_HEADER) {
+			n = sparse_collect(ss, &ss->chunk,
+					   sizeof(chunk_header_t), data, len);
+			if (ss->hdr_got == sizeof(chunk_header_t) &&
+			    sparse_chunk_start(ss))
+				return -1;
+		} else {
+			n = sparse_chunk_data(ss, data, len);
+			if (n < 0)
+				return -1;
+			/* Part of a block, with nowhere to keep it */
+			if (!n)
+				break;
 		}
+		data += n;
+		len -= n;
+	}
+
+	return ss->state == SPARSE_STATE_ERROR ? -1 : 0;
+}
+
+void sparse_stream_finish(struct sparse_stream *ss)
+{
+	if (ss->state == SPARSE_STATE_ERROR)
+		return;
+	if (ss->state != SPARSE_STATE_DONE) {
+		printf("%s: Sparse image ends in chunk %u of %u\n", __func__,
+		       ss->chunk_num, ss->header.total_chunks);
+		fastboot_fail("sparse image is truncated");
+		return;
 	}
 
 	debug("Wrote %d blocks, expected to write %d blocks\n",
-	      total_blocks, sparse_header->total_blks);
-	printf("........ wrote %u bytes to '%s'\n", bytes_written, part_name);
+	      ss->total_blocks, ss->header.total_blks);
+	printf("........ wrote %u bytes to '%s'\n", ss->bytes_written,
+	       ss->part_name);
+	if (ss->blks_erased)
+		printf("........ erased " LBAFU " blocks\n", ss->blks_erased);
 
-	if (total_blocks != sparse_header->total_blks)
+	if (ss->total_blocks != ss->header.total_blks)
 		fastboot_fail("sparse image write failure");
 	else
 		fastboot_okay("");
+}
+
+void write_sparse_image(
+		struct sparse_storage *info, const char *part_name,
+		void *data, unsigned sz)
+{
+	struct sparse_stream ss;
 
-	return;
+	/* The whole image is here, so raw data can be written in place */
+	sparse_stream_start(&ss, info, part_name, NULL, 0);
+	sparse_stream_write(&ss, data, sz);
+	sparse_stream_finish(&ss);
 }
@@ -8,6 +8,7 @@
 
 #include <common.h>
 #include <malloc.h>
+#include <malloc_track.h>
 #include <mapmem.h>
 #include <asm/io.h>
 
@@ -28,6 +29,9 @@ void *malloc_simple(size_t bytes)
 	ptr = map_sysmem(gd->malloc_base + gd->malloc_ptr, bytes);
 	gd->malloc_ptr = ALIGN(new_ptr, sizeof(new_ptr));
 	debug("%lx\n", (ulong)ptr);
+#if CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE) && CONFIG_IS_ENABLED(SYS_MALLOC_TRACK)
+	malloc_track_alloc(ptr, bytes, __builtin_return_address(0));
+#endif
 
 	return ptr;
 }
@@ -47,6 +51,9 @@ void *memalign_simple(size_t align, size_t bytes)
 	ptr = map_sysmem(addr, bytes);
 	gd->malloc_ptr = ALIGN(new_ptr, sizeof(new_ptr));
 	debug("%lx\n", (ulong)ptr);
+#if CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE) && CONFIG_IS_ENABLED(SYS_MALLOC_TRACK)
+	malloc_track_alloc(ptr, bytes, __builtin_return_address(0));
+#endif
 
 	return ptr;
 }
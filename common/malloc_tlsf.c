@@ -0,0 +1,191 @@
+/*
+ * malloc() and friends on top of a TLSF pool
+ *
+ * This replaces dlmalloc when CONFIG_SYS_MALLOC_TLSF is enabled, using the
+ * same function names from malloc.h so that USE_DL_PREFIX works. The whole
+ * malloc() area is handed to the pool by mem_malloc_init(), so there is no
+ * sbrk() and mem_malloc_brk is simply the end of the area.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#if CONFIG_IS_ENABLED(SYS_MALLOC_TRACK)
+/* The public functions are wrappers in malloc_track.c */
+#define USE_DL_PREFIX
+#endif
+
+#include <common.h>
+#include <malloc.h>
+#include <tlsf.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define MALLOC_PAGE_SIZE	4096
+
+ulong mem_malloc_start;
+ulong mem_malloc_end;
+ulong mem_malloc_brk;
+
+static struct tlsf *malloc_pool;
+
+void mem_malloc_init(ulong start, ulong size)
+{
+	mem_malloc_start = start;
+	mem_malloc_end = start + size;
+	mem_malloc_brk = mem_malloc_end;
+
+	debug("using memory %#lx-%#lx for malloc()\n", mem_malloc_start,
+	      mem_malloc_end);
+#ifdef CONFIG_SYS_MALLOC_CLEAR_ON_INIT
+	memset((void *)mem_malloc_start, 0x0, size);
+#endif
+	malloc_pool = tlsf_create((void *)start, size);
+}
+
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+void *mALLOc(size_t bytes)
+{
+#ifdef CONFIG_SYS_MALLOC_F_LEN
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		return malloc_simple(bytes);
+#endif
+	if (!malloc_pool)
+		return NULL;
+
+	return tlsf_malloc(malloc_pool, bytes);
+}
+
+void fREe(void *mem)
+{
+#ifdef CONFIG_SYS_MALLOC_F_LEN
+	/* free() is a no-op - all the memory will be freed on relocation */
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		return;
+#endif
+	if (malloc_pool)
+		tlsf_free(malloc_pool, mem);
+}
+
+void cfree(void *mem)
+{
+	fREe(mem);
+}
+
+void *rEALLOc(void *oldmem, size_t bytes)
+{
+#ifdef CONFIG_SYS_MALLOC_F_LEN
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT)) {
+		/* This is harder to support and should not be needed */
+		panic("pre-reloc realloc() is not supported");
+	}
+#endif
+	if (!malloc_pool)
+		return NULL;
+
+	return tlsf_realloc(malloc_pool, oldmem, bytes);
+}
+
+void *mEMALIGn(size_t alignment, size_t bytes)
+{
+#ifdef CONFIG_SYS_MALLOC_F_LEN
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		return memalign_simple(alignment, bytes);
+#endif
+	if (!malloc_pool)
+		return NULL;
+
+	return tlsf_memalign(malloc_pool, alignment, bytes);
+}
+
+void *vALLOc(size_t bytes)
+{
+	return mEMALIGn(MALLOC_PAGE_SIZE, bytes);
+}
+
+void *pvALLOc(size_t bytes)
+{
+	return mEMALIGn(MALLOC_PAGE_SIZE, ALIGN(bytes, MALLOC_PAGE_SIZE));
+}
+
+void *cALLOc(size_t n, size_t elem_size)
+{
+	size_t size = n * elem_size;
+	void *mem;
+
+	if (elem_size && size / elem_size != n)
+		return NULL;
+	mem = mALLOc(size);
+	if (mem)
+		memset(mem, '\0', size);
+
+	return mem;
+}
+
+int malloc_trim(size_t pad)
+{
+	/* The pool never gives memory back */
+	return 0;
+}
+
+size_t malloc_usable_size(void *mem)
+{
+	if (!mem)
+		return 0;
+
+	return tlsf_usable_size(mem);
+}
+
+/*
+ * As with dlmalloc, arena is the part of the malloc() area which has been
+ * used so far and uordblks the space in allocated blocks
+ */
+struct mallinfo mALLINFo(void)
+{
+	struct mallinfo mi;
+	struct tlsf_info info;
+
+	memset(&mi, '\0', sizeof(mi));
+	if (!malloc_pool)
+		return mi;
+
+	tlsf_get_info(malloc_pool, &info);
+	mi.arena = info.top;
+	mi.ordblks = info.free_blocks;
+	mi.uordblks = info.used;
+	mi.fordblks = info.size - info.used;
+
+	return mi;
+}
+
+void malloc_stats(void)
+{
+	struct tlsf_info info;
+
+	if (!malloc_pool)
+		return;
+
+	tlsf_get_info(malloc_pool, &info);
+	printf("system bytes     = %10u\n", (unsigned int)info.size);
+	printf("in use bytes     = %10u\n", (unsigned int)info.used);
+	printf("max in use bytes = %10u\n", (unsigned int)info.peak);
+	printf("free blocks      = %10u\n", info.free_blocks);
+	printf("largest free     = %10u\n", (unsigned int)info.largest);
+}
+
+int mALLOPt(int param_number, int value)
+{
+	/* There are no tunable parameters */
+	return 0;
+}
+#endif
+
+int initf_malloc(void)
+{
+#ifdef CONFIG_SYS_MALLOC_F_LEN
+	assert(gd->malloc_base);	/* Set up by crt0.S */
+	gd->malloc_limit = CONFIG_SYS_MALLOC_F_LEN;
+	gd->malloc_ptr = 0;
+#endif
+
+	return 0;
+}
@@ -0,0 +1,436 @@
+/*
+ * Per-call-site statistics for malloc()
+ *
+ * With CONFIG_SYS_MALLOC_TRACK the allocator is built with USE_DL_PREFIX
+ * and the public malloc() functions here record each call against its
+ * return address before passing it on. Live allocations are kept in a
+ * hash table so that free() can charge them back to their call site.
+ *
+ * In SPL the call-site table is written by malloc_simple() before BSS is
+ * set up, so it is in the data section. U-Boot proper cannot write to its
+ * globals before relocation, so allocations made then are only counted in
+ * the pre-relocation heap usage. The live-allocation table is only used
+ * once the full malloc() is running, so it lives in BSS.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <malloc.h>
+#include <malloc_track.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define MALLOC_TRACK_SITES	CONFIG_SYS_MALLOC_TRACK_SITES
+#define MALLOC_TRACK_LIVE	CONFIG_SYS_MALLOC_TRACK_LIVE
+
+/* Calls from sites which do not fit in the table are charged here */
+#define MALLOC_TRACK_OTHER	MALLOC_TRACK_SITES
+
+/**
+ * struct malloc_site - statistics for one call site
+ *
+ * @caller:	Link-time return address of the call, 0 for the overflow site
+ * @calls:	Number of successful allocations
+ * @bytes:	Total bytes requested
+ * @live:	Number of allocations not yet freed
+ * @live_bytes:	Bytes in allocations not yet freed
+ */
+struct malloc_site {
+	ulong caller;
+	uint calls;
+	ulong bytes;
+	uint live;
+	ulong live_bytes;
+};
+
+/**
+ * struct malloc_live - an allocation which has not been freed
+ *
+ * @ptr:	Address returned to the caller, NULL if the entry is empty
+ * @size:	Bytes requested
+ * @seq:	Sequence number of the allocation
+ * @site:	Index of the call site
+ */
+struct malloc_live {
+	void *ptr;
+	ulong size;
+	uint seq;
+	ushort site;
+};
+
+/**
+ * struct malloc_track - global statistics
+ *
+ * @calls:	Number of successful allocations
+ * @frees:	Number of tracked allocations freed
+ * @failed:	Number of allocations which returned NULL
+ * @untracked:	Number of allocations not tracked as the live table was full
+ * @live:	Number of tracked allocations not yet freed
+ * @cur:	Bytes in tracked allocations not yet freed
+ * @peak:	Largest value @cur has reached
+ * @seq:	Sequence number for the next allocation
+ * @nsites:	Number of entries used in @sites
+ * @sites:	Call sites, hashed by caller, plus the overflow site
+ */
+struct malloc_track {
+	ulong calls;
+	ulong frees;
+	ulong failed;
+	ulong untracked;
+	uint live;
+	ulong cur;
+	ulong peak;
+	uint seq;
+	int nsites;
+	struct malloc_site sites[MALLOC_TRACK_SITES + 1];
+};
+
+static struct malloc_track track __attribute__((section(".data")));
+
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+static struct malloc_live live_table[MALLOC_TRACK_LIVE];
+#endif
+
+static inline uint malloc_track_hash(ulong val, uint size)
+{
+	return ((val >> 2) * 2654435761U) % size;
+}
+
+static int malloc_track_site(void *caller)
+{
+	ulong addr = (ulong)caller;
+	struct malloc_site *site;
+	int i, n;
+
+	if (gd->flags & GD_FLG_RELOC)
+		addr -= gd->reloc_off;
+
+	i = malloc_track_hash(addr, MALLOC_TRACK_SITES);
+	for (n = 0; n < MALLOC_TRACK_SITES; n++) {
+		site = &track.sites[i];
+		if (site->caller == addr)
+			return i;
+		if (!site->caller) {
+			site->caller = addr;
+			track.nsites++;
+			return i;
+		}
+		if (++i == MALLOC_TRACK_SITES)
+			i = 0;
+	}
+
+	return MALLOC_TRACK_OTHER;
+}
+
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+static int malloc_track_live_add(void *ptr, ulong size, int site)
+{
+	struct malloc_live *entry;
+	int i;
+
+	/* Keep the table at most 7/8 full so that probes stay short */
+	if (track.live >= MALLOC_TRACK_LIVE - MALLOC_TRACK_LIVE / 8)
+		return -ENOSPC;
+
+	i = malloc_track_hash((ulong)ptr, MALLOC_TRACK_LIVE);
+	while (live_table[i].ptr) {
+		if (++i == MALLOC_TRACK_LIVE)
+			i = 0;
+	}
+	entry = &live_table[i];
+	entry->ptr = ptr;
+	entry->size = size;
+	entry->seq = track.seq;
+	entry->site = site;
+
+	return 0;
+}
+
+static struct malloc_live *malloc_track_live_find(void *ptr)
+{
+	int i;
+
+	i = malloc_track_hash((ulong)ptr, MALLOC_TRACK_LIVE);
+	while (live_table[i].ptr) {
+		if (live_table[i].ptr == ptr)
+			return &live_table[i];
+		if (++i == MALLOC_TRACK_LIVE)
+			i = 0;
+	}
+
+	return NULL;
+}
+
+/*
+ * Empty an entry, moving later entries of the same probe sequence back so
+ * that lookups never stop early at the hole
+ */
+static void malloc_track_live_remove(struct malloc_live *entry)
+{
+	int i = entry - live_table;
+	int j = i;
+	int home;
+
+	for (;;) {
+		if (++j == MALLOC_TRACK_LIVE)
+			j = 0;
+		if (!live_table[j].ptr)
+			break;
+		home = malloc_track_hash((ulong)live_table[j].ptr,
+					 MALLOC_TRACK_LIVE);
+		if (i <= j ? (home <= i || home > j) :
+			      (home <= i && home > j)) {
+			live_table[i] = live_table[j];
+			i = j;
+		}
+	}
+	live_table[i].ptr = NULL;
+}
+#endif
+
+void malloc_track_alloc(void *ptr, size_t bytes, void *caller)
+{
+	struct malloc_site *site;
+	int idx;
+
+#ifndef CONFIG_SPL_BUILD
+	if (!(gd->flags & GD_FLG_RELOC))
+		return;
+#endif
+	if (!ptr) {
+		track.failed++;
+		return;
+	}
+
+	idx = malloc_track_site(caller);
+	site = &track.sites[idx];
+	site->calls++;
+	site->bytes += bytes;
+	track.calls++;
+
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+	if (!(gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		return;
+	if (malloc_track_live_add(ptr, bytes, idx)) {
+		track.untracked++;
+		return;
+	}
+	track.seq++;
+	track.live++;
+	track.cur += bytes;
+	if (track.cur > track.peak)
+		track.peak = track.cur;
+	site->live++;
+	site->live_bytes += bytes;
+#endif
+}
+
+void malloc_track_free(void *ptr)
+{
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+	struct malloc_live *entry;
+	struct malloc_site *site;
+
+	if (!ptr || !(gd->flags & GD_FLG_FULL_MALLOC_INIT))
+		return;
+	entry = malloc_track_live_find(ptr);
+	if (!entry)
+		return;
+
+	site = &track.sites[entry->site];
+	site->live--;
+	site->live_bytes -= entry->size;
+	track.live--;
+	track.cur -= entry->size;
+	track.frees++;
+	malloc_track_live_remove(entry);
+#endif
+}
+
+uint malloc_track_seq(void)
+{
+	return track.seq;
+}
+
+ulong malloc_track_reset_peak(void)
+{
+	track.peak = track.cur;
+
+	return track.peak;
+}
+
+ulong malloc_track_peak(void)
+{
+	return track.peak;
+}
+
+void malloc_track_show_info(void)
+{
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+	printf("heap       %08lx - %08lx (%lu KiB)\n", mem_malloc_start,
+	       mem_malloc_end, (mem_malloc_end - mem_malloc_start) / 1024);
+#endif
+#ifdef CONFIG_SYS_MALLOC_F_LEN
+	printf("early      %lu of %lu bytes\n", gd->malloc_ptr,
+	       gd->malloc_limit);
+#endif
+	printf("in use     %lu bytes in %u allocations\n", track.cur,
+	       track.live);
+	printf("peak       %lu bytes\n", track.peak);
+	printf("calls      %lu allocations, %lu frees, %lu failed\n",
+	       track.calls, track.frees, track.failed);
+	printf("untracked  %lu allocations\n", track.untracked);
+	printf("sites      %d of %d\n", track.nsites, MALLOC_TRACK_SITES);
+}
+
+static void malloc_track_show_caller(ulong addr)
+{
+#ifdef CONFIG_KALLSYMS
+	const char *sym;
+	ulong base;
+
+	sym = symbol_lookup(addr, &base);
+	if (sym) {
+		printf("%s+%#lx", sym, addr - base);
+		return;
+	}
+#endif
+	if (!addr)
+		printf("(other)");
+}
+
+void malloc_track_show_sites(void)
+{
+	ushort order[MALLOC_TRACK_SITES + 1];
+	struct malloc_site *site;
+	int count = 0;
+	int i, j;
+
+	/* Insertion sort by bytes allocated, largest first */
+	for (i = 0; i <= MALLOC_TRACK_SITES; i++) {
+		site = &track.sites[i];
+		if (!site->calls)
+			continue;
+		for (j = count; j && track.sites[order[j - 1]].bytes <
+		     site->bytes; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+		count++;
+	}
+
+	printf("caller      calls       bytes   live  live bytes\n");
+	for (i = 0; i < count; i++) {
+		site = &track.sites[order[i]];
+		printf("%08lx %8u %11lu %6u %11lu  ", site->caller, site->calls,
+		       site->bytes, site->live, site->live_bytes);
+		malloc_track_show_caller(site->caller);
+		printf("\n");
+	}
+}
+
+int malloc_track_show_live(uint since)
+{
+	int count = 0;
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+	struct malloc_live *entry;
+	ulong bytes = 0;
+	int i;
+
+	for (i = 0; i < MALLOC_TRACK_LIVE; i++) {
+		entry = &live_table[i];
+		if (!entry->ptr || entry->seq < since)
+			continue;
+		if (!count)
+			printf("address         size      seq  caller\n");
+		printf("%08lx %11lu %8u  %08lx ", (ulong)entry->ptr,
+		       entry->size, entry->seq,
+		       track.sites[entry->site].caller);
+		malloc_track_show_caller(track.sites[entry->site].caller);
+		printf("\n");
+		bytes += entry->size;
+		count++;
+	}
+	printf("%d allocations, %lu bytes\n", count, bytes);
+#endif
+
+	return count;
+}
+
+#if !CONFIG_IS_ENABLED(SYS_MALLOC_SIMPLE)
+void *malloc(size_t bytes)
+{
+	void *ptr = dlmalloc(bytes);
+
+	malloc_track_alloc(ptr, bytes, __builtin_return_address(0));
+
+	return ptr;
+}
+
+void free(void *mem)
+{
+	malloc_track_free(mem);
+	dlfree(mem);
+}
+
+void *realloc(void *oldmem, size_t bytes)
+{
+	void *ptr = dlrealloc(oldmem, bytes);
+
+	if (ptr) {
+		malloc_track_free(oldmem);
+		malloc_track_alloc(ptr, bytes, __builtin_return_address(0));
+	}
+
+	return ptr;
+}
+
+void *memalign(size_t alignment, size_t bytes)
+{
+	void *ptr = dlmemalign(alignment, bytes);
+
+	malloc_track_alloc(ptr, bytes, __builtin_return_address(0));
+
+	return ptr;
+}
+
+void *valloc(size_t bytes)
+{
+	void *ptr = dlvalloc(bytes);
+
+	malloc_track_alloc(ptr, bytes, __builtin_return_address(0));
+
+	return ptr;
+}
+
+void *pvalloc(size_t bytes)
+{
+	void *ptr = dlpvalloc(bytes);
+
+	malloc_track_alloc(ptr, bytes, __builtin_return_address(0));
+
+	return ptr;
+}
+
+void *calloc(size_t n, size_t elem_size)
+{
+	void *ptr = dlcalloc(n, elem_size);
+
+	malloc_track_alloc(ptr, n * elem_size, __builtin_return_address(0));
+
+	return ptr;
+}
+
+/* dlmalloc only provides mallinfo() for unit tests */
+#if defined(CONFIG_UNIT_TEST) || defined(CONFIG_SYS_MALLOC_TLSF)
+struct mallinfo mallinfo(void)
+{
+	return dlmallinfo();
+}
+#endif
+
+int mallopt(int param_number, int value)
+{
+	return dlmallopt(param_number, value);
+}
+#endif
@@ -15,6 +15,7 @@
 #include <version.h>
 #include <image.h>
 #include <malloc.h>
+#include <malloc_track.h>
 #include <dm/root.h>
 #include <linux/compiler.h>
 #include <fdt_support.h>
@@ -423,6 +424,9 @@ void board_init_r(gd_t *dummy1, ulong dummy2)
 	debug("SPL malloc() used %#lx bytes (%ld KB)\n", gd->malloc_ptr,
 	      gd->malloc_ptr / 1024);
 #endif
+#if CONFIG_IS_ENABLED(SYS_MALLOC_TRACK)
+	malloc_track_show_sites();
+#endif
 
 	if (IS_ENABLED(CONFIG_SPL_ATF_SUPPORT)) {
 		debug("loaded - jumping to U-Boot via ATF BL31.\n");
@@ -48,14 +48,32 @@ DECLARE_GLOBAL_DATA_PTR;
 
 #define PORT_OVERCURRENT_MAX_SCAN_COUNT		3
 
+/*
+ * Each port on the scanning list goes through these states. All ports, on
+ * all hubs being scanned, are advanced together; only the reset is done one
+ * port at a time on each bus, since a device answers at address 0 from the
+ * end of its reset until it has been given an address.
+ */
+enum usb_port_state {
+	USB_PORT_WAIT_CONNECT,		/* Waiting for power and a connection */
+	USB_PORT_WAIT_RESET,		/* Waiting for the bus to be free */
+	USB_PORT_RESETTING,		/* Waiting for the reset to complete */
+};
+
 struct usb_device_scan {
 	struct usb_device *dev;		/* USB hub device to scan */
 	struct usb_hub_device *hub;	/* USB hub struct */
 	int port;			/* USB port to scan */
+	enum usb_port_state state;	/* Where the port is in the scan */
+	int tries;			/* Number of resets done */
+	ulong reset_timeout;		/* End of the current reset in ms */
+	unsigned short portstatus;	/* Port status when connected */
+	unsigned short portchange;	/* Port change when connected */
 	struct list_head list;
 };
 
 static LIST_HEAD(usb_scan_list);
+static bool usb_scan_deferred;
 
 __weak void usb_hub_reset_devices(int port)
 {
@@ -258,6 +276,65 @@ static inline char *portspeed(int portstatus)
 	return speed_str;
 }
 
+/**
+ * usb_hub_port_reset_done() - check whether a port reset has completed
+ *
+ * Read the port status after a reset and see if the port has been enabled,
+ * i.e. if a device is present and has come out of reset.
+ *
+ * @dev:	USB hub device
+ * @port:	Port number (note ports are numbered from 0 here)
+ * @portstat:	Returns port status
+ * @return 0 if the port is enabled, -EAGAIN if not, other -ve on error
+ */
+static int usb_hub_port_reset_done(struct usb_device *dev, int port,
+				   unsigned short *portstat)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
+	unsigned short portstatus, portchange;
+
+	if (usb_get_port_status(dev, port + 1, portsts) < 0) {
+		debug("get_port_status failed status %lX\n", dev->status);
+		return -EIO;
+	}
+	portstatus = le16_to_cpu(portsts->wPortStatus);
+	portchange = le16_to_cpu(portsts->wPortChange);
+
+	debug("portstatus %x, change %x, %s\n", portstatus, portchange,
+							portspeed(portstatus));
+
+	debug("STAT_C_CONNECTION = %d STAT_CONNECTION = %d" \
+	      "  USB_PORT_STAT_ENABLE %d\n",
+	      (portchange & USB_PORT_STAT_C_CONNECTION) ? 1 : 0,
+	      (portstatus & USB_PORT_STAT_CONNECTION) ? 1 : 0,
+	      (portstatus & USB_PORT_STAT_ENABLE) ? 1 : 0);
+
+	/*
+	 * Perhaps we should check for the following here:
+	 * - C_CONNECTION hasn't been set.
+	 * - CONNECTION is still set.
+	 *
+	 * Doing so would ensure that the device is still connected
+	 * to the bus, and hasn't been unplugged or replaced while the
+	 * USB bus reset was going on.
+	 *
+	 * However, if we do that, then (at least) a San Disk Ultra
+	 * USB 3.0 16GB device fails to reset on (at least) an NVIDIA
+	 * Tegra Jetson TK1 board. For some reason, the device appears
+	 * to briefly drop off the bus when this second bus reset is
+	 * executed, yet if we retry this loop, it'll eventually come
+	 * back after another reset or two.
+	 */
+
+	if (!(portstatus & USB_PORT_STAT_ENABLE))
+		return -EAGAIN;
+
+	usb_clear_port_feature(dev, port + 1, USB_PORT_FEAT_C_RESET);
+	*portstat = portstatus;
+
+	return 0;
+}
+
 /**
  * usb_hub_port_reset() - reset a port given its usb_device pointer
  *
@@ -272,8 +349,6 @@ static int usb_hub_port_reset(struct usb_device *dev, int port,
 			      unsigned short *portstat)
 {
 	int err, tries;
-	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
-	unsigned short portstatus, portchange;
 	int delay = HUB_SHORT_RESET_TIME; /* start with short reset delay */
 
 #ifdef CONFIG_DM_USB
@@ -289,64 +364,37 @@ static int usb_hub_port_reset(struct usb_device *dev, int port,
 
 		mdelay(delay);
 
-		if (usb_get_port_status(dev, port + 1, portsts) < 0) {
-			debug("get_port_status failed status %lX\n",
-			      dev->status);
-			return -1;
-		}
-		portstatus = le16_to_cpu(portsts->wPortStatus);
-		portchange = le16_to_cpu(portsts->wPortChange);
-
-		debug("portstatus %x, change %x, %s\n", portstatus, portchange,
-							portspeed(portstatus));
-
-		debug("STAT_C_CONNECTION = %d STAT_CONNECTION = %d" \
-		      "  USB_PORT_STAT_ENABLE %d\n",
-		      (portchange & USB_PORT_STAT_C_CONNECTION) ? 1 : 0,
-		      (portstatus & USB_PORT_STAT_CONNECTION) ? 1 : 0,
-		      (portstatus & USB_PORT_STAT_ENABLE) ? 1 : 0);
-
-		/*
-		 * Perhaps we should check for the following here:
-		 * - C_CONNECTION hasn't been set.
-		 * - CONNECTION is still set.
-		 *
-		 * Doing so would ensure that the device is still connected
-		 * to the bus, and hasn't been unplugged or replaced while the
-		 * USB bus reset was going on.
-		 *
-		 * However, if we do that, then (at least) a San Disk Ultra
-		 * USB 3.0 16GB device fails to reset on (at least) an NVIDIA
-		 * Tegra Jetson TK1 board. For some reason, the device appears
-		 * to briefly drop off the bus when this second bus reset is
-		 * executed, yet if we retry this loop, it'll eventually come
-		 * back after another reset or two.
-		 */
-
-		if (portstatus & USB_PORT_STAT_ENABLE)
-			break;
+		err = usb_hub_port_reset_done(dev, port, portstat);
+		if (err != -EAGAIN)
+			return err ? -1 : 0;
 
 		/* Switch to long reset delay for the next round */
 		delay = HUB_LONG_RESET_TIME;
 	}
 
-	if (tries == MAX_TRIES) {
-		debug("Cannot enable port %i after %i retries, " \
-		      "disabling port.\n", port + 1, MAX_TRIES);
-		debug("Maybe the USB cable is bad?\n");
-		return -1;
-	}
+	debug("Cannot enable port %i after %i retries, " \
+	      "disabling port.\n", port + 1, MAX_TRIES);
+	debug("Maybe the USB cable is bad?\n");
 
-	usb_clear_port_feature(dev, port + 1, USB_PORT_FEAT_C_RESET);
-	*portstat = portstatus;
-	return 0;
+	return -1;
 }
 
-int usb_hub_port_connect_change(struct usb_device *dev, int port)
+/**
+ * usb_hub_port_connect_status() - check for a device on a changed port
+ *
+ * Clear the connection change on a port and see whether something is
+ * connected to it.
+ *
+ * @dev:	USB hub device
+ * @port:	Port number (note ports are numbered from 0 here)
+ * @return 0 if the port should be reset, -ENOTCONN if nothing is connected,
+ *	other -ve on error
+ */
+static int usb_hub_port_connect_status(struct usb_device *dev, int port)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus;
-	int ret, speed;
+	int ret;
 
 	/* Check status */
 	ret = usb_get_port_status(dev, port + 1, portsts);
@@ -374,13 +422,21 @@ int usb_hub_port_connect_change(struct usb_device *dev, int port)
 			return -ENOTCONN;
 	}
 
-	/* Reset the port */
-	ret = usb_hub_port_reset(dev, port, &portstatus);
-	if (ret < 0) {
-		if (ret != -ENXIO)
-			printf("cannot reset port %i!?\n", port + 1);
-		return ret;
-	}
+	return 0;
+}
+
+/**
+ * usb_hub_port_new_device() - set up the device on a port which is reset
+ *
+ * @dev:	USB hub device
+ * @port:	Port number (note ports are numbered from 0 here)
+ * @portstatus:	Port status after the reset, giving the device speed
+ * @return 0 if OK, -ve on error, in which case the port is disabled
+ */
+static int usb_hub_port_new_device(struct usb_device *dev, int port,
+				   unsigned short portstatus)
+{
+	int ret, speed;
 
 	switch (portstatus & USB_PORT_STAT_SPEED_MASK) {
 	case USB_PORT_STAT_SUPER_SPEED:
@@ -430,69 +486,34 @@ int usb_hub_port_connect_change(struct usb_device *dev, int port)
 	return ret;
 }
 
-static int usb_scan_port(struct usb_device_scan *usb_scan)
+int usb_hub_port_connect_change(struct usb_device *dev, int port)
 {
-	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
 	unsigned short portstatus;
-	unsigned short portchange;
-	struct usb_device *dev;
-	struct usb_hub_device *hub;
-	int ret = 0;
-	int i;
-
-	dev = usb_scan->dev;
-	hub = usb_scan->hub;
-	i = usb_scan->port;
+	int ret;
 
-	/*
-	 * Don't talk to the device before the query delay is expired.
-	 * This is needed for voltages to stabalize.
-	 */
-	if (get_timer(0) < hub->query_delay)
-		return 0;
+	ret = usb_hub_port_connect_status(dev, port);
+	if (ret < 0)
+		return ret;
 
-	ret = usb_get_port_status(dev, i + 1, portsts);
+	/* Reset the port */
+	ret = usb_hub_port_reset(dev, port, &portstatus);
 	if (ret < 0) {
-		debug("get_port_status failed\n");
-		if (get_timer(0) >= hub->connect_timeout) {
-			debug("devnum=%d port=%d: timeout\n",
-			      dev->devnum, i + 1);
-			/* Remove this device from scanning list */
-			list_del(&usb_scan->list);
-			free(usb_scan);
-			return 0;
-		}
-		return 0;
-	}
-
-	portstatus = le16_to_cpu(portsts->wPortStatus);
-	portchange = le16_to_cpu(portsts->wPortChange);
-	debug("Port %d Status %X Change %X\n", i + 1, portstatus, portchange);
-
-	/*
-	 * No connection change happened, wait a bit more.
-	 *
-	 * For some situation, the hub reports no connection change but a
-	 * device is connected to the port (eg: CCS bit is set but CSC is not
-	 * in the PORTSC register of a root hub), ignore such case.
-	 */
-	if (!(portchange & USB_PORT_STAT_C_CONNECTION) &&
-	    !(portstatus & USB_PORT_STAT_CONNECTION)) {
-		if (get_timer(0) >= hub->connect_timeout) {
-			debug("devnum=%d port=%d: timeout\n",
-			      dev->devnum, i + 1);
-			/* Remove this device from scanning list */
-			list_del(&usb_scan->list);
-			free(usb_scan);
-			return 0;
-		}
-		return 0;
+		if (ret != -ENXIO)
+			printf("cannot reset port %i!?\n", port + 1);
+		return ret;
 	}
 
-	/* A new USB device is ready at this point */
-	debug("devnum=%d port=%d: USB dev found\n", dev->devnum, i + 1);
+	return usb_hub_port_new_device(dev, port, portstatus);
+}
 
-	usb_hub_port_connect_change(dev, i);
+/* Finish with a port once any device on it has been set up */
+static int usb_scan_port_done(struct usb_device_scan *usb_scan)
+{
+	unsigned short portstatus = usb_scan->portstatus;
+	unsigned short portchange = usb_scan->portchange;
+	struct usb_device *dev = usb_scan->dev;
+	struct usb_hub_device *hub = usb_scan->hub;
+	int i = usb_scan->port;
 
 	if (portchange & USB_PORT_STAT_C_ENABLE) {
 		debug("port %d enable change, status %x\n", i + 1, portstatus);
@@ -535,8 +556,10 @@ static int usb_scan_port(struct usb_device_scan *usb_scan)
 		 * the device from scan-list. This will re-issue a new scan.
 		 */
 		if (hub->overcurrent_count[i] <=
-		    PORT_OVERCURRENT_MAX_SCAN_COUNT)
+		    PORT_OVERCURRENT_MAX_SCAN_COUNT) {
+			usb_scan->state = USB_PORT_WAIT_CONNECT;
 			return 0;
+		}
 
 		/* Otherwise the device will get removed */
 		printf("Port %d over-current occurred %d times\n", i + 1,
@@ -558,6 +581,185 @@ static int usb_scan_port(struct usb_device_scan *usb_scan)
 	return 0;
 }
 
+/* Start a reset of the port, to be checked after @delay ms */
+static int usb_scan_port_reset_start(struct usb_device_scan *usb_scan,
+				     int delay)
+{
+	int ret;
+
+	ret = usb_set_port_feature(usb_scan->dev, usb_scan->port + 1,
+				   USB_PORT_FEAT_RESET);
+	if (ret < 0) {
+		printf("cannot reset port %i!?\n", usb_scan->port + 1);
+		return usb_scan_port_done(usb_scan);
+	}
+
+#ifdef CONFIG_SANDBOX
+	if (state_get_skip_delays())
+		delay = 0;
+#endif
+	usb_scan->state = USB_PORT_RESETTING;
+	usb_scan->reset_timeout = get_timer(0) + delay;
+
+	return 0;
+}
+
+/*
+ * Check whether another port on the same bus is being reset, in which case
+ * this one has to wait
+ */
+static bool usb_scan_bus_busy(struct usb_device_scan *usb_scan)
+{
+	struct usb_device_scan *other;
+
+	list_for_each_entry(other, &usb_scan_list, list) {
+		if (other == usb_scan || other->state != USB_PORT_RESETTING)
+			continue;
+#ifdef CONFIG_DM_USB
+		if (other->dev->controller_dev == usb_scan->dev->controller_dev)
+#else
+		if (other->dev->controller == usb_scan->dev->controller)
+#endif
+			return true;
+	}
+
+	return false;
+}
+
+static int usb_scan_port_reset(struct usb_device_scan *usb_scan)
+{
+	int ret;
+
+	if (usb_scan_bus_busy(usb_scan))
+		return 0;
+
+	ret = usb_hub_port_connect_status(usb_scan->dev, usb_scan->port);
+	if (ret < 0)
+		return usb_scan_port_done(usb_scan);
+
+#ifdef CONFIG_DM_USB
+	debug("%s: resetting '%s' port %d...\n", __func__,
+	      usb_scan->dev->dev->name, usb_scan->port + 1);
+#else
+	debug("%s: resetting port %d...\n", __func__, usb_scan->port + 1);
+#endif
+	usb_scan->tries = 0;
+
+	return usb_scan_port_reset_start(usb_scan, HUB_SHORT_RESET_TIME);
+}
+
+static int usb_scan_port_reset_check(struct usb_device_scan *usb_scan)
+{
+	struct usb_device *dev = usb_scan->dev;
+	unsigned short portstatus;
+	int i = usb_scan->port;
+	int ret;
+
+	if (get_timer(0) < usb_scan->reset_timeout)
+		return 0;
+
+	ret = usb_hub_port_reset_done(dev, i, &portstatus);
+	if (ret == -EAGAIN && ++usb_scan->tries < MAX_TRIES) {
+		/* Switch to long reset delay for the next round */
+		return usb_scan_port_reset_start(usb_scan,
+						 HUB_LONG_RESET_TIME);
+	}
+
+	if (ret) {
+		debug("Cannot enable port %i after %i retries, disabling port.\n",
+		      i + 1, usb_scan->tries);
+		debug("Maybe the USB cable is bad?\n");
+		printf("cannot reset port %i!?\n", i + 1);
+	} else {
+		usb_hub_port_new_device(dev, i, portstatus);
+	}
+
+	return usb_scan_port_done(usb_scan);
+}
+
+static int usb_scan_port_connect(struct usb_device_scan *usb_scan)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct usb_port_status, portsts, 1);
+	unsigned short portstatus;
+	unsigned short portchange;
+	struct usb_device *dev;
+	struct usb_hub_device *hub;
+	int ret = 0;
+	int i;
+
+	dev = usb_scan->dev;
+	hub = usb_scan->hub;
+	i = usb_scan->port;
+
+	/*
+	 * Don't talk to the device before the query delay is expired.
+	 * This is needed for voltages to stabalize.
+	 */
+	if (get_timer(0) < hub->query_delay)
+		return 0;
+
+	ret = usb_get_port_status(dev, i + 1, portsts);
+	if (ret < 0) {
+		debug("get_port_status failed\n");
+		if (get_timer(0) >= hub->connect_timeout) {
+			debug("devnum=%d port=%d: timeout\n",
+			      dev->devnum, i + 1);
+			/* Remove this device from scanning list */
+			list_del(&usb_scan->list);
+			free(usb_scan);
+			return 0;
+		}
+		return 0;
+	}
+
+	portstatus = le16_to_cpu(portsts->wPortStatus);
+	portchange = le16_to_cpu(portsts->wPortChange);
+	debug("Port %d Status %X Change %X\n", i + 1, portstatus, portchange);
+
+	/*
+	 * No connection change happened, wait a bit more.
+	 *
+	 * For some situation, the hub reports no connection change but a
+	 * device is connected to the port (eg: CCS bit is set but CSC is not
+	 * in the PORTSC register of a root hub), ignore such case.
+	 */
+	if (!(portchange & USB_PORT_STAT_C_CONNECTION) &&
+	    !(portstatus & USB_PORT_STAT_CONNECTION)) {
+		if (get_timer(0) >= hub->connect_timeout) {
+			debug("devnum=%d port=%d: timeout\n",
+			      dev->devnum, i + 1);
+			/* Remove this device from scanning list */
+			list_del(&usb_scan->list);
+			free(usb_scan);
+			return 0;
+		}
+		return 0;
+	}
+
+	/* A new USB device is ready at this point */
+	debug("devnum=%d port=%d: USB dev found\n", dev->devnum, i + 1);
+
+	usb_scan->portstatus = portstatus;
+	usb_scan->portchange = portchange;
+	usb_scan->state = USB_PORT_WAIT_RESET;
+
+	return usb_scan_port_reset(usb_scan);
+}
+
+static int usb_scan_port(struct usb_device_scan *usb_scan)
+{
+	switch (usb_scan->state) {
+	case USB_PORT_WAIT_CONNECT:
+		return usb_scan_port_connect(usb_scan);
+	case USB_PORT_WAIT_RESET:
+		return usb_scan_port_reset(usb_scan);
+	case USB_PORT_RESETTING:
+		return usb_scan_port_reset_check(usb_scan);
+	}
+
+	return 0;
+}
+
 static int usb_device_list_scan(void)
 {
 	struct usb_device_scan *usb_scan;
@@ -570,6 +772,7 @@ static int usb_device_list_scan(void)
 		return 0;
 
 	running = 1;
+	bootstage_start(BOOTSTAGE_ID_ACCUM_USB, "usb_scan");
 
 	while (1) {
 		/* We're done, once the list is empty again */
@@ -587,6 +790,8 @@ static int usb_device_list_scan(void)
 	}
 
 out:
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_USB);
+
 	/*
 	 * This USB controller has finished scanning all its connected
 	 * USB devices. Set "running" back to 0, so that other USB controllers
@@ -870,6 +1075,10 @@ static int usb_hub_configure(struct usb_device *dev)
 		list_add_tail(&usb_scan->list, &usb_scan_list);
 	}
 
+	/* The ports are scanned later if several buses are set up together */
+	if (usb_scan_deferred)
+		return 0;
+
 	/*
 	 * And now call the scanning code which loops over the generated list
 	 */
@@ -937,6 +1146,18 @@ int usb_hub_scan(struct udevice *hub)
 	return usb_hub_configure(udev);
 }
 
+void usb_hub_scan_start(void)
+{
+	usb_scan_deferred = true;
+}
+
+int usb_hub_scan_finish(void)
+{
+	usb_scan_deferred = false;
+
+	return usb_device_list_scan();
+}
+
 static int usb_hub_post_probe(struct udevice *dev)
 {
 	debug("%s\n", __func__);
@@ -42,6 +42,7 @@
 #include <memalign.h>
 #include <asm/byteorder.h>
 #include <asm/processor.h>
+#include <asm/unaligned.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 
@@ -58,7 +59,7 @@
 static const unsigned char us_direction[256/8] = {
 	0x28, 0x81, 0x14, 0x14, 0x20, 0x01, 0x90, 0x77,
 	0x0C, 0x20, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
+	0x00, 0x01, 0x00, 0x40, 0x00, 0x01, 0x00, 0x01,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 #define US_DIRECTION(x) ((us_direction[x>>3] >> (x & 7)) & 1)
@@ -85,6 +86,8 @@ struct us_data {
 	unsigned char	ep_in;			/* in endpoint */
 	unsigned char	ep_out;			/* out ....... */
 	unsigned char	ep_int;			/* interrupt . */
+	unsigned char	ep_cmd;			/* UAS command */
+	unsigned char	ep_status;		/* UAS status */
 	unsigned char	subclass;		/* as in overview */
 	unsigned char	protocol;		/* .............. */
 	unsigned char	attention_done;		/* force attn on first cmd */
@@ -100,17 +103,21 @@ struct us_data {
 	trans_cmnd	transport;		/* transport routine */
 };
 
-#ifdef CONFIG_USB_EHCI_HCD
+#if defined(CONFIG_USB_EHCI_HCD) || defined(CONFIG_USB_XHCI_HCD)
 /*
  * The U-Boot EHCI driver can handle any transfer length as long as there is
- * enough free heap space left, but the SCSI READ(10) and WRITE(10) commands are
- * limited to 65535 blocks.
+ * enough free heap space left, and the xHCI driver queues large transfers a
+ * chunk at a time, but the SCSI READ(10) and WRITE(10) commands are limited to
+ * 65535 blocks.
  */
 #define USB_MAX_XFER_BLK	65535
 #else
 #define USB_MAX_XFER_BLK	20
 #endif
 
+/* Number of read or write commands queued at a time with UAS */
+#define UAS_MAX_CMDS		4
+
 #ifndef CONFIG_BLK
 static struct us_data usb_stor[USB_MAX_STOR_DEV];
 #endif
@@ -183,6 +190,11 @@ static unsigned int usb_get_max_lun(struct us_data *us)
 {
 	int len;
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, result, 1);
+
+	/* There is no Get Max LUN request in UAS, so only LUN 0 is used */
+	if (us->protocol == US_PR_UAS)
+		return 0;
+
 	len = usb_control_msg(us->pusb_dev,
 			      usb_rcvctrlpipe(us->pusb_dev, 0),
 			      US_BBB_GET_MAX_LUN,
@@ -949,6 +961,119 @@ do_retry:
 	return USB_STOR_TRANSPORT_FAILED;
 }
 
+/* clear a stall on each pipe of a UAS device */
+static int usb_stor_UAS_reset(struct us_data *us)
+{
+	struct usb_device *udev = us->pusb_dev;
+
+	usb_clear_halt(udev, usb_sndbulkpipe(udev, us->ep_cmd));
+	usb_clear_halt(udev, usb_rcvbulkpipe(udev, us->ep_status));
+	usb_clear_halt(udev, usb_rcvbulkpipe(udev, us->ep_in));
+	usb_clear_halt(udev, usb_sndbulkpipe(udev, us->ep_out));
+
+	return 0;
+}
+
+/* send the command IU for srb, with the given tag */
+static int usb_stor_UAS_send(ccb *srb, struct us_data *us, int tag)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct uas_command_iu, iu, 1);
+	int actlen;
+
+	if (srb->cmdlen > sizeof(iu->CDB))
+		return -EINVAL;
+	memset(iu, '\0', sizeof(*iu));
+	iu->bIUID = UAS_IU_COMMAND;
+	iu->wTag = cpu_to_be16(tag);
+	iu->bLUN[1] = srb->lun;
+	memcpy(iu->CDB, srb->cmd, srb->cmdlen);
+
+	return usb_bulk_msg(us->pusb_dev,
+			    usb_sndbulkpipe(us->pusb_dev, us->ep_cmd),
+			    iu, sizeof(*iu), &actlen, USB_CNTL_TIMEOUT * 5);
+}
+
+/*
+ * Handle IUs from the status pipe until one of the queued commands ends. The
+ * device says which command it is ready to move data for, so the data phases
+ * are done here too. queued[] holds the commands, with tags from 1 upwards.
+ * Returns the tag of the command which ended, with its SCSI status in
+ * *statusp, or -ve if the device has to be reset.
+ */
+static int usb_stor_UAS_wait(struct us_data *us, ccb *queued[], int count,
+			     int *statusp)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(struct uas_sense_iu, iu, 1);
+	struct usb_device *udev = us->pusb_dev;
+	unsigned int pipe;
+	int tag, len, actlen, result;
+	ccb *srb;
+
+	for (;;) {
+		pipe = usb_rcvbulkpipe(udev, us->ep_status);
+		result = usb_bulk_msg(udev, pipe, iu, sizeof(*iu), &actlen,
+				      USB_CNTL_TIMEOUT * 5);
+		if (result < 0 || actlen < UAS_READY_IU_SIZE) {
+			debug("UAS: no status, result %d\n", result);
+			return -EIO;
+		}
+		tag = be16_to_cpu(iu->wTag);
+		if (tag < 1 || tag > count || !queued[tag - 1]) {
+			debug("UAS: unknown tag %d\n", tag);
+			return -EIO;
+		}
+		srb = queued[tag - 1];
+
+		switch (iu->bIUID) {
+		case UAS_IU_READ_READY:
+		case UAS_IU_WRITE_READY:
+			if (iu->bIUID == UAS_IU_READ_READY)
+				pipe = usb_rcvbulkpipe(udev, us->ep_in);
+			else
+				pipe = usb_sndbulkpipe(udev, us->ep_out);
+			result = usb_bulk_msg(udev, pipe, srb->pdata,
+					      srb->datalen, &actlen,
+					      USB_CNTL_TIMEOUT * 5);
+			/* the status still follows a stall */
+			if (result < 0 && (udev->status & USB_ST_STALLED))
+				result = usb_clear_halt(udev, pipe);
+			if (result < 0) {
+				debug("UAS: data phase failed, tag %d\n", tag);
+				return -EIO;
+			}
+			break;
+		case UAS_IU_SENSE:
+			if (actlen < UAS_SENSE_IU_SIZE)
+				return -EIO;
+			len = min3((int)be16_to_cpu(iu->wLength),
+				   actlen - UAS_SENSE_IU_SIZE,
+				   (int)sizeof(srb->sense_buf));
+			if (len > 0)
+				memcpy(srb->sense_buf, iu->bSenseData, len);
+			*statusp = iu->bStatus;
+			return tag;
+		default:
+			/* a RESPONSE IU means the command was not accepted */
+			debug("UAS: IU %#x, tag %d\n", iu->bIUID, tag);
+			return -EIO;
+		}
+	}
+}
+
+static int usb_stor_UAS_transport(ccb *srb, struct us_data *us)
+{
+	ccb *queued[1] = { srb };
+	int status;
+
+	if (usb_stor_UAS_send(srb, us, 1) < 0 ||
+	    usb_stor_UAS_wait(us, queued, 1, &status) < 0) {
+		usb_stor_UAS_reset(us);
+		return USB_STOR_TRANSPORT_FAILED;
+	}
+
+	return status ? USB_STOR_TRANSPORT_FAILED : USB_STOR_TRANSPORT_GOOD;
+}
+
 
 static int usb_inquiry(ccb *srb, struct us_data *ss)
 {
@@ -978,6 +1103,10 @@ static int usb_request_sense(ccb *srb, struct us_data *ss)
 {
 	char *ptr;
 
+	/* UAS devices return the sense data along with the status */
+	if (ss->protocol == US_PR_UAS)
+		return 0;
+
 	ptr = (char *)srb->pdata;
 	memset(&srb->cmd[0], 0, 12);
 	srb->cmd[0] = SCSI_REQ_SENSE;
@@ -1043,28 +1172,51 @@ static int usb_read_capacity(ccb *srb, struct us_data *ss)
 	return -1;
 }
 
-static int usb_read_10(ccb *srb, struct us_data *ss, unsigned long start,
-		       unsigned short blocks)
+/* used when READ CAPACITY(10) says there are more than 2^32 blocks */
+static int usb_read_capacity_16(ccb *srb, struct us_data *ss,
+				lbaint_t *capacity, u32 *blksz)
 {
-	memset(&srb->cmd[0], 0, 12);
-	srb->cmd[0] = SCSI_READ10;
-	srb->cmd[1] = srb->lun << 5;
-	srb->cmd[2] = ((unsigned char) (start >> 24)) & 0xff;
-	srb->cmd[3] = ((unsigned char) (start >> 16)) & 0xff;
-	srb->cmd[4] = ((unsigned char) (start >> 8)) & 0xff;
-	srb->cmd[5] = ((unsigned char) (start)) & 0xff;
-	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
-	srb->cmd[8] = (unsigned char) blocks & 0xff;
-	srb->cmdlen = 12;
-	debug("read10: start %lx blocks %x\n", start, blocks);
-	return ss->transport(srb, ss);
+	ALLOC_CACHE_ALIGN_BUFFER(u8, cap, 32);
+	unsigned char *ptr = srb->pdata;
+	int result;
+
+	memset(&srb->cmd[0], 0, 16);
+	srb->cmd[0] = SCSI_RD_CAPAC16;
+	srb->cmd[1] = 0x10;	/* service action: read capacity */
+	srb->cmd[13] = 32;
+	srb->datalen = 32;
+	srb->cmdlen = 16;
+	srb->pdata = cap;
+	result = ss->transport(srb, ss);
+	srb->pdata = ptr;
+	if (result != USB_STOR_TRANSPORT_GOOD)
+		return -1;
+
+	*capacity = get_unaligned_be64(cap) + 1;
+	*blksz = get_unaligned_be32(cap + 8);
+
+	return 0;
 }
 
-static int usb_write_10(ccb *srb, struct us_data *ss, unsigned long start,
-			unsigned short blocks)
+/*
+ * Set up a READ or WRITE command. The 16-byte commands are only used for
+ * blocks which READ(10) and WRITE(10) cannot reach.
+ */
+static void usb_setup_rw(ccb *srb, lbaint_t start, unsigned short blocks,
+			 bool write)
 {
-	memset(&srb->cmd[0], 0, 12);
-	srb->cmd[0] = SCSI_WRITE10;
+	memset(&srb->cmd[0], 0, 16);
+	if ((u64)(start + blocks - 1) >> 32) {
+		srb->cmd[0] = write ? SCSI_WRITE16 : SCSI_READ16;
+		put_unaligned_be64(start, &srb->cmd[2]);
+		srb->cmd[12] = ((unsigned char) (blocks >> 8)) & 0xff;
+		srb->cmd[13] = (unsigned char) blocks & 0xff;
+		srb->cmdlen = 16;
+		debug("%s16: start " LBAF " blocks %x\n",
+		      write ? "write" : "read", start, blocks);
+		return;
+	}
+	srb->cmd[0] = write ? SCSI_WRITE10 : SCSI_READ10;
 	srb->cmd[1] = srb->lun << 5;
 	srb->cmd[2] = ((unsigned char) (start >> 24)) & 0xff;
 	srb->cmd[3] = ((unsigned char) (start >> 16)) & 0xff;
@@ -1073,8 +1225,79 @@ static int usb_write_10(ccb *srb, struct us_data *ss, unsigned long start,
 	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
 	srb->cmd[8] = (unsigned char) blocks & 0xff;
 	srb->cmdlen = 12;
-	debug("write10: start %lx blocks %x\n", start, blocks);
-	return ss->transport(srb, ss);
+	debug("%s10: start " LBAF " blocks %x\n", write ? "write" : "read",
+	      start, blocks);
+}
+
+/*
+ * Read or write blocks on a UAS device, keeping up to UAS_MAX_CMDS commands
+ * queued so that the device never waits for the next one. Commands may end in
+ * any order; the count returned covers the blocks up to the first failure.
+ */
+static lbaint_t usb_stor_UAS_rw(struct us_data *ss,
+				struct blk_desc *block_dev, lbaint_t start,
+				lbaint_t blkcnt, uintptr_t buf_addr,
+				bool write)
+{
+	static ccb uas_ccb[UAS_MAX_CMDS];
+	ccb *queued[UAS_MAX_CMDS] = { NULL };
+	lbaint_t offset[UAS_MAX_CMDS];
+	lbaint_t next = 0, good = blkcnt;
+	unsigned short blks;
+	int busy = 0, tag, status, i;
+	ccb *srb;
+
+	while (next < good || busy) {
+		/* Queue up the commands which follow */
+		for (i = 0; i < UAS_MAX_CMDS && next < good; i++) {
+			if (queued[i])
+				continue;
+			srb = &uas_ccb[i];
+			blks = min(good - next, (lbaint_t)USB_MAX_XFER_BLK);
+			if (blks == USB_MAX_XFER_BLK)
+				usb_show_progress();
+			srb->lun = block_dev->lun;
+			srb->pdata = (unsigned char *)buf_addr +
+				next * block_dev->blksz;
+			srb->datalen = block_dev->blksz * blks;
+			usb_setup_rw(srb, start + next, blks, write);
+			if (usb_stor_UAS_send(srb, ss, i + 1) < 0) {
+				good = next;
+				break;
+			}
+			queued[i] = srb;
+			offset[i] = next;
+			next += blks;
+			busy++;
+		}
+		if (!busy)
+			break;
+
+		tag = usb_stor_UAS_wait(ss, queued, UAS_MAX_CMDS, &status);
+		if (tag < 0) {
+			/* nothing still queued can be relied on */
+			for (i = 0; i < UAS_MAX_CMDS; i++) {
+				if (queued[i] && offset[i] < good)
+					good = offset[i];
+			}
+			usb_stor_UAS_reset(ss);
+			break;
+		}
+		i = tag - 1;
+		if (status) {
+			debug("UAS: %s ERROR, sense %02X %02X %02X\n",
+			      write ? "Write" : "Read",
+			      queued[i]->sense_buf[2],
+			      queued[i]->sense_buf[12],
+			      queued[i]->sense_buf[13]);
+			if (offset[i] < good)
+				good = offset[i];
+		}
+		queued[i] = NULL;
+		busy--;
+	}
+
+	return good;
 }
 
 
@@ -1111,7 +1334,7 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks = 0;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1146,7 +1369,15 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 	debug("\nusb_read: dev %d startblk " LBAF ", blccnt " LBAF " buffer %"
 	      PRIxPTR "\n", block_dev->devnum, start, blks, buf_addr);
 
-	do {
+	if (IS_ENABLED(CONFIG_USB_STORAGE_UAS) && ss->protocol == US_PR_UAS) {
+		blkcnt = usb_stor_UAS_rw(ss, block_dev, start, blks, buf_addr,
+					 false);
+		start += blkcnt;
+		buf_addr += blkcnt * block_dev->blksz;
+		blks = 0;
+	}
+
+	while (blks != 0) {
 		/* XXX need some comment here */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1159,7 +1390,8 @@ retry_it:
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (usb_read_10(srb, ss, start, smallblks)) {
+		usb_setup_rw(srb, start, smallblks, false);
+		if (ss->transport(srb, ss)) {
 			debug("Read ERROR\n");
 			usb_request_sense(srb, ss);
 			if (retry--)
@@ -1170,7 +1402,7 @@ retry_it:
 		start += smallblks;
 		blks -= smallblks;
 		buf_addr += srb->datalen;
-	} while (blks != 0);
+	}
 	ss->flags &= ~USB_READY;
 
 	debug("usb_read: end startblk " LBAF
@@ -1193,7 +1425,7 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 {
 	lbaint_t start, blks;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks = 0;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1230,7 +1462,15 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 	debug("\nusb_write: dev %d startblk " LBAF ", blccnt " LBAF " buffer %"
 	      PRIxPTR "\n", block_dev->devnum, start, blks, buf_addr);
 
-	do {
+	if (IS_ENABLED(CONFIG_USB_STORAGE_UAS) && ss->protocol == US_PR_UAS) {
+		blkcnt = usb_stor_UAS_rw(ss, block_dev, start, blks, buf_addr,
+					 true);
+		start += blkcnt;
+		buf_addr += blkcnt * block_dev->blksz;
+		blks = 0;
+	}
+
+	while (blks != 0) {
 		/* If write fails retry for max retry count else
 		 * return with number of blocks written successfully.
 		 */
@@ -1245,7 +1485,8 @@ retry_it:
 			usb_show_progress();
 		srb->datalen = block_dev->blksz * smallblks;
 		srb->pdata = (unsigned char *)buf_addr;
-		if (usb_write_10(srb, ss, start, smallblks)) {
+		usb_setup_rw(srb, start, smallblks, true);
+		if (ss->transport(srb, ss)) {
 			debug("Write ERROR\n");
 			usb_request_sense(srb, ss);
 			if (retry--)
@@ -1256,7 +1497,7 @@ retry_it:
 		start += smallblks;
 		blks -= smallblks;
 		buf_addr += srb->datalen;
-	} while (blks != 0);
+	}
 	ss->flags &= ~USB_READY;
 
 	debug("usb_write: end startblk " LBAF ", blccnt %x buffer %"
@@ -1269,6 +1510,94 @@ retry_it:
 
 }
 
+/*
+ * Look for a UAS alternate setting of a storage interface. Only the first
+ * setting of each interface is kept when the configuration is parsed, with
+ * the endpoints of all of them, so go through the configuration descriptor
+ * again to pick out the Bulk-Only endpoints of setting 0 and the pipes of the
+ * UAS setting. Returns the alternate setting to use.
+ */
+static int usb_stor_UAS_probe(struct usb_device *dev,
+			      struct usb_interface *iface, struct us_data *ss)
+{
+	struct usb_interface_descriptor *idesc = NULL;
+	struct usb_endpoint_descriptor *edesc = NULL;
+	struct usb_pipe_usage_descriptor *pdesc;
+	struct usb_descriptor_header *head;
+	unsigned char pipe[UAS_PIPE_DATA_OUT + 1] = { 0 };
+	unsigned char ifnum = iface->desc.bInterfaceNumber;
+	unsigned char *buffer;
+	int len, index, uas_alt = -1;
+
+	len = usb_get_configuration_len(dev, dev->configno);
+	if (len < 0)
+		return 0;
+	buffer = malloc_cache_aligned(len);
+	if (!buffer)
+		return 0;
+	len = usb_get_configuration_no(dev, dev->configno, buffer, len);
+
+	for (index = 0; index + 1 < len; index += head->bLength) {
+		head = (struct usb_descriptor_header *)&buffer[index];
+		if (!head->bLength || index + head->bLength > len)
+			break;
+		switch (head->bDescriptorType) {
+		case USB_DT_INTERFACE:
+			idesc = (struct usb_interface_descriptor *)head;
+			edesc = NULL;
+			if (idesc->bInterfaceNumber == ifnum &&
+			    idesc->bInterfaceProtocol == US_PR_UAS &&
+			    uas_alt < 0)
+				uas_alt = idesc->bAlternateSetting;
+			break;
+		case USB_DT_ENDPOINT:
+			edesc = (struct usb_endpoint_descriptor *)head;
+			if (!idesc || idesc->bInterfaceNumber != ifnum ||
+			    idesc->bAlternateSetting != 0 ||
+			    !usb_endpoint_xfer_bulk(edesc))
+				break;
+			if (edesc->bEndpointAddress & USB_DIR_IN)
+				ss->ep_in = edesc->bEndpointAddress &
+						USB_ENDPOINT_NUMBER_MASK;
+			else
+				ss->ep_out = edesc->bEndpointAddress &
+						USB_ENDPOINT_NUMBER_MASK;
+			break;
+		case USB_DT_PIPE_USAGE:
+			pdesc = (struct usb_pipe_usage_descriptor *)head;
+			if (!edesc || idesc->bInterfaceNumber != ifnum ||
+			    idesc->bAlternateSetting != uas_alt ||
+			    pdesc->bPipeID < UAS_PIPE_COMMAND ||
+			    pdesc->bPipeID > UAS_PIPE_DATA_OUT)
+				break;
+			pipe[pdesc->bPipeID] = edesc->bEndpointAddress &
+						USB_ENDPOINT_NUMBER_MASK;
+			break;
+		}
+	}
+	free(buffer);
+
+	if (!pipe[UAS_PIPE_COMMAND] || !pipe[UAS_PIPE_STATUS] ||
+	    !pipe[UAS_PIPE_DATA_IN] || !pipe[UAS_PIPE_DATA_OUT])
+		return 0;
+	/* We cannot use bulk streams, which UAS needs at SuperSpeed */
+	if (dev->speed >= USB_SPEED_SUPER) {
+		debug("UAS needs streams, using Bulk-Only\n");
+		return 0;
+	}
+
+	debug("USB Attached SCSI, alternate setting %d\n", uas_alt);
+	ss->protocol = US_PR_UAS;
+	ss->transport = usb_stor_UAS_transport;
+	ss->transport_reset = usb_stor_UAS_reset;
+	ss->ep_cmd = pipe[UAS_PIPE_COMMAND];
+	ss->ep_status = pipe[UAS_PIPE_STATUS];
+	ss->ep_in = pipe[UAS_PIPE_DATA_IN];
+	ss->ep_out = pipe[UAS_PIPE_DATA_OUT];
+
+	return uas_alt;
+}
+
 /* Probe to see if a new device is actually a Storage device */
 int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 		      struct us_data *ss)
@@ -1277,6 +1606,7 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 	int i;
 	struct usb_endpoint_descriptor *ep_desc;
 	unsigned int flags = 0;
+	int alt = 0;
 
 	/* let's examine the device now */
 	iface = &dev->config.if_desc[ifnum];
@@ -1355,11 +1685,13 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 			ss->irqinterval = ep_desc->bInterval;
 		}
 	}
+	if (IS_ENABLED(CONFIG_USB_STORAGE_UAS) && iface->num_altsetting > 1)
+		alt = usb_stor_UAS_probe(dev, iface, ss);
 	debug("Endpoints In %d Out %d Int %d\n",
 	      ss->ep_in, ss->ep_out, ss->ep_int);
 
 	/* Do some basic sanity checks, and bail if we find a problem */
-	if (usb_set_interface(dev, iface->desc.bInterfaceNumber, 0) ||
+	if (usb_set_interface(dev, iface->desc.bInterfaceNumber, alt) ||
 	    !ss->ep_in || !ss->ep_out ||
 	    (ss->protocol == US_PR_CBI && ss->ep_int == 0)) {
 		debug("Problems with device\n");
@@ -1394,7 +1726,8 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	unsigned char perq, modi;
 	ALLOC_CACHE_ALIGN_BUFFER(u32, cap, 2);
 	ALLOC_CACHE_ALIGN_BUFFER(u8, usb_stor_buf, 36);
-	u32 capacity, blksz;
+	lbaint_t capacity;
+	u32 blksz;
 	ccb *pccb = &usb_ccb;
 
 	pccb->pdata = usb_stor_buf;
@@ -1461,10 +1794,14 @@ int usb_stor_get_info(struct usb_device *dev, struct us_data *ss,
 	cap[1] = cpu_to_be32(cap[1]);
 #endif
 
-	capacity = be32_to_cpu(cap[0]) + 1;
+	capacity = (lbaint_t)be32_to_cpu(cap[0]) + 1;
 	blksz = be32_to_cpu(cap[1]);
+	/* Only a 64-bit lbaint_t can hold more than 2^32 blocks */
+	if (sizeof(lbaint_t) > 4 && be32_to_cpu(cap[0]) == 0xffffffff &&
+	    usb_read_capacity_16(pccb, ss, &capacity, &blksz))
+		printf("READ_CAP16 ERROR\n");
 
-	debug("Capacity = 0x%08x, blocksz = 0x%08x\n", capacity, blksz);
+	debug("Capacity = " LBAF ", blocksz = 0x%08x\n", capacity, blksz);
 	dev_desc->lba = capacity;
 	dev_desc->blksz = blksz;
 	dev_desc->log2blksz = LOG2(dev_desc->blksz);
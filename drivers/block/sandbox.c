@@ -87,10 +87,33 @@ static unsigned long host_block_write(struct blk_desc *block_dev,
 	return -1;
 }
 
+/* Punch a hole in the backing file, so the blocks read as zeroes */
+#ifdef CONFIG_BLK
+static unsigned long host_block_erase(struct udevice *dev,
+				      unsigned long start, lbaint_t blkcnt)
+{
+	struct host_block_dev *host_dev = dev_get_priv(dev);
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+#else
+static unsigned long host_block_erase(struct blk_desc *block_dev,
+				      unsigned long start, lbaint_t blkcnt)
+{
+	int dev = block_dev->devnum;
+	struct host_block_dev *host_dev = find_host_device(dev);
+#endif
+
+	if (os_punch_hole(host_dev->fd, start * block_dev->blksz,
+			  blkcnt * block_dev->blksz))
+		return -1;
+
+	return blkcnt;
+}
+
 #ifdef CONFIG_BLK
 int host_dev_bind(int devnum, char *filename)
 {
 	struct host_block_dev *host_dev;
+	struct blk_desc *desc;
 	struct udevice *dev;
 	char dev_name[20], *str, *fname;
 	int ret, fd;
@@ -141,6 +164,9 @@ int host_dev_bind(int devnum, char *filename)
 	host_dev = dev_get_priv(dev);
 	host_dev->fd = fd;
 	host_dev->filename = fname;
+	desc = dev_get_uclass_platdata(dev);
+	desc->erase_grp = 1;
+	desc->erase_val = 0;
 
 	return blk_prepare_device(dev);
 err_file:
@@ -184,6 +210,9 @@ int host_dev_bind(int dev, char *filename)
 	blk_dev->lba = os_lseek(host_dev->fd, 0, OS_SEEK_END) / blk_dev->blksz;
 	blk_dev->block_read = host_block_read;
 	blk_dev->block_write = host_block_write;
+	blk_dev->block_erase = host_block_erase;
+	blk_dev->erase_grp = 1;
+	blk_dev->erase_val = 0;
 	blk_dev->devnum = dev;
 	blk_dev->part_type = PART_TYPE_UNKNOWN;
 	part_init(blk_dev);
@@ -221,6 +250,7 @@ int host_get_dev_err(int devnum, struct blk_desc **blk_devp)
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.erase	= host_block_erase,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
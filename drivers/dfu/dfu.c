@@ -16,6 +16,7 @@
 #include <hash.h>
 #include <linux/list.h>
 #include <linux/compiler.h>
+#include <linux/sizes.h>
 
 static LIST_HEAD(dfu_list);
 static int dfu_alt_num;
@@ -82,10 +83,29 @@ int dfu_init_env_entities(char *interface, char *devstr)
 static unsigned char *dfu_buf;
 static unsigned long dfu_buf_size;
 
+/*
+ * While writing, the buffer is split into parts. Once the part being filled
+ * with data from the host is full it is queued to be written, and the next
+ * free part is filled meanwhile. Queued parts are written in order, a step at
+ * a time from dfu_write_poll(), so that flash writes overlap with USB
+ * transfers.
+ */
+#define DFU_WRITE_STEP		SZ_64K
+
+static unsigned long dfu_wr_size;	/* Size of each part */
+static int dfu_wr_parts;		/* Number of parts */
+static int dfu_wr_first;		/* Oldest queued part */
+static int dfu_wr_count;		/* Number of queued parts */
+static u8 *dfu_wr_pos;			/* Next data to write from */
+static u8 *dfu_wr_end[CONFIG_DFU_WRITE_BUFFERS];	/* End of each part */
+static struct dfu_entity *dfu_wr_dfu;	/* Entity being written */
+static int dfu_wr_err;			/* Error from dfu_write_poll() */
+
 unsigned char *dfu_free_buf(void)
 {
 	free(dfu_buf);
 	dfu_buf = NULL;
+	dfu_wr_dfu = NULL;
 	return dfu_buf;
 }
 
@@ -108,6 +128,10 @@ unsigned char *dfu_get_buf(struct dfu_entity *dfu)
 	if (!s || !dfu_buf_size)
 		dfu_buf_size = CONFIG_SYS_DFU_DATA_BUF_SIZE;
 
+	/* Hold whole erase or program units of the medium */
+	if (dfu->write_align)
+		dfu_buf_size = roundup(dfu_buf_size, dfu->write_align);
+
 	if (dfu->max_buf_size && dfu_buf_size > dfu->max_buf_size)
 		dfu_buf_size = dfu->max_buf_size;
 
@@ -136,11 +160,65 @@ static char *dfu_get_hash_algo(void)
 	return NULL;
 }
 
-static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+/* Split the buffer into parts which hold whole write units of the medium */
+static void dfu_write_setup(struct dfu_entity *dfu)
 {
-	long w_size;
+	unsigned long align = dfu->write_align ? dfu->write_align : 1;
+
+	dfu_wr_parts = CONFIG_DFU_WRITE_BUFFERS;
+	dfu_wr_size = rounddown(dfu_buf_size / dfu_wr_parts, align);
+	if (!dfu_wr_size) {
+		dfu_wr_parts = 1;
+		dfu_wr_size = dfu_buf_size;
+	}
+	dfu_wr_first = 0;
+	dfu_wr_count = 0;
+	dfu_wr_dfu = dfu;
+	dfu_wr_err = 0;
+}
+
+/*
+ * Write data from the oldest queued part to the medium: either everything
+ * left in it, or a single step, which is kept short so as not to hold up USB
+ */
+static int dfu_write_part(struct dfu_entity *dfu, bool all)
+{
+	u8 *end = dfu_wr_end[dfu_wr_first];
+	long w_size = end - dfu_wr_pos;
 	int ret;
 
+	if (!all) {
+		w_size = min_t(long, w_size,
+			       roundup(DFU_WRITE_STEP, dfu->write_align ?
+				       dfu->write_align : 1));
+	}
+
+	ret = dfu->write_medium(dfu, dfu->offset, dfu_wr_pos, &w_size);
+	if (ret) {
+		debug("%s: Write error!\n", __func__);
+		return ret;
+	}
+
+	/* update offset */
+	dfu->offset += w_size;
+
+	dfu_wr_pos += w_size;
+	if (dfu_wr_pos >= end) {
+		dfu_wr_first = (dfu_wr_first + 1) % dfu_wr_parts;
+		dfu_wr_count--;
+		dfu_wr_pos = dfu_buf + dfu_wr_first * dfu_wr_size;
+		puts("#");
+	}
+
+	return 0;
+}
+
+/* Queue the part being filled to be written and move on to the next one */
+static int dfu_write_buffer_queue(struct dfu_entity *dfu)
+{
+	long w_size;
+	int part, ret;
+
 	/* flush size? */
 	w_size = dfu->i_buf - dfu->i_buf_start;
 	if (w_size == 0)
@@ -150,21 +228,79 @@ static int dfu_write_buffer_drain(struct dfu_entity *dfu)
 		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc,
 					   dfu->i_buf_start, w_size, 0);
 
-	ret = dfu->write_medium(dfu, dfu->offset, dfu->i_buf_start, &w_size);
-	if (ret)
-		debug("%s: Write error!\n", __func__);
+	part = (dfu_wr_first + dfu_wr_count) % dfu_wr_parts;
+	dfu_wr_end[part] = dfu->i_buf;
+	if (!dfu_wr_count)
+		dfu_wr_pos = dfu->i_buf_start;
+	dfu_wr_count++;
+
+	/* If no part is free, make room by writing out the oldest one */
+	if (dfu_wr_count == dfu_wr_parts) {
+		ret = dfu_write_part(dfu, true);
+		if (ret)
+			return ret;
+	}
 
-	/* point back */
+	part = (part + 1) % dfu_wr_parts;
+	dfu->i_buf_start = dfu_buf + part * dfu_wr_size;
+	dfu->i_buf_end = dfu->i_buf_start + dfu_wr_size;
 	dfu->i_buf = dfu->i_buf_start;
 
-	/* update offset */
-	dfu->offset += w_size;
+	return 0;
+}
 
-	puts("#");
+/* Write everything which has been received so far to the medium */
+static int dfu_write_buffer_drain(struct dfu_entity *dfu)
+{
+	int ret;
+
+	if (dfu_wr_err)
+		return dfu_wr_err;
+
+	ret = dfu_write_buffer_queue(dfu);
+	while (!ret && dfu_wr_count)
+		ret = dfu_write_part(dfu, true);
 
 	return ret;
 }
 
+void dfu_write_poll(void)
+{
+	if (!dfu_wr_dfu || !dfu_wr_count || dfu_wr_err)
+		return;
+
+	dfu_wr_err = dfu_write_part(dfu_wr_dfu, false);
+}
+
+/*
+ * Write whole write units of a large block straight from where it is. This is
+ * only done when the part being filled is empty, so that the medium is always
+ * written from a unit boundary.
+ */
+static int dfu_write_direct(struct dfu_entity *dfu, void *buf, long size)
+{
+	int ret;
+
+	ret = dfu_write_buffer_drain(dfu);
+	if (ret)
+		return ret;
+
+	if (dfu_hash_algo)
+		dfu_hash_algo->hash_update(dfu_hash_algo, &dfu->crc, buf,
+					   size, 0);
+
+	ret = dfu->write_medium(dfu, dfu->offset, buf, &size);
+	if (ret) {
+		debug("%s: Write error!\n", __func__);
+		return ret;
+	}
+
+	dfu->offset += size;
+	puts("#");
+
+	return 0;
+}
+
 void dfu_write_transaction_cleanup(struct dfu_entity *dfu)
 {
 	/* clear everything */
@@ -175,6 +311,9 @@ void dfu_write_transaction_cleanup(struct dfu_entity *dfu)
 	dfu->i_buf_end = dfu_buf;
 	dfu->i_buf = dfu->i_buf_start;
 	dfu->inited = 0;
+	dfu_wr_count = 0;
+	dfu_wr_err = 0;
+	dfu_wr_dfu = NULL;
 }
 
 int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
@@ -182,8 +321,10 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	int ret = 0;
 
 	ret = dfu_write_buffer_drain(dfu);
-	if (ret)
+	if (ret) {
+		dfu_write_transaction_cleanup(dfu);
 		return ret;
+	}
 
 	if (dfu->flush_medium)
 		ret = dfu->flush_medium(dfu);
@@ -199,6 +340,7 @@ int dfu_flush(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 
 int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 {
+	long chunk;
 	int ret;
 
 	debug("%s: name: %s buf: 0x%p size: 0x%x p_num: 0x%x offset: 0x%llx bufoffset: 0x%lx\n",
@@ -214,7 +356,8 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		dfu->i_buf_start = dfu_get_buf(dfu);
 		if (dfu->i_buf_start == NULL)
 			return -ENOMEM;
-		dfu->i_buf_end = dfu_get_buf(dfu) + dfu_buf_size;
+		dfu_write_setup(dfu);
+		dfu->i_buf_end = dfu->i_buf_start + dfu_wr_size;
 		dfu->i_buf = dfu->i_buf_start;
 
 		dfu->inited = 1;
@@ -227,6 +370,13 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 		return -1;
 	}
 
+	/* A write done in the background may have failed */
+	if (dfu_wr_err) {
+		ret = dfu_wr_err;
+		dfu_write_transaction_cleanup(dfu);
+		return ret;
+	}
+
 	/* DFU 1.1 standard says:
 	 * The wBlockNum field is a block sequence number. It increments each
 	 * time a block is transferred, wrapping to zero from 65,535. It is used
@@ -243,33 +393,37 @@ int dfu_write(struct dfu_entity *dfu, void *buf, int size, int blk_seq_num)
 	/* handle rollover */
 	dfu->i_blk_seq_num = (dfu->i_blk_seq_num + 1) & 0xffff;
 
-	/* flush buffer if overflow */
-	if ((dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
-		if (ret) {
+	/* The end of the data: queue what is left */
+	if (size == 0) {
+		ret = dfu_write_buffer_queue(dfu);
+		if (ret)
 			dfu_write_transaction_cleanup(dfu);
-			return ret;
-		}
-	}
-
-	/* we should be in buffer now (if not then size too large) */
-	if ((dfu->i_buf + size) > dfu->i_buf_end) {
-		error("Buffer overflow! (0x%p + 0x%x > 0x%p)\n", dfu->i_buf,
-		      size, dfu->i_buf_end);
-		dfu_write_transaction_cleanup(dfu);
-		return -1;
+		return ret;
 	}
 
-	memcpy(dfu->i_buf, buf, size);
-	dfu->i_buf += size;
-
-	/* if end or if buffer full flush */
-	if (size == 0 || (dfu->i_buf + size) > dfu->i_buf_end) {
-		ret = dfu_write_buffer_drain(dfu);
+	/*
+	 * Parts are only queued once full, so that each one starts and ends
+	 * on a write unit; a block may be split across parts to fill them
+	 */
+	while (size > 0) {
+		if (dfu->i_buf == dfu->i_buf_start && size > dfu_wr_size) {
+			chunk = rounddown(size, dfu->write_align ?
+					  dfu->write_align : 1);
+			ret = dfu_write_direct(dfu, buf, chunk);
+		} else {
+			chunk = min_t(long, size, dfu->i_buf_end - dfu->i_buf);
+			memcpy(dfu->i_buf, buf, chunk);
+			dfu->i_buf += chunk;
+			ret = 0;
+			if (dfu->i_buf == dfu->i_buf_end)
+				ret = dfu_write_buffer_queue(dfu);
+		}
 		if (ret) {
 			dfu_write_transaction_cleanup(dfu);
 			return ret;
 		}
+		buf += chunk;
+		size -= chunk;
 	}
 
 	return 0;
@@ -404,6 +558,7 @@ static int dfu_fill_entity(struct dfu_entity *dfu, char *s, int alt,
 
 	dfu->alt = alt;
 	dfu->max_buf_size = 0;
+	dfu->write_align = 0;
 	dfu->free_entity = NULL;
 
 	/* Specific for mmc device */
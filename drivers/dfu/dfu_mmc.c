@@ -385,6 +385,8 @@ int dfu_fill_entity_mmc(struct dfu_entity *dfu, char *devstr, char *s)
 	}
 
 	dfu->dev_type = DFU_DEV_MMC;
+	if (dfu->layout == DFU_RAW_ADDR)
+		dfu->write_align = dfu->data.mmc.lba_blk_size;
 	dfu->get_medium_size = dfu_get_medium_size_mmc;
 	dfu->read_medium = dfu_read_medium_mmc;
 	dfu->write_medium = dfu_write_medium_mmc;
@@ -234,6 +234,12 @@ int dfu_fill_entity_nand(struct dfu_entity *dfu, char *devstr, char *s)
 		return -1;
 	}
 
+	/* Each write erases the blocks it covers, so use whole blocks */
+	if (nand_curr_device >= 0 &&
+	    nand_curr_device < CONFIG_SYS_MAX_NAND_DEVICE &&
+	    nand_info[nand_curr_device])
+		dfu->write_align = nand_info[nand_curr_device]->erasesize;
+
 	dfu->get_medium_size = dfu_get_medium_size_nand;
 	dfu->read_medium = dfu_read_medium_nand;
 	dfu->write_medium = dfu_write_medium_nand;
@@ -33,11 +33,14 @@ static u64 find_sector(struct dfu_entity *dfu, u64 start, u64 offset)
 static int dfu_write_medium_sf(struct dfu_entity *dfu,
 		u64 offset, void *buf, long *len)
 {
+	u64 first, end;
 	int ret;
 
-	ret = spi_flash_erase(dfu->data.sf.dev,
-			      find_sector(dfu, dfu->data.sf.start, offset),
-			      dfu->data.sf.dev->sector_size);
+	/* Erase every sector which the data touches */
+	first = find_sector(dfu, dfu->data.sf.start, offset);
+	end = find_sector(dfu, dfu->data.sf.start, offset + *len - 1) +
+		dfu->data.sf.dev->sector_size;
+	ret = spi_flash_erase(dfu->data.sf.dev, first, end - first);
 	if (ret)
 		return ret;
 
@@ -124,7 +127,7 @@ int dfu_fill_entity_sf(struct dfu_entity *dfu, char *devstr, char *s)
 		return -ENODEV;
 
 	dfu->dev_type = DFU_DEV_SF;
-	dfu->max_buf_size = dfu->data.sf.dev->sector_size;
+	dfu->write_align = dfu->data.sf.dev->sector_size;
 
 	st = strsep(&s, " ");
 	if (!strcmp(st, "raw")) {
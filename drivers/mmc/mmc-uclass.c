@@ -79,6 +79,40 @@ int mmc_getcd(struct mmc *mmc)
 {
 	return dm_mmc_get_cd(mmc->dev);
 }
+
+int dm_mmc_set_signal_voltage(struct udevice *dev, enum mmc_voltage voltage)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+
+	if (!ops->set_signal_voltage)
+		return -ENOSYS;
+	return ops->set_signal_voltage(dev, voltage);
+}
+
+int mmc_set_signal_voltage(struct mmc *mmc, enum mmc_voltage voltage)
+{
+	int ret;
+
+	ret = dm_mmc_set_signal_voltage(mmc->dev, voltage);
+	if (!ret)
+		mmc->signal_voltage = voltage;
+
+	return ret;
+}
+
+int dm_mmc_execute_tuning(struct udevice *dev, uint opcode)
+{
+	struct dm_mmc_ops *ops = mmc_get_ops(dev);
+
+	if (!ops->execute_tuning)
+		return -ENOSYS;
+	return ops->execute_tuning(dev, opcode);
+}
+
+int mmc_execute_tuning(struct mmc *mmc, uint opcode)
+{
+	return dm_mmc_execute_tuning(mmc->dev, opcode);
+}
 #endif
 
 struct mmc *mmc_get_mmc_dev(struct udevice *dev)
@@ -150,7 +184,8 @@ void mmc_do_preinit(void)
 
 		if (!m)
 			continue;
-#ifdef CONFIG_FSL_ESDHC_ADAPTER_IDENT
+#if defined(CONFIG_FSL_ESDHC_ADAPTER_IDENT) || \
+	defined(CONFIG_MMC_BACKGROUND_INIT)
 		mmc_set_preinit(m, 1);
 #endif
 		if (m->preinit)
@@ -158,6 +193,21 @@ void mmc_do_preinit(void)
 	}
 }
 
+void mmc_do_init_poll(void)
+{
+	struct udevice *dev;
+	struct uclass *uc;
+
+	if (uclass_get(UCLASS_MMC, &uc))
+		return;
+	uclass_foreach_dev(dev, uc) {
+		struct mmc *m = mmc_get_mmc_dev(dev);
+
+		if (m && m->init_in_progress)
+			mmc_init_poll(m);
+	}
+}
+
 #if !defined(CONFIG_SPL_BUILD) || defined(CONFIG_SPL_LIBCOMMON_SUPPORT)
 void print_mmc_devices(char separator)
 {
@@ -40,13 +40,20 @@ struct mmc *find_mmc_device(int dev_num)
 void mmc_do_preinit(void)
 {
 	struct mmc *m = &mmc_static;
-#ifdef CONFIG_FSL_ESDHC_ADAPTER_IDENT
+#if defined(CONFIG_FSL_ESDHC_ADAPTER_IDENT) || \
+	defined(CONFIG_MMC_BACKGROUND_INIT)
 	mmc_set_preinit(m, 1);
 #endif
 	if (m->preinit)
 		mmc_start_init(m);
 }
 
+void mmc_do_init_poll(void)
+{
+	if (mmc_static.init_in_progress)
+		mmc_init_poll(&mmc_static);
+}
+
 struct blk_desc *mmc_get_blk_desc(struct mmc *mmc)
 {
 	return &mmc->block_dev;
@@ -220,11 +227,29 @@ int mmc_set_blocklen(struct mmc *mmc, int len)
 	return mmc_send_cmd(mmc, &cmd, NULL);
 }
 
+int mmc_set_blockcount(struct mmc *mmc, unsigned int blkcnt, bool rel_wr)
+{
+	struct mmc_cmd cmd;
+
+	cmd.cmdidx = MMC_CMD_SET_BLOCK_COUNT;
+	cmd.cmdarg = blkcnt & 0xffff;
+	if (rel_wr)
+		cmd.cmdarg |= 1 << 31;
+	cmd.resp_type = MMC_RSP_R1;
+
+	return mmc_send_cmd(mmc, &cmd, NULL);
+}
+
 static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 			   lbaint_t blkcnt)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
+	bool sbc = blkcnt > 1 && (mmc->card_caps & MMC_CAP_CMD23);
+
+	/* With the length set beforehand, no STOP_TRANSMISSION is needed */
+	if (sbc && mmc_set_blockcount(mmc, blkcnt, false))
+		return 0;
 
 	if (blkcnt > 1)
 		cmd.cmdidx = MMC_CMD_READ_MULTIPLE_BLOCK;
@@ -246,7 +271,7 @@ static int mmc_read_blocks(struct mmc *mmc, void *dst, lbaint_t start,
 	if (mmc_send_cmd(mmc, &cmd, &data))
 		return 0;
 
-	if (blkcnt > 1) {
+	if (blkcnt > 1 && !sbc) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -304,8 +329,7 @@ ulong mmc_bread(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	}
 
 	do {
-		cur = (blocks_todo > mmc->cfg->b_max) ?
-			mmc->cfg->b_max : blocks_todo;
+		cur = min(blocks_todo, mmc_max_blocks(mmc));
 		if (mmc_read_blocks(mmc, dst, start, cur) != cur) {
 			debug("%s: Failed to read blocks\n", __func__);
 			return 0;
@@ -339,71 +363,104 @@ static int mmc_go_idle(struct mmc *mmc)
 	return 0;
 }
 
-static int sd_send_op_cond(struct mmc *mmc)
+#ifdef CONFIG_MMC_UHS_SUPPORT
+/*
+ * Move a card which accepted OCR_S18R, and the host, to 1.8V signalling.
+ * If this fails the card needs a power cycle before it can be used again.
+ */
+static int sd_switch_voltage(struct mmc *mmc)
 {
-	int timeout = 1000;
-	int err;
 	struct mmc_cmd cmd;
+	uint clock = mmc->clock;
+	int err;
 
-	while (1) {
-		cmd.cmdidx = MMC_CMD_APP_CMD;
-		cmd.resp_type = MMC_RSP_R1;
-		cmd.cmdarg = 0;
-
-		err = mmc_send_cmd(mmc, &cmd, NULL);
-
-		if (err)
-			return err;
-
-		cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
-		cmd.resp_type = MMC_RSP_R3;
+	cmd.cmdidx = SD_CMD_SWITCH_UHS18V;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
 
-		/*
-		 * Most cards do not answer if some reserved bits
-		 * in the ocr are set. However, Some controller
-		 * can set bit 7 (reserved for low voltages), but
-		 * how to manage low voltages SD card is not yet
-		 * specified.
-		 */
-		cmd.cmdarg = mmc_host_is_spi(mmc) ? 0 :
-			(mmc->cfg->voltages & 0xff8000);
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (err)
+		return err;
 
-		if (mmc->version == SD_VERSION_2)
-			cmd.cmdarg |= OCR_HCS;
+	/* Stop the clock while the voltage changes */
+	mmc->clock = 0;
+	mmc_set_ios(mmc);
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	err = mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_180);
+	if (err)
+		return err;
 
-		if (err)
-			return err;
+	/* The card must see 1.8V for 5ms before the clock restarts */
+	mdelay(10);
+	mmc_set_clock(mmc, clock);
+	mdelay(1);
 
-		if (cmd.response[0] & OCR_BUSY)
-			break;
+	return 0;
+}
+#endif
 
-		if (timeout-- <= 0)
-			return -EOPNOTSUPP;
+/* Argument for SD_CMD_APP_SEND_OP_COND */
+static uint sd_op_cond_arg(struct mmc *mmc)
+{
+	uint arg;
 
-		udelay(1000);
+	/*
+	 * Most cards do not answer if some reserved bits
+	 * in the ocr are set. However, Some controller
+	 * can set bit 7 (reserved for low voltages), but
+	 * how to manage low voltages SD card is not yet
+	 * specified.
+	 */
+	arg = mmc_host_is_spi(mmc) ? 0 : (mmc->cfg->voltages & 0xff8000);
+
+	if (mmc->version == SD_VERSION_2) {
+		arg |= OCR_HCS;
+#ifdef CONFIG_MMC_UHS_SUPPORT
+		/* Ask for 1.8V signalling if the host can use UHS-I */
+		if (mmc->cfg->host_caps & MMC_MODE_UHS_SDR104)
+			arg |= OCR_S18R;
+#endif
 	}
 
-	if (mmc->version != SD_VERSION_2)
-		mmc->version = SD_VERSION_1_0;
+	return arg;
+}
 
-	if (mmc_host_is_spi(mmc)) { /* read OCR for spi */
-		cmd.cmdidx = MMC_CMD_SPI_READ_OCR;
-		cmd.resp_type = MMC_RSP_R3;
-		cmd.cmdarg = 0;
+static int sd_send_op_cond_iter(struct mmc *mmc)
+{
+	struct mmc_cmd cmd;
+	int err;
 
-		err = mmc_send_cmd(mmc, &cmd, NULL);
+	cmd.cmdidx = MMC_CMD_APP_CMD;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
 
-		if (err)
-			return err;
-	}
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (err)
+		return err;
+
+	cmd.cmdidx = SD_CMD_APP_SEND_OP_COND;
+	cmd.resp_type = MMC_RSP_R3;
+	cmd.cmdarg = sd_op_cond_arg(mmc);
 
+	err = mmc_send_cmd(mmc, &cmd, NULL);
+	if (err)
+		return err;
 	mmc->ocr = cmd.response[0];
+	return 0;
+}
 
-	mmc->high_capacity = ((mmc->ocr & OCR_HCS) == OCR_HCS);
-	mmc->rca = 0;
+static int sd_send_op_cond(struct mmc *mmc)
+{
+	int err;
 
+	err = sd_send_op_cond_iter(mmc);
+	if (err)
+		return err;
+
+	/* An SD card: mmc_complete_op_cond() waits for it to be ready */
+	if (mmc->version != SD_VERSION_2)
+		mmc->version = SD_VERSION_1_0;
+	mmc->op_cond_pending = 1;
 	return 0;
 }
 
@@ -445,10 +502,20 @@ static int mmc_send_op_cond(struct mmc *mmc)
 		if (mmc->ocr & OCR_BUSY)
 			break;
 	}
+	mmc->version = MMC_VERSION_UNKNOWN;
 	mmc->op_cond_pending = 1;
 	return 0;
 }
 
+/* Poll a card which is powering up; it is ready once OCR_BUSY is set */
+static int mmc_poll_op_cond(struct mmc *mmc)
+{
+	if (IS_SD(mmc))
+		return sd_send_op_cond_iter(mmc);
+
+	return mmc_send_op_cond_iter(mmc, 1);
+}
+
 static int mmc_complete_op_cond(struct mmc *mmc)
 {
 	struct mmc_cmd cmd;
@@ -459,18 +526,19 @@ static int mmc_complete_op_cond(struct mmc *mmc)
 	mmc->op_cond_pending = 0;
 	if (!(mmc->ocr & OCR_BUSY)) {
 		/* Some cards seem to need this */
-		mmc_go_idle(mmc);
+		if (!IS_SD(mmc))
+			mmc_go_idle(mmc);
 
 		start = get_timer(0);
 		while (1) {
-			err = mmc_send_op_cond_iter(mmc, 1);
+			err = mmc_poll_op_cond(mmc);
 			if (err)
 				return err;
 			if (mmc->ocr & OCR_BUSY)
 				break;
 			if (get_timer(start) > timeout)
 				return -EOPNOTSUPP;
-			udelay(100);
+			udelay(IS_SD(mmc) ? 1000 : 100);
 		}
 	}
 
@@ -487,10 +555,17 @@ static int mmc_complete_op_cond(struct mmc *mmc)
 		mmc->ocr = cmd.response[0];
 	}
 
-	mmc->version = MMC_VERSION_UNKNOWN;
-
 	mmc->high_capacity = ((mmc->ocr & OCR_HCS) == OCR_HCS);
-	mmc->rca = 1;
+	if (!IS_SD(mmc)) {
+		mmc->rca = 1;
+		return 0;
+	}
+
+	mmc->rca = 0;
+#ifdef CONFIG_MMC_UHS_SUPPORT
+	if (mmc->ocr & sd_op_cond_arg(mmc) & OCR_S18R)
+		return sd_switch_voltage(mmc);
+#endif
 
 	return 0;
 }
@@ -549,7 +624,7 @@ int mmc_switch(struct mmc *mmc, u8 set, u8 index, u8 value)
 static int mmc_change_freq(struct mmc *mmc)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(u8, ext_csd, MMC_MAX_BLOCK_LEN);
-	char cardtype;
+	u8 cardtype;
 	int err;
 
 	mmc->card_caps = 0;
@@ -557,6 +632,10 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (mmc_host_is_spi(mmc))
 		return 0;
 
+	/* SET_BLOCK_COUNT is supported since version 3 */
+	if (mmc->version >= MMC_VERSION_3)
+		mmc->card_caps |= MMC_CAP_CMD23;
+
 	/* Only version 4 supports high-speed */
 	if (mmc->version < MMC_VERSION_4)
 		return 0;
@@ -568,7 +647,7 @@ static int mmc_change_freq(struct mmc *mmc)
 	if (err)
 		return err;
 
-	cardtype = ext_csd[EXT_CSD_CARD_TYPE] & 0xf;
+	cardtype = ext_csd[EXT_CSD_CARD_TYPE];
 
 	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING, 1);
 
@@ -594,6 +673,11 @@ static int mmc_change_freq(struct mmc *mmc)
 		mmc->card_caps |= MMC_MODE_HS;
 	}
 
+	if (cardtype & EXT_CSD_CARD_TYPE_HS200)
+		mmc->card_caps |= MMC_MODE_HS200;
+	if (cardtype & EXT_CSD_CARD_TYPE_HS400)
+		mmc->card_caps |= MMC_MODE_HS400;
+
 	return 0;
 }
 
@@ -946,6 +1030,12 @@ retry_scr:
 	if (mmc->scr[0] & SD_DATA_4BIT)
 		mmc->card_caps |= MMC_MODE_4BIT;
 
+	if (mmc->scr[0] & SD_DATA_STAT_AFTER_ERASE)
+		mmc->erase_val = 0xff;
+
+	if (mmc->scr[0] & SD_SCR_CMD23_SUPPORT)
+		mmc->card_caps |= MMC_CAP_CMD23;
+
 	/* Version 1.0 doesn't support switching */
 	if (mmc->version == SD_VERSION_1_0)
 		return 0;
@@ -963,6 +1053,14 @@ retry_scr:
 			break;
 	}
 
+	/*
+	 * At 1.8V the high-speed function is SDR25. SDR104 is selected
+	 * later, once the bus is 4 bits wide.
+	 */
+	if (mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180 &&
+	    (__be32_to_cpu(switch_status[3]) & SD_SDR104_SUPPORTED))
+		mmc->card_caps |= MMC_MODE_UHS_SDR104;
+
 	/* If high-speed isn't supported, we return */
 	if (!(__be32_to_cpu(switch_status[3]) & SD_HIGHSPEED_SUPPORTED))
 		return 0;
@@ -1103,6 +1201,215 @@ static void mmc_set_bus_width(struct mmc *mmc, uint width)
 	mmc_set_ios(mmc);
 }
 
+const u8 tuning_blk_pattern_4bit[64] = {
+	0xff, 0x0f, 0xff, 0x00, 0xff, 0xcc, 0xc3, 0xcc,
+	0xc3, 0x3c, 0xcc, 0xff, 0xfe, 0xff, 0xfe, 0xef,
+	0xff, 0xdf, 0xff, 0xdd, 0xff, 0xfb, 0xff, 0xfb,
+	0xbf, 0xff, 0x7f, 0xff, 0x77, 0xf7, 0xbd, 0xef,
+	0xff, 0xf0, 0xff, 0xf0, 0x0f, 0xfc, 0xcc, 0x3c,
+	0xcc, 0x33, 0xcc, 0xcf, 0xff, 0xef, 0xff, 0xee,
+	0xff, 0xfd, 0xff, 0xfd, 0xdf, 0xff, 0xbf, 0xff,
+	0xbb, 0xff, 0xf7, 0xff, 0xf7, 0x7f, 0x7b, 0xde,
+};
+
+const u8 tuning_blk_pattern_8bit[128] = {
+	0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00, 0x00,
+	0xff, 0xff, 0xcc, 0xcc, 0xcc, 0x33, 0xcc, 0xcc,
+	0xcc, 0x33, 0x33, 0xcc, 0xcc, 0xcc, 0xff, 0xff,
+	0xff, 0xee, 0xff, 0xff, 0xff, 0xee, 0xee, 0xff,
+	0xff, 0xff, 0xdd, 0xff, 0xff, 0xff, 0xdd, 0xdd,
+	0xff, 0xff, 0xff, 0xbb, 0xff, 0xff, 0xff, 0xbb,
+	0xbb, 0xff, 0xff, 0xff, 0x77, 0xff, 0xff, 0xff,
+	0x77, 0x77, 0xff, 0x77, 0xbb, 0xdd, 0xee, 0xff,
+	0xff, 0xff, 0xff, 0x00, 0xff, 0xff, 0xff, 0x00,
+	0x00, 0xff, 0xff, 0xcc, 0xcc, 0xcc, 0x33, 0xcc,
+	0xcc, 0xcc, 0x33, 0x33, 0xcc, 0xcc, 0xcc, 0xff,
+	0xff, 0xff, 0xee, 0xff, 0xff, 0xff, 0xee, 0xee,
+	0xff, 0xff, 0xff, 0xdd, 0xff, 0xff, 0xff, 0xdd,
+	0xdd, 0xff, 0xff, 0xff, 0xbb, 0xff, 0xff, 0xff,
+	0xbb, 0xbb, 0xff, 0xff, 0xff, 0x77, 0xff, 0xff,
+	0xff, 0x77, 0x77, 0xff, 0x77, 0xbb, 0xdd, 0xee,
+};
+
+int mmc_send_tuning(struct mmc *mmc, uint opcode)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(u8, data_buf, sizeof(tuning_blk_pattern_8bit));
+	struct mmc_cmd cmd;
+	struct mmc_data data;
+	const u8 *pattern;
+	uint size;
+	int err;
+
+	if (mmc->bus_width == 8) {
+		pattern = tuning_blk_pattern_8bit;
+		size = sizeof(tuning_blk_pattern_8bit);
+	} else {
+		pattern = tuning_blk_pattern_4bit;
+		size = sizeof(tuning_blk_pattern_4bit);
+	}
+
+	cmd.cmdidx = opcode;
+	cmd.resp_type = MMC_RSP_R1;
+	cmd.cmdarg = 0;
+
+	data.dest = (char *)data_buf;
+	data.blocksize = size;
+	data.blocks = 1;
+	data.flags = MMC_DATA_READ;
+
+	err = mmc_send_cmd(mmc, &cmd, &data);
+	if (err)
+		return err;
+
+	if (memcmp(data_buf, pattern, size))
+		return -EIO;
+
+	return 0;
+}
+
+#ifdef CONFIG_MMC_UHS_SUPPORT
+/*
+ * Switch a UHS-I card from SDR25 to SDR104 and tune the host to it. If that
+ * fails the card is put back to SDR25, which needs no tuning.
+ */
+static int sd_select_sdr104(struct mmc *mmc)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint, switch_status, 16);
+	int err;
+
+	err = sd_switch(mmc, SD_SWITCH_SWITCH, 0, 3, (u8 *)switch_status);
+	if (!err &&
+	    (__be32_to_cpu(switch_status[4]) & 0x0f000000) != 0x03000000)
+		err = -EOPNOTSUPP;
+
+	if (!err) {
+		mmc->timing = MMC_TIMING_UHS_SDR104;
+		mmc_set_clock(mmc, 208000000);
+
+		err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK);
+		if (!err)
+			return 0;
+	}
+
+	debug("%s: SDR104 failed (err=%d), using SDR25\n", __func__, err);
+	mmc->timing = MMC_TIMING_HS;
+	mmc_set_clock(mmc, 50000000);
+	sd_switch(mmc, SD_SWITCH_SWITCH, 0, 1, (u8 *)switch_status);
+	mmc->card_caps &= ~MMC_MODE_UHS_SDR104;
+
+	return err;
+}
+#endif
+
+#ifdef CONFIG_MMC_HS200_SUPPORT
+#ifdef CONFIG_MMC_HS400_SUPPORT
+/*
+ * Move an eMMC tuned for HS200 on to HS400. The change goes through
+ * high-speed timing, since HS400 is only selectable from there.
+ */
+static int mmc_select_hs400(struct mmc *mmc)
+{
+	int err;
+
+	mmc->timing = MMC_TIMING_HS;
+	mmc_set_clock(mmc, 52000000);
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS);
+	if (err)
+		return err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+			 EXT_CSD_DDR_BUS_WIDTH_8);
+	if (err)
+		return err;
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS400);
+	if (err)
+		return err;
+
+	mmc->ddr_mode = 1;
+	mmc->timing = MMC_TIMING_MMC_HS400;
+	mmc_set_clock(mmc, 200000000);
+
+	return 0;
+}
+#endif
+
+/*
+ * Move an eMMC to HS200, tune the host to it and then go on to HS400 if both
+ * sides can. If any of this fails the card and host are put back into
+ * high-speed timing with a 1-bit bus, ready for the legacy modes to be tried.
+ */
+static int mmc_select_hs200(struct mmc *mmc, const u8 *ext_csd)
+{
+	u8 cardtype = ext_csd[EXT_CSD_CARD_TYPE];
+	enum mmc_voltage old_voltage = mmc->signal_voltage;
+	uint old_clock = mmc->clock;
+	uint width;
+	int err;
+
+	/* HS200 is a 4-bit or 8-bit mode, at 1.8V or 1.2V */
+	if (!(mmc->card_caps & (MMC_MODE_4BIT | MMC_MODE_8BIT)))
+		return -EOPNOTSUPP;
+
+	err = -EOPNOTSUPP;
+	if (cardtype & EXT_CSD_CARD_TYPE_HS200_1_8V)
+		err = mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_180);
+	if (err && (cardtype & EXT_CSD_CARD_TYPE_HS200_1_2V))
+		err = mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_120);
+	if (err)
+		return err;
+
+	width = mmc->card_caps & MMC_MODE_8BIT ? 8 : 4;
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+			 width == 8 ? EXT_CSD_BUS_WIDTH_8 :
+			 EXT_CSD_BUS_WIDTH_4);
+	if (err)
+		goto fallback;
+	mmc_set_bus_width(mmc, width);
+
+	err = mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+			 EXT_CSD_TIMING_HS200);
+	if (err)
+		goto fallback;
+	mmc->timing = MMC_TIMING_MMC_HS200;
+	mmc_set_clock(mmc, 200000000);
+
+	err = mmc_execute_tuning(mmc, MMC_CMD_SEND_TUNING_BLOCK_HS200);
+	if (err)
+		goto fallback;
+
+#ifdef CONFIG_MMC_HS400_SUPPORT
+	if ((mmc->card_caps & MMC_MODE_HS400) && width == 8) {
+		err = mmc_select_hs400(mmc);
+		if (err)
+			goto fallback;
+	}
+#endif
+	mmc->tran_speed = 200000000;
+
+	return 0;
+
+fallback:
+	debug("%s: HS200 failed (err=%d), using legacy modes\n", __func__,
+	      err);
+	mmc->timing = MMC_TIMING_HS;
+	mmc->ddr_mode = 0;
+	mmc_set_clock(mmc, old_clock);
+	mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_HS_TIMING,
+		   EXT_CSD_TIMING_HS);
+	mmc_switch(mmc, EXT_CSD_CMD_SET_NORMAL, EXT_CSD_BUS_WIDTH,
+		   EXT_CSD_BUS_WIDTH_1);
+	mmc_set_bus_width(mmc, 1);
+	mmc_set_signal_voltage(mmc, old_voltage);
+	mmc->card_caps &= ~(MMC_MODE_HS200 | MMC_MODE_HS400);
+
+	return err;
+}
+#endif
+
 static int mmc_startup(struct mmc *mmc)
 {
 	int err, i;
@@ -1259,6 +1566,9 @@ static int mmc_startup(struct mmc *mmc)
 	 * For SD, its erase group is always one sector
 	 */
 	mmc->erase_grp_size = 1;
+	mmc->can_trim = 0;
+	mmc->erase_val = 0;
+	mmc->rel_wr_sec_c = 0;
 	mmc->part_config = MMCPART_NOAVAILABLE;
 	if (!IS_SD(mmc) && (mmc->version >= MMC_VERSION_4)) {
 		/* check  ext_csd version and capacity */
@@ -1408,6 +1718,17 @@ static int mmc_startup(struct mmc *mmc)
 			* ext_csd[EXT_CSD_HC_WP_GRP_SIZE];
 
 		mmc->wr_rel_set = ext_csd[EXT_CSD_WR_REL_SET];
+
+		/* Legacy reliable writes cover one block or a whole unit */
+		if (!(ext_csd[EXT_CSD_WR_REL_PARAM] & EXT_CSD_EN_REL_WR))
+			mmc->rel_wr_sec_c = max_t(uint,
+					ext_csd[EXT_CSD_REL_WR_SEC_C], 1);
+
+		/* TRIM erases single blocks rather than whole groups */
+		if (ext_csd[EXT_CSD_SEC_FEATURE_SUPPORT] & EXT_CSD_SEC_GB_CL_EN)
+			mmc->can_trim = 1;
+		if (ext_csd[EXT_CSD_ERASED_MEM_CONT])
+			mmc->erase_val = 0xff;
 	}
 
 	err = mmc_set_capacity(mmc, mmc_get_blk_desc(mmc)->hwpart);
@@ -1425,6 +1746,12 @@ static int mmc_startup(struct mmc *mmc)
 	/* Restrict card's capabilities by what the host can do */
 	mmc->card_caps &= mmc->cfg->host_caps;
 
+#ifdef CONFIG_MMC_HS200_SUPPORT
+	/* The legacy eMMC modes below are the fallback if HS200 fails */
+	if (!IS_SD(mmc) && (mmc->card_caps & MMC_MODE_HS200))
+		mmc_select_hs200(mmc, ext_csd);
+#endif
+
 	if (IS_SD(mmc)) {
 		if (mmc->card_caps & MMC_MODE_4BIT) {
 			cmd.cmdidx = MMC_CMD_APP_CMD;
@@ -1445,15 +1772,24 @@ static int mmc_startup(struct mmc *mmc)
 			mmc_set_bus_width(mmc, 4);
 		}
 
+#ifdef CONFIG_MMC_UHS_SUPPORT
+		if ((mmc->card_caps & MMC_MODE_UHS_SDR104) &&
+		    mmc->bus_width == 4)
+			sd_select_sdr104(mmc);
+#endif
+
 		err = sd_read_ssr(mmc);
 		if (err)
 			return err;
 
-		if (mmc->card_caps & MMC_MODE_HS)
+		if (mmc->timing == MMC_TIMING_UHS_SDR104)
+			mmc->tran_speed = 208000000;
+		else if (mmc->card_caps & MMC_MODE_HS)
 			mmc->tran_speed = 50000000;
 		else
 			mmc->tran_speed = 25000000;
-	} else if (mmc->version >= MMC_VERSION_4) {
+	} else if (mmc->version >= MMC_VERSION_4 &&
+		   mmc->timing < MMC_TIMING_MMC_HS200) {
 		/* Only version 4 of MMC supports wider bus widths */
 		int idx;
 
@@ -1545,6 +1881,11 @@ static int mmc_startup(struct mmc *mmc)
 		}
 	}
 
+	/* The tuned modes have set their timing already */
+	if (mmc->timing < MMC_TIMING_UHS_SDR104 &&
+	    (mmc->card_caps & MMC_MODE_HS))
+		mmc->timing = mmc->ddr_mode ? MMC_TIMING_MMC_DDR52 :
+			      MMC_TIMING_HS;
 	mmc_set_clock(mmc, mmc->tran_speed);
 
 	/* Fix the block length for DDR mode */
@@ -1561,6 +1902,8 @@ static int mmc_startup(struct mmc *mmc)
 	bdesc->blksz = mmc->read_bl_len;
 	bdesc->log2blksz = LOG2(bdesc->blksz);
 	bdesc->lba = lldiv(mmc->capacity, mmc->read_bl_len);
+	bdesc->erase_grp = mmc->erase_grp_size;
+	bdesc->erase_val = mmc->erase_val;
 #if !defined(CONFIG_SPL_BUILD) || \
 		(defined(CONFIG_SPL_LIBCOMMON_SUPPORT) && \
 		!defined(CONFIG_USE_TINY_PRINTF))
@@ -1682,6 +2025,11 @@ int mmc_start_init(struct mmc *mmc)
 		return err;
 #endif
 	mmc->ddr_mode = 0;
+	mmc->timing = MMC_TIMING_LEGACY;
+#if defined(CONFIG_MMC_UHS_SUPPORT) || defined(CONFIG_MMC_HS200_SUPPORT)
+	/* Cards are identified with 3.3V signalling */
+	mmc_set_signal_voltage(mmc, MMC_SIGNAL_VOLTAGE_330);
+#endif
 	mmc_set_bus_width(mmc, 1);
 	mmc_set_clock(mmc, 1);
 
@@ -1712,8 +2060,10 @@ int mmc_start_init(struct mmc *mmc)
 		}
 	}
 
-	if (!err)
+	if (!err) {
 		mmc->init_in_progress = 1;
+		mmc->op_cond_time = get_timer(0);
+	}
 
 	return err;
 }
@@ -1748,18 +2098,48 @@ int mmc_init(struct mmc *mmc)
 		return 0;
 
 	start = get_timer(0);
+	bootstage_start(BOOTSTAGE_ID_ACCUM_MMC, "mmc_init");
 
 	if (!mmc->init_in_progress)
 		err = mmc_start_init(mmc);
 
 	if (!err)
 		err = mmc_complete_init(mmc);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_MMC);
 	if (err)
 		printf("%s: %d, time %lu\n", __func__, err, get_timer(start));
 
 	return err;
 }
 
+int mmc_init_poll(struct mmc *mmc)
+{
+	int err;
+
+	if (mmc->has_init)
+		return 0;
+	if (!mmc->init_in_progress)
+		return -ENODEV;
+	/* Once the card is ready, the startup is left to mmc_init() */
+	if (!mmc->op_cond_pending || (mmc->ocr & OCR_BUSY))
+		return 0;
+
+	/* Don't hold up the caller with back-to-back polls */
+	if (get_timer(mmc->op_cond_time) < 1)
+		return -EAGAIN;
+
+	err = mmc_poll_op_cond(mmc);
+	mmc->op_cond_time = get_timer(0);
+	if (err) {
+		/* Leave mmc_init() to start again */
+		mmc->op_cond_pending = 0;
+		mmc->init_in_progress = 0;
+		return err;
+	}
+
+	return mmc->ocr & OCR_BUSY ? 0 : -EAGAIN;
+}
+
 int mmc_set_dsr(struct mmc *mmc, u16 val)
 {
 	mmc->dsr = val;
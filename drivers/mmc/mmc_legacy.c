@@ -56,13 +56,26 @@ void mmc_do_preinit(void)
 	list_for_each(entry, &mmc_devices) {
 		m = list_entry(entry, struct mmc, link);
 
-#ifdef CONFIG_FSL_ESDHC_ADAPTER_IDENT
+#if defined(CONFIG_FSL_ESDHC_ADAPTER_IDENT) || \
+	defined(CONFIG_MMC_BACKGROUND_INIT)
 		mmc_set_preinit(m, 1);
 #endif
 		if (m->preinit)
 			mmc_start_init(m);
 	}
 }
+
+void mmc_do_init_poll(void)
+{
+	struct mmc *m;
+	struct list_head *entry;
+
+	list_for_each(entry, &mmc_devices) {
+		m = list_entry(entry, struct mmc, link);
+		if (m->init_in_progress)
+			mmc_init_poll(m);
+	}
+}
 #endif
 
 void mmc_list_init(void)
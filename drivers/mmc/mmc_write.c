@@ -15,7 +15,8 @@
 #include <linux/math64.h>
 #include "mmc_private.h"
 
-static ulong mmc_erase_t(struct mmc *mmc, ulong start, lbaint_t blkcnt)
+static ulong mmc_erase_t(struct mmc *mmc, ulong start, lbaint_t blkcnt,
+			 uint arg)
 {
 	struct mmc_cmd cmd;
 	ulong end;
@@ -52,7 +53,7 @@ static ulong mmc_erase_t(struct mmc *mmc, ulong start, lbaint_t blkcnt)
 		goto err_out;
 
 	cmd.cmdidx = MMC_CMD_ERASE;
-	cmd.cmdarg = MMC_ERASE_ARG;
+	cmd.cmdarg = arg;
 	cmd.resp_type = MMC_RSP_R1b;
 
 	err = mmc_send_cmd(mmc, &cmd, NULL);
@@ -66,15 +67,9 @@ err_out:
 	return err;
 }
 
-#ifdef CONFIG_BLK
-ulong mmc_berase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
-#else
-ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
-#endif
+static ulong mmc_erase_blocks(struct blk_desc *block_dev, lbaint_t start,
+			      lbaint_t blkcnt, uint arg)
 {
-#ifdef CONFIG_BLK
-	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
-#endif
 	int dev_num = block_dev->devnum;
 	int err = 0;
 	u32 start_rem, blkcnt_rem;
@@ -84,6 +79,8 @@ ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
 
 	if (!mmc)
 		return -1;
+	if (arg == MMC_TRIM_ARG && !mmc->can_trim)
+		return 0;
 
 	err = blk_select_hwpart_devnum(IF_TYPE_MMC, dev_num,
 				       block_dev->hwpart);
@@ -97,7 +94,7 @@ ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
 	 */
 	err = div_u64_rem(start, mmc->erase_grp_size, &start_rem);
 	err = div_u64_rem(blkcnt, mmc->erase_grp_size, &blkcnt_rem);
-	if (start_rem || blkcnt_rem)
+	if ((start_rem || blkcnt_rem) && arg != MMC_TRIM_ARG)
 		printf("\n\nCaution! Your devices Erase group is 0x%x\n"
 		       "The erase range would be change to "
 		       "0x" LBAF "~0x" LBAF "\n\n",
@@ -113,7 +110,7 @@ ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
 			blk_r = ((blkcnt - blk) > mmc->erase_grp_size) ?
 				mmc->erase_grp_size : (blkcnt - blk);
 		}
-		err = mmc_erase_t(mmc, start + blk, blk_r);
+		err = mmc_erase_t(mmc, start + blk, blk_r, arg);
 		if (err)
 			break;
 
@@ -127,12 +124,31 @@ ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
 	return blk;
 }
 
+#ifdef CONFIG_BLK
+ulong mmc_berase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
+#else
+ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
+#endif
+{
+#ifdef CONFIG_BLK
+	struct blk_desc *block_dev = dev_get_uclass_platdata(dev);
+#endif
+
+	return mmc_erase_blocks(block_dev, start, blkcnt, MMC_ERASE_ARG);
+}
+
+ulong mmc_trim(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
+{
+	return mmc_erase_blocks(block_dev, start, blkcnt, MMC_TRIM_ARG);
+}
+
 static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
-		lbaint_t blkcnt, const void *src)
+		lbaint_t blkcnt, const void *src, bool rel_wr)
 {
 	struct mmc_cmd cmd;
 	struct mmc_data data;
 	int timeout = 1000;
+	bool sbc = (blkcnt > 1 || rel_wr) && (mmc->card_caps & MMC_CAP_CMD23);
 
 	if ((start + blkcnt) > mmc_get_blk_desc(mmc)->lba) {
 		printf("MMC: block number 0x" LBAF " exceeds max(0x" LBAF ")\n",
@@ -142,11 +158,20 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 
 	if (blkcnt == 0)
 		return 0;
-	else if (blkcnt == 1)
+	else if (blkcnt == 1 && !sbc)
 		cmd.cmdidx = MMC_CMD_WRITE_SINGLE_BLOCK;
 	else
 		cmd.cmdidx = MMC_CMD_WRITE_MULTIPLE_BLOCK;
 
+	/*
+	 * With the length set beforehand, no STOP_TRANSMISSION is needed.
+	 * Reliable writes are requested here too.
+	 */
+	if (sbc && mmc_set_blockcount(mmc, blkcnt, rel_wr)) {
+		printf("mmc fail to set block count\n");
+		return 0;
+	}
+
 	if (mmc->high_capacity)
 		cmd.cmdarg = start;
 	else
@@ -167,7 +192,7 @@ static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 	/* SPI multiblock writes terminate using a special
 	 * token, not a STOP_TRANSMISSION request.
 	 */
-	if (!mmc_host_is_spi(mmc) && blkcnt > 1) {
+	if (!mmc_host_is_spi(mmc) && blkcnt > 1 && !sbc) {
 		cmd.cmdidx = MMC_CMD_STOP_TRANSMISSION;
 		cmd.cmdarg = 0;
 		cmd.resp_type = MMC_RSP_R1b;
@@ -197,6 +222,7 @@ ulong mmc_bwrite(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 #endif
 	int dev_num = block_dev->devnum;
 	lbaint_t cur, blocks_todo = blkcnt;
+	bool rel_wr;
 	int err;
 
 	struct mmc *mmc = find_mmc_device(dev_num);
@@ -210,10 +236,20 @@ ulong mmc_bwrite(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt,
 	if (mmc_set_blocklen(mmc, mmc->write_bl_len))
 		return 0;
 
+	rel_wr = mmc->reliable_write && !IS_SD(mmc) &&
+		 (mmc->card_caps & MMC_CAP_CMD23);
+
 	do {
-		cur = (blocks_todo > mmc->cfg->b_max) ?
-			mmc->cfg->b_max : blocks_todo;
-		if (mmc_write_blocks(mmc, start, cur, src) != cur)
+		cur = min(blocks_todo, mmc_max_blocks(mmc));
+		/* Legacy reliable writes are one block or one aligned unit */
+		if (rel_wr && mmc->rel_wr_sec_c) {
+			if (!IS_ALIGNED(start, mmc->rel_wr_sec_c) ||
+			    cur < mmc->rel_wr_sec_c)
+				cur = 1;
+			else
+				cur = mmc->rel_wr_sec_c;
+		}
+		if (mmc_write_blocks(mmc, start, cur, src, rel_wr) != cur)
 			return 0;
 		blocks_todo -= cur;
 		start += cur;
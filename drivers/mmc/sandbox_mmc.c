@@ -11,32 +11,289 @@
 #include <fdtdec.h>
 #include <mmc.h>
 #include <asm/test.h>
+#include <asm/unaligned.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
+/* Size of the emulated card, as given by the CSD below */
+#define SANDBOX_MMC_SIZE	(1 << 20)
+
+/*
+ * Sample points the emulated host can choose between when tuning, and the
+ * ones at which data from the card arrives intact in the tuned modes
+ */
+#define SANDBOX_MMC_PHASES	16
+#define SANDBOX_MMC_PHASE_MIN	5
+#define SANDBOX_MMC_PHASE_MAX	9
+
 struct sandbox_mmc_plat {
 	struct mmc_config cfg;
 	struct mmc mmc;
 };
 
+struct sandbox_mmc_priv {
+	u8 buf[SANDBOX_MMC_SIZE];
+	bool emmc;		/* Emulate an eMMC rather than an SD card */
+	u8 ext_csd[MMC_MAX_BLOCK_LEN];	/* eMMC only */
+	bool app_cmd;		/* Next command is an SD application command */
+	uint busy_polls;	/* Op-cond polls left until power-up is done */
+	bool s18a;		/* SD card accepted 1.8V signalling */
+	bool uhs;		/* SD card has switched to 1.8V signalling */
+	uint sd_func;		/* SD bus speed function (group 1) */
+	uint bus_width;		/* SD bus width */
+	uint phase;		/* Host sample point chosen by tuning */
+	bool fail_tuning;	/* No sample point works */
+	uint blk_count;		/* Blocks set by MMC_CMD_SET_BLOCK_COUNT */
+	bool open_ended;	/* Transfer needs MMC_CMD_STOP_TRANSMISSION */
+	uint cmd_count[64];	/* Number of times each command was sent */
+};
+
+/*
+ * Check that the host is set up to match the card: bus width and signal
+ * voltage, and in the modes which need tuning, the sample point.
+ */
+static bool sandbox_mmc_bus_ok(struct sandbox_mmc_priv *priv,
+			       struct mmc *mmc)
+{
+	static const uint emmc_widths[] = {
+		[EXT_CSD_BUS_WIDTH_1] = 1,
+		[EXT_CSD_BUS_WIDTH_4] = 4,
+		[EXT_CSD_BUS_WIDTH_8] = 8,
+		[EXT_CSD_DDR_BUS_WIDTH_4] = 4,
+		[EXT_CSD_DDR_BUS_WIDTH_8] = 8,
+	};
+	uint width;
+
+	if (priv->emmc) {
+		width = emmc_widths[priv->ext_csd[EXT_CSD_BUS_WIDTH] & 7];
+		if (priv->ext_csd[EXT_CSD_HS_TIMING] >= EXT_CSD_TIMING_HS200 &&
+		    mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_330)
+			return false;
+	} else {
+		width = priv->bus_width;
+		if (priv->uhs !=
+		    (mmc->signal_voltage == MMC_SIGNAL_VOLTAGE_180))
+			return false;
+	}
+	if (width != mmc->bus_width)
+		return false;
+	if (mmc->timing < MMC_TIMING_UHS_SDR104)
+		return true;
+
+	return !priv->fail_tuning && priv->phase >= SANDBOX_MMC_PHASE_MIN &&
+		priv->phase <= SANDBOX_MMC_PHASE_MAX;
+}
+
+/*
+ * Read or write the card contents. A multiple-block transfer must match the
+ * count set by a preceding MMC_CMD_SET_BLOCK_COUNT, if any, and otherwise
+ * has to be stopped with MMC_CMD_STOP_TRANSMISSION.
+ */
+static int sandbox_mmc_transfer(struct sandbox_mmc_priv *priv,
+				struct mmc *mmc, struct mmc_cmd *cmd,
+				struct mmc_data *data)
+{
+	ulong offset = (ulong)cmd->cmdarg * data->blocksize;
+	ulong size = data->blocks * data->blocksize;
+	uint blk_count = priv->blk_count;
+
+	priv->blk_count = 0;
+	if (offset + size > SANDBOX_MMC_SIZE)
+		return -EINVAL;
+	if (!sandbox_mmc_bus_ok(priv, mmc))
+		return -EILSEQ;
+	if (cmd->cmdidx == MMC_CMD_READ_MULTIPLE_BLOCK ||
+	    cmd->cmdidx == MMC_CMD_WRITE_MULTIPLE_BLOCK) {
+		if (blk_count && blk_count != data->blocks)
+			return -EINVAL;
+		priv->open_ended = !blk_count;
+	}
+
+	if (data->flags == MMC_DATA_READ)
+		memcpy(data->dest, priv->buf + offset, size);
+	else
+		memcpy(priv->buf + offset, data->src, size);
+
+	return 0;
+}
+
+/*
+ * Send the tuning block, which only arrives intact if the host samples it
+ * at a good point
+ */
+static int sandbox_mmc_tuning(struct sandbox_mmc_priv *priv, struct mmc *mmc,
+			      struct mmc_cmd *cmd, struct mmc_data *data)
+{
+	u8 *ext_csd = priv->ext_csd;
+	bool tuning_mode;
+
+	if (priv->emmc)
+		tuning_mode = cmd->cmdidx == MMC_CMD_SEND_TUNING_BLOCK_HS200 &&
+			ext_csd[EXT_CSD_HS_TIMING] == EXT_CSD_TIMING_HS200;
+	else
+		tuning_mode = cmd->cmdidx == MMC_CMD_SEND_TUNING_BLOCK &&
+			priv->sd_func == 3;
+	if (!tuning_mode || !data)
+		return -EINVAL;
+
+	if (data->blocksize == sizeof(tuning_blk_pattern_8bit))
+		memcpy(data->dest, tuning_blk_pattern_8bit, data->blocksize);
+	else if (data->blocksize == sizeof(tuning_blk_pattern_4bit))
+		memcpy(data->dest, tuning_blk_pattern_4bit, data->blocksize);
+	else
+		return -EINVAL;
+	if (!sandbox_mmc_bus_ok(priv, mmc))
+		data->dest[0] = ~data->dest[0];
+
+	return 0;
+}
+
+/*
+ * Check or switch the SD bus speed function: default and high speed (SDR25
+ * at 1.8V) are supported, plus SDR104 at 1.8V
+ */
+static int sandbox_mmc_switch_func(struct sandbox_mmc_priv *priv,
+				   struct mmc_cmd *cmd, struct mmc_data *data)
+{
+	u32 *resp = (u32 *)data->dest;
+	uint func = cmd->cmdarg & 0xf;
+	uint supported;
+
+	supported = 1 << 0 | 1 << 1;
+	if (priv->uhs)
+		supported |= 1 << 3;
+
+	if (func == 0xf)
+		func = priv->sd_func;
+	else if (!(supported & 1 << func))
+		func = 0xf;
+	else if (cmd->cmdarg & 1 << 31)
+		priv->sd_func = func;
+
+	memset(resp, '\0', data->blocksize);
+	resp[3] = cpu_to_be32(supported << 16);
+	resp[4] = cpu_to_be32(func << 24);
+
+	return 0;
+}
+
+/* Emulate the SD commands sent after MMC_CMD_APP_CMD */
+static int sandbox_mmc_app_cmd(struct sandbox_mmc_priv *priv,
+			       struct mmc_cmd *cmd, struct mmc_data *data)
+{
+	switch (cmd->cmdidx) {
+	case SD_CMD_APP_SET_BUS_WIDTH:
+		priv->bus_width = cmd->cmdarg == 2 ? 4 : 1;
+		break;
+	case SD_CMD_APP_SD_STATUS:
+		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
+		memset(data->dest, '\0', data->blocksize);
+		break;
+	case SD_CMD_APP_SEND_OP_COND:
+		cmd->response[1] = 0;
+		cmd->response[2] = 0;
+		if (priv->busy_polls) {
+			priv->busy_polls--;
+			cmd->response[0] = 0;
+			break;
+		}
+		cmd->response[0] = OCR_BUSY | OCR_HCS;
+		if ((cmd->cmdarg & OCR_S18R) && !priv->uhs) {
+			cmd->response[0] |= OCR_S18R;
+			priv->s18a = true;
+		}
+		break;
+	case SD_CMD_APP_SEND_SCR: {
+		u32 *scr = (u32 *)data->dest;
+
+		/* SD version 3 */
+		scr[0] = cpu_to_be32(2 << 24 | 1 << 15 | SD_DATA_4BIT |
+				     SD_SCR_CMD23_SUPPORT);
+		scr[1] = 0;
+		break;
+	}
+	default:
+		debug("%s: Unknown command %d\n", __func__, cmd->cmdidx);
+		break;
+	}
+
+	return 0;
+}
+
 /**
- * sandbox_mmc_send_cmd() - Emulate SD commands
+ * sandbox_mmc_send_cmd() - Emulate SD and eMMC commands
  *
- * This emulate an SD card version 2. Single-block reads result in zero data.
- * Multiple-block reads return a test string.
+ * This emulates an SD card version 3 or an eMMC version 5.0 of 1MiB, which
+ * supports MMC_CMD_SET_BLOCK_COUNT. The SD card can switch to 1.8V and
+ * SDR104, and the eMMC supports HS200 and HS400 at 1.8V. The card starts out
+ * holding a test string. MMC_CMD_GO_IDLE_STATE stands in for a power cycle,
+ * so it also drops the SD card back to 3.3V, and the card then reports that
+ * it is powering up to the next SANDBOX_MMC_POWERUP_POLLS op-cond commands.
  */
 static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 				struct mmc_data *data)
 {
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	bool app_cmd = priv->app_cmd;
+
+	if (cmd->cmdidx < ARRAY_SIZE(priv->cmd_count))
+		priv->cmd_count[cmd->cmdidx]++;
+
+	priv->app_cmd = false;
+	if (app_cmd)
+		return sandbox_mmc_app_cmd(priv, cmd, data);
+
 	switch (cmd->cmdidx) {
+	case MMC_CMD_GO_IDLE_STATE:
+		priv->busy_polls = SANDBOX_MMC_POWERUP_POLLS;
+		priv->s18a = false;
+		priv->uhs = false;
+		priv->sd_func = 0;
+		priv->bus_width = 1;
+		priv->ext_csd[EXT_CSD_BUS_WIDTH] = EXT_CSD_BUS_WIDTH_1;
+		priv->ext_csd[EXT_CSD_HS_TIMING] = EXT_CSD_TIMING_LEGACY;
+		break;
+	case MMC_CMD_SEND_OP_COND:
+		if (!priv->emmc)
+			return -ETIMEDOUT;
+		cmd->response[0] = OCR_VOLTAGE_MASK;
+		if (priv->busy_polls)
+			priv->busy_polls--;
+		else
+			cmd->response[0] |= OCR_BUSY | OCR_HCS;
+		break;
 	case MMC_CMD_ALL_SEND_CID:
 		break;
 	case SD_CMD_SEND_RELATIVE_ADDR:
 		cmd->response[0] = 0 << 16; /* mmc->rca */
-	case MMC_CMD_GO_IDLE_STATE:
 		break;
+	case SD_CMD_SWITCH_FUNC:
+		if (priv->emmc) {
+			/* MMC_CMD_SWITCH: only byte writes are used */
+			priv->ext_csd[(cmd->cmdarg >> 16) & 0xff] =
+				(cmd->cmdarg >> 8) & 0xff;
+			break;
+		}
+		if (!sandbox_mmc_bus_ok(priv, &plat->mmc))
+			return -EILSEQ;
+		return sandbox_mmc_switch_func(priv, cmd, data);
 	case SD_CMD_SEND_IF_COND:
-		cmd->response[0] = 0xaa;
+		if (!priv->emmc) {
+			cmd->response[0] = 0xaa;
+			break;
+		}
+		/* MMC_CMD_SEND_EXT_CSD */
+		if (!data)
+			return -ETIMEDOUT;
+		if (!sandbox_mmc_bus_ok(priv, &plat->mmc))
+			return -EILSEQ;
+		memcpy(data->dest, priv->ext_csd, sizeof(priv->ext_csd));
+		break;
+	case SD_CMD_SWITCH_UHS18V:
+		if (priv->emmc || !priv->s18a || priv->uhs)
+			return -EINVAL;
+		priv->uhs = true;
 		break;
 	case MMC_CMD_SEND_STATUS:
 		cmd->response[0] = MMC_STATUS_RDY_FOR_DATA;
@@ -44,39 +301,41 @@ static int sandbox_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 	case MMC_CMD_SELECT_CARD:
 		break;
 	case MMC_CMD_SEND_CSD:
-		cmd->response[0] = 0;
+		if (priv->emmc) {
+			/* Version 4 at 25MHz */
+			cmd->response[0] = 4 << 26 | 0x32;
+			cmd->response[3] = 9 << 22;	/* 1 << write_bl_len */
+		} else {
+			cmd->response[0] = 0;
+			cmd->response[3] = 0;
+		}
 		cmd->response[1] = 10 << 16;	/* 1 << block_len */
+		cmd->response[2] = 0;
 		break;
-	case SD_CMD_SWITCH_FUNC: {
-		u32 *resp = (u32 *)data->dest;
-
-		resp[7] = cpu_to_be32(SD_HIGHSPEED_BUSY);
-		break;
-	}
+	case MMC_CMD_SEND_TUNING_BLOCK:
+	case MMC_CMD_SEND_TUNING_BLOCK_HS200:
+		return sandbox_mmc_tuning(priv, &plat->mmc, cmd, data);
 	case MMC_CMD_READ_SINGLE_BLOCK:
-		memset(data->dest, '\0', data->blocksize);
-		break;
 	case MMC_CMD_READ_MULTIPLE_BLOCK:
-		strcpy(data->dest, "this is a test");
+	case MMC_CMD_WRITE_SINGLE_BLOCK:
+	case MMC_CMD_WRITE_MULTIPLE_BLOCK:
+		return sandbox_mmc_transfer(priv, &plat->mmc, cmd, data);
+	case MMC_CMD_SET_BLOCK_COUNT:
+		priv->blk_count = cmd->cmdarg & 0xffff;
 		break;
 	case MMC_CMD_STOP_TRANSMISSION:
-		break;
-	case SD_CMD_APP_SEND_OP_COND:
-		cmd->response[0] = OCR_BUSY | OCR_HCS;
-		cmd->response[1] = 0;
-		cmd->response[2] = 0;
+		if (!priv->open_ended)
+			return -EINVAL;
+		priv->open_ended = false;
 		break;
 	case MMC_CMD_APP_CMD:
+		if (priv->emmc)
+			return -ETIMEDOUT;
+		priv->app_cmd = true;
 		break;
 	case MMC_CMD_SET_BLOCKLEN:
 		debug("block len %d\n", cmd->cmdarg);
 		break;
-	case SD_CMD_APP_SEND_SCR: {
-		u32 *scr = (u32 *)data->dest;
-
-		scr[0] = cpu_to_be32(2 << 24 | 1 << 15);  /* SD version 3 */
-		break;
-	}
 	default:
 		debug("%s: Unknown command %d\n", __func__, cmd->cmdidx);
 		break;
@@ -90,6 +349,42 @@ static int sandbox_mmc_set_ios(struct udevice *dev)
 	return 0;
 }
 
+static int sandbox_mmc_set_signal_voltage(struct udevice *dev,
+					  enum mmc_voltage voltage)
+{
+	/* There is no 1.2V supply */
+	if (voltage == MMC_SIGNAL_VOLTAGE_120)
+		return -EOPNOTSUPP;
+
+	return 0;
+}
+
+/* Try each sample point, and use the middle of the window which works */
+static int sandbox_mmc_execute_tuning(struct udevice *dev, uint opcode)
+{
+	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+	int first = -1, last = -1;
+	uint phase;
+
+	for (phase = 0; phase < SANDBOX_MMC_PHASES; phase++) {
+		priv->phase = phase;
+		if (mmc_send_tuning(&plat->mmc, opcode)) {
+			if (first >= 0)
+				break;
+			continue;
+		}
+		if (first < 0)
+			first = phase;
+		last = phase;
+	}
+	if (first < 0)
+		return -EIO;
+	priv->phase = (first + last) / 2;
+
+	return 0;
+}
+
 static int sandbox_mmc_get_cd(struct udevice *dev)
 {
 	return 1;
@@ -99,11 +394,48 @@ static const struct dm_mmc_ops sandbox_mmc_ops = {
 	.send_cmd = sandbox_mmc_send_cmd,
 	.set_ios = sandbox_mmc_set_ios,
 	.get_cd = sandbox_mmc_get_cd,
+	.set_signal_voltage = sandbox_mmc_set_signal_voltage,
+	.execute_tuning = sandbox_mmc_execute_tuning,
 };
 
+int sandbox_mmc_get_cmd_count(struct udevice *dev, uint cmdidx)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	if (cmdidx >= ARRAY_SIZE(priv->cmd_count))
+		return -EINVAL;
+
+	return priv->cmd_count[cmdidx];
+}
+
+void sandbox_mmc_set_fail_tuning(struct udevice *dev, bool fail)
+{
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	priv->fail_tuning = fail;
+}
+
 int sandbox_mmc_probe(struct udevice *dev)
 {
 	struct sandbox_mmc_plat *plat = dev_get_platdata(dev);
+	struct sandbox_mmc_priv *priv = dev_get_priv(dev);
+
+	strcpy((char *)priv->buf, "this is a test");
+	priv->emmc = dev_get_driver_data(dev);
+	if (priv->emmc) {
+		u8 *ext_csd = priv->ext_csd;
+
+		ext_csd[EXT_CSD_REV] = 7;	/* Version 5.0 */
+		ext_csd[EXT_CSD_CARD_TYPE] = EXT_CSD_CARD_TYPE_26 |
+			EXT_CSD_CARD_TYPE_52 | EXT_CSD_CARD_TYPE_DDR_1_8V |
+			EXT_CSD_CARD_TYPE_HS200_1_8V |
+			EXT_CSD_CARD_TYPE_HS400_1_8V;
+		put_unaligned_le32(SANDBOX_MMC_SIZE / MMC_MAX_BLOCK_LEN,
+				   &ext_csd[EXT_CSD_SEC_CNT]);
+		ext_csd[EXT_CSD_HC_ERASE_GRP_SIZE] = 1;
+		ext_csd[EXT_CSD_HC_WP_GRP_SIZE] = 1;
+		ext_csd[EXT_CSD_REL_WR_SEC_C] = 1;
+	}
 
 	return mmc_init(&plat->mmc);
 }
@@ -114,10 +446,12 @@ int sandbox_mmc_bind(struct udevice *dev)
 	struct mmc_config *cfg = &plat->cfg;
 
 	cfg->name = dev->name;
-	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_8BIT;
+	cfg->host_caps = MMC_MODE_HS_52MHz | MMC_MODE_HS | MMC_MODE_4BIT |
+			 MMC_MODE_8BIT | MMC_MODE_DDR_52MHz | MMC_MODE_HS200 |
+			 MMC_MODE_HS400 | MMC_MODE_UHS_SDR104 | MMC_CAP_CMD23;
 	cfg->voltages = MMC_VDD_165_195 | MMC_VDD_32_33 | MMC_VDD_33_34;
 	cfg->f_min = 1000000;
-	cfg->f_max = 52000000;
+	cfg->f_max = 208000000;
 	cfg->b_max = U32_MAX;
 
 	return mmc_bind(dev, &plat->mmc, cfg);
@@ -132,6 +466,7 @@ int sandbox_mmc_unbind(struct udevice *dev)
 
 static const struct udevice_id sandbox_mmc_ids[] = {
 	{ .compatible = "sandbox,mmc" },
+	{ .compatible = "sandbox,emmc", .data = true },
 	{ }
 };
 
@@ -143,5 +478,6 @@ U_BOOT_DRIVER(mmc_sandbox) = {
 	.bind		= sandbox_mmc_bind,
 	.unbind		= sandbox_mmc_unbind,
 	.probe		= sandbox_mmc_probe,
+	.priv_auto_alloc_size = sizeof(struct sandbox_mmc_priv),
 	.platdata_auto_alloc_size = sizeof(struct sandbox_mmc_plat),
 };
@@ -123,6 +123,59 @@ static int sdhci_transfer_data(struct sdhci_host *host, struct mmc_data *data,
 	return 0;
 }
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+/*
+ * Describe the whole transfer in the ADMA2 descriptor table, so that the
+ * controller needs no attention until it is done. Returns false if the
+ * buffer cannot be reached with 32-bit ADMA2, to use PIO instead.
+ */
+static bool sdhci_prepare_adma(struct sdhci_host *host, struct mmc_data *data,
+			       unsigned int trans_bytes)
+{
+	struct sdhci_adma_desc *desc = host->adma_desc;
+	unsigned long start, addr;
+	unsigned int len, seg;
+	u8 ctrl;
+
+	if (data->flags == MMC_DATA_READ)
+		start = (unsigned long)data->dest;
+	else
+		start = (unsigned long)data->src;
+
+	if (!desc || upper_32_bits((unsigned long)desc) || (start & 0x3) ||
+	    upper_32_bits(start + trans_bytes - 1) ||
+	    trans_bytes > SDHCI_ADMA_DESC_COUNT * SDHCI_ADMA_MAX_LEN)
+		return false;
+
+	addr = start;
+	len = trans_bytes;
+	do {
+		seg = min_t(unsigned int, len, SDHCI_ADMA_MAX_LEN);
+		desc->attr = SDHCI_ADMA_DESC_VALID | SDHCI_ADMA_DESC_TRAN;
+		desc->reserved = 0;
+		desc->len = cpu_to_le16(seg & 0xffff);
+		desc->addr = cpu_to_le32(addr);
+		addr += seg;
+		len -= seg;
+		desc++;
+	} while (len);
+	desc[-1].attr |= SDHCI_ADMA_DESC_END;
+
+	flush_cache((unsigned long)host->adma_desc,
+		    ALIGN((unsigned long)desc - (unsigned long)host->adma_desc,
+			  CONFIG_SYS_CACHELINE_SIZE));
+	flush_cache(start, ALIGN(trans_bytes, CONFIG_SYS_CACHELINE_SIZE));
+
+	sdhci_writel(host, (unsigned long)host->adma_desc, SDHCI_ADMA_ADDRESS);
+	ctrl = sdhci_readb(host, SDHCI_HOST_CONTROL);
+	ctrl &= ~SDHCI_CTRL_DMA_MASK;
+	ctrl |= SDHCI_CTRL_ADMA32;
+	sdhci_writeb(host, ctrl, SDHCI_HOST_CONTROL);
+
+	return true;
+}
+#endif
+
 /*
  * No command will be sent by driver if card is busy, so driver must wait
  * for card ready state.
@@ -211,6 +264,10 @@ static int sdhci_send_command(struct mmc *mmc, struct mmc_cmd *cmd,
 		if (data->flags == MMC_DATA_READ)
 			mode |= SDHCI_TRNS_READ;
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+		if (sdhci_prepare_adma(host, data, trans_bytes))
+			mode |= SDHCI_TRNS_DMA;
+#endif
 #ifdef CONFIG_MMC_SDHCI_SDMA
 		if (data->flags == MMC_DATA_READ)
 			start_addr = (unsigned long)data->dest;
@@ -488,6 +545,17 @@ static int sdhci_init(struct mmc *mmc)
 		}
 	}
 
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (!host->adma_desc) {
+		host->adma_desc = memalign(CONFIG_SYS_CACHELINE_SIZE,
+					   SDHCI_ADMA_TABLE_SIZE);
+		if (!host->adma_desc) {
+			printf("%s: ADMA table alloc failed!!!\n", __func__);
+			return -ENOMEM;
+		}
+	}
+#endif
+
 	sdhci_set_power(host, fls(mmc->cfg->voltages) - 1);
 
 	if (host->ops && host->ops->get_cd)
@@ -535,6 +603,13 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 		       __func__);
 		return -EINVAL;
 	}
+#endif
+#ifdef CONFIG_MMC_SDHCI_ADMA
+	if (!(caps & SDHCI_CAN_DO_ADMA2)) {
+		printf("%s: Your controller doesn't support ADMA2!!\n",
+		       __func__);
+		return -EINVAL;
+	}
 #endif
 	if (host->quirks & SDHCI_QUIRK_REG32_RW)
 		host->version =
@@ -593,6 +668,10 @@ int sdhci_setup_cfg(struct mmc_config *cfg, struct sdhci_host *host,
 	if (host->quirks & SDHCI_QUIRK_BROKEN_VOLTAGE)
 		cfg->voltages |= host->voltages;
 
+	/*
+	 * Not every controller copes with SET_BLOCK_COUNT, so drivers which
+	 * do opt in by setting MMC_CAP_CMD23 in host->host_caps
+	 */
 	cfg->host_caps = MMC_MODE_HS | MMC_MODE_HS_52MHz | MMC_MODE_4BIT;
 
 	/* Since Host Controller Version3.0 */
@@ -304,6 +304,7 @@ static void fec_rbd_init(struct fec_priv *fec, int count, int dsize)
 	/* Mark the last RBD to close the ring. */
 	fec->rbd_base[i - 1].status = FEC_RBD_WRAP | FEC_RBD_EMPTY;
 	fec->rbd_index = 0;
+	fec->rbd_reclaim = 0;
 
 	flush_dcache_range((unsigned)fec->rbd_base,
 			   (unsigned)fec->rbd_base + size);
@@ -430,6 +431,7 @@ static int fec_open(struct eth_device *edev)
 	/* full-duplex, heartbeat disabled */
 	writel(1 << 2, &fec->eth->x_cntrl);
 	fec->rbd_index = 0;
+	fec->rbd_reclaim = 0;
 
 	/* Invalidate all descriptors */
 	for (i = 0; i < FEC_RBD_NUM - 1; i++)
@@ -622,6 +624,7 @@ static void fec_halt(struct eth_device *dev)
 	writel(readl(&fec->eth->ecntrl) & ~FEC_ECNTRL_ETHER_EN,
 	       &fec->eth->ecntrl);
 	fec->rbd_index = 0;
+	fec->rbd_reclaim = 0;
 	fec->tbd_index = 0;
 	debug("eth_halt: done\n");
 }
@@ -780,28 +783,63 @@ out:
 }
 
 /**
- * Pull one frame from the card
+ * Give the oldest receive buffer taken from the ring back to the card
+ * @param[in] fec all we know about the device yet
+ * @param[in] length number of bytes of the buffer which may have been written
+ */
+static void fec_rx_recycle(struct fec_priv *fec, int length)
+{
+	struct fec_bd *rbd = &fec->rbd_base[fec->rbd_reclaim];
+	uint32_t addr, size;
+	int i;
+
+	/*
+	 * The stack may have written to the frame, for example to turn it
+	 * into a reply. Write that back now, so that it cannot land on top
+	 * of the next frame the card puts in the buffer.
+	 */
+	if (length > 0) {
+		addr = readl(&rbd->data_pointer);
+		flush_dcache_range(addr,
+				   addr + roundup(length, ARCH_DMA_MINALIGN));
+	}
+
+	/*
+	 * Free the buffer and restart the engine. Here we check if the whole
+	 * cacheline of descriptors was already processed and if so, we mark
+	 * it free as whole.
+	 */
+	size = RXDESC_PER_CACHELINE - 1;
+	if ((fec->rbd_reclaim & size) == size) {
+		i = fec->rbd_reclaim - size;
+		addr = (uint32_t)&fec->rbd_base[i];
+		for (; i <= fec->rbd_reclaim ; i++) {
+			fec_rbd_clean(i == (FEC_RBD_NUM - 1),
+				      &fec->rbd_base[i]);
+		}
+		flush_dcache_range(addr,
+				   addr + ARCH_DMA_MINALIGN);
+	}
+
+	fec_rx_task_enable(fec);
+	fec->rbd_reclaim = (fec->rbd_reclaim + 1) % FEC_RBD_NUM;
+}
+
+/**
+ * Handle error events, restarting the card if needed
  * @param[in] dev Our ethernet device to handle
- * @return Length of packet read
+ * @return -EAGAIN if the card was restarted, so the ring is empty, else 0
  */
 #ifdef CONFIG_DM_ETH
-static int fecmxc_recv(struct udevice *dev, int flags, uchar **packetp)
-#else
-static int fec_recv(struct eth_device *dev)
-#endif
+static int fec_rx_events(struct udevice *dev)
 {
-#ifdef CONFIG_DM_ETH
 	struct fec_priv *fec = dev_get_priv(dev);
 #else
+static int fec_rx_events(struct eth_device *dev)
+{
 	struct fec_priv *fec = (struct fec_priv *)dev->priv;
 #endif
-	struct fec_bd *rbd = &fec->rbd_base[fec->rbd_index];
 	unsigned long ievent;
-	int frame_length, len = 0;
-	uint16_t bd_status;
-	uint32_t addr, size, end;
-	int i;
-	ALLOC_CACHE_ALIGN_BUFFER(uchar, buff, FEC_MAX_PKT_SIZE);
 
 	/* Check if any critical events have happened */
 	ievent = readl(&fec->eth->ievent);
@@ -816,7 +854,7 @@ static int fec_recv(struct eth_device *dev)
 		fec_init(dev, fec->bd);
 #endif
 		printf("some error: 0x%08lx\n", ievent);
-		return 0;
+		return -EAGAIN;
 	}
 	if (ievent & FEC_IEVENT_HBERR) {
 		/* Heartbeat error */
@@ -838,9 +876,32 @@ static int fec_recv(struct eth_device *dev)
 #else
 			fec_init(dev, fec->bd);
 #endif
+			return -EAGAIN;
 		}
 	}
 
+	return 0;
+}
+
+/**
+ * Take the next frame from the receive ring
+ *
+ * The frame is passed on in the buffer the card wrote it to. The buffer is
+ * not given back to the card until fec_rx_recycle() reaches it, so several
+ * can be held at once.
+ *
+ * @param[in] fec all we know about the device yet
+ * @param[out] packetp set to the frame
+ * @return length of the frame, 0 if it had an error, -EAGAIN if the ring
+ * is empty
+ */
+static int fec_rx_frame(struct fec_priv *fec, uchar **packetp)
+{
+	struct fec_bd *rbd = &fec->rbd_base[fec->rbd_index];
+	int frame_length, len = 0;
+	uint16_t bd_status;
+	uint32_t addr, size, end;
+
 	/*
 	 * Read the buffer status. Before the status can be read, the data cache
 	 * must be invalidated, because the data in RAM might have been changed
@@ -862,55 +923,111 @@ static int fec_recv(struct eth_device *dev)
 	bd_status = readw(&rbd->status);
 	debug("fec_recv: status 0x%x\n", bd_status);
 
-	if (!(bd_status & FEC_RBD_EMPTY)) {
-		if ((bd_status & FEC_RBD_LAST) && !(bd_status & FEC_RBD_ERR) &&
-		    ((readw(&rbd->data_length) - 4) > 14)) {
-			/* Get buffer address and size */
-			addr = readl(&rbd->data_pointer);
-			frame_length = readw(&rbd->data_length) - 4;
-			/* Invalidate data cache over the buffer */
-			end = roundup(addr + frame_length, ARCH_DMA_MINALIGN);
-			addr &= ~(ARCH_DMA_MINALIGN - 1);
-			invalidate_dcache_range(addr, end);
-
-			/* Fill the buffer and pass it to upper layers */
+	if (bd_status & FEC_RBD_EMPTY) {
+		debug("fec_recv: stop\n");
+		return -EAGAIN;
+	}
+
+	if ((bd_status & FEC_RBD_LAST) && !(bd_status & FEC_RBD_ERR) &&
+	    ((readw(&rbd->data_length) - 4) > 14)) {
+		/* Get buffer address and size */
+		addr = readl(&rbd->data_pointer);
+		frame_length = readw(&rbd->data_length) - 4;
+		/* Invalidate data cache over the buffer */
+		end = roundup(addr + frame_length, ARCH_DMA_MINALIGN);
+		invalidate_dcache_range(addr & ~(ARCH_DMA_MINALIGN - 1), end);
+
+		/* Pass the buffer to upper layers */
 #ifdef CONFIG_FEC_MXC_SWAP_PACKET
-			swap_packet((uint32_t *)addr, frame_length);
+		swap_packet((uint32_t *)addr, frame_length);
 #endif
-			memcpy(buff, (char *)addr, frame_length);
-			net_process_received_packet(buff, frame_length);
-			len = frame_length;
+		len = frame_length;
+		*packetp = (uchar *)addr;
+	} else {
+		if (bd_status & FEC_RBD_ERR)
+			printf("error frame: 0x%08x 0x%08x\n",
+			       addr, bd_status);
+	}
+
+	fec->rbd_index = (fec->rbd_index + 1) % FEC_RBD_NUM;
+
+	return len;
+}
+
+#ifdef CONFIG_DM_ETH
+/**
+ * Pull up to max frames from the card
+ *
+ * The stack gives every buffer back through fecmxc_free_pkt(), in order,
+ * before calling this again.
+ */
+static int fecmxc_recv_batch(struct udevice *dev, int flags, uchar **packets,
+			     int *lengths, int max)
+{
+	struct fec_priv *fec = dev_get_priv(dev);
+	int count = 0;
+	int len, ret;
+
+	if (flags & ETH_RECV_CHECK_DEVICE) {
+		ret = fec_rx_events(dev);
+		if (ret)
+			return ret;
+	}
+
+	/* Give back a bad frame which ended the last batch */
+	while (fec->rbd_reclaim != fec->rbd_index)
+		fec_rx_recycle(fec, 0);
+
+	while (count < max) {
+		len = fec_rx_frame(fec, &packets[count]);
+		if (len < 0)
+			break;
+		if (len) {
+			lengths[count++] = len;
+		} else if (!count) {
+			fec_rx_recycle(fec, 0);
 		} else {
-			if (bd_status & FEC_RBD_ERR)
-				printf("error frame: 0x%08x 0x%08x\n",
-				       addr, bd_status);
+			/* Buffers must go back in order, so stop here */
+			break;
 		}
+	}
 
-		/*
-		 * Free the current buffer, restart the engine and move forward
-		 * to the next buffer. Here we check if the whole cacheline of
-		 * descriptors was already processed and if so, we mark it free
-		 * as whole.
-		 */
-		size = RXDESC_PER_CACHELINE - 1;
-		if ((fec->rbd_index & size) == size) {
-			i = fec->rbd_index - size;
-			addr = (uint32_t)&fec->rbd_base[i];
-			for (; i <= fec->rbd_index ; i++) {
-				fec_rbd_clean(i == (FEC_RBD_NUM - 1),
-					      &fec->rbd_base[i]);
-			}
-			flush_dcache_range(addr,
-					   addr + ARCH_DMA_MINALIGN);
-		}
+	return count ? count : -EAGAIN;
+}
 
-		fec_rx_task_enable(fec);
-		fec->rbd_index = (fec->rbd_index + 1) % FEC_RBD_NUM;
-	}
-	debug("fec_recv: stop\n");
+static int fecmxc_free_pkt(struct udevice *dev, uchar *packet, int length)
+{
+	struct fec_priv *fec = dev_get_priv(dev);
+
+	fec_rx_recycle(fec, length);
+
+	return 0;
+}
+#else
+/**
+ * Pull one frame from the card and process it where the card wrote it
+ * @param[in] dev Our ethernet device to handle
+ * @return Length of packet read
+ */
+static int fec_recv(struct eth_device *dev)
+{
+	struct fec_priv *fec = (struct fec_priv *)dev->priv;
+	uchar *packet;
+	int len;
+
+	if (fec_rx_events(dev))
+		return 0;
+
+	len = fec_rx_frame(fec, &packet);
+	if (len < 0)
+		return 0;
+	if (len)
+		net_process_received_packet(packet, len);
+	fec_rx_recycle(fec, len);
 
 	return len;
 }
+#endif
 
 static void fec_set_dev_name(char *dest, int dev_id)
 {
@@ -961,6 +1078,7 @@ static int fec_alloc_descs(struct fec_priv *fec)
 	fec->rbd_base[i - 1].status = FEC_RBD_WRAP | FEC_RBD_EMPTY;
 
 	fec->rbd_index = 0;
+	fec->rbd_reclaim = 0;
 	fec->tbd_index = 0;
 
 	return 0;
@@ -1183,7 +1301,8 @@ static int fecmxc_read_rom_hwaddr(struct udevice *dev)
 static const struct eth_ops fecmxc_ops = {
 	.start			= fecmxc_init,
 	.send			= fecmxc_send,
-	.recv			= fecmxc_recv,
+	.recv_batch		= fecmxc_recv_batch,
+	.free_pkt		= fecmxc_free_pkt,
 	.stop			= fecmxc_halt,
 	.write_hwaddr		= fecmxc_set_hwaddr,
 	.read_rom_hwaddr	= fecmxc_read_rom_hwaddr,
@@ -239,6 +239,7 @@ struct fec_priv {
 	enum xceiver_type xcv_type;	/* transceiver type */
 	struct fec_bd *rbd_base;	/* RBD ring */
 	int rbd_index;			/* next receive BD to read */
+	int rbd_reclaim;		/* next receive BD to give back */
 	struct fec_bd *tbd_base;	/* TBD ring */
 	int tbd_index;			/* next transmit BD to write */
 	bd_t *bd;
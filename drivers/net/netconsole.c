@@ -145,6 +145,9 @@ int nc_input_packet(uchar *pkt, struct in_addr src_ip, unsigned dest_port,
 	if (src_ip.s_addr != nc_ip.s_addr && !is_broadcast(nc_ip))
 		return 0; /* not from our client */
 
+	if (!net_udp_csum_copy(NULL, NULL, 0))
+		return 1; /* corrupt */
+
 	debug_cond(DEBUG_DEV_PKT, "input: \"%*.*s\"\n", len, len, pkt);
 
 	if (input_size == sizeof(input_buffer))
@@ -217,7 +220,7 @@ static void nc_send_packet(const char *buf, int len)
 
 	if (inited) {
 		if (eth_is_on_demand_init())
-			eth_halt();
+			eth_release();
 		else
 			eth_halt_state_only();
 	}
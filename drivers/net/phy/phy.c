@@ -165,6 +165,8 @@ int genphy_restart_aneg(struct phy_device *phydev)
 	ctl &= ~(BMCR_ISOLATE);
 
 	ctl = phy_write(phydev, MDIO_DEVAD_NONE, MII_BMCR, ctl);
+	if (ctl >= 0)
+		phydev->aneg_start = get_timer(0);
 
 	return ctl;
 }
@@ -217,10 +219,17 @@ int genphy_config_aneg(struct phy_device *phydev)
  * Description: Update the value in phydev->link to reflect the
  *   current link value.  In order to do this, we need to read
  *   the status register twice, keeping the second value.
+ *
+ *   Autonegotiation starts when the PHY is reset or configured, which
+ *   is usually when the Ethernet device is probed during boot, so it
+ *   may be done or nearly done by now. We only wait for the rest of
+ *   PHY_ANEG_TIMEOUT from when it started.
  */
 int genphy_update_link(struct phy_device *phydev)
 {
 	unsigned int mii_reg;
+	ulong start;
+	int dots;
 
 	/*
 	 * Wait if the link is up, and autonegotiation is in progress
@@ -237,15 +246,24 @@ int genphy_update_link(struct phy_device *phydev)
 
 	if ((phydev->autoneg == AUTONEG_ENABLE) &&
 	    !(mii_reg & BMSR_ANEGCOMPLETE)) {
-		int i = 0;
+		/*
+		 * If we do not know when it started, or it should have
+		 * finished long ago (the PHY restarts it by itself when a
+		 * cable is plugged in), allow it the full time from now
+		 */
+		if (!phydev->aneg_start ||
+		    get_timer(phydev->aneg_start) > PHY_ANEG_TIMEOUT)
+			phydev->aneg_start = get_timer(0);
 
 		printf("%s Waiting for PHY auto negotiation to complete",
 			phydev->dev->name);
+		start = get_timer(0);
+		dots = 0;
 		while (!(mii_reg & BMSR_ANEGCOMPLETE)) {
 			/*
 			 * Timeout reached ?
 			 */
-			if (i > PHY_ANEG_TIMEOUT) {
+			if (get_timer(phydev->aneg_start) > PHY_ANEG_TIMEOUT) {
 				printf(" TIMEOUT !\n");
 				phydev->link = 0;
 				return -ETIMEDOUT;
@@ -257,8 +275,10 @@ int genphy_update_link(struct phy_device *phydev)
 				return -EINTR;
 			}
 
-			if ((i++ % 500) == 0)
+			if (get_timer(start) >= dots * 500) {
 				printf(".");
+				dots++;
+			}
 
 			udelay(1000);	/* 1 ms */
 			mii_reg = phy_read(phydev, MDIO_DEVAD_NONE, MII_BMSR);
@@ -799,6 +819,9 @@ int phy_reset(struct phy_device *phydev)
 		return -1;
 	}
 
+	/* A reset restarts autonegotiation, if it is enabled */
+	phydev->aneg_start = get_timer(0);
+
 	return 0;
 }
 
@@ -9,9 +9,11 @@
 
 #include <common.h>
 #include <dm.h>
+#include <fastboot.h>
 #include <malloc.h>
 #include <net.h>
 #include <asm/test.h>
+#include <asm/unaligned.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -22,16 +24,185 @@ DECLARE_GLOBAL_DATA_PTR;
  * fake_host_ipaddr: IP address of mocked machine
  * recv_packet_buffer: buffer of the packet returned as received
  * recv_packet_length: length of the packet returned as received
+ * recv_buf: index in net_rx_packets[] of recv_packet_buffer
  */
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
 	struct in_addr fake_host_ipaddr;
 	uchar *recv_packet_buffer;
 	int recv_packet_length;
+	int recv_buf;
 };
 
 static bool disabled[8] = {false};
 static bool skip_timeout;
+static int arp_requests;
+static int starts;
+/* Most packets handed to the stack at once, or 0 for one at a time */
+static int rx_batch;
+/* Packets the stack has not given back, and the most it has held */
+static int rx_held;
+static int rx_held_max;
+
+/* TFTP opcodes and the port the mock server uses for transfers */
+#define SB_TFTP_RRQ		1
+#define SB_TFTP_DATA		3
+#define SB_TFTP_ACK		4
+#define SB_TFTP_ERROR		5
+#define SB_TFTP_OACK		6
+#define SB_TFTP_PORT		69
+#define SB_TFTP_DATA_PORT	3069
+/* Largest block which fits in an Ethernet frame */
+#define SB_TFTP_MAX_BLKSIZE	1468
+/* Most requests for missing files waiting for an answer */
+#define SB_TFTP_MAX_MISSING	16
+
+/**
+ * struct sb_eth_tftp - mock TFTP server which serves one file from memory
+ *
+ * data: file contents, NULL if the server is disabled
+ * size: file size in bytes
+ * name: file name, NULL to serve the file for any name
+ * rtt_ms: milliseconds to advance the time for each ACK received
+ * drop_block: block to drop the next time it is sent, 0 for none
+ * max_window: largest window the server agrees to, 0 for no limit
+ * acks: number of ACKs received
+ * requests: number of read requests received
+ * missing_ports: ports of requests for other files, to answer with an error
+ * missing: number of entries in missing_ports
+ * client_hwaddr: MAC address of U-Boot
+ * client_ip: IP address of U-Boot
+ * client_port: UDP port U-Boot sent the request from
+ * block_size: negotiated block size
+ * window_size: negotiated window size
+ * next_block: next block to send
+ * window_left: blocks left to send before waiting for an ACK
+ */
+struct sb_eth_tftp {
+	const uchar *data;
+	int size;
+	const char *name;
+	int rtt_ms;
+	int drop_block;
+	int max_window;
+	int acks;
+	int requests;
+	int missing_ports[SB_TFTP_MAX_MISSING];
+	int missing;
+	uchar client_hwaddr[ARP_HLEN];
+	struct in_addr client_ip;
+	int client_port;
+	int block_size;
+	int window_size;
+	int next_block;
+	int window_left;
+};
+
+static struct sb_eth_tftp sb_tftp;
+
+/* Port and initial sequence number of the mock HTTP server */
+#define SB_HTTP_PORT		80
+#define SB_HTTP_ISS		0x10000000
+/* Largest segment which fits in an Ethernet frame */
+#define SB_HTTP_MSS		1460
+
+/**
+ * struct sb_eth_http - mock HTTP server which serves one file from memory
+ *
+ * data: file contents, NULL if the server is disabled
+ * size: file size in bytes
+ * send_len: true to send a Content-Length, false to mark the end of the
+ *	file by closing the connection
+ * requests: number of GET requests received
+ * client_hwaddr: MAC address of U-Boot
+ * client_ip: IP address of U-Boot
+ * client_port: TCP port U-Boot connected from
+ * rcv_nxt: sequence number of the next byte expected from U-Boot
+ * syn_ack: true if a SYN-ACK is waiting to be sent
+ * sending: true while the reply is being sent
+ * hdr: header of the reply
+ * hdr_len: length of the header
+ * sent: bytes of the reply (header and file) sent so far
+ */
+struct sb_eth_http {
+	const uchar *data;
+	int size;
+	bool send_len;
+	int requests;
+	uchar client_hwaddr[ARP_HLEN];
+	struct in_addr client_ip;
+	int client_port;
+	u32 rcv_nxt;
+	bool syn_ack;
+	bool sending;
+	char hdr[64];
+	int hdr_len;
+	int sent;
+};
+
+static struct sb_eth_http sb_http;
+
+/* Address and port of the mock fastboot host */
+#define SB_FB_HOST_IP		"1.1.2.2"
+#define SB_FB_HOST_PORT		45000
+/* Packet types, and the port U-Boot listens on */
+#define SB_FB_QUERY		1
+#define SB_FB_INIT		2
+#define SB_FB_FASTBOOT		3
+#define SB_FB_PORT		5554
+#define SB_FB_HDR_SIZE		4
+/* Most responses kept for the test to check */
+#define SB_FB_MAX_RESPONSES	8
+
+/* What the mock fastboot host sends next */
+enum sb_fb_state {
+	SB_FB_STATE_QUERY,	/* Ask for U-Boot's sequence number */
+	SB_FB_STATE_INIT,	/* Start the session */
+	SB_FB_STATE_COMMAND,	/* Send the next command */
+	SB_FB_STATE_ASK,	/* Ask for the response to the command */
+	SB_FB_STATE_DATA,	/* Send the next packet of the download */
+	SB_FB_STATE_DONE,	/* Nothing: all the commands are done */
+};
+
+/**
+ * struct sb_eth_fastboot - mock fastboot host which runs a list of commands
+ *
+ * cmds: commands to send, ending with NULL; NULL if the host is disabled
+ * data: data to send when a command is answered with DATA
+ * size: size of data in bytes
+ * corrupt: number of the data packet whose checksum is broken the first
+ *	time it is sent, -1 for none
+ * state: what to send next
+ * cmd: index of the current command
+ * seq: sequence number of the packet being sent
+ * max_data: most data in a packet, from U-Boot's reply to INIT
+ * pos: bytes of data acknowledged so far
+ * len: bytes of data in the packet being sent
+ * data_pkts: number of data packets acknowledged so far
+ * waiting: true if the packet sent has not been answered
+ * resends: number of packets which were not answered and sent again
+ * responses: responses to the commands, including INFO messages
+ * num_responses: number of entries in responses
+ */
+struct sb_eth_fastboot {
+	const char *const *cmds;
+	const uchar *data;
+	int size;
+	int corrupt;
+	enum sb_fb_state state;
+	int cmd;
+	u16 seq;
+	int max_data;
+	int pos;
+	int len;
+	int data_pkts;
+	bool waiting;
+	int resends;
+	char responses[SB_FB_MAX_RESPONSES][FASTBOOT_RESPONSE_LEN];
+	int num_responses;
+};
+
+static struct sb_eth_fastboot sb_fb;
 
 /*
  * sandbox_eth_disable_response()
@@ -54,15 +225,684 @@ void sandbox_eth_skip_timeout(void)
 	skip_timeout = true;
 }
 
+/*
+ * sandbox_eth_arp_requests()
+ *
+ * Return the number of ARP requests sent so far
+ */
+int sandbox_eth_arp_requests(void)
+{
+	return arp_requests;
+}
+
+/*
+ * sandbox_eth_starts()
+ *
+ * Return the number of times a device has been started
+ */
+int sandbox_eth_starts(void)
+{
+	return starts;
+}
+
+/*
+ * sandbox_eth_set_rx_batch()
+ *
+ * max - Most packets to hand to the stack in one recv_batch() call, in
+ *	separate buffers; 0 to hand them over one at a time
+ */
+void sandbox_eth_set_rx_batch(int max)
+{
+	rx_batch = max;
+	rx_held = 0;
+	rx_held_max = 0;
+}
+
+/*
+ * sandbox_eth_rx_held()
+ *
+ * Return the number of received packets not yet passed back to free_pkt()
+ */
+int sandbox_eth_rx_held(void)
+{
+	return rx_held;
+}
+
+/*
+ * sandbox_eth_rx_held_max()
+ *
+ * Return the most received packets the stack has held at once
+ */
+int sandbox_eth_rx_held_max(void)
+{
+	return rx_held_max;
+}
+
+/*
+ * sandbox_eth_tftp_set_file()
+ *
+ * data - File to serve for any read request, NULL to disable the server
+ * size - File size in bytes
+ * rtt_ms - Round-trip time to simulate, in milliseconds
+ */
+void sandbox_eth_tftp_set_file(const void *data, int size, int rtt_ms)
+{
+	memset(&sb_tftp, '\0', sizeof(sb_tftp));
+	sb_tftp.data = data;
+	sb_tftp.size = size;
+	sb_tftp.rtt_ms = rtt_ms;
+}
+
+/*
+ * sandbox_eth_tftp_set_name()
+ *
+ * name - Only serve the file for this name, NULL for any
+ */
+void sandbox_eth_tftp_set_name(const char *name)
+{
+	sb_tftp.name = name;
+}
+
+/*
+ * sandbox_eth_tftp_drop_block()
+ *
+ * block - Block to drop the next time the mock TFTP server sends it
+ */
+void sandbox_eth_tftp_drop_block(int block)
+{
+	sb_tftp.drop_block = block;
+}
+
+/*
+ * sandbox_eth_tftp_set_max_window()
+ *
+ * window - Largest window to put in the OACK, 0 for whatever is asked for
+ */
+void sandbox_eth_tftp_set_max_window(int window)
+{
+	sb_tftp.max_window = window;
+}
+
+/*
+ * sandbox_eth_tftp_window()
+ *
+ * Return the window size the server agreed to for the last transfer
+ */
+int sandbox_eth_tftp_window(void)
+{
+	return sb_tftp.window_size;
+}
+
+/*
+ * sandbox_eth_tftp_acks()
+ *
+ * Return the number of ACKs the mock TFTP server has received
+ */
+int sandbox_eth_tftp_acks(void)
+{
+	return sb_tftp.acks;
+}
+
+/*
+ * sandbox_eth_tftp_requests()
+ *
+ * Return the number of read requests the mock TFTP server has received
+ */
+int sandbox_eth_tftp_requests(void)
+{
+	return sb_tftp.requests;
+}
+
+/*
+ * sandbox_eth_http_set_file()
+ *
+ * data - File to serve for any GET request, NULL to disable the server
+ * size - File size in bytes
+ * send_len - true to send a Content-Length with the file
+ */
+void sandbox_eth_http_set_file(const void *data, int size, bool send_len)
+{
+	memset(&sb_http, '\0', sizeof(sb_http));
+	sb_http.data = data;
+	sb_http.size = size;
+	sb_http.send_len = send_len;
+}
+
+/*
+ * sandbox_eth_http_requests()
+ *
+ * Return the number of GET requests the mock HTTP server has received
+ */
+int sandbox_eth_http_requests(void)
+{
+	return sb_http.requests;
+}
+
+/*
+ * sandbox_eth_fastboot_start()
+ *
+ * cmds - Commands for the mock fastboot host to send, ending with NULL;
+ *	NULL to disable it
+ * data - Data to send for a download
+ * size - Size of the data in bytes
+ * corrupt - Data packet to corrupt the first time it is sent, -1 for none
+ */
+void sandbox_eth_fastboot_start(const char *const *cmds, const void *data,
+				int size, int corrupt)
+{
+	memset(&sb_fb, '\0', sizeof(sb_fb));
+	sb_fb.cmds = cmds;
+	sb_fb.data = data;
+	sb_fb.size = size;
+	sb_fb.corrupt = corrupt;
+}
+
+/*
+ * sandbox_eth_fastboot_response()
+ *
+ * index - Number of the response, counting from 0
+ *
+ * Return a response the mock fastboot host received, or "" if there were
+ * not that many
+ */
+const char *sandbox_eth_fastboot_response(int index)
+{
+	if (index >= sb_fb.num_responses)
+		return "";
+
+	return sb_fb.responses[index];
+}
+
+/*
+ * sandbox_eth_fastboot_resends()
+ *
+ * Return the number of packets the mock fastboot host had to send again
+ */
+int sandbox_eth_fastboot_resends(void)
+{
+	return sb_fb.resends;
+}
+
+/*
+ * Add the Ethernet, IP and UDP headers to a packet from the mock TFTP
+ * server, whose payload of len bytes is already in the receive buffer
+ */
+static int sb_eth_tftp_reply(struct eth_sandbox_priv *priv, int sport,
+			     int len)
+{
+	struct ethernet_hdr *eth = (void *)priv->recv_packet_buffer;
+	struct ip_udp_hdr *ip = (void *)priv->recv_packet_buffer +
+		ETHER_HDR_SIZE;
+
+	memcpy(eth->et_dest, sb_tftp.client_hwaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip->ip_hl_v = 0x45;
+	ip->ip_tos = 0;
+	ip->ip_len = htons(IP_UDP_HDR_SIZE + len);
+	ip->ip_id = 0;
+	ip->ip_off = htons(IP_FLAGS_DFRAG);
+	ip->ip_ttl = 255;
+	ip->ip_p = IPPROTO_UDP;
+	ip->ip_sum = 0;
+	net_write_ip((void *)&ip->ip_src, priv->fake_host_ipaddr);
+	net_write_ip((void *)&ip->ip_dst, sb_tftp.client_ip);
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+
+	ip->udp_src = htons(sport);
+	ip->udp_dst = htons(sb_tftp.client_port);
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	ip->udp_xsum = 0;
+
+	return ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+}
+
+/*
+ * Handle a read request or ACK sent to the mock TFTP server. A read
+ * request is answered with an OACK for the blksize and windowsize options
+ * it contains, or later with an error if it is for another file; each ACK
+ * starts a new window after the block it ACKs.
+ */
+static void sb_eth_tftp_handle(struct eth_sandbox_priv *priv, void *packet)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	char *req = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	char *end = req + ntohs(ip->udp_len) - UDP_HDR_SIZE;
+	char *oack, *opt, *val;
+	int block, len;
+
+	switch (ntohs(*(__be16 *)req)) {
+	case SB_TFTP_RRQ:
+		if (ntohs(ip->udp_dst) != SB_TFTP_PORT)
+			return;
+		sb_tftp.requests++;
+		memcpy(sb_tftp.client_hwaddr, eth->et_src, ARP_HLEN);
+		sb_tftp.client_ip = net_read_ip(&ip->ip_src);
+		if (sb_tftp.name && strcmp(req + 2, sb_tftp.name)) {
+			if (sb_tftp.missing < SB_TFTP_MAX_MISSING)
+				sb_tftp.missing_ports[sb_tftp.missing++] =
+					ntohs(ip->udp_src);
+			return;
+		}
+		sb_tftp.client_port = ntohs(ip->udp_src);
+		sb_tftp.block_size = 512;
+		sb_tftp.window_size = 1;
+		sb_tftp.next_block = 1;
+		sb_tftp.window_left = 0;
+
+		oack = (char *)priv->recv_packet_buffer + ETHER_HDR_SIZE +
+			IP_UDP_HDR_SIZE;
+		*(__be16 *)oack = htons(SB_TFTP_OACK);
+		len = 2;
+		/* Skip the file name and mode */
+		opt = req + 2;
+		opt += strlen(opt) + 1;
+		opt += strlen(opt) + 1;
+		for (; opt < end; opt = val + strlen(val) + 1) {
+			val = opt + strlen(opt) + 1;
+			if (!strcmp(opt, "blksize")) {
+				sb_tftp.block_size = min(SB_TFTP_MAX_BLKSIZE,
+					(int)simple_strtol(val, NULL, 10));
+				len += sprintf(oack + len, "blksize%c%d%c", 0,
+					       sb_tftp.block_size, 0);
+			} else if (!strcmp(opt, "windowsize")) {
+				sb_tftp.window_size = simple_strtol(val, NULL,
+								    10);
+				if (sb_tftp.max_window)
+					sb_tftp.window_size = min(
+						sb_tftp.window_size,
+						sb_tftp.max_window);
+				len += sprintf(oack + len, "windowsize%c%d%c",
+					       0, sb_tftp.window_size, 0);
+			}
+		}
+		if (len > 2)
+			priv->recv_packet_length = sb_eth_tftp_reply(priv,
+					SB_TFTP_DATA_PORT, len);
+		else
+			sb_tftp.window_left = 1;
+		break;
+	case SB_TFTP_ACK:
+		if (ntohs(ip->udp_dst) != SB_TFTP_DATA_PORT)
+			return;
+		sb_tftp.acks++;
+		sandbox_timer_add_offset(sb_tftp.rtt_ms);
+		block = ntohs(*(__be16 *)(req + 2));
+		/* The block ACKed may be the last one, which is short */
+		if (block * sb_tftp.block_size > sb_tftp.size) {
+			sb_tftp.window_left = 0;
+			break;
+		}
+		sb_tftp.next_block = block + 1;
+		sb_tftp.window_left = sb_tftp.window_size;
+		break;
+	}
+}
+
+/*
+ * Prepare the next packet from the mock TFTP server, if any: an error for a
+ * missing file, or the next data block
+ */
+static void sb_eth_tftp_send_data(struct eth_sandbox_priv *priv)
+{
+	char *pkt = (char *)priv->recv_packet_buffer + ETHER_HDR_SIZE +
+		IP_UDP_HDR_SIZE;
+	int block, offset, len, port;
+
+	if (sb_tftp.missing) {
+		/* The error goes to the port the request came from */
+		port = sb_tftp.client_port;
+		sb_tftp.client_port = sb_tftp.missing_ports[0];
+		sb_tftp.missing--;
+		memmove(sb_tftp.missing_ports, sb_tftp.missing_ports + 1,
+			sb_tftp.missing * sizeof(int));
+		*(__be16 *)pkt = htons(SB_TFTP_ERROR);
+		*(__be16 *)(pkt + 2) = htons(1);
+		strcpy(pkt + 4, "File not found");
+		priv->recv_packet_length = sb_eth_tftp_reply(priv,
+				SB_TFTP_DATA_PORT, 4 + 15);
+		sb_tftp.client_port = port;
+		return;
+	}
+
+	while (sb_tftp.window_left) {
+		block = sb_tftp.next_block++;
+		offset = (block - 1) * sb_tftp.block_size;
+		len = min(sb_tftp.block_size, sb_tftp.size - offset);
+		sb_tftp.window_left--;
+		if (len < sb_tftp.block_size)
+			sb_tftp.window_left = 0;
+		if (block == sb_tftp.drop_block) {
+			sb_tftp.drop_block = 0;
+			continue;
+		}
+
+		*(__be16 *)pkt = htons(SB_TFTP_DATA);
+		*(__be16 *)(pkt + 2) = htons(block);
+		memcpy(pkt + 4, sb_tftp.data + offset, len);
+		priv->recv_packet_length = sb_eth_tftp_reply(priv,
+				SB_TFTP_DATA_PORT, 4 + len);
+		break;
+	}
+}
+
+/*
+ * Checksum of the TCP or UDP packet of len bytes at l4 in the IP packet ip,
+ * including the pseudo-header
+ */
+static unsigned sb_eth_l4_checksum(struct ip_hdr *ip, void *l4, int len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dst;
+		u8 zero;
+		u8 proto;
+		__be16 len;
+	} ph;
+	unsigned sum;
+
+	ph.src = net_read_ip(&ip->ip_src);
+	ph.dst = net_read_ip(&ip->ip_dst);
+	ph.zero = 0;
+	ph.proto = ip->ip_p;
+	ph.len = htons(len);
+	sum = compute_ip_checksum(l4, len);
+
+	return add_ip_checksums(sizeof(ph),
+				compute_ip_checksum(&ph, sizeof(ph)), sum);
+}
+
+/*
+ * Add the Ethernet, IP and TCP headers to a segment from the mock HTTP
+ * server, whose payload of len bytes is already in the receive buffer. A
+ * SYN carries an MSS option instead of a payload.
+ */
+static int sb_eth_http_reply(struct eth_sandbox_priv *priv, u8 flags, u32 seq,
+			     int len)
+{
+	struct ethernet_hdr *eth = (void *)priv->recv_packet_buffer;
+	struct ip_hdr *ip = (void *)priv->recv_packet_buffer + ETHER_HDR_SIZE;
+	struct tcp_hdr *tcp = (void *)ip + IP_HDR_SIZE;
+	uchar *opt = (uchar *)(tcp + 1);
+	int hdr_len = TCP_HDR_SIZE;
+
+	if (flags & TCP_SYN) {
+		opt[0] = 2;	/* MSS */
+		opt[1] = 4;
+		put_unaligned_be16(SB_HTTP_MSS, opt + 2);
+		hdr_len += 4;
+	}
+
+	memcpy(eth->et_dest, sb_http.client_hwaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip->ip_hl_v = 0x45;
+	ip->ip_tos = 0;
+	ip->ip_len = htons(IP_HDR_SIZE + hdr_len + len);
+	ip->ip_id = 0;
+	ip->ip_off = htons(IP_FLAGS_DFRAG);
+	ip->ip_ttl = 255;
+	ip->ip_p = IPPROTO_TCP;
+	ip->ip_sum = 0;
+	net_write_ip((void *)&ip->ip_src, priv->fake_host_ipaddr);
+	net_write_ip((void *)&ip->ip_dst, sb_http.client_ip);
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+
+	tcp->tcp_src = htons(SB_HTTP_PORT);
+	tcp->tcp_dst = htons(sb_http.client_port);
+	put_unaligned_be32(seq, &tcp->tcp_seq);
+	put_unaligned_be32(sb_http.rcv_nxt, &tcp->tcp_ack);
+	tcp->tcp_off = hdr_len << 2;
+	tcp->tcp_flags = flags;
+	tcp->tcp_win = htons(0xffff);
+	tcp->tcp_sum = 0;
+	tcp->tcp_urg = 0;
+	tcp->tcp_sum = sb_eth_l4_checksum(ip, tcp, hdr_len + len);
+
+	return ETHER_HDR_SIZE + IP_HDR_SIZE + hdr_len + len;
+}
+
+/*
+ * Handle a segment sent to the mock HTTP server. A SYN opens a new
+ * connection and a GET request starts the reply; anything else in order is
+ * just counted, and ACKs are ignored since the server never loses data.
+ */
+static void sb_eth_http_handle(struct eth_sandbox_priv *priv, void *packet)
+{
+	struct ethernet_hdr *eth = packet;
+	struct ip_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct tcp_hdr *tcp = (void *)ip + IP_HDR_SIZE;
+	int hdr_len = (tcp->tcp_off >> 4) * 4;
+	int len = ntohs(ip->ip_len) - IP_HDR_SIZE - hdr_len;
+	char *req = (char *)tcp + hdr_len;
+	u32 seq = get_unaligned_be32(&tcp->tcp_seq);
+
+	if (ntohs(tcp->tcp_dst) != SB_HTTP_PORT)
+		return;
+
+	if (tcp->tcp_flags & TCP_SYN) {
+		memcpy(sb_http.client_hwaddr, eth->et_src, ARP_HLEN);
+		sb_http.client_ip = net_read_ip(&ip->ip_src);
+		sb_http.client_port = ntohs(tcp->tcp_src);
+		sb_http.rcv_nxt = seq + 1;
+		sb_http.syn_ack = true;
+		sb_http.sending = false;
+		sb_http.sent = 0;
+		return;
+	}
+	if (ntohs(tcp->tcp_src) != sb_http.client_port ||
+	    seq != sb_http.rcv_nxt)
+		return;
+	sb_http.rcv_nxt += len;
+	if (tcp->tcp_flags & TCP_FIN)
+		sb_http.rcv_nxt++;
+
+	/* The request is small enough to arrive in one segment */
+	if (len >= 4 && !strncmp(req, "GET ", 4)) {
+		sb_http.requests++;
+		if (sb_http.send_len)
+			sb_http.hdr_len = sprintf(sb_http.hdr,
+				"HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n",
+				sb_http.size);
+		else
+			sb_http.hdr_len = sprintf(sb_http.hdr,
+						  "HTTP/1.1 200 OK\r\n\r\n");
+		sb_http.sending = true;
+	}
+}
+
+/*
+ * Prepare the next segment from the mock HTTP server, if any: the SYN-ACK,
+ * the next part of the reply, or the FIN once it has all been sent
+ */
+static void sb_eth_http_send_data(struct eth_sandbox_priv *priv)
+{
+	uchar *pkt = priv->recv_packet_buffer + ETHER_HDR_SIZE + IP_HDR_SIZE +
+		TCP_HDR_SIZE;
+	int total = sb_http.hdr_len + sb_http.size;
+	int len, count = 0;
+
+	if (sb_http.syn_ack) {
+		sb_http.syn_ack = false;
+		priv->recv_packet_length = sb_eth_http_reply(priv,
+				TCP_SYN | TCP_ACK, SB_HTTP_ISS, 0);
+		return;
+	}
+	if (!sb_http.sending)
+		return;
+
+	if (sb_http.sent == total) {
+		sb_http.sending = false;
+		priv->recv_packet_length = sb_eth_http_reply(priv,
+				TCP_FIN | TCP_ACK, SB_HTTP_ISS + 1 + total, 0);
+		return;
+	}
+
+	len = min(SB_HTTP_MSS, total - sb_http.sent);
+	if (sb_http.sent < sb_http.hdr_len) {
+		count = min(len, sb_http.hdr_len - sb_http.sent);
+		memcpy(pkt, sb_http.hdr + sb_http.sent, count);
+	}
+	memcpy(pkt + count,
+	       sb_http.data + sb_http.sent + count - sb_http.hdr_len,
+	       len - count);
+	priv->recv_packet_length = sb_eth_http_reply(priv, TCP_ACK | TCP_PSH,
+			SB_HTTP_ISS + 1 + sb_http.sent, len);
+	sb_http.sent += len;
+}
+
+/*
+ * Handle a reply from U-Boot to the mock fastboot host, moving on to the
+ * next packet if it answers the one sent
+ */
+static void sb_eth_fastboot_handle(void *packet)
+{
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	uchar *pkt = (uchar *)ip + IP_UDP_HDR_SIZE;
+	int len = ntohs(ip->udp_len) - UDP_HDR_SIZE - SB_FB_HDR_SIZE;
+	char *resp;
+
+	if (ntohs(ip->udp_src) != SB_FB_PORT ||
+	    ntohs(ip->udp_dst) != SB_FB_HOST_PORT || len < 0)
+		return;
+
+	if (sb_fb.state == SB_FB_STATE_QUERY) {
+		/* The reply carries the sequence number to start from */
+		if (pkt[0] != SB_FB_QUERY || len < 2)
+			return;
+		sb_fb.seq = get_unaligned_be16(pkt + SB_FB_HDR_SIZE);
+		sb_fb.state = SB_FB_STATE_INIT;
+		sb_fb.waiting = false;
+		return;
+	}
+	if (get_unaligned_be16(pkt + 2) != sb_fb.seq)
+		return;
+	sb_fb.seq++;
+	sb_fb.waiting = false;
+
+	switch (sb_fb.state) {
+	case SB_FB_STATE_INIT:
+		sb_fb.max_data = get_unaligned_be16(pkt + SB_FB_HDR_SIZE + 2) -
+			SB_FB_HDR_SIZE;
+		sb_fb.state = SB_FB_STATE_COMMAND;
+		break;
+	case SB_FB_STATE_COMMAND:
+		sb_fb.state = SB_FB_STATE_ASK;
+		break;
+	case SB_FB_STATE_ASK:
+		if (sb_fb.num_responses < SB_FB_MAX_RESPONSES) {
+			resp = sb_fb.responses[sb_fb.num_responses++];
+			len = min(len, FASTBOOT_RESPONSE_LEN - 1);
+			memcpy(resp, pkt + SB_FB_HDR_SIZE, len);
+			resp[len] = '\0';
+		}
+		/* INFO messages come before the response; ask again */
+		if (!strncmp((char *)pkt + SB_FB_HDR_SIZE, "INFO", 4))
+			break;
+		if (!strncmp((char *)pkt + SB_FB_HDR_SIZE, "DATA", 4)) {
+			sb_fb.pos = 0;
+			sb_fb.state = SB_FB_STATE_DATA;
+			break;
+		}
+		sb_fb.cmd++;
+		sb_fb.state = sb_fb.cmds[sb_fb.cmd] ? SB_FB_STATE_COMMAND :
+			SB_FB_STATE_DONE;
+		break;
+	case SB_FB_STATE_DATA:
+		sb_fb.pos += sb_fb.len;
+		sb_fb.data_pkts++;
+		if (sb_fb.pos >= sb_fb.size)
+			sb_fb.state = SB_FB_STATE_ASK;
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Prepare the next packet from the mock fastboot host, or the last one again
+ * if U-Boot did not answer it
+ */
+static void sb_eth_fastboot_send(struct udevice *dev)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct eth_pdata *pdata = dev_get_platdata(dev);
+	struct ethernet_hdr *eth = (void *)priv->recv_packet_buffer;
+	struct ip_udp_hdr *ip = (void *)eth + ETHER_HDR_SIZE;
+	uchar *pkt = (uchar *)ip + IP_UDP_HDR_SIZE;
+	int len = SB_FB_HDR_SIZE;
+	bool corrupt = false;
+	unsigned sum;
+
+	if (sb_fb.state == SB_FB_STATE_DONE)
+		return;
+	if (sb_fb.waiting)
+		sb_fb.resends++;
+	sb_fb.waiting = true;
+
+	pkt[0] = SB_FB_FASTBOOT;
+	pkt[1] = 0;
+	put_unaligned_be16(sb_fb.seq, pkt + 2);
+	switch (sb_fb.state) {
+	case SB_FB_STATE_QUERY:
+		pkt[0] = SB_FB_QUERY;
+		break;
+	case SB_FB_STATE_INIT:
+		pkt[0] = SB_FB_INIT;
+		/* Version, and the largest packet the host takes */
+		put_unaligned_be16(1, pkt + len);
+		put_unaligned_be16(2048, pkt + len + 2);
+		len += 4;
+		break;
+	case SB_FB_STATE_COMMAND:
+		strcpy((char *)pkt + len, sb_fb.cmds[sb_fb.cmd]);
+		len += strlen(sb_fb.cmds[sb_fb.cmd]);
+		break;
+	case SB_FB_STATE_DATA:
+		sb_fb.len = min(sb_fb.max_data, sb_fb.size - sb_fb.pos);
+		memcpy(pkt + len, sb_fb.data + sb_fb.pos, sb_fb.len);
+		len += sb_fb.len;
+		if (sb_fb.data_pkts == sb_fb.corrupt) {
+			sb_fb.corrupt = -1;
+			corrupt = true;
+		}
+		break;
+	default:
+		break;
+	}
+
+	memcpy(eth->et_dest, pdata->enetaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+	net_set_udp_header((uchar *)ip, net_ip, SB_FB_PORT, SB_FB_HOST_PORT,
+			   len);
+	net_write_ip((void *)&ip->ip_src, string_to_ip(SB_FB_HOST_IP));
+	ip->ip_sum = 0;
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+	sum = sb_eth_l4_checksum((struct ip_hdr *)ip, &ip->udp_src,
+				 UDP_HDR_SIZE + len);
+	ip->udp_xsum = sum ? sum : 0xffff;
+	/* Flip a bit after the checksum, as a corrupt link would */
+	if (corrupt)
+		pkt[SB_FB_HDR_SIZE] ^= 1;
+
+	priv->recv_packet_length = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+}
+
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
 
 	debug("eth_sandbox: Start\n");
+	starts++;
 
 	fdtdec_get_byte_array(gd->fdt_blob, dev_of_offset(dev),
 			      "fake-host-hwaddr", priv->fake_host_hwaddr,
 			      ARP_HLEN);
+	priv->recv_buf = 0;
 	priv->recv_packet_buffer = net_rx_packets[0];
 	return 0;
 }
@@ -85,6 +925,7 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 			struct ethernet_hdr *eth_recv;
 			struct arp_hdr *arp_recv;
 
+			arp_requests++;
 			/* store this as the assumed IP of the fake host */
 			priv->fake_host_ipaddr = net_read_ip(&arp->ar_tpa);
 			/* Formulate a fake response */
@@ -134,9 +975,12 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 				       ARP_HLEN);
 				ipr->ip_sum = 0;
 				ipr->ip_off = 0;
+				/*
+				 * reply from the address that was pinged, as
+				 * it need not have been looked up with ARP
+				 */
 				net_copy_ip((void *)&ipr->ip_dst, &ip->ip_src);
-				net_write_ip((void *)&ipr->ip_src,
-					     priv->fake_host_ipaddr);
+				net_copy_ip((void *)&ipr->ip_src, &ip->ip_dst);
 				ipr->ip_sum = compute_ip_checksum(ipr,
 					IP_HDR_SIZE);
 
@@ -147,6 +991,12 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 
 				priv->recv_packet_length = length;
 			}
+		} else if (ip->ip_p == IPPROTO_UDP && sb_tftp.data) {
+			sb_eth_tftp_handle(priv, packet);
+		} else if (ip->ip_p == IPPROTO_UDP && sb_fb.cmds) {
+			sb_eth_fastboot_handle(packet);
+		} else if (ip->ip_p == IPPROTO_TCP && sb_http.data) {
+			sb_eth_http_handle(priv, packet);
 		}
 	}
 
@@ -162,6 +1012,13 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 		skip_timeout = false;
 	}
 
+	if (!priv->recv_packet_length)
+		sb_eth_tftp_send_data(priv);
+	if (!priv->recv_packet_length && sb_http.data)
+		sb_eth_http_send_data(priv);
+	if (!priv->recv_packet_length && sb_fb.cmds)
+		sb_eth_fastboot_send(dev);
+
 	if (priv->recv_packet_length) {
 		int lcl_recv_packet_length = priv->recv_packet_length;
 
@@ -174,6 +1031,44 @@ static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 	return 0;
 }
 
+static int sb_eth_recv_batch(struct udevice *dev, int flags, uchar **packets,
+			     int *lengths, int max)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int count = 0;
+	int len;
+
+	/* Keep one buffer free for the replies to the packets handed over */
+	if (rx_batch)
+		max = min(max, min(rx_batch, PKTBUFSRX - 1));
+	else
+		max = min(max, 1);
+
+	while (count < max) {
+		len = sb_eth_recv(dev, flags, &packets[count]);
+		if (len <= 0)
+			break;
+		lengths[count++] = len;
+		if (rx_batch) {
+			priv->recv_buf = (priv->recv_buf + 1) % PKTBUFSRX;
+			priv->recv_packet_buffer =
+				net_rx_packets[priv->recv_buf];
+		}
+	}
+
+	rx_held += count;
+	rx_held_max = max(rx_held_max, rx_held);
+
+	return count;
+}
+
+static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
+{
+	rx_held--;
+
+	return 0;
+}
+
 static void sb_eth_stop(struct udevice *dev)
 {
 	debug("eth_sandbox: Stop\n");
@@ -192,6 +1087,8 @@ static const struct eth_ops sb_eth_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
+	.recv_batch		= sb_eth_recv_batch,
+	.free_pkt		= sb_eth_free_pkt,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
 };
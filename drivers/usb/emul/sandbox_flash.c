@@ -10,19 +10,29 @@
 #include <os.h>
 #include <scsi.h>
 #include <usb.h>
+#include <asm/unaligned.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
 /*
  * This driver emulates a flash stick using the UFI command specification and
  * the BBB (bulk/bulk/bulk) protocol. It supports only a single logical unit
- * number (LUN 0).
+ * number (LUN 0). With the "sandbox,uas" property it also offers USB Attached
+ * SCSI in alternate setting 1, where it queues up to SANDBOX_FLASH_UAS_CMDS
+ * commands and runs them in order. With "sandbox,capacity" (two cells, in
+ * blocks) it reports that size rather than the size of its file, and blocks
+ * past the end of the file read as zeroes.
  */
 
 enum {
 	SANDBOX_FLASH_EP_OUT		= 1,	/* endpoints */
 	SANDBOX_FLASH_EP_IN		= 2,
+	SANDBOX_FLASH_EP_CMD		= 1,	/* UAS endpoints */
+	SANDBOX_FLASH_EP_STATUS		= 2,
+	SANDBOX_FLASH_EP_DATA_IN	= 3,
+	SANDBOX_FLASH_EP_DATA_OUT	= 4,
 	SANDBOX_FLASH_BLOCK_LEN		= 512,
+	SANDBOX_FLASH_UAS_CMDS		= 8,
 };
 
 enum cmd_phase {
@@ -46,18 +56,24 @@ enum {
  * @alloc_len:	Allocation length from the last incoming command
  * @transfer_len: Transfer length from CBW header
  * @read_len:	Number of blocks of data left in the current read command
+ * @read_pos:	Offset in the file of the next data to read
  * @tag:	Tag value from last command
  * @fd:		File descriptor of backing file
  * @file_size:	Size of file in bytes
  * @status_buff:	Data buffer for outgoing status
  * @buff_used:	Number of bytes ready to transfer back to host
  * @buff:	Data buffer for outgoing data
+ * @alt:	Alternate setting selected by the host (1 for UAS)
+ * @uas_cmd:	Queued UAS command IUs, the oldest first
+ * @uas_count:	Number of queued UAS commands
+ * @uas_ok:	true if the oldest UAS command has run and can move data
  */
 struct sandbox_flash_priv {
 	bool error;
 	int alloc_len;
 	int transfer_len;
 	int read_len;
+	loff_t read_pos;
 	enum cmd_phase phase;
 	u32 tag;
 	int fd;
@@ -65,10 +81,16 @@ struct sandbox_flash_priv {
 	struct umass_bbb_csw status;
 	int buff_used;
 	u8 buff[512];
+	int alt;
+	struct uas_command_iu uas_cmd[SANDBOX_FLASH_UAS_CMDS];
+	int uas_count;
+	bool uas_ok;
 };
 
 struct sandbox_flash_plat {
 	const char *pathname;
+	bool uas;
+	u64 capacity;
 	struct usb_string flash_strings[STRINGID_COUNT];
 };
 
@@ -170,6 +192,116 @@ static void *flash_desc_list[] = {
 	NULL,
 };
 
+/* The UAS descriptors need their own configuration for wTotalLength */
+static struct usb_config_descriptor flash_uas_config0 = {
+	.bLength		= sizeof(flash_uas_config0),
+	.bDescriptorType	= USB_DT_CONFIG,
+
+	/* wTotalLength is set up by usb-emul-uclass */
+	.bNumInterfaces		= 1,
+	.bConfigurationValue	= 0,
+	.iConfiguration		= 0,
+	.bmAttributes		= 1 << 7,
+	.bMaxPower		= 50,
+};
+
+static struct usb_interface_descriptor flash_interface0_uas = {
+	.bLength		= sizeof(flash_interface0_uas),
+	.bDescriptorType	= USB_DT_INTERFACE,
+
+	.bInterfaceNumber	= 0,
+	.bAlternateSetting	= 1,
+	.bNumEndpoints		= 4,
+	.bInterfaceClass	= USB_CLASS_MASS_STORAGE,
+	.bInterfaceSubClass	= US_SC_SCSI,
+	.bInterfaceProtocol	= US_PR_UAS,
+	.iInterface		= 0,
+};
+
+static struct usb_endpoint_descriptor flash_uas_endpoint_cmd = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_CMD,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_pipe_cmd = {
+	.bLength		= sizeof(flash_uas_pipe_cmd),
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_PIPE_COMMAND,
+};
+
+static struct usb_endpoint_descriptor flash_uas_endpoint_status = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_STATUS |
+				  USB_ENDPOINT_DIR_MASK,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_pipe_status = {
+	.bLength		= sizeof(flash_uas_pipe_status),
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_PIPE_STATUS,
+};
+
+static struct usb_endpoint_descriptor flash_uas_endpoint_data_in = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_DATA_IN |
+				  USB_ENDPOINT_DIR_MASK,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_pipe_data_in = {
+	.bLength		= sizeof(flash_uas_pipe_data_in),
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_PIPE_DATA_IN,
+};
+
+static struct usb_endpoint_descriptor flash_uas_endpoint_data_out = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_DATA_OUT,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_pipe_data_out = {
+	.bLength		= sizeof(flash_uas_pipe_data_out),
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_PIPE_DATA_OUT,
+};
+
+static void *flash_uas_desc_list[] = {
+	&flash_device_desc,
+	&flash_uas_config0,
+	&flash_interface0,
+	&flash_endpoint0_out,
+	&flash_endpoint1_in,
+	&flash_interface0_uas,
+	&flash_uas_endpoint_cmd,
+	&flash_uas_pipe_cmd,
+	&flash_uas_endpoint_status,
+	&flash_uas_pipe_status,
+	&flash_uas_endpoint_data_in,
+	&flash_uas_pipe_data_in,
+	&flash_uas_endpoint_data_out,
+	&flash_uas_pipe_data_out,
+	NULL,
+};
+
 static int sandbox_flash_control(struct udevice *dev, struct usb_device *udev,
 				 unsigned long pipe, void *buff, int len,
 				 struct devrequest *setup)
@@ -180,6 +312,7 @@ static int sandbox_flash_control(struct udevice *dev, struct usb_device *udev,
 		switch (setup->request) {
 		case US_BBB_RESET:
 			priv->error = false;
+			priv->phase = PHASE_START;
 			return 0;
 		case US_BBB_GET_MAX_LUN:
 			*(char *)buff = '\0';
@@ -188,6 +321,12 @@ static int sandbox_flash_control(struct udevice *dev, struct usb_device *udev,
 			debug("request=%x\n", setup->request);
 			break;
 		}
+	} else if (pipe == usb_sndctrlpipe(udev, 0) &&
+		   setup->request == USB_REQ_SET_INTERFACE) {
+		priv->alt = setup->value;
+		priv->uas_count = 0;
+		priv->uas_ok = false;
+		return 0;
 	}
 	debug("pipe=%lx\n", pipe);
 
@@ -226,12 +365,23 @@ static void setup_response(struct sandbox_flash_priv *priv, void *resp,
 	priv->buff_used = size;
 }
 
-static void handle_read(struct sandbox_flash_priv *priv, ulong lba,
+/* Number of blocks on the device */
+static u64 sandbox_flash_blocks(struct sandbox_flash_plat *plat,
+				struct sandbox_flash_priv *priv)
+{
+	if (plat->capacity)
+		return plat->capacity;
+
+	return priv->file_size / SANDBOX_FLASH_BLOCK_LEN;
+}
+
+static void handle_read(struct sandbox_flash_priv *priv, u64 lba,
 			ulong transfer_len)
 {
-	debug("%s: lba=%lx, transfer_len=%lx\n", __func__, lba, transfer_len);
+	debug("%s: lba=%llx, transfer_len=%lx\n", __func__, lba, transfer_len);
 	if (priv->fd != -1) {
-		os_lseek(priv->fd, lba * SANDBOX_FLASH_BLOCK_LEN, OS_SEEK_SET);
+		priv->read_pos = lba * SANDBOX_FLASH_BLOCK_LEN;
+		os_lseek(priv->fd, priv->read_pos, OS_SEEK_SET);
 		priv->read_len = transfer_len;
 		setup_response(priv, priv->buff,
 			       transfer_len * SANDBOX_FLASH_BLOCK_LEN);
@@ -269,17 +419,25 @@ static int handle_ufi_command(struct sandbox_flash_plat *plat,
 		break;
 	case SCSI_RD_CAPAC: {
 		struct scsi_read_capacity_resp *resp = (void *)priv->buff;
-		uint blocks;
+		u64 blocks = sandbox_flash_blocks(plat, priv);
 
-		if (priv->file_size)
-			blocks = priv->file_size / SANDBOX_FLASH_BLOCK_LEN - 1;
-		else
-			blocks = 0;
+		/* The last block, or 0xffffffff to ask for READ CAPACITY(16) */
+		blocks = blocks ? min(blocks - 1, (u64)0xffffffff) : 0;
 		resp->last_block_addr = cpu_to_be32(blocks);
 		resp->block_len = cpu_to_be32(SANDBOX_FLASH_BLOCK_LEN);
 		setup_response(priv, resp, sizeof(*resp));
 		break;
 	}
+	case SCSI_RD_CAPAC16: {
+		u64 blocks = sandbox_flash_blocks(plat, priv);
+
+		priv->alloc_len = get_unaligned_be32(&req->cmd[10]);
+		memset(priv->buff, '\0', 32);
+		put_unaligned_be64(blocks ? blocks - 1 : 0, priv->buff);
+		put_unaligned_be32(SANDBOX_FLASH_BLOCK_LEN, priv->buff + 8);
+		setup_response(priv, priv->buff, 32);
+		break;
+	}
 	case SCSI_READ10: {
 		struct scsi_read10_req *req = (void *)buff;
 
@@ -287,6 +445,10 @@ static int handle_ufi_command(struct sandbox_flash_plat *plat,
 			    be16_to_cpu(req->transfer_len));
 		break;
 	}
+	case SCSI_READ16:
+		handle_read(priv, get_unaligned_be64(&req->cmd[2]),
+			    get_unaligned_be32(&req->cmd[10]));
+		break;
 	default:
 		debug("Command not supported: %x\n", req->cmd[0]);
 		return -EPROTONOSUPPORT;
@@ -296,6 +458,101 @@ static int handle_ufi_command(struct sandbox_flash_plat *plat,
 	return 0;
 }
 
+/* Send back data for the current command */
+static int handle_data_in(struct sandbox_flash_priv *priv, void *buff, int len)
+{
+	debug("data in, len=%x, alloc_len=%x, priv->read_len=%x\n",
+	      len, priv->alloc_len, priv->read_len);
+	if (priv->read_len) {
+		loff_t bytes = priv->file_size - priv->read_pos;
+
+		bytes = max(min(bytes, (loff_t)len), (loff_t)0);
+		if (bytes && os_read(priv->fd, buff, bytes) != bytes)
+			return -EIO;
+		memset(buff + bytes, '\0', len - bytes);
+		priv->read_pos += len;
+		priv->read_len -= len / SANDBOX_FLASH_BLOCK_LEN;
+		if (!priv->read_len)
+			priv->phase = PHASE_STATUS;
+	} else {
+		if (priv->alloc_len && len > priv->alloc_len)
+			len = priv->alloc_len;
+		memcpy(buff, priv->buff, len);
+		priv->phase = PHASE_STATUS;
+	}
+
+	return len;
+}
+
+/*
+ * Answer a read of the UAS status pipe. The oldest queued command is run
+ * first; if it has data the host is told it can read it, otherwise (or once
+ * that is done) the command ends with a sense IU.
+ */
+static int handle_uas_status(struct sandbox_flash_plat *plat,
+			     struct sandbox_flash_priv *priv, void *buff,
+			     int len)
+{
+	struct uas_command_iu *cmd = &priv->uas_cmd[0];
+	struct uas_sense_iu *iu = buff;
+	bool failed = false;
+
+	if (!priv->uas_count || len < UAS_SENSE_IU_SIZE)
+		return -EIO;
+	memset(iu, '\0', UAS_SENSE_IU_SIZE);
+	iu->wTag = cmd->wTag;
+
+	if (!priv->uas_ok) {
+		priv->alloc_len = 0;
+		priv->read_len = 0;
+		priv->buff_used = 0;
+		priv->transfer_len = 0;
+		priv->tag = be16_to_cpu(cmd->wTag);
+		failed = handle_ufi_command(plat, priv, cmd->CDB,
+					    sizeof(cmd->CDB)) ||
+			 priv->status.bCSWStatus != CSWSTATUS_GOOD;
+		if (!failed && (priv->read_len || priv->buff_used)) {
+			priv->uas_ok = true;
+			priv->phase = PHASE_DATA;
+			iu->bIUID = UAS_IU_READ_READY;
+			return UAS_READY_IU_SIZE;
+		}
+	}
+
+	iu->bIUID = UAS_IU_SENSE;
+	iu->bStatus = failed ? 2 : 0;	/* CHECK CONDITION or GOOD */
+	priv->uas_ok = false;
+	priv->uas_count--;
+	memmove(&priv->uas_cmd[0], &priv->uas_cmd[1],
+		priv->uas_count * sizeof(*cmd));
+
+	return UAS_SENSE_IU_SIZE;
+}
+
+static int sandbox_flash_uas_bulk(struct sandbox_flash_plat *plat,
+				  struct sandbox_flash_priv *priv, int ep,
+				  void *buff, int len)
+{
+	struct uas_command_iu *cmd = buff;
+
+	switch (ep) {
+	case SANDBOX_FLASH_EP_CMD:
+		if (len != sizeof(*cmd) || cmd->bIUID != UAS_IU_COMMAND ||
+		    priv->uas_count == SANDBOX_FLASH_UAS_CMDS)
+			return -EIO;
+		memcpy(&priv->uas_cmd[priv->uas_count++], cmd, len);
+		return len;
+	case SANDBOX_FLASH_EP_STATUS:
+		return handle_uas_status(plat, priv, buff, len);
+	case SANDBOX_FLASH_EP_DATA_IN:
+		if (!priv->uas_ok || priv->phase != PHASE_DATA)
+			return -EIO;
+		return handle_data_in(priv, buff, len);
+	default:
+		return -EIO;
+	}
+}
+
 static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 			      unsigned long pipe, void *buff, int len)
 {
@@ -303,9 +560,12 @@ static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 	struct sandbox_flash_priv *priv = dev_get_priv(dev);
 	int ep = usb_pipeendpoint(pipe);
 	struct umass_bbb_cbw *cbw = buff;
+	int ret;
 
 	debug("%s: dev=%s, pipe=%lx, ep=%x, len=%x, phase=%d\n", __func__,
 	      dev->name, pipe, ep, len, priv->phase);
+	if (priv->alt)
+		return sandbox_flash_uas_bulk(plat, priv, ep, buff, len);
 	switch (ep) {
 	case SANDBOX_FLASH_EP_OUT:
 		switch (priv->phase) {
@@ -318,12 +578,18 @@ static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 			if ((cbw->bCBWFlags & CBWFLAGS_SBZ) ||
 			    cbw->bCBWLUN != 0)
 				goto err;
-			if (cbw->bCDBLength < 1 || cbw->bCDBLength >= 0x10)
+			if (cbw->bCDBLength < 1 || cbw->bCDBLength > 0x10)
 				goto err;
 			priv->transfer_len = cbw->dCBWDataTransferLength;
 			priv->tag = cbw->dCBWTag;
-			return handle_ufi_command(plat, priv, cbw->CBWCDB,
-						  cbw->bCDBLength);
+			ret = handle_ufi_command(plat, priv, cbw->CBWCDB,
+						 cbw->bCDBLength);
+			/* Data for the host needs a data-in CBW */
+			if (!ret && priv->transfer_len &&
+			    (priv->read_len || priv->buff_used) &&
+			    !(cbw->bCBWFlags & CBWFLAGS_IN))
+				goto err;
+			return ret;
 		case PHASE_DATA:
 			debug("data out\n");
 			break;
@@ -333,24 +599,7 @@ static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 	case SANDBOX_FLASH_EP_IN:
 		switch (priv->phase) {
 		case PHASE_DATA:
-			debug("data in, len=%x, alloc_len=%x, priv->read_len=%x\n",
-			      len, priv->alloc_len, priv->read_len);
-			if (priv->read_len) {
-				ulong bytes_read;
-
-				bytes_read = os_read(priv->fd, buff, len);
-				if (bytes_read != len)
-					return -EIO;
-				priv->read_len -= len / SANDBOX_FLASH_BLOCK_LEN;
-				if (!priv->read_len)
-					priv->phase = PHASE_STATUS;
-			} else {
-				if (priv->alloc_len && len > priv->alloc_len)
-					len = priv->alloc_len;
-				memcpy(buff, priv->buff, len);
-				priv->phase = PHASE_STATUS;
-			}
-			return len;
+			return handle_data_in(priv, buff, len);
 		case PHASE_STATUS:
 			debug("status in, len=%x\n", len);
 			if (len > sizeof(priv->status))
@@ -372,7 +621,11 @@ static int sandbox_flash_ofdata_to_platdata(struct udevice *dev)
 {
 	struct sandbox_flash_plat *plat = dev_get_platdata(dev);
 
+	u32 cells[2];
+
 	plat->pathname = dev_read_string(dev, "sandbox,filepath");
+	if (!dev_read_u32_array(dev, "sandbox,capacity", cells, 2))
+		plat->capacity = (u64)cells[0] << 32 | cells[1];
 
 	return 0;
 }
@@ -389,8 +642,10 @@ static int sandbox_flash_bind(struct udevice *dev)
 	fs[1].s = "flash";
 	fs[2].id = STRINGID_SERIAL;
 	fs[2].s = dev->name;
+	plat->uas = dev_read_bool(dev, "sandbox,uas");
 
 	return usb_emul_setup_device(dev, PACKET_SIZE_64, plat->flash_strings,
+				     plat->uas ? flash_uas_desc_list :
 				     flash_desc_list);
 }
 
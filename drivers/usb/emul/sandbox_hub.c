@@ -8,6 +8,7 @@
 #include <common.h>
 #include <dm.h>
 #include <usb.h>
+#include <asm/test.h>
 #include <dm/device-internal.h>
 
 DECLARE_GLOBAL_DATA_PTR;
@@ -116,11 +117,106 @@ static void *hub_desc_list[] = {
 	NULL,
 };
 
+/**
+ * struct sandbox_hub_priv - state of an emulated hub
+ *
+ * status: status of each port (USB_PORT_STAT_...)
+ * change: changes of each port waiting to be cleared
+ * resets: number of port resets started
+ * overlaps: number of port resets started while another port on the same
+ *	controller was still being reset
+ */
 struct sandbox_hub_priv {
 	int status[SANDBOX_NUM_PORTS];
 	int change[SANDBOX_NUM_PORTS];
+	int resets;
+	int overlaps;
 };
 
+/* Find the controller an emulator is on */
+static struct udevice *sandbox_hub_get_bus(struct udevice *dev)
+{
+	while (dev && device_get_uclass_id(dev) != UCLASS_USB)
+		dev = dev->parent;
+
+	return dev;
+}
+
+/*
+ * Call @func for each active emulated hub on @bus, stopping if it returns
+ * non-zero, which is then returned
+ */
+static int sandbox_hub_for_each(struct udevice *bus,
+				int (*func)(struct sandbox_hub_priv *priv,
+					    void *data),
+				void *data)
+{
+	struct udevice *dev;
+	struct uclass *uc;
+	int ret;
+
+	ret = uclass_get(UCLASS_USB_EMUL, &uc);
+	if (ret)
+		return ret;
+	uclass_foreach_dev(dev, uc) {
+		if (dev->driver != DM_GET_DRIVER(usb_sandbox_hub) ||
+		    !device_active(dev) || sandbox_hub_get_bus(dev) != bus)
+			continue;
+		ret = func(dev_get_priv(dev), data);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int sandbox_hub_check_resetting(struct sandbox_hub_priv *priv,
+				       void *data)
+{
+	int port;
+
+	for (port = 0; port < SANDBOX_NUM_PORTS; port++) {
+		if (priv->status[port] & USB_PORT_STAT_RESET)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int sandbox_hub_add_resets(struct sandbox_hub_priv *priv, void *data)
+{
+	int *counts = data;
+
+	counts[0] += priv->resets;
+	counts[1] += priv->overlaps;
+
+	return 0;
+}
+
+int sandbox_usb_hub_get_resets(struct udevice *bus, int *overlapsp)
+{
+	int counts[2] = { 0, 0 };
+	int ret;
+
+	ret = sandbox_hub_for_each(bus, sandbox_hub_add_resets, counts);
+	if (ret)
+		return ret;
+	*overlapsp = counts[1];
+
+	return counts[0];
+}
+
+/* Count a port reset, noting whether another one is still going on */
+static void sandbox_hub_start_reset(struct udevice *hub)
+{
+	struct sandbox_hub_priv *priv = dev_get_priv(hub);
+
+	priv->resets++;
+	if (sandbox_hub_for_each(sandbox_hub_get_bus(hub),
+				 sandbox_hub_check_resetting, NULL) > 0)
+		priv->overlaps++;
+}
+
 static struct udevice *hub_find_device(struct udevice *hub, int port)
 {
 	struct udevice *dev;
@@ -174,6 +270,23 @@ static int clrset_post_state(struct udevice *hub, int port, int clear, int set)
 	return ret;
 }
 
+/*
+ * A port reset disables the port until it completes, which is by the next
+ * time that the port status is read
+ */
+static void sandbox_hub_reset_done(struct udevice *hub, int port)
+{
+	struct sandbox_hub_priv *priv = dev_get_priv(hub);
+	int set = 0;
+
+	if (!(priv->status[port] & USB_PORT_STAT_RESET))
+		return;
+	if (priv->status[port] & USB_PORT_STAT_CONNECTION)
+		set = USB_PORT_STAT_ENABLE;
+	clrset_post_state(hub, port, USB_PORT_STAT_RESET, set);
+	priv->change[port] &= ~USB_PORT_STAT_C_ENABLE;
+}
+
 static int sandbox_hub_submit_control_msg(struct udevice *bus,
 					  struct usb_device *udev,
 					  unsigned long pipe,
@@ -209,6 +322,7 @@ static int sandbox_hub_submit_control_msg(struct udevice *bus,
 				int port;
 
 				port = (setup->index & USB_HUB_PORT_MASK) - 1;
+				sandbox_hub_reset_done(bus, port);
 				portsts->wPortStatus = priv->status[port];
 				portsts->wPortChange = priv->change[port];
 				udev->status = 0;
@@ -231,7 +345,13 @@ static int sandbox_hub_submit_control_msg(struct udevice *bus,
 				port = (setup->index & USB_HUB_PORT_MASK) - 1;
 				debug("set feature port=%x, feature=%x\n",
 				      port, setup->value);
-				if (setup->value < USB_PORT_FEAT_C_CONNECTION) {
+				if (setup->value == USB_PORT_FEAT_RESET) {
+					sandbox_hub_start_reset(bus);
+					ret = clrset_post_state(bus, port,
+							USB_PORT_STAT_ENABLE,
+							USB_PORT_STAT_RESET);
+				} else if (setup->value <
+					   USB_PORT_FEAT_C_CONNECTION) {
 					ret = clrset_post_state(bus, port, 0,
 							1 << setup->value);
 				} else {
@@ -249,8 +369,8 @@ static int sandbox_hub_submit_control_msg(struct udevice *bus,
 					ret = clrset_post_state(bus, port,
 							1 << setup->value, 0);
 				} else {
-					priv->change[port] &= 1 <<
-						(setup->value - 16);
+					priv->change[port] &= ~(1 <<
+						(setup->value - 16));
 				}
 				udev->status = 0;
 				return 0;
@@ -19,7 +19,6 @@
 #include <linux/usb/gadget.h>
 #include <linux/usb/composite.h>
 #include <linux/compiler.h>
-#include <version.h>
 #include <g_dnl.h>
 #ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
 #include <fb_mmc.h>
@@ -27,8 +26,10 @@
 #ifdef CONFIG_FASTBOOT_FLASH_NAND_DEV
 #include <fb_nand.h>
 #endif
-
-#define FASTBOOT_VERSION		"0.4"
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+#include <image-sparse.h>
+#include <linux/sizes.h>
+#endif
 
 #define FASTBOOT_INTERFACE_CLASS	0xff
 #define FASTBOOT_INTERFACE_SUB_CLASS	0x42
@@ -62,6 +63,26 @@ static struct f_fastboot *fastboot_func;
 static unsigned int download_size;
 static unsigned int download_bytes;
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+/*
+ * A streamed download gathers raw data at the start of the buffer, and keeps
+ * each received packet after that while the next one arrives
+ */
+#define FB_STREAM_BUF_SIZE	SZ_1M
+#define FB_STREAM_PKT_ADDR	(CONFIG_FASTBOOT_BUF_ADDR + FB_STREAM_BUF_SIZE)
+/* Largest sparse image rx_bytes_expected() can count down */
+#define FB_STREAM_MAX_DOWNLOAD	(SZ_2G - EP_BUFFER_SIZE)
+
+#if CONFIG_FASTBOOT_BUF_SIZE < FB_STREAM_BUF_SIZE + EP_BUFFER_SIZE
+#error "CONFIG_FASTBOOT_BUF_SIZE is too small for CONFIG_FASTBOOT_FLASH_STREAM"
+#endif
+
+static char stream_part[32 + 1];	/* Partition set by "oem stream" */
+static struct sparse_stream *stream;	/* Stream of the download, if any */
+static bool download_streamed;		/* Download was not kept in buffer */
+static char stream_response[FASTBOOT_RESPONSE_LEN];
+#endif
+
 static struct usb_endpoint_descriptor fs_ep_in = {
 	.bLength            = USB_DT_ENDPOINT_SIZE,
 	.bDescriptorType    = USB_DT_ENDPOINT,
@@ -150,21 +171,6 @@ static struct usb_gadget_strings *fastboot_strings[] = {
 static void rx_handler_command(struct usb_ep *ep, struct usb_request *req);
 static int strcmp_l1(const char *s1, const char *s2);
 
-
-static char *fb_response_str;
-
-void fastboot_fail(const char *reason)
-{
-	strncpy(fb_response_str, "FAIL\0", 5);
-	strncat(fb_response_str, reason, FASTBOOT_RESPONSE_LEN - 4 - 1);
-}
-
-void fastboot_okay(const char *reason)
-{
-	strncpy(fb_response_str, "OKAY\0", 5);
-	strncat(fb_response_str, reason, FASTBOOT_RESPONSE_LEN - 4 - 1);
-}
-
 static void fastboot_complete(struct usb_ep *ep, struct usb_request *req)
 {
 	int status = req->status;
@@ -373,11 +379,6 @@ static void compl_do_reset(struct usb_ep *ep, struct usb_request *req)
 	do_reset(NULL, 0, 0, NULL);
 }
 
-int __weak fb_set_reboot_flag(void)
-{
-	return -ENOSYS;
-}
-
 static void cb_reboot(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
@@ -402,11 +403,6 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
 	char response[FASTBOOT_RESPONSE_LEN];
-	const char *s;
-	size_t chars_left;
-
-	strcpy(response, "OKAY");
-	chars_left = sizeof(response) - strlen(response) - 1;
 
 	strsep(&cmd, ":");
 	if (!cmd) {
@@ -415,42 +411,10 @@ static void cb_getvar(struct usb_ep *ep, struct usb_request *req)
 		return;
 	}
 
-	if (!strcmp_l1("version", cmd)) {
-		strncat(response, FASTBOOT_VERSION, chars_left);
-	} else if (!strcmp_l1("bootloader-version", cmd)) {
-		strncat(response, U_BOOT_VERSION, chars_left);
-	} else if (!strcmp_l1("downloadsize", cmd) ||
-		!strcmp_l1("max-download-size", cmd)) {
-		char str_num[12];
-
-		sprintf(str_num, "0x%08x", CONFIG_FASTBOOT_BUF_SIZE);
-		strncat(response, str_num, chars_left);
-	} else if (!strcmp_l1("serialno", cmd)) {
-		s = getenv("serial#");
-		if (s)
-			strncat(response, s, chars_left);
-		else
-			strcpy(response, "FAILValue not set");
-	} else {
-		char *envstr;
-
-		envstr = malloc(strlen("fastboot.") + strlen(cmd) + 1);
-		if (!envstr) {
-			fastboot_tx_write_str("FAILmalloc error");
-			return;
-		}
-
-		sprintf(envstr, "fastboot.%s", cmd);
-		s = getenv(envstr);
-		if (s) {
-			strncat(response, s, chars_left);
-		} else {
-			printf("WARNING: unknown variable: %s\n", cmd);
-			strcpy(response, "FAILVariable not implemented");
-		}
+	/* initialize the response buffer */
+	fb_response_str = response;
 
-		free(envstr);
-	}
+	fastboot_getvar(cmd);
 	fastboot_tx_write_str(response);
 }
 
@@ -478,6 +442,57 @@ static unsigned int rx_bytes_expected(struct usb_ep *ep)
 	return rx_remain;
 }
 
+static bool download_fits(unsigned int size)
+{
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	/* Sparse images for "oem stream" need not fit in the buffer */
+	if (stream_part[0])
+		return size <= FB_STREAM_MAX_DOWNLOAD;
+#endif
+	return size <= CONFIG_FASTBOOT_BUF_SIZE;
+}
+
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+static void stream_download_start(const void *data, unsigned int len)
+{
+	download_streamed = false;
+	if (!stream_part[0])
+		return;
+
+	fb_response_str = stream_response;
+	fastboot_okay("");
+	if (len >= sizeof(sparse_header_t) && is_sparse_image((void *)data)) {
+		download_streamed = true;
+		stream = fb_mmc_stream_start(stream_part,
+					     (void *)CONFIG_FASTBOOT_BUF_ADDR,
+					     FB_STREAM_BUF_SIZE);
+	} else if (download_size > CONFIG_FASTBOOT_BUF_SIZE) {
+		/* Only sparse images are written as they arrive */
+		download_streamed = true;
+		fastboot_fail("data too large");
+	}
+}
+
+static void stream_download_write(const void *data, unsigned int len)
+{
+	if (stream) {
+		fb_response_str = stream_response;
+		sparse_stream_write(stream, data, len);
+	}
+}
+
+static void stream_download_finish(const void *data, unsigned int len,
+				   char *response)
+{
+	stream_download_write(data, len);
+	if (stream) {
+		sparse_stream_finish(stream);
+		stream = NULL;
+	}
+	strcpy(response, stream_response);
+}
+#endif
+
 #define BYTES_PER_DOT	0x20000
 static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 {
@@ -495,6 +510,15 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 	if (buffer_size < transfer_size)
 		transfer_size = buffer_size;
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	if (!download_bytes)
+		stream_download_start(buffer, transfer_size);
+	if (download_streamed) {
+		/* Keep the data, as the request is queued for the next */
+		memcpy((void *)FB_STREAM_PKT_ADDR, buffer, transfer_size);
+		buffer = (void *)FB_STREAM_PKT_ADDR;
+	} else
+#endif
 	memcpy((void *)CONFIG_FASTBOOT_BUF_ADDR + download_bytes,
 	       buffer, transfer_size);
 
@@ -519,6 +543,11 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 		req->length = EP_BUFFER_SIZE;
 
 		strcpy(response, "OKAY");
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+		if (download_streamed)
+			stream_download_finish(buffer, transfer_size,
+					       response);
+#endif
 		fastboot_tx_write_str(response);
 
 		printf("\ndownloading of %d bytes finished\n", download_bytes);
@@ -528,6 +557,12 @@ static void rx_handler_dl_image(struct usb_ep *ep, struct usb_request *req)
 
 	req->actual = 0;
 	usb_ep_queue(ep, req, 0);
+
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	/* Write the data while the controller receives the next */
+	if (download_streamed && download_size)
+		stream_download_write(buffer, transfer_size);
+#endif
 }
 
 static void cb_download(struct usb_ep *ep, struct usb_request *req)
@@ -543,7 +578,7 @@ static void cb_download(struct usb_ep *ep, struct usb_request *req)
 
 	if (0 == download_size) {
 		strcpy(response, "FAILdata invalid size");
-	} else if (download_size > CONFIG_FASTBOOT_BUF_SIZE) {
+	} else if (!download_fits(download_size)) {
 		download_size = 0;
 		strcpy(response, "FAILdata too large");
 	} else {
@@ -601,6 +636,18 @@ static void cb_flash(struct usb_ep *ep, struct usb_request *req)
 	/* initialize the response buffer */
 	fb_response_str = response;
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	if (download_streamed) {
+		/* The image was written while it was downloaded */
+		if (strcmp(cmd, stream_part))
+			fastboot_fail("image was streamed elsewhere");
+		else
+			strcpy(response, stream_response);
+		fastboot_tx_write_str(response);
+		return;
+	}
+#endif
+
 	fastboot_fail("no flash device defined");
 #ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
 	fb_mmc_flash_write(cmd, (void *)CONFIG_FASTBOOT_BUF_ADDR,
@@ -615,6 +662,26 @@ static void cb_flash(struct usb_ep *ep, struct usb_request *req)
 }
 #endif
 
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+static void cb_oem_stream(const char *part)
+{
+	while (*part == ' ')
+		part++;
+	if (strlen(part) >= sizeof(stream_part)) {
+		fastboot_tx_write_str("FAILpartition name too long");
+		return;
+	}
+
+	strcpy(stream_part, part);
+	download_streamed = false;
+	fastboot_set_max_download_size(*part ? FB_STREAM_MAX_DOWNLOAD : 0);
+	if (*part)
+		printf("Sparse images will be written to '%s' as they arrive\n",
+		       part);
+	fastboot_tx_write_str("OKAY");
+}
+#endif
+
 static void cb_oem(struct usb_ep *ep, struct usb_request *req)
 {
 	char *cmd = req->buf;
@@ -628,6 +695,11 @@ static void cb_oem(struct usb_ep *ep, struct usb_request *req)
                 else
 			fastboot_tx_write_str("OKAY");
 	} else
+#endif
+#ifdef CONFIG_FASTBOOT_FLASH_STREAM
+	if (strncmp("stream", cmd + 4, 6) == 0) {
+		cb_oem_stream(cmd + 10);
+	} else
 #endif
 	if (strncmp("unlock", cmd + 4, 8) == 0) {
 		fastboot_tx_write_str("FAILnot implemented");
@@ -704,13 +704,13 @@ static int do_read(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = &common->luns[common->lun];
 	u32			lba;
-	struct fsg_buffhd	*bh;
+	struct fsg_buffhd	*bh, *nbh;
 	int			rc;
 	u32			amount_left;
 	loff_t			file_offset;
 	unsigned int		amount;
 	unsigned int		partial_page;
-	ssize_t			nread;
+	ssize_t			nread, len;
 
 	/* Get the starting Logical Block Address and check that it's
 	 * not too big */
@@ -773,6 +773,16 @@ static int do_read(struct fsg_common *common)
 			break;
 		}
 
+		/* Read ahead into the empty buffers which follow this one in
+		 * memory, so that a single read fills all of them */
+		if (partial_page == 0) {
+			for (nbh = bh; amount < amount_left &&
+			     nbh->next->buf == nbh->buf + FSG_BUFLEN &&
+			     nbh->next->state == BUF_STATE_EMPTY;
+			     nbh = nbh->next)
+				amount = min(amount_left, amount + FSG_BUFLEN);
+		}
+
 		/* Perform the read */
 		rc = ums[common->lun].read_sector(&ums[common->lun],
 				      file_offset / SECTOR_SIZE,
@@ -799,7 +809,19 @@ static int do_read(struct fsg_common *common)
 		file_offset  += nread;
 		amount_left  -= nread;
 		common->residue -= nread;
-		bh->inreq->length = nread;
+
+		/* Send all but the last of the buffers just filled */
+		for (len = nread; len > FSG_BUFLEN; len -= FSG_BUFLEN) {
+			bh->inreq->length = FSG_BUFLEN;
+			bh->state = BUF_STATE_FULL;
+			bh->inreq->zero = 0;
+			START_TRANSFER_OR(common, bulk_in, bh->inreq,
+				       &bh->inreq_busy, &bh->state)
+				return -EIO;
+			bh = bh->next;
+			common->next_buffhd_to_fill = bh;
+		}
+		bh->inreq->length = len;
 		bh->state = BUF_STATE_FULL;
 
 		/* If an error occurred, report it and its position */
@@ -831,7 +853,7 @@ static int do_write(struct fsg_common *common)
 {
 	struct fsg_lun		*curlun = &common->luns[common->lun];
 	u32			lba;
-	struct fsg_buffhd	*bh;
+	struct fsg_buffhd	*bh, *last;
 	int			get_some_more;
 	u32			amount_left_to_req, amount_left_to_write;
 	loff_t			usb_offset, file_offset;
@@ -945,7 +967,20 @@ static int do_write(struct fsg_common *common)
 				break;
 			}
 
+			/* Write the full buffers which follow this one in
+			 * memory along with it. The remaining empty buffers
+			 * are already queued, so the host keeps sending
+			 * while the medium is written. */
 			amount = bh->outreq->actual;
+			for (last = bh; last->outreq->actual == FSG_BUFLEN &&
+			     last->next->buf == last->buf + FSG_BUFLEN &&
+			     last->next->state == BUF_STATE_FULL &&
+			     last->next->outreq->status == 0;
+			     last = last->next) {
+				last->next->state = BUF_STATE_EMPTY;
+				amount += last->next->outreq->actual;
+			}
+			common->next_buffhd_to_drain = last->next;
 
 			/* Perform the write */
 			rc = ums[common->lun].write_sector(&ums[common->lun],
@@ -984,7 +1019,7 @@ static int do_write(struct fsg_common *common)
 			}
 
 			/* Did the host decide to stop early? */
-			if (bh->outreq->actual != bh->outreq->length) {
+			if (last->outreq->actual != last->outreq->length) {
 				common->short_packet_received = 1;
 				break;
 			}
@@ -2460,6 +2495,7 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	struct fsg_buffhd *bh;
 	struct fsg_lun *curlun;
 	int nluns, i, rc;
+	char *buf;
 
 	/* Find out how many LUNs there should be */
 	nluns = ums_count;
@@ -2514,8 +2550,17 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 	}
 	common->lun = 0;
 
-	/* Data buffers cyclic list */
+	/*
+	 * Data buffers cyclic list. The buffers are allocated in one piece
+	 * so that neighbouring ones can be read or written together.
+	 */
 	bh = common->buffhds;
+	buf = memalign(CONFIG_SYS_CACHELINE_SIZE,
+		       FSG_NUM_BUFFERS * FSG_BUFLEN);
+	if (unlikely(!buf)) {
+		rc = -ENOMEM;
+		goto error_release;
+	}
 
 	i = FSG_NUM_BUFFERS;
 	goto buffhds_first_it;
@@ -2525,11 +2570,8 @@ static struct fsg_common *fsg_common_init(struct fsg_common *common,
 buffhds_first_it:
 		bh->inreq_busy = 0;
 		bh->outreq_busy = 0;
-		bh->buf = memalign(CONFIG_SYS_CACHELINE_SIZE, FSG_BUFLEN);
-		if (unlikely(!bh->buf)) {
-			rc = -ENOMEM;
-			goto error_release;
-		}
+		bh->buf = buf;
+		buf += FSG_BUFLEN;
 	} while (--i);
 	bh->next = common->buffhds;
 
@@ -2591,13 +2633,8 @@ static void fsg_common_release(struct kref *ref)
 		kfree(common->luns);
 	}
 
-	{
-		struct fsg_buffhd *bh = common->buffhds;
-		unsigned i = FSG_NUM_BUFFERS;
-		do {
-			kfree(bh->buf);
-		} while (++bh, --i);
-	}
+	/* The first buffer holds the allocation for all of them */
+	kfree(common->buffhds[0].buf);
 
 	if (common->free_storage_on_release)
 		kfree(common);
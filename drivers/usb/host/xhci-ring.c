@@ -543,85 +543,44 @@ static void record_transfer_result(struct usb_device *udev,
 }
 
 /**** Bulk and Control transfer methods ****/
+
+/*
+ * A bulk transfer is queued as a single TD, but it is handed to the
+ * controller XHCI_BULK_CHUNK_TRBS TRBs at a time, with an interrupt at the
+ * end of each chunk. Up to XHCI_BULK_CHUNKS chunks are in flight, so that
+ * the controller goes on with the next one while the completion of the last
+ * one is handled, and the size of a transfer is not limited by the size of
+ * the ring. Since it is one TD, a short packet still ends the whole transfer.
+ */
+#define XHCI_BULK_CHUNK_TRBS	16
+#define XHCI_BULK_CHUNKS	3
+
 /**
- * Queues up the BULK Request
+ * Queues up the next chunk of a BULK Request and rings the doorbell
  *
  * @param udev		pointer to the USB device structure
  * @param pipe		contains the DIR_IN or OUT , devnum
- * @param length	length of the buffer
- * @param buffer	buffer to be read/written based on the request
- * @return returns 0 if successful else -1 on failure
+ * @param ring		transfer ring of the endpoint
+ * @param buffer	address of the buffer
+ * @param queued	number of bytes queued before this chunk
+ * @param length	length of the whole transfer
+ * @return number of bytes in the chunk
  */
-int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
-			int length, void *buffer)
+static int xhci_queue_bulk_chunk(struct usb_device *udev, unsigned long pipe,
+				 struct xhci_ring *ring, u64 buffer,
+				 int queued, int length)
 {
-	int num_trbs = 0;
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
 	struct xhci_generic_trb *start_trb;
-	bool first_trb = 0;
 	int start_cycle;
-	u32 field = 0;
-	u32 length_field = 0;
-	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
-	int slot_id = udev->slot_id;
-	int ep_index;
-	struct xhci_virt_device *virt_dev;
-	struct xhci_ep_ctx *ep_ctx;
-	struct xhci_ring *ring;		/* EP transfer ring */
-	union xhci_trb *event;
-
+	u32 field, remainder;
 	int running_total, trb_buff_len;
 	unsigned int total_packet_count;
 	int maxpacketsize;
+	bool last = false;
 	u64 addr;
-	int ret;
 	u32 trb_fields[4];
-	u64 val_64 = (uintptr_t)buffer;
-
-	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
-		udev, pipe, buffer, length);
-
-	ep_index = usb_pipe_ep_index(pipe);
-	virt_dev = ctrl->devs[slot_id];
-
-	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
-			 virt_dev->out_ctx->size);
-
-	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
-
-	ring = virt_dev->eps[ep_index].ring;
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
-	running_total = TRB_MAX_BUFF_SIZE -
-			(lower_32_bits(val_64) & (TRB_MAX_BUFF_SIZE - 1));
-	trb_buff_len = running_total;
-	running_total &= TRB_MAX_BUFF_SIZE - 1;
-
-	/*
-	 * If there's some data on this 64KB chunk, or we have to send a
-	 * zero-length transfer, we need at least one TRB
-	 */
-	if (running_total != 0 || length == 0)
-		num_trbs++;
-
-	/* How many more 64KB chunks to transfer, how many more TRBs? */
-	while (running_total < length) {
-		num_trbs++;
-		running_total += TRB_MAX_BUFF_SIZE;
-	}
-
-	/*
-	 * XXX: Calling routine prepare_ring() called in place of
-	 * prepare_trasfer() as there in 'Linux' since we are not
-	 * maintaining multiple TDs/transfer at the same time.
-	 */
-	ret = prepare_ring(ctrl, ring,
-			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
-	if (ret < 0)
-		return ret;
+	int i;
 
 	/*
 	 * Don't give the first TRB to the hardware (by toggling the cycle bit)
@@ -631,48 +590,38 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	start_trb = &ring->enqueue->generic;
 	start_cycle = ring->cycle_state;
 
-	running_total = 0;
 	maxpacketsize = usb_maxpacket(udev, pipe);
-
 	total_packet_count = DIV_ROUND_UP(length, maxpacketsize);
 
-	/* How much data is in the first TRB? */
-	/*
-	 * How much data is (potentially) left before the 64KB boundary?
-	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
-	 * that the buffer should not span 64KB boundary. if so
-	 * we send request in more than 1 TRB by chaining them.
-	 */
-	addr = val_64;
-
-	if (trb_buff_len > length)
-		trb_buff_len = length;
-
-	first_trb = true;
-
-	/* flush the buffer before use */
-	xhci_flush_cache((uintptr_t)buffer, length);
+	running_total = queued;
+	addr = buffer + queued;
 
 	/* Queue the first TRB, even if it's zero-length */
-	do {
-		u32 remainder = 0;
-		field = 0;
+	for (i = 0; i < XHCI_BULK_CHUNK_TRBS && !last; i++) {
+		/*
+		 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of
+		 * XHCI Spec) that the buffer should not span 64KB boundary.
+		 * if so we send request in more than 1 TRB by chaining them.
+		 */
+		trb_buff_len = TRB_MAX_BUFF_SIZE -
+			(lower_32_bits(addr) & (TRB_MAX_BUFF_SIZE - 1));
+		trb_buff_len = min(length - running_total, trb_buff_len);
+		last = running_total + trb_buff_len == length;
+
 		/* Don't change the cycle bit of the first TRB until later */
-		if (first_trb) {
-			first_trb = false;
-			if (start_cycle == 0)
-				field |= TRB_CYCLE;
-		} else {
-			field |= ring->cycle_state;
-		}
+		if (i == 0)
+			field = start_cycle ? 0 : TRB_CYCLE;
+		else
+			field = ring->cycle_state;
 
 		/*
 		 * Chain all the TRBs together; clear the chain bit in the last
-		 * TRB to indicate it's the last TRB in the chain.
+		 * TRB to indicate it's the last TRB in the chain. The last TRB
+		 * of each chunk interrupts, so that the next can be queued.
 		 */
-		if (num_trbs > 1)
+		if (!last)
 			field |= TRB_CHAIN;
-		else
+		if (last || i == XHCI_BULK_CHUNK_TRBS - 1)
 			field |= TRB_IOC;
 
 		/* Only set interrupt on short packet for IN endpoints */
@@ -687,48 +636,155 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 							   trb_buff_len,
 							   total_packet_count,
 							   maxpacketsize,
-							   num_trbs - 1);
-
-		length_field = ((trb_buff_len & TRB_LEN_MASK) |
-				remainder |
-				((0 & TRB_INTR_TARGET_MASK) <<
-				TRB_INTR_TARGET_SHIFT));
+							   !last);
 
 		trb_fields[0] = lower_32_bits(addr);
 		trb_fields[1] = upper_32_bits(addr);
-		trb_fields[2] = length_field;
+		trb_fields[2] = (trb_buff_len & TRB_LEN_MASK) | remainder |
+				((0 & TRB_INTR_TARGET_MASK) <<
+				TRB_INTR_TARGET_SHIFT);
 		trb_fields[3] = field | (TRB_NORMAL << TRB_TYPE_SHIFT);
 
-		queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
-
-		--num_trbs;
+		queue_trb(ctrl, ring, !last, trb_fields);
 
 		running_total += trb_buff_len;
-
-		/* Calculate length for next transfer */
 		addr += trb_buff_len;
-		trb_buff_len = min((length - running_total), TRB_MAX_BUFF_SIZE);
-	} while (running_total < length);
+	}
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+	giveback_first_trb(udev, usb_pipe_ep_index(pipe), start_cycle,
+			   start_trb);
 
-	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
-	if (!event) {
-		debug("XHCI bulk transfer timed out, aborting...\n");
-		abort_td(udev, ep_index);
-		udev->status = USB_ST_NAK_REC;  /* closest thing to a timeout */
-		udev->act_len = 0;
-		return -ETIMEDOUT;
-	}
-	field = le32_to_cpu(event->trans_event.flags);
+	return running_total - queued;
+}
 
-	BUG_ON(TRB_TO_SLOT_ID(field) != slot_id);
-	BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
-	BUG_ON(*(void **)(uintptr_t)le64_to_cpu(event->trans_event.buffer) -
-		buffer > (size_t)length);
+/**
+ * Works out how much of a chunk was transferred from its transfer event.
+ * After a short packet the event is for the TRB the packet ended in, which
+ * need not be the last one of the chunk.
+ *
+ * @param event		transfer event for the chunk
+ * @param start		address of the start of the chunk
+ * @param length	length of the chunk
+ * @return number of bytes transferred
+ */
+static int xhci_bulk_chunk_len(union xhci_trb *event, u64 start, int length)
+{
+	struct xhci_generic_trb *trb;
+	u64 addr;
+	int len;
 
-	record_transfer_result(udev, event, length);
-	xhci_acknowledge_event(ctrl);
+	trb = (void *)(uintptr_t)le64_to_cpu(event->trans_event.buffer);
+	addr = le32_to_cpu(trb->field[0]) |
+		(u64)le32_to_cpu(trb->field[1]) << 32;
+	BUG_ON(addr < start || addr - start > (u64)length);
+
+	len = le32_to_cpu(trb->field[2]) & TRB_LEN_MASK;
+	len -= EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len));
+
+	return min(length, (int)(addr - start) + max(len, 0));
+}
+
+/**
+ * Queues up the BULK Request and waits for it to complete
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param length	length of the buffer
+ * @param buffer	buffer to be read/written based on the request
+ * @return returns 0 if successful else -1 on failure
+ */
+int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
+			int length, void *buffer)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int slot_id = udev->slot_id;
+	int ep_index;
+	struct xhci_virt_device *virt_dev;
+	struct xhci_ep_ctx *ep_ctx;
+	struct xhci_ring *ring;		/* EP transfer ring */
+	union xhci_trb *event;
+	u32 field;
+	u64 val_64 = (uintptr_t)buffer;
+	/* Lengths of the chunks in flight, the oldest first */
+	int chunk_len[XHCI_BULK_CHUNKS];
+	int chunks = 0;
+	int queued = 0, done = 0;
+	int len, ret, i;
+
+	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
+		udev, pipe, buffer, length);
+
+	ep_index = usb_pipe_ep_index(pipe);
+	virt_dev = ctrl->devs[slot_id];
+
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+			 virt_dev->out_ctx->size);
+
+	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
+
+	ring = virt_dev->eps[ep_index].ring;
+
+	/*
+	 * Calling routine prepare_ring() called in place of
+	 * prepare_trasfer() as there in 'Linux' since we are not
+	 * maintaining multiple TDs/transfer at the same time.
+	 */
+	ret = prepare_ring(ctrl, ring,
+			   le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK);
+	if (ret < 0)
+		return ret;
+
+	/* flush the buffer before use */
+	xhci_flush_cache((uintptr_t)buffer, length);
+
+	do {
+		/* Keep the controller busy with the rest of the buffer */
+		while (chunks < XHCI_BULK_CHUNKS &&
+		       (queued < length || !length)) {
+			len = xhci_queue_bulk_chunk(udev, pipe, ring, val_64,
+						    queued, length);
+			chunk_len[chunks++] = len;
+			queued += len;
+			if (!length)
+				break;
+		}
+
+		event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
+		if (!event) {
+			debug("XHCI bulk transfer timed out, aborting...\n");
+			abort_td(udev, ep_index);
+			udev->status = USB_ST_NAK_REC;  /* closest thing to a timeout */
+			udev->act_len = 0;
+			return -ETIMEDOUT;
+		}
+		field = le32_to_cpu(event->trans_event.flags);
+
+		BUG_ON(TRB_TO_SLOT_ID(field) != slot_id);
+		BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
+
+		len = chunk_len[0];
+		record_transfer_result(udev, event, len);
+		udev->act_len = xhci_bulk_chunk_len(event, val_64 + done, len);
+		xhci_acknowledge_event(ctrl);
+
+		done += udev->act_len;
+		for (i = 1; i < chunks; i++)
+			chunk_len[i - 1] = chunk_len[i];
+		chunks--;
+
+		if (udev->status || udev->act_len < len) {
+			/*
+			 * The transfer ended early. If the end of the TD has
+			 * not been queued yet, the controller is waiting for
+			 * it, so stop the endpoint and drop the rest.
+			 */
+			if (!udev->status && queued < length)
+				abort_td(udev, ep_index);
+			break;
+		}
+	} while (done < length);
+
+	udev->act_len = done;
 	xhci_inval_cache((uintptr_t)buffer, length);
 
 	return (udev->status != USB_ST_NOT_PROC) ? 0 : -1;
@@ -62,6 +62,13 @@ struct blk_desc {
 	char		vendor[40+1];	/* IDE model, SCSI Vendor */
 	char		product[20+1];	/* IDE Serial no, SCSI product */
 	char		revision[8+1];	/* firmware revision */
+	/*
+	 * blk_derase() is best used on whole groups of erase_grp blocks,
+	 * which then read as bytes of erase_val (-1 if that is not known).
+	 * erase_grp is 0 if erasing is not supported.
+	 */
+	unsigned long	erase_grp;
+	int		erase_val;
 #ifdef CONFIG_BLK
 	/*
 	 * For now we have a few functions which take struct blk_desc as a
@@ -85,6 +85,9 @@ struct sf_internal_data {
 #ifndef CONFIG_SYS_DFU_DATA_BUF_SIZE
 #define CONFIG_SYS_DFU_DATA_BUF_SIZE		(1024*1024*8)	/* 8 MiB */
 #endif
+#ifndef CONFIG_DFU_WRITE_BUFFERS
+#define CONFIG_DFU_WRITE_BUFFERS	2
+#endif
 #ifndef CONFIG_SYS_DFU_MAX_FILE_SIZE
 #define CONFIG_SYS_DFU_MAX_FILE_SIZE CONFIG_SYS_DFU_DATA_BUF_SIZE
 #endif
@@ -102,6 +105,7 @@ struct dfu_entity {
 	enum dfu_device_type    dev_type;
 	enum dfu_layout         layout;
 	unsigned long           max_buf_size;
+	unsigned long           write_align;	/* Erase/program unit, or 0 */
 
 	union {
 		struct mmc_internal_data mmc;
@@ -163,6 +167,15 @@ int dfu_read(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 int dfu_write(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 int dfu_flush(struct dfu_entity *de, void *buf, int size, int blk_seq_num);
 
+/**
+ * dfu_write_poll - write some of the received data to the medium
+ *
+ * This should be called while waiting for more data from the host, so that
+ * data received by dfu_write() is written to the medium in the meantime. Any
+ * error is returned by the next call to dfu_write() or dfu_flush().
+ */
+void dfu_write_poll(void);
+
 /*
  * dfu_defer_flush - pointer to store dfu_entity for deferred flashing.
  *		     It should be NULL when not used.
@@ -15,8 +15,61 @@
 
 /* The 64 defined bytes plus \0 */
 #define FASTBOOT_RESPONSE_LEN	(64 + 1)
+/* Commands are limited to 64 bytes too */
+#define FASTBOOT_COMMAND_LEN	(64 + 1)
+
+/*
+ * Buffer of FASTBOOT_RESPONSE_LEN bytes for the response to the command
+ * being run, which fastboot_fail() and fastboot_okay() fill in
+ */
+extern char *fb_response_str;
 
 void fastboot_fail(const char *reason);
 void fastboot_okay(const char *reason);
 
+/**
+ * fastboot_getvar() - get the value of a variable for the host
+ *
+ * The response, with the value or the reason for failure, is written to
+ * fb_response_str.
+ *
+ * @cmd:	Name of the variable, from the getvar command
+ */
+void fastboot_getvar(const char *cmd);
+
+/**
+ * fastboot_progress() - report that a long operation is still going
+ *
+ * This is called regularly while an image is written, so that the transport
+ * can stop the host from giving up on the response.
+ */
+void fastboot_progress(void);
+
+/**
+ * fastboot_set_progress_callback() - set what fastboot_progress() calls
+ *
+ * @progress:	Function to call, or NULL for none
+ */
+void fastboot_set_progress_callback(void (*progress)(void));
+
+/**
+ * fastboot_set_max_download_size() - set the size reported by getvar
+ *
+ * This is the largest download the transport accepts, which is the size of
+ * the download buffer unless images are written while they arrive.
+ *
+ * @size:	Size in bytes, or 0 for CONFIG_FASTBOOT_BUF_SIZE
+ */
+void fastboot_set_max_download_size(unsigned int size);
+
+/**
+ * fb_set_reboot_flag() - make the next boot stay in the bootloader
+ *
+ * This is used for the "reboot-bootloader" command. Boards which support
+ * it override this weak function.
+ *
+ * @return 0 if OK, -ENOSYS if not supported
+ */
+int fb_set_reboot_flag(void);
+
 #endif /* _FASTBOOT_H_ */
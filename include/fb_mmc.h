@@ -7,3 +7,15 @@
 void fb_mmc_flash_write(const char *cmd, void *download_buffer,
 			unsigned int download_bytes);
 void fb_mmc_erase(const char *cmd);
+
+/**
+ * fb_mmc_stream_start() - start writing a sparse image as it is downloaded
+ *
+ * @cmd:	Partition to write to
+ * @buf:	Buffer for the stream to gather raw data in
+ * @buf_size:	Size of @buf in bytes
+ * @return stream to pass the image to, or NULL on error (after
+ *	fastboot_fail())
+ */
+struct sparse_stream *fb_mmc_stream_start(const char *cmd, void *buf,
+					  unsigned int buf_size);
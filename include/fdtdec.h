@@ -990,6 +990,16 @@ int fdtdec_setup_memory_banksize(void);
  */
 int fdtdec_setup(void);
 
+/**
+ * fdtdec_setup_index() - build a lookup index for the control FDT
+ *
+ * This allocates the index with malloc() so must be called after relocation.
+ * The index is dropped automatically if the control FDT is later modified.
+ *
+ * @return 0 if OK, -ENOMEM if out of memory, -EINVAL if the FDT is invalid
+ */
+int fdtdec_setup_index(void);
+
 /**
  * Board-specific FDT initialization. Returns the address to a device tree blob.
  * Called when CONFIG_OF_BOARD is defined.
@@ -23,6 +23,17 @@ struct sparse_storage {
 	lbaint_t	(*reserve)(struct sparse_storage *info,
 				 lbaint_t blk,
 				 lbaint_t blkcnt);
+
+	/*
+	 * Optional: erase blocks, like write(). It is only used on whole
+	 * groups of erase_grp blocks, which then read as bytes of erase_val
+	 * (-1 if that is not known).
+	 */
+	lbaint_t	(*erase)(struct sparse_storage *info,
+				 lbaint_t blk,
+				 lbaint_t blkcnt);
+	lbaint_t	erase_grp;
+	int		erase_val;
 };
 
 static inline int is_sparse_image(void *buf)
@@ -36,5 +47,97 @@ static inline int is_sparse_image(void *buf)
 	return 0;
 }
 
+enum sparse_stream_state {
+	SPARSE_STATE_HEADER,		/* Reading the file header */
+	SPARSE_STATE_CHUNK_HEADER,	/* Reading a chunk header */
+	SPARSE_STATE_CHUNK_DATA,	/* Reading the data of a chunk */
+	SPARSE_STATE_DONE,		/* Read all the chunks */
+	SPARSE_STATE_ERROR,		/* Gave up, after fastboot_fail() */
+};
+
+/**
+ * struct sparse_stream - a sparse image being written as it arrives
+ *
+ * The image can be passed to sparse_stream_write() in pieces of any size,
+ * so it can be written while the rest is still being downloaded. Raw data
+ * which does not arrive in whole blocks is gathered in @buf.
+ *
+ * @info:	Storage to write to
+ * @part_name:	Name of the partition, for messages
+ * @state:	What is being read
+ * @header:	File header
+ * @chunk:	Header of the current chunk
+ * @hdr_got:	Bytes of the current header (or fill value) read so far
+ * @skip:	Bytes still to be skipped, from headers longer than expected
+ * @chunk_num:	Number of the current chunk
+ * @data_left:	Bytes of the current chunk's data still to come
+ * @fill_val:	Fill value of the current chunk
+ * @blk:	Next block to write
+ * @bytes_written:	Bytes written so far
+ * @blks_erased:	Blocks erased, rather than written, so far
+ * @total_blocks:	Blocks of the image handled so far
+ * @buf:	Buffer for raw data, or NULL to only write from the data passed
+ * @buf_size:	Size of @buf, a multiple of the storage block size
+ * @buf_fill:	Bytes of raw data in @buf
+ */
+struct sparse_stream {
+	struct sparse_storage	*info;
+	const char		*part_name;
+	enum sparse_stream_state state;
+	sparse_header_t		header;
+	chunk_header_t		chunk;
+	unsigned int		hdr_got;
+	unsigned int		skip;
+	unsigned int		chunk_num;
+	unsigned int		data_left;
+	uint32_t		fill_val;
+	lbaint_t		blk;
+	uint32_t		bytes_written;
+	lbaint_t		blks_erased;
+	uint32_t		total_blocks;
+	void			*buf;
+	unsigned int		buf_size;
+	unsigned int		buf_fill;
+};
+
+/**
+ * sparse_stream_start() - start writing a sparse image
+ *
+ * @ss:		Stream to set up
+ * @info:	Storage to write to
+ * @part_name:	Name of the partition, for messages
+ * @buf:	Buffer for raw data which does not arrive in whole blocks, or
+ *		NULL if the whole image is passed to one sparse_stream_write()
+ * @buf_size:	Size of @buf, a multiple of info->blksz
+ */
+void sparse_stream_start(struct sparse_stream *ss, struct sparse_storage *info,
+			 const char *part_name, void *buf,
+			 unsigned int buf_size);
+
+/**
+ * sparse_stream_write() - write the next piece of a sparse image
+ *
+ * Errors are reported with fastboot_fail(), after which the rest of the
+ * image is ignored.
+ *
+ * @ss:		Stream to write
+ * @data:	Next piece of the image
+ * @len:	Length of @data in bytes
+ * @return 0 if OK, -1 if the image cannot be written
+ */
+int sparse_stream_write(struct sparse_stream *ss, const void *data,
+			unsigned int len);
+
+/**
+ * sparse_stream_finish() - finish writing a sparse image
+ *
+ * Raw data is written out when its chunk ends, so nothing is left in the
+ * buffer once the last chunk is complete. This checks that the image was
+ * complete and reports the result with fastboot_okay() or fastboot_fail().
+ *
+ * @ss:		Stream to finish
+ */
+void sparse_stream_finish(struct sparse_stream *ss);
+
 void write_sparse_image(struct sparse_storage *info, const char *part_name,
 			void *data, unsigned sz);
@@ -878,7 +878,6 @@ extern Void_t*     sbrk();
 #define memalign memalign_simple
 static inline void free(void *ptr) {}
 void *calloc(size_t nmemb, size_t size);
-void *memalign_simple(size_t alignment, size_t bytes);
 void *realloc_simple(void *ptr, size_t size);
 #else
 
@@ -913,6 +912,7 @@ int initf_malloc(void);
 
 /* Simple versions which can be used when space is tight */
 void *malloc_simple(size_t size);
+void *memalign_simple(size_t alignment, size_t bytes);
 
 #pragma GCC visibility push(hidden)
 # if __STD_C
@@ -945,6 +945,30 @@ void    malloc_stats();
 int     mALLOPt();
 struct mallinfo mALLINFo();
 # endif
+# if CONFIG_IS_ENABLED(SYS_MALLOC_TRACK)
+/*
+ * The allocator is built with USE_DL_PREFIX and the public functions are
+ * wrappers in common/malloc_track.c, so declare both sets
+ */
+Void_t* dlmalloc(size_t);
+void    dlfree(Void_t*);
+Void_t* dlrealloc(Void_t*, size_t);
+Void_t* dlmemalign(size_t, size_t);
+Void_t* dlvalloc(size_t);
+Void_t* dlpvalloc(size_t);
+Void_t* dlcalloc(size_t, size_t);
+int     dlmallopt(int, int);
+struct mallinfo dlmallinfo(void);
+Void_t* malloc(size_t);
+void    free(Void_t*);
+Void_t* realloc(Void_t*, size_t);
+Void_t* memalign(size_t, size_t);
+Void_t* valloc(size_t);
+Void_t* pvalloc(size_t);
+Void_t* calloc(size_t, size_t);
+int     mallopt(int, int);
+struct mallinfo mallinfo(void);
+# endif
 #endif
 #pragma GCC visibility pop
 
@@ -0,0 +1,76 @@
+/*
+ * Per-call-site statistics for malloc()
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _MALLOC_TRACK_H
+#define _MALLOC_TRACK_H
+
+/**
+ * malloc_track_alloc() - record an allocation
+ *
+ * This is called by the malloc() wrappers, and by malloc_simple() when
+ * that is the only allocator. Before the full malloc() is set up only the
+ * call site's totals are updated, since those allocations are never freed.
+ *
+ * @ptr:	Memory returned by the allocator, or NULL if it failed
+ * @bytes:	Number of bytes requested
+ * @caller:	Return address of the call
+ */
+void malloc_track_alloc(void *ptr, size_t bytes, void *caller);
+
+/**
+ * malloc_track_free() - record that an allocation has been freed
+ *
+ * @ptr:	Memory being freed; NULL and untracked pointers are ignored
+ */
+void malloc_track_free(void *ptr);
+
+/**
+ * malloc_track_seq() - get the sequence number of the next allocation
+ *
+ * Allocations are numbered as they are recorded, so this can be passed to
+ * malloc_track_show_live() to list only those made after this point.
+ *
+ * @return sequence number
+ */
+uint malloc_track_seq(void);
+
+/**
+ * malloc_track_reset_peak() - start a new high-water mark
+ *
+ * @return number of bytes currently allocated, which becomes the peak
+ */
+ulong malloc_track_reset_peak(void);
+
+/**
+ * malloc_track_peak() - get the high-water mark
+ *
+ * @return the largest number of bytes allocated at once since startup or
+ * the last call to malloc_track_reset_peak()
+ */
+ulong malloc_track_peak(void);
+
+/**
+ * malloc_track_show_info() - print heap usage totals
+ */
+void malloc_track_show_info(void);
+
+/**
+ * malloc_track_show_sites() - print the statistics for each call site
+ *
+ * Sites are listed with the most bytes allocated first. Their addresses
+ * are link-time addresses, so they can be looked up in System.map.
+ */
+void malloc_track_show_sites(void);
+
+/**
+ * malloc_track_show_live() - print allocations which have not been freed
+ *
+ * @since:	Only list allocations with at least this sequence number
+ * @return number of allocations listed
+ */
+int malloc_track_show_live(uint since);
+
+#endif
@@ -58,8 +58,16 @@
 #define MMC_MODE_8BIT		(1 << 3)
 #define MMC_MODE_SPI		(1 << 4)
 #define MMC_MODE_DDR_52MHz	(1 << 5)
+#define MMC_MODE_HS200		(1 << 6)
+#define MMC_MODE_HS400		(1 << 7)
+#define MMC_MODE_UHS_SDR104	(1 << 8)
+
+/* Multiple-block transfers may be preceded by SET_BLOCK_COUNT (CMD23) */
+#define MMC_CAP_CMD23		(1 << 16)
 
 #define SD_DATA_4BIT	0x00040000
+#define SD_DATA_STAT_AFTER_ERASE	0x00800000
+#define SD_SCR_CMD23_SUPPORT	0x00000002
 
 #define IS_SD(x)	((x)->version & SD_VERSION_SD)
 #define IS_MMC(x)	((x)->version & MMC_VERSION_MMC)
@@ -82,6 +90,8 @@
 #define MMC_CMD_SET_BLOCKLEN		16
 #define MMC_CMD_READ_SINGLE_BLOCK	17
 #define MMC_CMD_READ_MULTIPLE_BLOCK	18
+#define MMC_CMD_SEND_TUNING_BLOCK	19
+#define MMC_CMD_SEND_TUNING_BLOCK_HS200	21
 #define MMC_CMD_SET_BLOCK_COUNT         23
 #define MMC_CMD_WRITE_SINGLE_BLOCK	24
 #define MMC_CMD_WRITE_MULTIPLE_BLOCK	25
@@ -112,11 +122,13 @@
 /* SCR definitions in different words */
 #define SD_HIGHSPEED_BUSY	0x00020000
 #define SD_HIGHSPEED_SUPPORTED	0x00020000
+#define SD_SDR104_SUPPORTED	0x00080000
 
 #define OCR_BUSY		0x80000000
 #define OCR_HCS			0x40000000
 #define OCR_VOLTAGE_MASK	0x007FFF80
 #define OCR_ACCESS_MODE		0x60000000
+#define OCR_S18R		0x01000000	/* Ask for / accept 1.8V */
 
 #define MMC_ERASE_ARG		0x00000000
 #define MMC_SECURE_ERASE_ARG	0x80000000
@@ -179,6 +191,7 @@
 #define EXT_CSD_WR_REL_SET		167	/* R/W */
 #define EXT_CSD_RPMB_MULT		168	/* RO */
 #define EXT_CSD_ERASE_GROUP_DEF		175	/* R/W */
+#define EXT_CSD_ERASED_MEM_CONT		181	/* RO */
 #define EXT_CSD_BOOT_BUS_WIDTH		177
 #define EXT_CSD_PART_CONF		179	/* R/W */
 #define EXT_CSD_BUS_WIDTH		183	/* R/W */
@@ -187,7 +200,9 @@
 #define EXT_CSD_CARD_TYPE		196	/* RO */
 #define EXT_CSD_SEC_CNT			212	/* RO, 4 bytes */
 #define EXT_CSD_HC_WP_GRP_SIZE		221	/* RO */
+#define EXT_CSD_REL_WR_SEC_C		222	/* RO */
 #define EXT_CSD_HC_ERASE_GRP_SIZE	224	/* RO */
+#define EXT_CSD_SEC_FEATURE_SUPPORT	231	/* RO */
 #define EXT_CSD_BOOT_MULT		226	/* RO */
 #define EXT_CSD_BKOPS_SUPPORT		502	/* RO */
 
@@ -205,6 +220,19 @@
 #define EXT_CSD_CARD_TYPE_DDR_1_2V	(1 << 3)
 #define EXT_CSD_CARD_TYPE_DDR_52	(EXT_CSD_CARD_TYPE_DDR_1_8V \
 					| EXT_CSD_CARD_TYPE_DDR_1_2V)
+#define EXT_CSD_CARD_TYPE_HS200_1_8V	(1 << 4)
+#define EXT_CSD_CARD_TYPE_HS200_1_2V	(1 << 5)
+#define EXT_CSD_CARD_TYPE_HS200		(EXT_CSD_CARD_TYPE_HS200_1_8V \
+					| EXT_CSD_CARD_TYPE_HS200_1_2V)
+#define EXT_CSD_CARD_TYPE_HS400_1_8V	(1 << 6)
+#define EXT_CSD_CARD_TYPE_HS400_1_2V	(1 << 7)
+#define EXT_CSD_CARD_TYPE_HS400		(EXT_CSD_CARD_TYPE_HS400_1_8V \
+					| EXT_CSD_CARD_TYPE_HS400_1_2V)
+
+#define EXT_CSD_TIMING_LEGACY	0	/* Backwards-compatible timing */
+#define EXT_CSD_TIMING_HS	1	/* High-speed timing */
+#define EXT_CSD_TIMING_HS200	2	/* HS200 timing */
+#define EXT_CSD_TIMING_HS400	3	/* HS400 timing */
 
 #define EXT_CSD_BUS_WIDTH_1	0	/* Card is in 1 bit mode */
 #define EXT_CSD_BUS_WIDTH_4	1	/* Card is in 4 bit mode */
@@ -231,6 +259,9 @@
 #define EXT_CSD_ENH_GP(x)	(1 << ((x)+1))	/* GP part (x+1) is enhanced */
 
 #define EXT_CSD_HS_CTRL_REL	(1 << 0)	/* host controlled WR_REL_SET */
+#define EXT_CSD_EN_REL_WR	(1 << 2)	/* enhanced reliable write */
+
+#define EXT_CSD_SEC_GB_CL_EN	(1 << 4)	/* TRIM is supported */
 
 #define EXT_CSD_WR_DATA_REL_USR		(1 << 0)	/* user data area WR_REL */
 #define EXT_CSD_WR_DATA_REL_GP(x)	(1 << ((x)+1))	/* GP part (x+1) WR_REL */
@@ -308,6 +339,26 @@ struct mmc_cmd {
 	uint response[4];
 };
 
+/* I/O signalling voltages */
+enum mmc_voltage {
+	MMC_SIGNAL_VOLTAGE_330,
+	MMC_SIGNAL_VOLTAGE_180,
+	MMC_SIGNAL_VOLTAGE_120,
+};
+
+/*
+ * Bus timings, in order of speed. Those from MMC_TIMING_UHS_SDR104 on need
+ * the host to be tuned to the card.
+ */
+enum mmc_timing {
+	MMC_TIMING_LEGACY,
+	MMC_TIMING_HS,
+	MMC_TIMING_MMC_DDR52,
+	MMC_TIMING_UHS_SDR104,
+	MMC_TIMING_MMC_HS200,
+	MMC_TIMING_MMC_HS400,
+};
+
 struct mmc_data {
 	union {
 		char *dest;
@@ -357,6 +408,33 @@ struct dm_mmc_ops {
 	 * @return 0 if write-enabled, 1 if write-protected, -ve on error
 	 */
 	int (*get_wp)(struct udevice *dev);
+
+	/**
+	 * set_signal_voltage() - Change the I/O signalling voltage
+	 *
+	 * This is used by the UHS-I, HS200 and HS400 modes. The clock is
+	 * stopped while the voltage changes.
+	 *
+	 * @dev:	Device to update
+	 * @voltage:	New voltage
+	 * @return 0 if OK, -ve on error (e.g. the host cannot use @voltage)
+	 */
+	int (*set_signal_voltage)(struct udevice *dev,
+				  enum mmc_voltage voltage);
+
+	/**
+	 * execute_tuning() - Find the best sample point for the current timing
+	 *
+	 * This is called for the modes which need tuning, once the timing and
+	 * clock are set. The host normally sends the tuning command
+	 * repeatedly with mmc_send_tuning(), varying its sample point.
+	 *
+	 * @dev:	Device to tune
+	 * @opcode:	Tuning command: MMC_CMD_SEND_TUNING_BLOCK for SD cards,
+	 *		MMC_CMD_SEND_TUNING_BLOCK_HS200 for eMMC
+	 * @return 0 if OK, -ve if no sample point works
+	 */
+	int (*execute_tuning)(struct udevice *dev, uint opcode);
 };
 
 #define mmc_get_ops(dev)        ((struct dm_mmc_ops *)(dev)->driver->ops)
@@ -366,11 +444,15 @@ int dm_mmc_send_cmd(struct udevice *dev, struct mmc_cmd *cmd,
 int dm_mmc_set_ios(struct udevice *dev);
 int dm_mmc_get_cd(struct udevice *dev);
 int dm_mmc_get_wp(struct udevice *dev);
+int dm_mmc_set_signal_voltage(struct udevice *dev, enum mmc_voltage voltage);
+int dm_mmc_execute_tuning(struct udevice *dev, uint opcode);
 
 /* Transition functions for compatibility */
 int mmc_set_ios(struct mmc *mmc);
 int mmc_getcd(struct mmc *mmc);
 int mmc_getwp(struct mmc *mmc);
+int mmc_set_signal_voltage(struct mmc *mmc, enum mmc_voltage voltage);
+int mmc_execute_tuning(struct mmc *mmc, uint opcode);
 
 #else
 struct mmc_ops {
@@ -435,6 +517,9 @@ struct mmc {
 	uint read_bl_len;
 	uint write_bl_len;
 	uint erase_grp_size;	/* in 512-byte sectors */
+	u8 can_trim;		/* TRIM is supported, see mmc_trim() */
+	u8 erase_val;		/* Value of each byte after an erase */
+	uint rel_wr_sec_c;	/* reliable write unit in blocks, 0 if any */
 	uint hc_wp_grp_size;	/* in 512-byte sectors */
 	struct sd_ssr	ssr;	/* SD status register */
 	u64 capacity;
@@ -450,7 +535,11 @@ struct mmc {
 	char op_cond_pending;	/* 1 if we are waiting on an op_cond command */
 	char init_in_progress;	/* 1 if we have done mmc_start_init() */
 	char preinit;		/* start init as early as possible */
+	ulong op_cond_time;	/* get_timer() when op_cond was last polled */
+	char reliable_write;	/* 1 to request reliable writes */
 	int ddr_mode;
+	enum mmc_timing timing;
+	enum mmc_voltage signal_voltage;
 #ifdef CONFIG_DM_MMC
 	struct udevice *dev;	/* Device for this MMC controller */
 #endif
@@ -506,6 +595,20 @@ int mmc_init(struct mmc *mmc);
 int mmc_read(struct mmc *mmc, u64 src, uchar *dst, int size);
 void mmc_set_clock(struct mmc *mmc, uint clock);
 struct mmc *find_mmc_device(int dev_num);
+
+/**
+ * mmc_trim() - erase blocks with TRIM rather than ERASE
+ *
+ * TRIM works on single blocks rather than whole erase groups, which then
+ * read as bytes of the erased value. blk_derase() does not use it, so that
+ * the erase command behaves the same on every card.
+ *
+ * @block_dev:	Block device to erase, on its hardware partition
+ * @start:	First block to erase
+ * @blkcnt:	Number of blocks to erase
+ * @return number of blocks erased, 0 if the card cannot TRIM
+ */
+ulong mmc_trim(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt);
 int mmc_set_dev(int dev_num);
 void print_mmc_devices(char separator);
 
@@ -519,6 +622,21 @@ int mmc_switch_part(struct mmc *mmc, unsigned int part_num);
 int mmc_hwpart_config(struct mmc *mmc, const struct mmc_hwpart_conf *conf,
 		      enum mmc_hwpart_conf_mode mode);
 
+/* Data sent by the tuning commands on a 4-bit and an 8-bit bus */
+extern const u8 tuning_blk_pattern_4bit[64];
+extern const u8 tuning_blk_pattern_8bit[128];
+
+/**
+ * mmc_send_tuning() - Send a tuning command and check the data received
+ *
+ * This is used by host drivers to try out a sample point while tuning.
+ *
+ * @mmc:	MMC device
+ * @opcode:	Tuning command, as passed to execute_tuning()
+ * @return 0 if the tuning block was received intact, -ve on error
+ */
+int mmc_send_tuning(struct mmc *mmc, uint opcode);
+
 #ifndef CONFIG_DM_MMC_OPS
 int mmc_getcd(struct mmc *mmc);
 int board_mmc_getcd(struct mmc *mmc);
@@ -558,6 +676,30 @@ int mmc_set_bkops_enable(struct mmc *mmc);
  */
 int mmc_start_init(struct mmc *mmc);
 
+/**
+ * mmc_init_poll() - Move on the initialisation of a device without waiting
+ *
+ * After mmc_start_init(), this polls the card's operating condition once.
+ * It only waits for the card to power up: the rest of the initialisation,
+ * such as selecting the bus mode and tuning, is left to mmc_init(), so
+ * that this takes no longer than a single command.
+ *
+ * @mmc:	MMC device
+ * @return 0 if the card is ready (or the device is initialised), -EAGAIN if
+ * the card is still powering up, -ENODEV if initialisation has not been
+ * started, other -ve on error (mmc_init() then starts again)
+ */
+int mmc_init_poll(struct mmc *mmc);
+
+/**
+ * mmc_do_init_poll() - Call mmc_init_poll() for every device
+ *
+ * With CONFIG_MMC_BACKGROUND_INIT this is called while U-Boot is otherwise
+ * waiting, e.g. for the autoboot delay, so that devices started by
+ * mmc_initialize() are ready by the time they are used.
+ */
+void mmc_do_init_poll(void);
+
 /**
  * Set preinit flag of mmc device.
  *
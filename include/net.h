@@ -14,6 +14,7 @@
 
 #include <asm/cache.h>
 #include <asm/byteorder.h>	/* for nton* / ntoh* stuff */
+#include <linux/errno.h>
 
 #define DEBUG_LL_STATE 0	/* Link local state machine changes */
 #define DEBUG_DEV_PKT 0		/* Packets or info directed to the device */
@@ -28,6 +29,8 @@
 
 #ifdef CONFIG_SYS_RX_ETH_BUFFER
 # define PKTBUFSRX	CONFIG_SYS_RX_ETH_BUFFER
+#elif defined(CONFIG_NET_RX_BUFFERS)
+# define PKTBUFSRX	CONFIG_NET_RX_BUFFERS
 #else
 # define PKTBUFSRX	4
 #endif
@@ -117,9 +120,18 @@ enum eth_recv_flags {
  *	 indicate that the hardware receive FIFO is empty. If 0 is returned, the
  *	 network stack will not process the empty packet, but free_pkt() will be
  *	 called if supplied
+ * recv_batch: Like recv, but hand over up to max packets at once, setting
+ *	       packets[] and lengths[] for each. Return the number of packets,
+ *	       0 if there are none or -ve on error. The stack processes them
+ *	       all and then passes each one to free_pkt(), in order, before
+ *	       calling recv_batch again. Used instead of recv if supplied -
+ *	       optional
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
- *	     called when no error was returned from recv - optional
+ *	     called when no error was returned from recv. Drivers with a DMA
+ *	     ring should return the buffer the hardware wrote to from recv and
+ *	     give it back to the hardware here, rather than copy each packet
+ *	     - optional
  * stop: Stop the hardware from looking for packets - may be called even if
  *	 state == PASSIVE
  * mcast: Join or leave a multicast group (for TFTP) - optional
@@ -137,6 +149,8 @@ struct eth_ops {
 	int (*start)(struct udevice *dev);
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
+	int (*recv_batch)(struct udevice *dev, int flags, uchar **packets,
+			  int *lengths, int max);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
 	void (*stop)(struct udevice *dev);
 #ifdef CONFIG_MCAST_TFTP
@@ -160,6 +174,16 @@ unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
 void eth_halt_state_only(void); /* Set passive state */
+
+/**
+ * eth_disable_persistent_link() - halt a device after each network command
+ *
+ * Drivers whose hardware cannot be left running between commands call this
+ * from their probe() method, to opt out of CONFIG_NET_PERSISTENT_LINK.
+ *
+ * @dev:	Ethernet device
+ */
+void eth_disable_persistent_link(struct udevice *dev);
 #endif
 
 #ifndef CONFIG_DM_ETH
@@ -287,6 +311,22 @@ extern void (*push_packet)(void *packet, int length);
 #endif
 int eth_rx(void);			/* Check for received packets */
 void eth_halt(void);			/* stop SCC */
+/*
+ * Finish using the device after a network command. With
+ * CONFIG_NET_PERSISTENT_LINK it is left running, so that the next command
+ * does not have to wait for the link to come up again; else it is halted.
+ */
+void eth_release(void);
+/*
+ * Stop the device before handing over to an OS or application: NetConsole or
+ * CONFIG_NET_PERSISTENT_LINK may have left it receiving into U-Boot's buffers.
+ * Every boot command must call this just before it jumps.
+ */
+#if defined(CONFIG_NETCONSOLE) || defined(CONFIG_NET_PERSISTENT_LINK)
+void eth_halt_before_boot(void);
+#else
+static inline void eth_halt_before_boot(void) {}
+#endif
 const char *eth_get_name(void);		/* get name of current device */
 
 #ifdef CONFIG_MCAST_TFTP
@@ -353,6 +393,7 @@ struct vlan_ethernet_hdr {
 #define PROT_PPP_SES	0x8864		/* PPPoE session messages	*/
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -402,6 +443,29 @@ struct ip_udp_hdr {
 #define IP_UDP_HDR_SIZE		(sizeof(struct ip_udp_hdr))
 #define UDP_HDR_SIZE		(IP_UDP_HDR_SIZE - IP_HDR_SIZE)
 
+/*
+ *	Transmission Control Protocol (TCP) header, without options.
+ */
+struct tcp_hdr {
+	u16		tcp_src;	/* Source port			*/
+	u16		tcp_dst;	/* Destination port		*/
+	u32		tcp_seq;	/* Sequence number		*/
+	u32		tcp_ack;	/* Acknowledgment number	*/
+	u8		tcp_off;	/* Header length / 4, in bits 7:4 */
+	u8		tcp_flags;	/* TCP_FIN etc.			*/
+	u16		tcp_win;	/* Receive window		*/
+	u16		tcp_sum;	/* Checksum			*/
+	u16		tcp_urg;	/* Urgent pointer		*/
+};
+
+#define TCP_HDR_SIZE		(sizeof(struct tcp_hdr))
+
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
 /*
  *	Address Resolution Protocol (ARP) header.
  */
@@ -538,7 +602,7 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL
+	TFTPSRV, TFTPPUT, LINKLOCAL, WGET, FASTBOOT
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -603,12 +667,50 @@ void net_set_udp_header(uchar *pkt, struct in_addr dest, int dport,
 /**
  * compute_ip_checksum() - Compute IP checksum
  *
- * @addr:	Address to check (must be 16-bit aligned)
+ * @addr:	Address to check
  * @nbytes:	Number of bytes to check (normally a multiple of 2)
  * @return 16-bit IP checksum
  */
 unsigned compute_ip_checksum(const void *addr, unsigned nbytes);
 
+/**
+ * ip_checksum_partial() - add data to a one's complement sum
+ *
+ * This allows a checksum to be built up from several pieces, such as a
+ * pseudo-header and the data which follows it. Each piece is taken to start
+ * at an even offset in the data being checksummed.
+ *
+ * @addr:	Address of the data
+ * @nbytes:	Number of bytes to add
+ * @sum:	Sum so far (0 to start), which may also include other 16-bit
+ *		words, such as a length, in network byte order
+ * @return new sum, which is not complemented; see ip_checksum_fold()
+ */
+unsigned ip_checksum_partial(const void *addr, unsigned nbytes, unsigned sum);
+
+/**
+ * ip_checksum_copy() - copy data, adding it to a one's complement sum
+ *
+ * This is the same as memcpy() followed by ip_checksum_partial() on @src,
+ * but only reads the data once.
+ *
+ * @dst:	Where to copy the data
+ * @src:	Data to copy
+ * @nbytes:	Number of bytes to copy
+ * @sum:	Sum so far (0 to start)
+ * @return new sum, which is not complemented
+ */
+unsigned ip_checksum_copy(void *dst, const void *src, unsigned nbytes,
+			  unsigned sum);
+
+/**
+ * ip_checksum_fold() - turn a sum into a checksum
+ *
+ * @sum:	Sum returned by ip_checksum_partial() or ip_checksum_copy()
+ * @return 16-bit IP checksum, as returned by compute_ip_checksum()
+ */
+unsigned ip_checksum_fold(unsigned sum);
+
 /**
  * add_ip_checksums() - add two IP checksums
  *
@@ -633,6 +735,35 @@ int ip_checksum_ok(const void *addr, unsigned nbytes);
 /* Callbacks */
 rxhand_f *net_get_udp_handler(void);	/* Get UDP RX packet handler */
 void net_set_udp_handler(rxhand_f *);	/* Set UDP RX packet handler */
+
+/**
+ * net_set_udp_handler_csum() - set a UDP handler which checks checksums
+ *
+ * This is like net_set_udp_handler(), but the UDP checksum of a packet is
+ * not checked before it is passed to the handler. Instead, the handler calls
+ * net_udp_csum_copy() before acting on it, and can check the data while
+ * copying it into place, rather than reading it twice.
+ *
+ * @f:		Handler to set
+ */
+void net_set_udp_handler_csum(rxhand_f *f);
+
+/**
+ * net_udp_csum_copy() - copy data from a received UDP packet
+ *
+ * This is called by a handler set with net_set_udp_handler_csum(), or by
+ * anything else which sees the packet before it, to check the UDP checksum.
+ * If that has already been done, or the packet has no checksum, this just
+ * copies the data.
+ *
+ * @dst:	Where to copy @len bytes from @src, or NULL to only check the
+ *		checksum
+ * @src:	Data to copy, within the packet passed to the handler
+ * @len:	Number of bytes to copy
+ * @return true if the checksum is correct, false if the packet is corrupt
+ * and must be dropped (although the data has still been copied)
+ */
+bool net_udp_csum_copy(void *dst, const uchar *src, unsigned int len);
 rxhand_f *net_get_arp_handler(void);	/* Get ARP RX packet handler */
 void net_set_arp_handler(rxhand_f *);	/* Set ARP RX packet handler */
 void net_set_icmp_handler(rxhand_icmp_f *f); /* Set ICMP RX handler */
@@ -673,6 +804,64 @@ static inline void net_send_packet(uchar *pkt, int len)
 int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport,
 			int sport, int payload_len);
 
+/*
+ * Transmit "net_tx_packet" as IP packet, performing ARP request if needed
+ *  (ether will be populated)
+ *
+ * The IP header and payload must already be in place after the ethernet
+ * header.
+ *
+ * @param ether Raw packet buffer
+ * @param dest IP address to send the packet to
+ * @param len Length of the IP packet, including the IP header
+ * @return 0 if transmitted, 1 if waiting for ARP, -ve on error
+ */
+int net_send_ip_packet(uchar *ether, struct in_addr dest, int len);
+
+#ifdef CONFIG_NET_ARP_CACHE
+/**
+ * arp_cache_lookup() - find the MAC address to send a packet to
+ *
+ * This looks up the next hop for @dest, which is the gateway if @dest is
+ * not on our subnet. Entries which have not been confirmed for a while
+ * are dropped, so that they are looked up again with ARP.
+ *
+ * @dest:	IP address the packet is for
+ * @ethaddr:	Returns the MAC address, if found
+ * @return 0 if found, -ENOENT if not
+ */
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr);
+
+/**
+ * arp_cache_update() - record the MAC address of a host on our subnet
+ *
+ * If the cache is full, the entry used least recently is replaced.
+ *
+ * @ip:		IP address of the host
+ * @ethaddr:	Its MAC address
+ */
+void arp_cache_update(struct in_addr ip, const uchar *ethaddr);
+
+/* Forget all entries in the ARP cache */
+void arp_cache_flush(void);
+
+/* Print the entries in the ARP cache */
+void arp_cache_show(void);
+#else
+static inline int arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	return -ENOENT;
+}
+
+static inline void arp_cache_update(struct in_addr ip, const uchar *ethaddr)
+{
+}
+
+static inline void arp_cache_flush(void)
+{
+}
+#endif
+
 /* Processes a received packet */
 void net_process_received_packet(uchar *in_packet, int len);
 
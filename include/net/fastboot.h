@@ -0,0 +1,21 @@
+/*
+ * Fastboot over UDP
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __NET_FASTBOOT_H__
+#define __NET_FASTBOOT_H__
+
+/* UDP port which the fastboot host sends to */
+#define FASTBOOT_UDP_PORT	5554
+
+/**
+ * fastboot_start_server() - wait for a fastboot host
+ *
+ * This is called by net_loop() for the FASTBOOT protocol. The loop runs
+ * until the host sends "continue", or ctrl-c is pressed.
+ */
+void fastboot_start_server(void);
+
+#endif /* __NET_FASTBOOT_H__ */
@@ -22,6 +22,27 @@ void tftp_start(enum proto_t protocol);	/* Begin TFTP get/put */
 void tftp_start_server(void);	/* Wait for incoming TFTP put */
 #endif
 
+#ifdef CONFIG_CMD_PXE
+/* Most files tftp_probe() can ask for at once */
+#define TFTP_PROBE_MAX	16
+
+/**
+ * tftp_probe() - load the first of several files which the server has
+ *
+ * Read requests for all the files are sent at once, each from its own port,
+ * rather than waiting for the server to answer one before asking for the
+ * next. The transfer of the first file in @names which the server has goes
+ * on as if it was the only one asked for, and the others are cancelled.
+ *
+ * @names:	file names, optionally with "server:" before them, most
+ *		preferred first
+ * @count:	number of names, at most TFTP_PROBE_MAX
+ * @addr:	address to load the file at
+ * @return index in @names of the file loaded, or -ENOENT if none was
+ */
+int tftp_probe(const char *const names[], int count, ulong addr);
+#endif
+
 extern ulong tftp_timeout_ms;
 extern int tftp_timeout_count_max;
 
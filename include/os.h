@@ -61,6 +61,18 @@ off_t os_lseek(int fd, off_t offset, int whence);
 #define OS_SEEK_CUR	1
 #define OS_SEEK_END	2
 
+/**
+ * Free part of a file, so that it reads as zeroes
+ *
+ * If the host file system cannot do this, zeroes are written instead.
+ *
+ * \param fd	File descriptor as returned by os_open()
+ * \param offset	Start of the part in bytes
+ * \param len	Length of the part in bytes
+ * \return 0 on success, -1 on error
+ */
+int os_punch_hole(int fd, off_t offset, off_t len);
+
 /**
  * Access to the OS open() system call
  *
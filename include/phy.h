@@ -184,6 +184,8 @@ struct phy_device {
 	u32 mmds;
 
 	int autoneg;
+	/* Time autonegotiation was last started, 0 if unknown */
+	ulong aneg_start;
 	int addr;
 	int pause;
 	int asym_pause;
@@ -224,6 +224,28 @@ struct sdhci_host;
  */
 #define SDHCI_DEFAULT_BOUNDARY_SIZE	(512 * 1024)
 #define SDHCI_DEFAULT_BOUNDARY_ARG	(7)
+
+/*
+ * 32-bit ADMA2 descriptors. Each moves up to 64KiB, and the table holds
+ * enough of them for the largest transfer.
+ */
+#define SDHCI_ADMA_MAX_LEN	65536
+#define SDHCI_ADMA_DESC_COUNT	DIV_ROUND_UP(CONFIG_SYS_MMC_MAX_BLK_COUNT * \
+				MMC_MAX_BLOCK_LEN, SDHCI_ADMA_MAX_LEN)
+#define SDHCI_ADMA_TABLE_SIZE	(SDHCI_ADMA_DESC_COUNT * \
+				sizeof(struct sdhci_adma_desc))
+
+#define SDHCI_ADMA_DESC_VALID	BIT(0)
+#define SDHCI_ADMA_DESC_END	BIT(1)
+#define SDHCI_ADMA_DESC_TRAN	(2 << 4)
+
+struct sdhci_adma_desc {
+	u8	attr;
+	u8	reserved;
+	__le16	len;		/* 0 means 64KiB */
+	__le32	addr;
+};
+
 struct sdhci_ops {
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
 	u32	(*read_l)(struct sdhci_host *host, int reg);
@@ -259,6 +281,7 @@ struct sdhci_host {
 	uint	voltages;
 
 	struct mmc_config cfg;
+	struct sdhci_adma_desc *adma_desc;	/* ADMA2 descriptor table */
 };
 
 #ifdef CONFIG_MMC_SDHCI_IO_ACCESSORS
@@ -8,8 +8,14 @@
 #ifndef __TEST_SUITES_H__
 #define __TEST_SUITES_H__
 
+int do_ut_csum(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
+int do_ut_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 int do_ut_dm(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 int do_ut_env(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
+int do_ut_fdt(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
+int do_ut_fdt_index(cmd_tbl_t *cmdtp, int flag, int argc,
+		    char * const argv[]);
+int do_ut_malloc(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 int do_ut_overlay(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 int do_ut_time(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 
@@ -0,0 +1,121 @@
+/*
+ * Two-Level Segregated Fit memory allocator
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef _TLSF_H
+#define _TLSF_H
+
+#include <linux/types.h>
+
+struct tlsf;
+
+/**
+ * struct tlsf_info - statistics about a TLSF pool
+ *
+ * @size:	Bytes managed by the pool, excluding its control structure
+ * @used:	Bytes in allocated blocks, including their headers
+ * @peak:	Largest value @used has reached
+ * @top:	Highest offset from the start of the pool that has been allocated
+ * @largest:	Size of the largest free block
+ * @free_blocks: Number of free blocks
+ */
+struct tlsf_info {
+	size_t size;
+	size_t used;
+	size_t peak;
+	size_t top;
+	size_t largest;
+	int free_blocks;
+};
+
+/**
+ * tlsf_create() - set up a TLSF pool in a region of memory
+ *
+ * The control structure is placed at the start of the region and the rest
+ * becomes a single free block.
+ *
+ * @mem:	Start of the region
+ * @size:	Size of the region in bytes
+ * @return pool, or NULL if the region is too small
+ */
+struct tlsf *tlsf_create(void *mem, size_t size);
+
+/**
+ * tlsf_malloc() - allocate memory from a pool
+ *
+ * @tlsf:	Pool to allocate from
+ * @bytes:	Number of bytes required
+ * @return pointer to the memory, or NULL if there is no free block large
+ * enough
+ */
+void *tlsf_malloc(struct tlsf *tlsf, size_t bytes);
+
+/**
+ * tlsf_memalign() - allocate aligned memory from a pool
+ *
+ * The space before the aligned address and after the end of the allocation
+ * is returned to the pool.
+ *
+ * @tlsf:	Pool to allocate from
+ * @align:	Required alignment, rounded up to a power of two
+ * @bytes:	Number of bytes required
+ * @return pointer to the memory, or NULL if there is no free block large
+ * enough
+ */
+void *tlsf_memalign(struct tlsf *tlsf, size_t align, size_t bytes);
+
+/**
+ * tlsf_realloc() - change the size of an allocation
+ *
+ * The block is grown into a free neighbour or shrunk in place if possible,
+ * otherwise the contents are copied to a new block.
+ *
+ * @tlsf:	Pool the allocation came from
+ * @ptr:	Allocation to resize, or NULL to allocate a new one
+ * @bytes:	New size in bytes
+ * @return pointer to the resized memory, or NULL if there is not enough
+ * space, in which case @ptr is left untouched
+ */
+void *tlsf_realloc(struct tlsf *tlsf, void *ptr, size_t bytes);
+
+/**
+ * tlsf_free() - return memory to a pool
+ *
+ * @tlsf:	Pool the allocation came from
+ * @ptr:	Allocation to free, or NULL to do nothing
+ */
+void tlsf_free(struct tlsf *tlsf, void *ptr);
+
+/**
+ * tlsf_usable_size() - get the number of bytes usable in an allocation
+ *
+ * @ptr:	Allocation returned by one of the functions above
+ * @return number of usable bytes, which may be more than were requested
+ */
+size_t tlsf_usable_size(void *ptr);
+
+/**
+ * tlsf_get_info() - get statistics about a pool
+ *
+ * This walks the free lists, so it takes time proportional to the number
+ * of free blocks.
+ *
+ * @tlsf:	Pool to look at
+ * @info:	Returns the statistics
+ */
+void tlsf_get_info(struct tlsf *tlsf, struct tlsf_info *info);
+
+/**
+ * tlsf_check() - check the consistency of a pool
+ *
+ * Walks every block in the pool, checking its header against its
+ * neighbours and the free lists.
+ *
+ * @tlsf:	Pool to check
+ * @return 0 if the pool is consistent, -EINVAL if not
+ */
+int tlsf_check(struct tlsf *tlsf);
+
+#endif
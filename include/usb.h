@@ -645,11 +645,13 @@ struct usb_dev_platdata {
  *		so this will be false.
  * @companion:  True if this is a companion controller to another USB
  *		controller
+ * @scan_err:	Error from setting up the root hub on the last scan, or 0
  */
 struct usb_bus_priv {
 	int next_addr;
 	bool desc_before_addr;
 	bool companion;
+	int scan_err;
 };
 
 /**
@@ -815,6 +817,25 @@ bool usb_hub_is_root_hub(struct udevice *hub);
  */
 int usb_hub_scan(struct udevice *hub);
 
+/**
+ * usb_hub_scan_start() - Start scanning several buses together
+ *
+ * Until usb_hub_scan_finish() is called, setting up a hub only powers up its
+ * ports and adds them to the scanning list. This allows the ports of all
+ * buses to wait for power and connections at the same time.
+ */
+void usb_hub_scan_start(void);
+
+/**
+ * usb_hub_scan_finish() - Scan all ports added since usb_hub_scan_start()
+ *
+ * This returns once all devices on these ports, including any hubs and the
+ * devices attached to them, have been found.
+ *
+ * @return 0 if OK, -ve on error
+ */
+int usb_hub_scan_finish(void);
+
 /**
  * usb_scan_device() - Scan a device on a bus
  *
@@ -46,6 +46,7 @@
 #define US_PR_CB               1		/* Control/Bulk w/o interrupt */
 #define US_PR_CBI              0		/* Control/Bulk/Interrupt */
 #define US_PR_BULK             0x50		/* bulk only */
+#define US_PR_UAS              0x62		/* USB Attached SCSI */
 
 /* USB types */
 #define USB_TYPE_STANDARD   (0x00 << 5)
@@ -363,4 +364,57 @@ struct umass_bbb_csw {
 #define US_BBB_RESET		0xff
 #define US_BBB_GET_MAX_LUN	0xfe
 
+/*
+ * USB Attached SCSI
+ */
+
+/* Pipe usage descriptor, which follows each endpoint of a UAS interface */
+#define USB_DT_PIPE_USAGE	0x24
+
+struct usb_pipe_usage_descriptor {
+	__u8		bLength;
+	__u8		bDescriptorType;
+	__u8		bPipeID;
+#	define UAS_PIPE_COMMAND		1
+#	define UAS_PIPE_STATUS		2
+#	define UAS_PIPE_DATA_IN		3
+#	define UAS_PIPE_DATA_OUT	4
+	__u8		Reserved;
+} __attribute__ ((packed));
+
+/* Information units sent on the command and status pipes */
+#define UAS_IU_COMMAND		0x01
+#define UAS_IU_SENSE		0x03
+#define UAS_IU_RESPONSE		0x04
+#define UAS_IU_READ_READY	0x06
+#define UAS_IU_WRITE_READY	0x07
+
+/* Command IU */
+struct uas_command_iu {
+	__u8		bIUID;
+	__u8		bReserved;
+	__be16		wTag;
+	__u8		bPrioAttr;
+	__u8		bReserved2;
+	__u8		bAddCDBLength;
+	__u8		bReserved3;
+	__u8		bLUN[8];
+	__u8		CDB[16];
+};
+
+/* Sense IU, which ends a command; READ READY and WRITE READY are its header */
+struct uas_sense_iu {
+	__u8		bIUID;
+	__u8		bReserved;
+	__be16		wTag;
+	__be16		wStatusQualifier;
+	__u8		bStatus;
+	__u8		bReserved2[7];
+	__be16		wLength;
+#	define UAS_SENSE_LEN	96
+	__u8		bSenseData[UAS_SENSE_LEN];
+};
+#define UAS_READY_IU_SIZE	4
+#define UAS_SENSE_IU_SIZE	16
+
 #endif /*_USB_DEFS_H_ */
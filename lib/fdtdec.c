@@ -1243,4 +1243,33 @@ int fdtdec_setup(void)
 	return fdtdec_prepare_fdt();
 }
 
+#ifdef CONFIG_OF_LIBFDT_INDEX
+int fdtdec_setup_index(void)
+{
+	static struct fdt_index index;
+	void *buf;
+	int size;
+	int ret;
+
+	size = fdt_index_size(gd->fdt_blob);
+	if (size < 0) {
+		debug("%s: Cannot size index: %s\n", __func__,
+		      fdt_strerror(size));
+		return -EINVAL;
+	}
+	buf = malloc(size);
+	if (!buf)
+		return -ENOMEM;
+	ret = fdt_index_build(&index, gd->fdt_blob, buf, size);
+	if (ret) {
+		debug("%s: Cannot build index: %s\n", __func__,
+		      fdt_strerror(ret));
+		free(buf);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+#endif
+
 #endif /* !USE_HOSTCC */
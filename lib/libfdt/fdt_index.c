@@ -0,0 +1,504 @@
+/*
+ * libfdt - Flat Device Tree manipulation
+ * Lookup index for path, phandle and compatible searches
+ * SPDX-License-Identifier:	GPL-2.0+ BSD-2-Clause
+ */
+#include <libfdt_env.h>
+
+#ifndef USE_HOSTCC
+#include <fdt.h>
+#include <libfdt.h>
+#else
+#include "fdt_host.h"
+#endif
+
+#include "libfdt_internal.h"
+
+#define FDT_INDEX_HASH_BASIS	2166136261U
+#define FDT_INDEX_HASH_PRIME	16777619U
+
+struct fdt_index_node {
+	int offset;		/* Offset of the node in the struct block, or -1
+				   if it has been deleted */
+	int parent;		/* Index of parent node, -1 for the root */
+	uint32_t hash;		/* Hash of parent and name without unit address */
+	int next;		/* Next node in the same hash bucket, or -1 */
+};
+
+struct fdt_index_phandle {
+	uint32_t phandle;
+	int offset;
+};
+
+struct fdt_index_compat {
+	uint32_t hash;		/* Hash of the compatible string */
+	int offset;		/* Offset of the node it belongs to */
+	int next;		/* Next entry in the same hash bucket, or -1 */
+};
+
+/*
+ * The active index is looked up on every search, possibly before U-Boot
+ * has relocated and cleared BSS, so keep it in the data section.
+ */
+#ifdef USE_HOSTCC
+static struct fdt_index *fdt_active_index;
+#else
+static struct fdt_index *fdt_active_index __attribute__((section(".data")));
+#endif
+
+static uint32_t _fdt_index_hash(uint32_t hash, const char *s, int len)
+{
+	while (len--)
+		hash = (hash ^ (uint8_t)*s++) * FDT_INDEX_HASH_PRIME;
+
+	return hash;
+}
+
+/* Hash a node name under a given parent, ignoring any unit address */
+static uint32_t _fdt_index_child_hash(int parent, const char *name, int len)
+{
+	const char *at = memchr(name, '@', len);
+	uint32_t hash;
+
+	if (at)
+		len = at - name;
+	hash = (FDT_INDEX_HASH_BASIS ^ parent) * FDT_INDEX_HASH_PRIME;
+
+	return _fdt_index_hash(hash, name, len);
+}
+
+static int _fdt_index_buckets(int count)
+{
+	int buckets = 16;
+
+	while (buckets < count)
+		buckets <<= 1;
+
+	return buckets;
+}
+
+/*
+ * Count the nodes, phandles and compatible strings in the tree. Returns 0 or
+ * a -FDT_ERR_... value
+ */
+static int _fdt_index_count(const void *fdt, int *nodesp, int *phandlesp,
+			    int *compatsp)
+{
+	int offset, depth = -1;
+	int nodes = 0, phandles = 0, compats = 0;
+
+	for (offset = fdt_next_node(fdt, -1, &depth);
+	     offset >= 0 && depth >= 0;
+	     offset = fdt_next_node(fdt, offset, &depth)) {
+		int count;
+
+		nodes++;
+		if (fdt_get_phandle(fdt, offset))
+			phandles++;
+		count = fdt_stringlist_count(fdt, offset, "compatible");
+		if (count > 0)
+			compats += count;
+	}
+	if (offset < 0 && offset != -FDT_ERR_NOTFOUND)
+		return offset;
+
+	*nodesp = nodes;
+	*phandlesp = phandles;
+	*compatsp = compats;
+
+	return 0;
+}
+
+static int _fdt_index_bytes(int nodes, int phandles, int compats)
+{
+	return nodes * sizeof(struct fdt_index_node) +
+		phandles * sizeof(struct fdt_index_phandle) +
+		compats * sizeof(struct fdt_index_compat) +
+		(_fdt_index_buckets(nodes) + _fdt_index_buckets(compats)) *
+		sizeof(int);
+}
+
+int fdt_index_size(const void *fdt)
+{
+	int nodes, phandles, compats;
+	int err;
+
+	FDT_CHECK_HEADER(fdt);
+
+	err = _fdt_index_count(fdt, &nodes, &phandles, &compats);
+	if (err)
+		return err;
+
+	return _fdt_index_bytes(nodes, phandles, compats);
+}
+
+/*
+ * Insertion sort, keeping tree order for duplicate phandles. Trees usually
+ * number phandles in tree order so this is close to linear.
+ */
+static void _fdt_index_sort_phandles(struct fdt_index_phandle *ph, int count)
+{
+	int i, j;
+
+	for (i = 1; i < count; i++) {
+		struct fdt_index_phandle tmp = ph[i];
+
+		for (j = i; j > 0 && ph[j - 1].phandle > tmp.phandle; j--)
+			ph[j] = ph[j - 1];
+		ph[j] = tmp;
+	}
+}
+
+int fdt_index_build(struct fdt_index *idx, const void *fdt, void *buf,
+		    int bufsize)
+{
+	int nodes, phandles, compats;
+	int path_buckets, compat_buckets;
+	int offset, depth = -1, prev_depth = -1;
+	int node = -1, nph = 0, ncompat = 0;
+	char *p = buf;
+	int err, i;
+
+	FDT_CHECK_HEADER(fdt);
+
+	err = _fdt_index_count(fdt, &nodes, &phandles, &compats);
+	if (err)
+		return err;
+	if (bufsize < _fdt_index_bytes(nodes, phandles, compats))
+		return -FDT_ERR_NOSPACE;
+
+	path_buckets = _fdt_index_buckets(nodes);
+	compat_buckets = _fdt_index_buckets(compats);
+	idx->nodes = (struct fdt_index_node *)p;
+	p += nodes * sizeof(struct fdt_index_node);
+	idx->phandles = (struct fdt_index_phandle *)p;
+	p += phandles * sizeof(struct fdt_index_phandle);
+	idx->compats = (struct fdt_index_compat *)p;
+	p += compats * sizeof(struct fdt_index_compat);
+	idx->path_hash = (int *)p;
+	p += path_buckets * sizeof(int);
+	idx->compat_hash = (int *)p;
+	for (i = 0; i < path_buckets; i++)
+		idx->path_hash[i] = -1;
+	for (i = 0; i < compat_buckets; i++)
+		idx->compat_hash[i] = -1;
+
+	for (offset = fdt_next_node(fdt, -1, &depth);
+	     offset >= 0 && depth >= 0 && node + 1 < nodes;
+	     offset = fdt_next_node(fdt, offset, &depth)) {
+		struct fdt_index_node *np = &idx->nodes[++node];
+		const char *name, *list, *end;
+		uint32_t phandle, bucket;
+		int parent, len;
+
+		/* Work out the parent from the previous node */
+		if (node == 0) {
+			parent = -1;
+		} else if (depth > prev_depth) {
+			parent = node - 1;
+		} else {
+			parent = idx->nodes[node - 1].parent;
+			for (i = depth; i < prev_depth; i++)
+				parent = idx->nodes[parent].parent;
+		}
+		prev_depth = depth;
+
+		np->offset = offset;
+		np->parent = parent;
+		name = fdt_get_name(fdt, offset, &len);
+		if (!name)
+			return len;
+		np->hash = _fdt_index_child_hash(parent, name, len);
+		bucket = np->hash & (path_buckets - 1);
+		np->next = idx->path_hash[bucket];
+		idx->path_hash[bucket] = node;
+
+		phandle = fdt_get_phandle(fdt, offset);
+		if (phandle && nph < phandles) {
+			idx->phandles[nph].phandle = phandle;
+			idx->phandles[nph++].offset = offset;
+		}
+
+		list = fdt_getprop(fdt, offset, "compatible", &len);
+		if (!list)
+			continue;
+		for (end = list + len; list < end && ncompat < compats;
+		     list += len + 1) {
+			struct fdt_index_compat *cp = &idx->compats[ncompat];
+
+			len = strnlen(list, end - list);
+			cp->hash = _fdt_index_hash(FDT_INDEX_HASH_BASIS, list,
+						   len);
+			cp->offset = offset;
+			bucket = cp->hash & (compat_buckets - 1);
+			cp->next = idx->compat_hash[bucket];
+			idx->compat_hash[bucket] = ncompat++;
+		}
+	}
+	if (offset < 0 && offset != -FDT_ERR_NOTFOUND)
+		return offset;
+
+	_fdt_index_sort_phandles(idx->phandles, nph);
+	idx->num_nodes = node + 1;
+	idx->num_phandles = nph;
+	idx->num_compats = ncompat;
+	idx->hash_mask = path_buckets - 1;
+	idx->nodes_added = 0;
+	idx->phandle_lo = ~0U;
+	idx->phandle_hi = 0;
+	idx->fdt = fdt;
+	fdt_active_index = idx;
+
+	return 0;
+}
+
+void fdt_index_release(struct fdt_index *idx)
+{
+	if (fdt_active_index == idx)
+		fdt_active_index = NULL;
+	idx->fdt = NULL;
+}
+
+void fdt_index_invalidate(const void *fdt)
+{
+	struct fdt_index *idx = fdt_active_index;
+
+	if (idx && idx->fdt == fdt)
+		fdt_index_release(idx);
+}
+
+/*
+ * Move an offset after a region which changes size. Nodes inside the region
+ * are going away, so mark their entries as deleted.
+ */
+static void _fdt_index_shift(int *offsetp, int start, int end, int delta)
+{
+	if (*offsetp >= end)
+		*offsetp += delta;
+	else if (*offsetp >= start)
+		*offsetp = -1;
+}
+
+void _fdt_index_adjust(const void *fdt, int start, int oldlen, int newlen,
+		       int seq)
+{
+	struct fdt_index *idx = fdt_active_index;
+	int end = start + oldlen, delta = newlen - oldlen;
+	int i;
+
+	if (!idx || idx->fdt != fdt)
+		return;
+
+	for (i = 0; i < idx->num_nodes; i++)
+		_fdt_index_shift(&idx->nodes[i].offset, start, end, delta);
+	for (i = 0; i < idx->num_phandles; i++)
+		_fdt_index_shift(&idx->phandles[i].offset, start, end, delta);
+	for (i = 0; i < idx->num_compats; i++)
+		_fdt_index_shift(&idx->compats[i].offset, start, end, delta);
+	if (seq == FDT_TXN_SPLICE_NODE)
+		idx->nodes_added = 1;
+}
+
+static void _fdt_index_phandle_changed(struct fdt_index *idx,
+				       const void *val, int len)
+{
+	uint32_t phandle;
+
+	if (!val || len != sizeof(fdt32_t))
+		return;
+	memcpy(&phandle, val, sizeof(phandle));
+	phandle = fdt32_to_cpu(phandle);
+	if (!phandle || phandle == (uint32_t)-1)
+		return;
+	if (phandle < idx->phandle_lo)
+		idx->phandle_lo = phandle;
+	if (phandle > idx->phandle_hi)
+		idx->phandle_hi = phandle;
+}
+
+static int _fdt_index_name_is(const char *name, int namelen, const char *s)
+{
+	return strlen(s) == namelen && !memcmp(name, s, namelen);
+}
+
+/*
+ * Called before a property is set (@len is the new length), changed in some
+ * other way (@len is -1) or deleted (@val is NULL)
+ */
+void _fdt_index_prop_changed(const void *fdt, int node, const char *name,
+			     int namelen, const void *val, int len)
+{
+	struct fdt_index *idx = fdt_active_index;
+	const void *old;
+	int oldlen;
+
+	if (!idx || idx->fdt != fdt)
+		return;
+
+	if (_fdt_index_name_is(name, namelen, "compatible")) {
+		fdt_index_invalidate(fdt);
+	} else if (_fdt_index_name_is(name, namelen, "phandle") ||
+		   _fdt_index_name_is(name, namelen, "linux,phandle")) {
+		if (len < 0) {
+			fdt_index_invalidate(fdt);
+			return;
+		}
+
+		/*
+		 * Lookups of the old and new values must scan the blob. Either
+		 * property may end up giving the phandle of the node.
+		 */
+		old = fdt_getprop(fdt, node, "phandle", &oldlen);
+		_fdt_index_phandle_changed(idx, old, oldlen);
+		old = fdt_getprop(fdt, node, "linux,phandle", &oldlen);
+		_fdt_index_phandle_changed(idx, old, oldlen);
+		_fdt_index_phandle_changed(idx, val, len);
+	}
+}
+
+struct fdt_index *_fdt_index_active(void)
+{
+	return fdt_active_index;
+}
+
+void _fdt_index_activate(struct fdt_index *idx)
+{
+	fdt_active_index = idx;
+}
+
+const struct fdt_index *_fdt_index_get(const void *fdt)
+{
+	struct fdt_index *idx = fdt_active_index;
+
+	return idx && idx->fdt == fdt ? idx : NULL;
+}
+
+int _fdt_index_phandle(const struct fdt_index *idx, uint32_t phandle)
+{
+	int lo = 0, hi = idx->num_phandles;
+
+	/* Find the first entry with this phandle, i.e. in tree order */
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+
+		if (idx->phandles[mid].phandle < phandle)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < idx->num_phandles && idx->phandles[lo].phandle == phandle;
+	     lo++) {
+		if (idx->phandles[lo].offset >= 0)
+			return idx->phandles[lo].offset;
+	}
+
+	return -FDT_ERR_NOTFOUND;
+}
+
+uint32_t _fdt_index_max_phandle(const struct fdt_index *idx)
+{
+	int i;
+
+	/* Like fdt_get_max_phandle(), skip nodes with the invalid phandle */
+	for (i = idx->num_phandles - 1; i >= 0; i--) {
+		if (idx->phandles[i].phandle != (uint32_t)-1 &&
+		    idx->phandles[i].offset >= 0)
+			return idx->phandles[i].phandle;
+	}
+
+	return 0;
+}
+
+int _fdt_index_compatible(const struct fdt_index *idx, int startoffset,
+			  const char *compatible)
+{
+	uint32_t hash;
+	int best = -FDT_ERR_NOTFOUND;
+	int i, mask;
+
+	if (!idx->num_compats)
+		return best;
+
+	hash = _fdt_index_hash(FDT_INDEX_HASH_BASIS, compatible,
+			       strlen(compatible));
+	mask = _fdt_index_buckets(idx->num_compats) - 1;
+
+	/* Chains are in reverse tree order, so look for the lowest offset */
+	for (i = idx->compat_hash[hash & mask]; i >= 0;
+	     i = idx->compats[i].next) {
+		const struct fdt_index_compat *cp = &idx->compats[i];
+
+		if (cp->hash != hash || cp->offset < 0 ||
+		    cp->offset <= startoffset)
+			continue;
+		if (best >= 0 && cp->offset >= best)
+			continue;
+		if (!fdt_node_check_compatible(idx->fdt, cp->offset,
+					       compatible))
+			best = cp->offset;
+	}
+
+	return best;
+}
+
+/*
+ * Check whether a node name matches a path component, following the rules
+ * of fdt_subnode_offset(): a component without a unit address matches a node
+ * which has one.
+ */
+static int _fdt_index_name_eq(const void *fdt, int offset, const char *s,
+			      int len)
+{
+	const char *name;
+	int namelen;
+
+	name = fdt_get_name(fdt, offset, &namelen);
+	if (!name || namelen < len || memcmp(name, s, len))
+		return 0;
+
+	return namelen == len || (name[len] == '@' && !memchr(s, '@', len));
+}
+
+int _fdt_index_path(const struct fdt_index *idx, const char *path, int len)
+{
+	const char *end = path + len;
+	const char *p = path;
+	int node = 0;
+
+	while (p < end) {
+		const char *q;
+		uint32_t hash;
+		int i, best = -1;
+
+		while (p < end && *p == '/')
+			p++;
+		if (p == end)
+			break;
+		for (q = p; q < end && *q != '/'; q++)
+			;
+
+		/*
+		 * Like fdt_subnode_offset(), take the first matching subnode
+		 * in tree order, i.e. the one with the lowest offset.
+		 */
+		hash = _fdt_index_child_hash(node, p, q - p);
+		for (i = idx->path_hash[hash & idx->hash_mask]; i >= 0;
+		     i = idx->nodes[i].next) {
+			const struct fdt_index_node *np = &idx->nodes[i];
+
+			if (np->hash != hash || np->parent != node ||
+			    np->offset < 0)
+				continue;
+			if (best >= 0 && np->offset >= idx->nodes[best].offset)
+				continue;
+			if (_fdt_index_name_eq(idx->fdt, np->offset, p, q - p))
+				best = i;
+		}
+		if (best < 0)
+			return -FDT_ERR_NOTFOUND;
+		node = best;
+		p = q;
+	}
+
+	return idx->nodes[node].offset;
+}
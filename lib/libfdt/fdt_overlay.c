@@ -325,38 +325,24 @@ static int overlay_update_local_references(void *fdto, uint32_t delta)
 }
 
 /**
- * overlay_fixup_one_phandle - Set an overlay phandle to the base one
+ * overlay_symbol_phandle - Look up the phandle of a base label
  * @fdt: Base Device Tree blob
- * @fdto: Device tree overlay blob
  * @symbols_off: Node offset of the symbols node in the base device tree
- * @path: Path to a node holding a phandle in the overlay
- * @path_len: number of path characters to consider
- * @name: Name of the property holding the phandle reference in the overlay
- * @name_len: number of name characters to consider
- * @poffset: Offset within the overlay property where the phandle is stored
  * @label: Label of the node referenced by the phandle
+ * @phandle: Set to the phandle of the node on success
  *
- * overlay_fixup_one_phandle() resolves an overlay phandle pointing to
- * a node in the base device tree.
- *
- * This is part of the device tree overlay application process, when
- * you want all the phandles in the overlay to point to the actual
- * base dt nodes.
+ * overlay_symbol_phandle() finds the node a label of the base device
+ * tree points to and returns its phandle.
  *
  * returns:
  *      0 on success
  *      Negative error code on failure
  */
-static int overlay_fixup_one_phandle(void *fdt, void *fdto,
-				     int symbols_off,
-				     const char *path, uint32_t path_len,
-				     const char *name, uint32_t name_len,
-				     int poffset, const char *label)
+static int overlay_symbol_phandle(const void *fdt, int symbols_off,
+				  const char *label, uint32_t *phandle)
 {
 	const char *symbol_path;
-	uint32_t phandle;
-	fdt32_t phandle_prop;
-	int symbol_off, fixup_off;
+	int symbol_off;
 	int prop_len;
 
 	if (symbols_off < 0)
@@ -371,10 +357,42 @@ static int overlay_fixup_one_phandle(void *fdt, void *fdto,
 	if (symbol_off < 0)
 		return symbol_off;
 
-	phandle = fdt_get_phandle(fdt, symbol_off);
-	if (!phandle)
+	*phandle = fdt_get_phandle(fdt, symbol_off);
+	if (!*phandle)
 		return -FDT_ERR_NOTFOUND;
 
+	return 0;
+}
+
+/**
+ * overlay_fixup_one_phandle - Set an overlay phandle to the base one
+ * @fdto: Device tree overlay blob
+ * @path: Path to a node holding a phandle in the overlay
+ * @path_len: number of path characters to consider
+ * @name: Name of the property holding the phandle reference in the overlay
+ * @name_len: number of name characters to consider
+ * @poffset: Offset within the overlay property where the phandle is stored
+ * @phandle: Phandle of the base node referenced
+ *
+ * overlay_fixup_one_phandle() resolves an overlay phandle pointing to
+ * a node in the base device tree.
+ *
+ * This is part of the device tree overlay application process, when
+ * you want all the phandles in the overlay to point to the actual
+ * base dt nodes.
+ *
+ * returns:
+ *      0 on success
+ *      Negative error code on failure
+ */
+static int overlay_fixup_one_phandle(void *fdto,
+				     const char *path, uint32_t path_len,
+				     const char *name, uint32_t name_len,
+				     int poffset, uint32_t phandle)
+{
+	fdt32_t phandle_prop;
+	int fixup_off;
+
 	fixup_off = fdt_path_offset_namelen(fdto, path, path_len);
 	if (fixup_off == -FDT_ERR_NOTFOUND)
 		return -FDT_ERR_BADOVERLAY;
@@ -397,7 +415,8 @@ static int overlay_fixup_one_phandle(void *fdt, void *fdto,
  *
  * overlay_fixup_phandle() resolves all the overlay phandles pointed
  * to in a __fixups__ property, and updates them to match the phandles
- * in use in the base device tree.
+ * in use in the base device tree. The label is looked up in the base
+ * only once, however many references there are to it.
  *
  * This is part of the device tree overlay application process, when
  * you want all the phandles in the overlay to point to the actual
@@ -412,6 +431,7 @@ static int overlay_fixup_phandle(void *fdt, void *fdto, int symbols_off,
 {
 	const char *value;
 	const char *label;
+	uint32_t phandle = 0;
 	int len;
 
 	value = fdt_getprop_by_offset(fdto, property,
@@ -462,9 +482,15 @@ static int overlay_fixup_phandle(void *fdt, void *fdto, int symbols_off,
 		if ((*endptr != '\0') || (endptr <= (sep + 1)))
 			return -FDT_ERR_BADOVERLAY;
 
-		ret = overlay_fixup_one_phandle(fdt, fdto, symbols_off,
-						path, path_len, name, name_len,
-						poffset, label);
+		if (!phandle) {
+			ret = overlay_symbol_phandle(fdt, symbols_off, label,
+						     &phandle);
+			if (ret)
+				return ret;
+		}
+
+		ret = overlay_fixup_one_phandle(fdto, path, path_len, name,
+						name_len, poffset, phandle);
 		if (ret)
 			return ret;
 	} while (len > 0);
@@ -630,48 +656,117 @@ static int overlay_merge(void *fdt, void *fdto)
 	return 0;
 }
 
-int fdt_overlay_apply(void *fdt, void *fdto)
+/**
+ * overlay_apply - Apply an overlay on a base device tree
+ * @fdt: Base Device Tree blob
+ * @fdto: Device tree overlay blob
+ *
+ * overlay_apply() runs all the steps of the overlay application,
+ * leaving the magic of both blobs alone.
+ *
+ * returns:
+ *      0 on success
+ *      Negative error code on failure
+ */
+static int overlay_apply(void *fdt, void *fdto)
 {
 	uint32_t delta = fdt_get_max_phandle(fdt);
 	int ret;
 
-	FDT_CHECK_HEADER(fdt);
-	FDT_CHECK_HEADER(fdto);
-
 	ret = overlay_adjust_local_phandles(fdto, delta);
 	if (ret)
-		goto err;
+		return ret;
 
 	ret = overlay_update_local_references(fdto, delta);
 	if (ret)
-		goto err;
+		return ret;
 
 	ret = overlay_fixup_phandles(fdt, fdto);
 	if (ret)
-		goto err;
+		return ret;
 
-	ret = overlay_merge(fdt, fdto);
-	if (ret)
-		goto err;
+	return overlay_merge(fdt, fdto);
+}
+
+int fdt_overlay_apply(void *fdt, void *fdto)
+{
+	int ret;
+
+	FDT_CHECK_HEADER(fdt);
+	FDT_CHECK_HEADER(fdto);
+
+	ret = overlay_apply(fdt, fdto);
 
 	/*
 	 * The overlay has been damaged, erase its magic.
 	 */
 	fdt_set_magic(fdto, ~0);
 
-	return 0;
-
-err:
 	/*
-	 * The overlay might have been damaged, erase its magic.
+	 * On error the base device tree might have been damaged too,
+	 * erase its magic.
 	 */
-	fdt_set_magic(fdto, ~0);
+	if (ret)
+		fdt_set_magic(fdt, ~0);
+
+	return ret;
+}
+
+int fdt_overlay_apply_list(void *fdt, void * const fdtos[], int count,
+			   void *buf, int bufsize)
+{
+	struct fdt_index idx, *prev;
+	struct fdt_txn txn;
+	int logsize = (bufsize / 2) & ~3;
+	int ret = 0, err;
+	int i;
+
+	FDT_CHECK_HEADER(fdt);
+	for (i = 0; i < count; i++)
+		FDT_CHECK_HEADER(fdtos[i]);
+
+	err = fdt_txn_begin(&txn, fdt, buf, logsize);
+	if (err)
+		return err;
+
+	/* Any other index (e.g. of the control FDT) is put back at the end */
+	prev = _fdt_index_active();
+	idx.fdt = NULL;
+	for (i = 0; i < count && !ret; i++) {
+		/*
+		 * Merging an overlay adds nodes and phandles, after which
+		 * the index only helps with some lookups, so build it again
+		 * for the next one. Without enough room the lookups just
+		 * scan the tree as usual.
+		 */
+		if (!idx.fdt || idx.nodes_added ||
+		    idx.phandle_lo <= idx.phandle_hi) {
+			fdt_index_release(&idx);
+			fdt_index_build(&idx, fdt, (char *)buf + logsize,
+					bufsize - logsize);
+		}
+
+		ret = overlay_apply(fdt, fdtos[i]);
+
+		/*
+		 * The overlay has been damaged, erase its magic.
+		 */
+		fdt_set_magic(fdtos[i], ~0);
+	}
+	fdt_index_release(&idx);
+	if (prev && prev->fdt && prev->fdt != fdt)
+		_fdt_index_activate(prev);
+
+	err = fdt_txn_commit(&txn);
+	if (!ret)
+		ret = err;
 
 	/*
 	 * The base device tree might have been damaged, erase its
 	 * magic.
 	 */
-	fdt_set_magic(fdt, ~0);
+	if (ret)
+		fdt_set_magic(fdt, ~0);
 
 	return ret;
 }
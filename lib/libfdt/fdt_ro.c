@@ -49,9 +49,14 @@ static int _fdt_string_eq(const void *fdt, int stroffset,
 
 uint32_t fdt_get_max_phandle(const void *fdt)
 {
+	const struct fdt_index *idx;
 	uint32_t max_phandle = 0;
 	int offset;
 
+	idx = _fdt_index_get(fdt);
+	if (idx && idx->phandle_lo > idx->phandle_hi)
+		return _fdt_index_max_phandle(idx);
+
 	for (offset = fdt_next_node(fdt, -1, NULL);;
 	     offset = fdt_next_node(fdt, offset, NULL)) {
 		uint32_t phandle;
@@ -162,10 +167,16 @@ int fdt_path_offset_namelen(const void *fdt, const char *path, int namelen)
 {
 	const char *end = path + namelen;
 	const char *p = path;
+	const struct fdt_index *idx;
 	int offset = 0;
 
 	FDT_CHECK_HEADER(fdt);
 
+	idx = _fdt_index_get(fdt);
+	if (idx && !idx->nodes_added && *path == '/' &&
+	    !memchr(path, ':', namelen))
+		return _fdt_index_path(idx, path, strnlen(path, namelen));
+
 	/* see if we have an alias */
 	if (*path != '/') {
 		const char *q = fdt_path_next_separator(path, namelen);
@@ -229,6 +240,49 @@ const char *fdt_get_name(const void *fdt, int nodeoffset, int *len)
 	return NULL;
 }
 
+/* Skip properties deleted by an open transaction */
+static int _nextprop_live(const void *fdt, int offset)
+{
+	offset = _nextprop(fdt, offset);
+	while (offset >= 0 && _fdt_txn_deleted_at(fdt, offset))
+		offset = _nextprop(fdt, _fdt_check_prop_offset(fdt, offset));
+
+	return offset;
+}
+
+/* Find the end of the properties of a node, from one of them */
+static int _propend(const void *fdt, int offset)
+{
+	uint32_t tag;
+	int nextoffset;
+
+	for (;;) {
+		tag = fdt_next_tag(fdt, offset, &nextoffset);
+		if (tag != FDT_PROP && tag != FDT_NOP)
+			return offset;
+		offset = nextoffset;
+	}
+}
+
+/*
+ * Find the next property from @offset in the blob, unless an open
+ * transaction has added one in front of it: that is, after the one added
+ * at @pos with sequence number @seq, or after @pos if @seq is 0.
+ */
+static int _nextprop_added(const void *fdt, int offset, int pos, int seq)
+{
+	int next, end, added;
+
+	next = _nextprop_live(fdt, offset);
+	if (!_fdt_txn_get(fdt))
+		return next;
+
+	end = next >= 0 ? next : _propend(fdt, offset);
+	added = _fdt_txn_next_new_prop(fdt, pos, seq, end);
+
+	return added >= 0 ? added : next;
+}
+
 int fdt_first_property_offset(const void *fdt, int nodeoffset)
 {
 	int offset;
@@ -236,15 +290,22 @@ int fdt_first_property_offset(const void *fdt, int nodeoffset)
 	if ((offset = _fdt_check_node_offset(fdt, nodeoffset)) < 0)
 		return offset;
 
-	return _nextprop(fdt, offset);
+	return _nextprop_added(fdt, offset, offset - 1, 0);
 }
 
 int fdt_next_property_offset(const void *fdt, int offset)
 {
+	int pos, seq;
+
+	/* A property added in an open transaction */
+	if (!_fdt_txn_new_prop_at(fdt, offset, &pos, &seq))
+		return _nextprop_added(fdt, pos, pos, seq);
+
+	pos = offset;
 	if ((offset = _fdt_check_prop_offset(fdt, offset)) < 0)
 		return offset;
 
-	return _nextprop(fdt, offset);
+	return _nextprop_added(fdt, offset, pos, 0);
 }
 
 const struct fdt_property *fdt_get_property_by_offset(const void *fdt,
@@ -254,14 +315,16 @@ const struct fdt_property *fdt_get_property_by_offset(const void *fdt,
 	int err;
 	const struct fdt_property *prop;
 
-	if ((err = _fdt_check_prop_offset(fdt, offset)) < 0) {
-		if (lenp)
-			*lenp = err;
-		return NULL;
+	prop = _fdt_txn_prop_at(fdt, offset);
+	if (!prop) {
+		if ((err = _fdt_check_prop_offset(fdt, offset)) < 0) {
+			if (lenp)
+				*lenp = err;
+			return NULL;
+		}
+		prop = _fdt_offset_ptr(fdt, offset);
 	}
 
-	prop = _fdt_offset_ptr(fdt, offset);
-
 	if (lenp)
 		*lenp = fdt32_to_cpu(prop->len);
 
@@ -273,6 +336,11 @@ const struct fdt_property *fdt_get_property_namelen(const void *fdt,
 						    const char *name,
 						    int namelen, int *lenp)
 {
+	const struct fdt_property *pending;
+
+	if (_fdt_txn_getprop(fdt, offset, name, namelen, &pending, lenp))
+		return pending;
+
 	for (offset = fdt_first_property_offset(fdt, offset);
 	     (offset >= 0);
 	     (offset = fdt_next_property_offset(fdt, offset))) {
@@ -503,6 +571,7 @@ int fdt_node_offset_by_prop_value(const void *fdt, int startoffset,
 
 int fdt_node_offset_by_phandle(const void *fdt, uint32_t phandle)
 {
+	const struct fdt_index *idx;
 	int offset;
 
 	if ((phandle == 0) || (phandle == -1))
@@ -510,6 +579,10 @@ int fdt_node_offset_by_phandle(const void *fdt, uint32_t phandle)
 
 	FDT_CHECK_HEADER(fdt);
 
+	idx = _fdt_index_get(fdt);
+	if (idx && (phandle < idx->phandle_lo || phandle > idx->phandle_hi))
+		return _fdt_index_phandle(idx, phandle);
+
 	/* FIXME: The algorithm here is pretty horrible: we
 	 * potentially scan each property of a node in
 	 * fdt_get_phandle(), then if that didn't find what
@@ -659,10 +732,19 @@ int fdt_node_check_compatible(const void *fdt, int nodeoffset,
 int fdt_node_offset_by_compatible(const void *fdt, int startoffset,
 				  const char *compatible)
 {
+	const struct fdt_index *idx;
 	int offset, err;
 
 	FDT_CHECK_HEADER(fdt);
 
+	idx = _fdt_index_get(fdt);
+	if (idx && !idx->nodes_added) {
+		if (startoffset >= 0 &&
+		    (err = _fdt_check_node_offset(fdt, startoffset)) < 0)
+			return err;
+		return _fdt_index_compatible(idx, startoffset, compatible);
+	}
+
 	/* FIXME: The algorithm here is pretty horrible: we scan each
 	 * property of a node in fdt_node_check_compatible(), then if
 	 * that didn't find what we want, we scan over them again
@@ -48,6 +48,14 @@ static int _fdt_rw_check_header(void *fdt)
 			return __err; \
 	}
 
+/* Write out any batched edits before moving the blob as a whole */
+#define FDT_RW_FLUSH_TXN(fdt) \
+	{ \
+		int __err; \
+		if ((__err = _fdt_txn_flush(fdt)) != 0) \
+			return __err; \
+	}
+
 static inline int _fdt_data_size(void *fdt)
 {
 	return fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt);
@@ -62,7 +70,8 @@ static int _fdt_splice(void *fdt, void *splicepoint, int oldlen, int newlen)
 		return -FDT_ERR_BADOFFSET;
 	if ((p < (char *)fdt) || ((end - oldlen + newlen) < (char *)fdt))
 		return -FDT_ERR_BADOFFSET;
-	if ((end - oldlen + newlen) > ((char *)fdt + fdt_totalsize(fdt)))
+	if ((end - oldlen + newlen + _fdt_txn_delta(fdt)) >
+	    ((char *)fdt + fdt_totalsize(fdt)))
 		return -FDT_ERR_NOSPACE;
 	memmove(p + newlen, p + oldlen, end - p - oldlen);
 	return 0;
@@ -81,10 +90,10 @@ static int _fdt_splice_mem_rsv(void *fdt, struct fdt_reserve_entry *p,
 	return 0;
 }
 
-static int _fdt_splice_struct(void *fdt, void *p,
-			      int oldlen, int newlen)
+int _fdt_rw_splice_struct(void *fdt, void *p, int oldlen, int newlen, int seq)
 {
 	int delta = newlen - oldlen;
+	int offset;
 	int err;
 
 	if ((err = _fdt_splice(fdt, p, oldlen, newlen)))
@@ -92,9 +101,19 @@ static int _fdt_splice_struct(void *fdt, void *p,
 
 	fdt_set_size_dt_struct(fdt, fdt_size_dt_struct(fdt) + delta);
 	fdt_set_off_dt_strings(fdt, fdt_off_dt_strings(fdt) + delta);
+	offset = (char *)p - (char *)_fdt_offset_ptr(fdt, 0);
+	_fdt_index_adjust(fdt, offset, oldlen, newlen, seq);
+	_fdt_txn_adjust(fdt, offset, oldlen, newlen, seq);
 	return 0;
 }
 
+static int _fdt_splice_struct(void *fdt, void *p,
+			      int oldlen, int newlen)
+{
+	return _fdt_rw_splice_struct(fdt, p, oldlen, newlen,
+				     FDT_TXN_SPLICE_DATA);
+}
+
 static int _fdt_splice_string(void *fdt, int newlen)
 {
 	void *p = (char *)fdt
@@ -108,7 +127,7 @@ static int _fdt_splice_string(void *fdt, int newlen)
 	return 0;
 }
 
-static int _fdt_find_add_string(void *fdt, const char *s)
+int _fdt_rw_find_add_string(void *fdt, const char *s)
 {
 	char *strtab = (char *)fdt + fdt_off_dt_strings(fdt);
 	const char *p;
@@ -188,14 +207,15 @@ static int _fdt_add_property(void *fdt, int nodeoffset, const char *name,
 	if ((nextoffset = _fdt_check_node_offset(fdt, nodeoffset)) < 0)
 		return nextoffset;
 
-	namestroff = _fdt_find_add_string(fdt, name);
+	namestroff = _fdt_rw_find_add_string(fdt, name);
 	if (namestroff < 0)
 		return namestroff;
 
 	*prop = _fdt_offset_ptr_w(fdt, nextoffset);
 	proplen = sizeof(**prop) + FDT_TAGALIGN(len);
 
-	err = _fdt_splice_struct(fdt, *prop, 0, proplen);
+	err = _fdt_rw_splice_struct(fdt, *prop, 0, proplen,
+				    _fdt_txn_next_seq(fdt));
 	if (err)
 		return err;
 
@@ -219,6 +239,7 @@ int fdt_set_name(void *fdt, int nodeoffset, const char *name)
 
 	newlen = strlen(name);
 
+	fdt_index_invalidate(fdt);
 	err = _fdt_splice_struct(fdt, namep, FDT_TAGALIGN(oldlen+1),
 				 FDT_TAGALIGN(newlen+1));
 	if (err)
@@ -236,6 +257,13 @@ int fdt_setprop(void *fdt, int nodeoffset, const char *name,
 
 	FDT_RW_CHECK_HEADER(fdt);
 
+	_fdt_index_prop_changed(fdt, nodeoffset, name, strlen(name), val, len);
+	if (_fdt_txn_get(fdt)) {
+		err = _fdt_txn_setprop(fdt, nodeoffset, name, val, len, 0);
+		if (err <= 0)
+			return err;
+	}
+
 	err = _fdt_resize_property(fdt, nodeoffset, name, len, &prop);
 	if (err == -FDT_ERR_NOTFOUND)
 		err = _fdt_add_property(fdt, nodeoffset, name, len, &prop);
@@ -244,6 +272,7 @@ int fdt_setprop(void *fdt, int nodeoffset, const char *name,
 
 	if (len)
 		memcpy(prop->data, val, len);
+	memset(prop->data + len, 0, FDT_TAGALIGN(len) - len);
 	return 0;
 }
 
@@ -255,6 +284,14 @@ int fdt_appendprop(void *fdt, int nodeoffset, const char *name,
 
 	FDT_RW_CHECK_HEADER(fdt);
 
+	_fdt_index_prop_changed(fdt, nodeoffset, name, strlen(name), val,
+				-1);
+	if (_fdt_txn_get(fdt)) {
+		err = _fdt_txn_setprop(fdt, nodeoffset, name, val, len, 1);
+		if (err <= 0)
+			return err;
+	}
+
 	prop = fdt_get_property_w(fdt, nodeoffset, name, &oldlen);
 	if (prop) {
 		newlen = len + oldlen;
@@ -270,7 +307,9 @@ int fdt_appendprop(void *fdt, int nodeoffset, const char *name,
 		if (err)
 			return err;
 		memcpy(prop->data, val, len);
+		newlen = len;
 	}
+	memset(prop->data + newlen, 0, FDT_TAGALIGN(newlen) - newlen);
 	return 0;
 }
 
@@ -278,9 +317,18 @@ int fdt_delprop(void *fdt, int nodeoffset, const char *name)
 {
 	struct fdt_property *prop;
 	int len, proplen;
+	int err;
 
 	FDT_RW_CHECK_HEADER(fdt);
 
+	_fdt_index_prop_changed(fdt, nodeoffset, name, strlen(name), NULL,
+				0);
+	if (_fdt_txn_get(fdt)) {
+		err = _fdt_txn_delprop(fdt, nodeoffset, name);
+		if (err <= 0)
+			return err;
+	}
+
 	prop = fdt_get_property_w(fdt, nodeoffset, name, &len);
 	if (!prop)
 		return len;
@@ -317,7 +365,7 @@ int fdt_add_subnode_namelen(void *fdt, int parentoffset,
 	nh = _fdt_offset_ptr_w(fdt, offset);
 	nodelen = sizeof(*nh) + FDT_TAGALIGN(namelen+1) + FDT_TAGSIZE;
 
-	err = _fdt_splice_struct(fdt, nh, 0, nodelen);
+	err = _fdt_rw_splice_struct(fdt, nh, 0, nodelen, FDT_TXN_SPLICE_NODE);
 	if (err)
 		return err;
 
@@ -381,7 +429,9 @@ int fdt_open_into(const void *fdt, void *buf, int bufsize)
 	char *tmp;
 
 	FDT_CHECK_HEADER(fdt);
+	FDT_RW_FLUSH_TXN(fdt);
 
+	fdt_index_invalidate(buf);
 	mem_rsv_size = (fdt_num_mem_rsv(fdt)+1)
 		* sizeof(struct fdt_reserve_entry);
 
@@ -440,6 +490,7 @@ int fdt_pack(void *fdt)
 	int mem_rsv_size;
 
 	FDT_RW_CHECK_HEADER(fdt);
+	FDT_RW_FLUSH_TXN(fdt);
 
 	mem_rsv_size = (fdt_num_mem_rsv(fdt)+1)
 		* sizeof(struct fdt_reserve_entry);
@@ -459,6 +510,10 @@ int fdt_remove_unused_strings(const void *old, void *new)
 	int ret;
 	int tag = FDT_PROP;
 
+	ret = _fdt_txn_flush(old);
+	if (ret)
+		return ret;
+
 	/* Make a copy and remove the strings */
 	memcpy(new, old, size);
 	fdt_set_size_dt_strings(new, 0);
@@ -472,7 +527,7 @@ int fdt_remove_unused_strings(const void *old, void *new)
 		new_prop = (struct fdt_property *)(unsigned long)
 			fdt_get_property_by_offset(new, offset, NULL);
 		str = fdt_string(old, fdt32_to_cpu(old_prop->nameoff));
-		ret = _fdt_find_add_string(new, str);
+		ret = _fdt_rw_find_add_string(new, str);
 		if (ret < 0)
 			return ret;
 		new_prop->nameoff = cpu_to_fdt32(ret);
@@ -0,0 +1,911 @@
+/*
+ * libfdt - Flat Device Tree manipulation
+ * Batched property edits
+ * SPDX-License-Identifier:	GPL-2.0+ BSD-2-Clause
+ */
+#include <libfdt_env.h>
+
+#ifndef USE_HOSTCC
+#include <fdt.h>
+#include <libfdt.h>
+#else
+#include "fdt_host.h"
+#endif
+
+#include "libfdt_internal.h"
+
+#define FDT_TXN_DEAD		(1 << 0)	/* No longer in effect */
+#define FDT_TXN_DELETED		(1 << 1)	/* Property is removed */
+#define FDT_TXN_NOP		(1 << 2)	/* Nopped node, see below */
+
+/*
+ * One log entry. Entries live at the start of the log buffer; an array of
+ * their positions grows down from the end of the buffer.
+ *
+ * An entry either changes a property which is in the blob (@oldsize is
+ * non-zero and @pos is the offset of the property) or adds a new one (@pos
+ * is the start of the node's properties, where fdt_setprop() would put it).
+ * Direct edits of the blob while the log is open update @node and @pos so
+ * that they stay correct.
+ *
+ * A node which is nopped while edits within it are pending gets an entry
+ * with FDT_TXN_NOP, which resizes the nopped region (@oldsize bytes at
+ * @pos) to what the edits would have made it, given by @prop.len. Its @node
+ * is -1 as the node no longer exists.
+ */
+struct fdt_txn_edit {
+	int node;		/* Offset of the node holding the property */
+	int pos;		/* Offset in the struct block, see above */
+	int seq;		/* Order in which new properties were added */
+	int flags;		/* FDT_TXN_... */
+	int space;		/* Bytes available for the value */
+	int oldsize;		/* Size of the property in the blob, 0 if new */
+	int shift;		/* Used while writing out: total delta so far */
+	struct fdt_property prop;	/* Value as seen by readers */
+};
+
+/* See fdt_index.c for why this is not in BSS */
+#ifdef USE_HOSTCC
+static struct fdt_txn *fdt_active_txn;
+#else
+static struct fdt_txn *fdt_active_txn __attribute__((section(".data")));
+#endif
+
+static int *_fdt_txn_slots(struct fdt_txn *txn)
+{
+	return (int *)(txn->buf + txn->size) - txn->count;
+}
+
+/* Get entry @i, in the order they were created */
+static struct fdt_txn_edit *_fdt_txn_edit(struct fdt_txn *txn, int i)
+{
+	return (struct fdt_txn_edit *)(txn->buf +
+				       _fdt_txn_slots(txn)[txn->count - 1 - i]);
+}
+
+static int _fdt_txn_edit_size(int space)
+{
+	return FDT_ALIGN(sizeof(struct fdt_txn_edit) + space, sizeof(int));
+}
+
+/* Size of a property in the struct block, including its header */
+static int _fdt_txn_prop_size(int len)
+{
+	return sizeof(struct fdt_property) + FDT_TAGALIGN(len);
+}
+
+static int _fdt_txn_newsize(const struct fdt_txn_edit *e)
+{
+	if (e->flags & FDT_TXN_DELETED)
+		return 0;
+	if (e->flags & FDT_TXN_NOP)
+		return fdt32_to_cpu(e->prop.len);
+
+	return _fdt_txn_prop_size(fdt32_to_cpu(e->prop.len));
+}
+
+static int _fdt_txn_fits(struct fdt_txn *txn, int space)
+{
+	return txn->used + _fdt_txn_edit_size(space) +
+		(txn->count + 1) * (int)sizeof(int) <= txn->size;
+}
+
+static struct fdt_txn_edit *_fdt_txn_alloc(struct fdt_txn *txn, int space)
+{
+	struct fdt_txn_edit *e = (struct fdt_txn_edit *)(txn->buf + txn->used);
+
+	txn->count++;
+	_fdt_txn_slots(txn)[0] = txn->used;
+	txn->used += _fdt_txn_edit_size(space);
+	memset(e, 0, sizeof(*e));
+	e->space = space;
+
+	return e;
+}
+
+/* Squeeze out dead entries, keeping the others in order */
+static void _fdt_txn_compact(struct fdt_txn *txn)
+{
+	int i, count = 0, used = 0;
+	int *slots = _fdt_txn_slots(txn);
+
+	for (i = txn->count - 1; i >= 0; i--) {
+		struct fdt_txn_edit *e;
+		int size;
+
+		e = (struct fdt_txn_edit *)(txn->buf + slots[i]);
+		if (e->flags & FDT_TXN_DEAD)
+			continue;
+		size = _fdt_txn_edit_size(e->space);
+		memmove(txn->buf + used, e, size);
+		slots[txn->count - 1 - count++] = used;
+		used += size;
+	}
+	txn->count = count;
+	txn->used = used;
+}
+
+#define FDT_TXN_FILTER_BITS	(FDT_TXN_FILTER_WORDS * 32)
+
+static void _fdt_txn_filter_add(struct fdt_txn *txn, int pos)
+{
+	int bit = (pos / FDT_TAGSIZE) % FDT_TXN_FILTER_BITS;
+
+	txn->filter[bit / 32] |= 1U << (bit % 32);
+}
+
+static int _fdt_txn_filter_test(struct fdt_txn *txn, int pos)
+{
+	int bit = (pos / FDT_TAGSIZE) % FDT_TXN_FILTER_BITS;
+
+	return txn->filter[bit / 32] & (1U << (bit % 32));
+}
+
+/* Set up the filter again after entries have moved */
+static void _fdt_txn_filter_rebuild(struct fdt_txn *txn)
+{
+	int i;
+
+	memset(txn->filter, 0, sizeof(txn->filter));
+	for (i = 0; i < txn->count; i++) {
+		struct fdt_txn_edit *e = _fdt_txn_edit(txn, i);
+
+		if (e->oldsize && !(e->flags & (FDT_TXN_DEAD | FDT_TXN_NOP)))
+			_fdt_txn_filter_add(txn, e->pos);
+	}
+}
+
+/* Remove an entry from the log without writing it out */
+static void _fdt_txn_kill(struct fdt_txn *txn, struct fdt_txn_edit *e)
+{
+	txn->delta -= _fdt_txn_newsize(e) - e->oldsize;
+	e->flags |= FDT_TXN_DEAD;
+}
+
+/* Check whether an entry edits something within a region of the blob */
+static int _fdt_txn_within(const struct fdt_txn_edit *e, int start, int end)
+{
+	int offset = e->flags & FDT_TXN_NOP ? e->pos : e->node;
+
+	return offset >= start && offset < end;
+}
+
+struct fdt_txn *_fdt_txn_get(const void *fdt)
+{
+	struct fdt_txn *txn = fdt_active_txn;
+
+	return txn && txn->fdt == fdt ? txn : NULL;
+}
+
+int _fdt_txn_delta(const void *fdt)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+
+	return txn ? txn->delta : 0;
+}
+
+int _fdt_txn_next_seq(const void *fdt)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+
+	return txn ? txn->seq++ : 0;
+}
+
+void _fdt_txn_adjust(const void *fdt, int start, int oldlen, int newlen,
+		     int seq)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	int end = start + oldlen;
+	int delta = newlen - oldlen;
+	int moved = 0;
+	int i;
+
+	if (!txn)
+		return;
+
+	for (i = 0; i < txn->count; i++) {
+		struct fdt_txn_edit *e = _fdt_txn_edit(txn, i);
+
+		if (e->flags & FDT_TXN_DEAD)
+			continue;
+
+		/*
+		 * Drop edits to anything which has been removed. Nopping a
+		 * node removes nothing; _fdt_txn_nop_node() has seen to the
+		 * edits within it.
+		 */
+		if (_fdt_txn_within(e, start, end) && oldlen != newlen) {
+			_fdt_txn_kill(txn, e);
+			continue;
+		}
+		if (e->node >= end)
+			e->node += delta;
+
+		if (e->oldsize) {
+			if (e->pos >= end && delta) {
+				e->pos += delta;
+				moved = 1;
+			}
+		} else if (e->pos > start) {
+			if (e->pos < end)
+				_fdt_txn_kill(txn, e);
+			else
+				e->pos += delta;
+		} else if (e->pos == start && !oldlen) {
+			/*
+			 * A new property goes after anything inserted at the
+			 * same place, except subnodes and properties added
+			 * after it.
+			 */
+			if (seq == FDT_TXN_SPLICE_DATA ||
+			    (seq >= 0 && e->seq < seq))
+				e->pos += delta;
+		}
+	}
+	if (moved)
+		_fdt_txn_filter_rebuild(txn);
+}
+
+/* Find the live entry for a property, preferring one which is not deleted */
+static struct fdt_txn_edit *_fdt_txn_find(struct fdt_txn *txn, int node,
+					  const char *name, int namelen)
+{
+	struct fdt_txn_edit *found = NULL;
+	int i;
+
+	for (i = txn->count - 1; i >= 0; i--) {
+		struct fdt_txn_edit *e = _fdt_txn_edit(txn, i);
+		const char *p;
+
+		if (e->node != node || (e->flags & FDT_TXN_DEAD))
+			continue;
+		p = fdt_string(txn->fdt, fdt32_to_cpu(e->prop.nameoff));
+		if (strnlen(p, namelen + 1) != namelen ||
+		    memcmp(p, name, namelen))
+			continue;
+		if (!(e->flags & FDT_TXN_DELETED))
+			return e;
+		found = e;
+	}
+
+	return found;
+}
+
+static struct fdt_txn_edit *_fdt_txn_find_offset(struct fdt_txn *txn,
+						 int offset)
+{
+	int i;
+
+	if (!_fdt_txn_filter_test(txn, offset))
+		return NULL;
+
+	for (i = txn->count - 1; i >= 0; i--) {
+		struct fdt_txn_edit *e = _fdt_txn_edit(txn, i);
+
+		if (e->oldsize && e->pos == offset &&
+		    !(e->flags & (FDT_TXN_DEAD | FDT_TXN_NOP)))
+			return e;
+	}
+
+	return NULL;
+}
+
+/* Find a property in the blob itself, ignoring the log */
+static int _fdt_txn_blob_prop(const void *fdt, int node, const char *name,
+			      int namelen)
+{
+	int offset, nextoffset;
+	uint32_t tag;
+
+	offset = _fdt_check_node_offset(fdt, node);
+	if (offset < 0)
+		return offset;
+
+	for (;; offset = nextoffset) {
+		const struct fdt_property *prop;
+		const char *p;
+
+		tag = fdt_next_tag(fdt, offset, &nextoffset);
+		if (tag == FDT_NOP)
+			continue;
+		if (tag != FDT_PROP)
+			return -FDT_ERR_NOTFOUND;
+		prop = _fdt_offset_ptr(fdt, offset);
+		p = fdt_string(fdt, fdt32_to_cpu(prop->nameoff));
+		if (strnlen(p, namelen + 1) == namelen &&
+		    !memcmp(p, name, namelen))
+			return offset;
+	}
+}
+
+static void _fdt_txn_fill_prop(char *p, const struct fdt_txn_edit *e)
+{
+	int len = fdt32_to_cpu(e->prop.len);
+
+	memcpy(p, &e->prop, sizeof(e->prop) + len);
+	memset(p + sizeof(e->prop) + len, 0, FDT_TAGALIGN(len) - len);
+}
+
+static void _fdt_txn_fill_nop(char *p, int size)
+{
+	fdt32_t nop = cpu_to_fdt32(FDT_NOP);
+	int i;
+
+	for (i = 0; i < size; i += FDT_TAGSIZE)
+		memcpy(p + i, &nop, FDT_TAGSIZE);
+}
+
+/* Write a single entry to the blob and remove it from the log */
+static int _fdt_txn_write_edit(struct fdt_txn *txn, struct fdt_txn_edit *e)
+{
+	void *fdt = txn->fdt;
+	int newsize = _fdt_txn_newsize(e);
+	char *p = _fdt_offset_ptr_w(fdt, e->pos);
+	int err;
+
+	_fdt_txn_kill(txn, e);
+	err = _fdt_rw_splice_struct(fdt, p, e->oldsize, newsize,
+				    e->oldsize ? FDT_TXN_SPLICE_DATA : e->seq);
+	if (err)
+		return err;
+	if (e->flags & FDT_TXN_NOP)
+		_fdt_txn_fill_nop(p, newsize);
+	else if (newsize)
+		_fdt_txn_fill_prop(p, e);
+
+	return 0;
+}
+
+int _fdt_txn_write_prop(void *fdt, int node, const char *name)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *e;
+	int err;
+
+	if (!txn)
+		return 0;
+	while ((e = _fdt_txn_find(txn, node, name, strlen(name)))) {
+		err = _fdt_txn_write_edit(txn, e);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/* Write out the entries for anything within a node */
+static int _fdt_txn_write_node(struct fdt_txn *txn, int node, int *endp)
+{
+	int i, err;
+
+	for (i = 0; i < txn->count; i++) {
+		struct fdt_txn_edit *e = _fdt_txn_edit(txn, i);
+
+		if ((e->flags & FDT_TXN_DEAD) ||
+		    !_fdt_txn_within(e, node, *endp))
+			continue;
+		*endp += _fdt_txn_newsize(e) - e->oldsize;
+		err = _fdt_txn_write_edit(txn, e);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/*
+ * Without a log, the edits pending within a node would have changed its size
+ * before it was nopped. Drop them and record the size instead, so that the
+ * same amount of padding is left. If the log is full, write them out.
+ */
+int _fdt_txn_nop_node(void *fdt, int node, int *endp)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *e;
+	int i, delta = 0;
+
+	if (!txn)
+		return 0;
+
+	for (i = 0; i < txn->count; i++) {
+		e = _fdt_txn_edit(txn, i);
+		if (!(e->flags & FDT_TXN_DEAD) &&
+		    _fdt_txn_within(e, node, *endp))
+			delta += _fdt_txn_newsize(e) - e->oldsize;
+	}
+	if (delta && !_fdt_txn_fits(txn, 0)) {
+		_fdt_txn_compact(txn);
+		if (!_fdt_txn_fits(txn, 0))
+			return _fdt_txn_write_node(txn, node, endp);
+	}
+
+	for (i = 0; i < txn->count; i++) {
+		e = _fdt_txn_edit(txn, i);
+		if (!(e->flags & FDT_TXN_DEAD) &&
+		    _fdt_txn_within(e, node, *endp))
+			_fdt_txn_kill(txn, e);
+	}
+	if (!delta)
+		return 0;
+
+	e = _fdt_txn_alloc(txn, 0);
+	e->node = -1;
+	e->pos = node;
+	e->flags = FDT_TXN_NOP;
+	e->oldsize = *endp - node;
+	e->prop.tag = cpu_to_fdt32(FDT_NOP);
+	e->prop.len = cpu_to_fdt32(e->oldsize + delta);
+	txn->delta += delta;
+
+	return 0;
+}
+
+int _fdt_txn_getprop(const void *fdt, int node, const char *name,
+		     int namelen, const struct fdt_property **propp, int *lenp)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *e;
+
+	if (!txn)
+		return 0;
+	e = _fdt_txn_find(txn, node, name, namelen);
+	if (!e)
+		return 0;
+
+	if (e->flags & FDT_TXN_DELETED) {
+		*propp = NULL;
+		if (lenp)
+			*lenp = -FDT_ERR_NOTFOUND;
+	} else {
+		*propp = &e->prop;
+		if (lenp)
+			*lenp = fdt32_to_cpu(e->prop.len);
+	}
+
+	return 1;
+}
+
+/*
+ * Properties added in the transaction have no place in the blob yet. So
+ * that they can be iterated over like the others, give them offsets past
+ * the end of the blob, by sequence number.
+ */
+static int _fdt_txn_new_offset(struct fdt_txn *txn,
+			       const struct fdt_txn_edit *e)
+{
+	return fdt_totalsize(txn->fdt) + e->seq * FDT_TAGSIZE;
+}
+
+/* Find the live property added with the given offset */
+static struct fdt_txn_edit *_fdt_txn_find_new(struct fdt_txn *txn,
+					      int offset)
+{
+	int i;
+
+	if (offset < (int)fdt_totalsize(txn->fdt))
+		return NULL;
+
+	for (i = txn->count - 1; i >= 0; i--) {
+		struct fdt_txn_edit *e = _fdt_txn_edit(txn, i);
+
+		if (!e->oldsize && !(e->flags & FDT_TXN_DEAD) &&
+		    _fdt_txn_new_offset(txn, e) == offset)
+			return e;
+	}
+
+	return NULL;
+}
+
+int _fdt_txn_new_prop_at(const void *fdt, int offset, int *posp, int *seqp)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *e;
+
+	if (!txn)
+		return -FDT_ERR_BADOFFSET;
+	e = _fdt_txn_find_new(txn, offset);
+	if (!e)
+		return -FDT_ERR_BADOFFSET;
+	*posp = e->pos;
+	*seqp = e->seq;
+
+	return 0;
+}
+
+int _fdt_txn_next_new_prop(const void *fdt, int pos, int seq, int end)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *next = NULL;
+	int i;
+
+	if (!txn)
+		return -FDT_ERR_NOTFOUND;
+
+	/*
+	 * Properties added at the same place go in the order fdt_setprop()
+	 * would have put them, the most recent first
+	 */
+	for (i = 0; i < txn->count; i++) {
+		struct fdt_txn_edit *e = _fdt_txn_edit(txn, i);
+
+		if (e->oldsize || (e->flags & FDT_TXN_DEAD) || e->pos > end ||
+		    e->pos < pos || (e->pos == pos && e->seq >= seq))
+			continue;
+		if (!next || e->pos < next->pos ||
+		    (e->pos == next->pos && e->seq > next->seq))
+			next = e;
+	}
+
+	return next ? _fdt_txn_new_offset(txn, next) : -FDT_ERR_NOTFOUND;
+}
+
+const struct fdt_property *_fdt_txn_prop_at(const void *fdt, int offset)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *e;
+
+	if (!txn)
+		return NULL;
+	e = _fdt_txn_find_new(txn, offset);
+	if (e)
+		return &e->prop;
+	e = _fdt_txn_find_offset(txn, offset);
+	if (!e || (e->flags & FDT_TXN_DELETED))
+		return NULL;
+
+	return &e->prop;
+}
+
+int _fdt_txn_deleted_at(const void *fdt, int offset)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *e;
+
+	if (!txn)
+		return 0;
+	e = _fdt_txn_find_offset(txn, offset);
+
+	return e && (e->flags & FDT_TXN_DELETED);
+}
+
+/* Check that the blob still has room once a further @delta is applied */
+static int _fdt_txn_check_space(struct fdt_txn *txn, int delta)
+{
+	void *fdt = txn->fdt;
+
+	if (fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt) + txn->delta +
+	    delta > fdt_totalsize(fdt))
+		return -FDT_ERR_NOSPACE;
+
+	return 0;
+}
+
+/*
+ * Make room for a new entry. If the log is full, write out any entries for
+ * this property and return 1 to have the caller edit the blob directly. That
+ * moves only what a direct edit of the property would move anyway, so
+ * offsets the caller holds stay as valid as they would be without a log.
+ */
+static int _fdt_txn_reserve(struct fdt_txn *txn, int node, const char *name,
+			    int space)
+{
+	int err;
+
+	if (_fdt_txn_fits(txn, space))
+		return 0;
+	_fdt_txn_compact(txn);
+	if (_fdt_txn_fits(txn, space))
+		return 0;
+	err = _fdt_txn_write_prop(txn->fdt, node, name);
+
+	return err ? err : 1;
+}
+
+int _fdt_txn_setprop(void *fdt, int node, const char *name, const void *val,
+		     int len, int append)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	struct fdt_txn_edit *e, *old;
+	const struct fdt_property *prop = NULL;
+	int namelen = strlen(name);
+	int oldlen = 0, newlen, delta;
+	int propoff, nameoff;
+	int err;
+
+	err = _fdt_check_node_offset(fdt, node);
+	if (err < 0)
+		return err;
+
+	old = _fdt_txn_find(txn, node, name, namelen);
+	if (old && (old->flags & FDT_TXN_DELETED))
+		old = NULL;
+	if (old) {
+		oldlen = fdt32_to_cpu(old->prop.len);
+	} else if (!_fdt_txn_find(txn, node, name, namelen)) {
+		propoff = _fdt_txn_blob_prop(fdt, node, name, namelen);
+		if (propoff >= 0) {
+			prop = _fdt_offset_ptr(fdt, propoff);
+			oldlen = fdt32_to_cpu(prop->len);
+		} else if (propoff != -FDT_ERR_NOTFOUND) {
+			return propoff;
+		}
+	}
+	newlen = append ? oldlen + len : len;
+
+	if (old) {
+		/* Update a pending value */
+		delta = FDT_TAGALIGN(newlen) - FDT_TAGALIGN(oldlen);
+		err = _fdt_txn_check_space(txn, delta);
+		if (err)
+			return err;
+		if (newlen > old->space) {
+			err = _fdt_txn_reserve(txn, node, name, newlen);
+			if (err)
+				return err;
+			/* The log may have been compacted */
+			old = _fdt_txn_find(txn, node, name, namelen);
+			e = _fdt_txn_alloc(txn, newlen);
+			e->node = old->node;
+			e->pos = old->pos;
+			e->seq = old->seq;
+			e->oldsize = old->oldsize;
+			e->prop = old->prop;
+			if (append)
+				memcpy(e->prop.data, old->prop.data, oldlen);
+			old->flags |= FDT_TXN_DEAD;
+		} else {
+			e = old;
+		}
+	} else if (prop) {
+		/* Change a property which is in the blob */
+		delta = FDT_TAGALIGN(newlen) - FDT_TAGALIGN(oldlen);
+		err = _fdt_txn_check_space(txn, delta);
+		if (err)
+			return err;
+		err = _fdt_txn_reserve(txn, node, name, newlen);
+		if (err)
+			return err;
+		e = _fdt_txn_alloc(txn, newlen);
+		e->node = node;
+		e->pos = propoff;
+		e->oldsize = _fdt_txn_prop_size(oldlen);
+		_fdt_txn_filter_add(txn, propoff);
+		e->prop = *prop;
+		if (append)
+			memcpy(e->prop.data, prop->data, oldlen);
+	} else {
+		/* Add a new property, at the start of the node */
+		delta = _fdt_txn_prop_size(newlen);
+		err = _fdt_txn_check_space(txn, delta);
+		if (err)
+			return err;
+		err = _fdt_txn_reserve(txn, node, name, newlen);
+		if (err)
+			return err;
+		nameoff = _fdt_rw_find_add_string(fdt, name);
+		if (nameoff < 0)
+			return nameoff;
+		e = _fdt_txn_alloc(txn, newlen);
+		e->node = node;
+		e->pos = _fdt_check_node_offset(fdt, node);
+		e->seq = txn->seq++;
+		e->prop.tag = cpu_to_fdt32(FDT_PROP);
+		e->prop.nameoff = cpu_to_fdt32(nameoff);
+		oldlen = 0;
+	}
+
+	if (len)
+		memmove(e->prop.data + (append ? oldlen : 0), val, len);
+	e->prop.len = cpu_to_fdt32(newlen);
+	txn->delta += delta;
+
+	return 0;
+}
+
+int _fdt_txn_delprop(void *fdt, int node, const char *name)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	const struct fdt_property *prop;
+	struct fdt_txn_edit *e;
+	int namelen = strlen(name);
+	int propoff;
+	int err;
+
+	err = _fdt_check_node_offset(fdt, node);
+	if (err < 0)
+		return err;
+
+	e = _fdt_txn_find(txn, node, name, namelen);
+	if (e && (e->flags & FDT_TXN_DELETED))
+		return -FDT_ERR_NOTFOUND;
+
+	if (e) {
+		if (e->oldsize) {
+			txn->delta -= _fdt_txn_newsize(e);
+			e->flags |= FDT_TXN_DELETED;
+		} else {
+			_fdt_txn_kill(txn, e);
+		}
+		return 0;
+	}
+
+	propoff = _fdt_txn_blob_prop(fdt, node, name, namelen);
+	if (propoff < 0)
+		return propoff;
+
+	err = _fdt_txn_reserve(txn, node, name, 0);
+	if (err)
+		return err;
+	prop = _fdt_offset_ptr(fdt, propoff);
+	e = _fdt_txn_alloc(txn, 0);
+	e->node = node;
+	e->pos = propoff;
+	e->flags = FDT_TXN_DELETED;
+	_fdt_txn_filter_add(txn, propoff);
+	e->oldsize = _fdt_txn_prop_size(fdt32_to_cpu(prop->len));
+	e->prop = *prop;
+	txn->delta -= e->oldsize;
+
+	return 0;
+}
+
+/*
+ * Order of edits in the struct block. New properties go in front of any
+ * existing property at the same place, the most recently added first, as
+ * that is where fdt_setprop() would have put them.
+ */
+static int _fdt_txn_before(const struct fdt_txn_edit *a,
+			   const struct fdt_txn_edit *b)
+{
+	if (a->pos != b->pos)
+		return a->pos < b->pos;
+	if (!a->oldsize != !b->oldsize)
+		return !a->oldsize;
+
+	return a->seq > b->seq;
+}
+
+int _fdt_txn_flush(const void *fdt)
+{
+	struct fdt_txn *txn = _fdt_txn_get(fdt);
+	char *base, *dst;
+	int *slots;
+	int count, end, total;
+	int i, j, k;
+
+	if (!txn || !txn->count)
+		return 0;
+
+	base = _fdt_offset_ptr_w(txn->fdt, 0);
+	end = fdt_off_dt_strings(fdt) + fdt_size_dt_strings(fdt) -
+		fdt_off_dt_struct(fdt);
+
+	/* Drop dead entries */
+	slots = _fdt_txn_slots(txn);
+	for (i = 0, count = 0; i < txn->count; i++) {
+		struct fdt_txn_edit *e;
+
+		e = (struct fdt_txn_edit *)(txn->buf + slots[i]);
+		if (!(e->flags & FDT_TXN_DEAD))
+			slots[count++] = slots[i];
+	}
+
+	/* Sort into struct-block order; there are rarely many entries */
+	for (i = 1; i < count; i++) {
+		int tmp = slots[i];
+		struct fdt_txn_edit *e = (struct fdt_txn_edit *)
+			(txn->buf + tmp);
+
+		for (j = i; j > 0 && _fdt_txn_before(e,
+				(struct fdt_txn_edit *)(txn->buf +
+							slots[j - 1])); j--)
+			slots[j] = slots[j - 1];
+		slots[j] = tmp;
+	}
+
+	total = 0;
+	for (i = 0; i < count; i++) {
+		struct fdt_txn_edit *e = (struct fdt_txn_edit *)
+			(txn->buf + slots[i]);
+
+		e->shift = total;
+		total += _fdt_txn_newsize(e) - e->oldsize;
+	}
+
+	/*
+	 * Move the unchanged data between edits. Segment k runs from the end
+	 * of edit k - 1 to the start of edit k and moves by the total delta
+	 * of the edits before it. Segments moving down are done first, in
+	 * ascending order, then segments moving up, in descending order, so
+	 * that nothing is overwritten before it is moved.
+	 */
+	for (k = 0; k <= count; k++) {
+		struct fdt_txn_edit *prev, *next;
+		int start, stop, shift;
+
+		prev = k ? (struct fdt_txn_edit *)(txn->buf + slots[k - 1]) :
+			NULL;
+		next = k < count ?
+			(struct fdt_txn_edit *)(txn->buf + slots[k]) : NULL;
+		shift = next ? next->shift : total;
+		if (shift >= 0)
+			continue;
+		start = prev ? prev->pos + prev->oldsize : 0;
+		stop = next ? next->pos : end;
+		memmove(base + start + shift, base + start, stop - start);
+	}
+	for (k = count; k >= 0; k--) {
+		struct fdt_txn_edit *prev, *next;
+		int start, stop, shift;
+
+		prev = k ? (struct fdt_txn_edit *)(txn->buf + slots[k - 1]) :
+			NULL;
+		next = k < count ?
+			(struct fdt_txn_edit *)(txn->buf + slots[k]) : NULL;
+		shift = next ? next->shift : total;
+		if (shift <= 0)
+			continue;
+		start = prev ? prev->pos + prev->oldsize : 0;
+		stop = next ? next->pos : end;
+		memmove(base + start + shift, base + start, stop - start);
+	}
+
+	/* Fill in the edited properties */
+	for (i = 0; i < count; i++) {
+		struct fdt_txn_edit *e = (struct fdt_txn_edit *)
+			(txn->buf + slots[i]);
+
+		dst = base + e->pos + e->shift;
+		if (e->flags & FDT_TXN_NOP)
+			_fdt_txn_fill_nop(dst, _fdt_txn_newsize(e));
+		else if (!(e->flags & FDT_TXN_DELETED))
+			_fdt_txn_fill_prop(dst, e);
+	}
+
+	fdt_set_size_dt_struct(txn->fdt, fdt_size_dt_struct(fdt) + total);
+	fdt_set_off_dt_strings(txn->fdt, fdt_off_dt_strings(fdt) + total);
+	fdt_index_invalidate(fdt);
+
+	txn->used = 0;
+	txn->count = 0;
+	txn->delta = 0;
+	memset(txn->filter, 0, sizeof(txn->filter));
+
+	return 0;
+}
+
+int fdt_txn_begin(struct fdt_txn *txn, void *fdt, void *buf, int bufsize)
+{
+	FDT_CHECK_HEADER(fdt);
+
+	if (fdt_active_txn)
+		return -FDT_ERR_BADSTATE;
+	if (fdt_version(fdt) < 17)
+		return -FDT_ERR_BADVERSION;
+
+	txn->fdt = fdt;
+	txn->buf = buf;
+	txn->size = bufsize & ~(sizeof(int) - 1);
+	txn->used = 0;
+	txn->count = 0;
+	txn->seq = 0;
+	txn->delta = 0;
+	memset(txn->filter, 0, sizeof(txn->filter));
+	fdt_active_txn = txn;
+
+	return 0;
+}
+
+int fdt_txn_commit(struct fdt_txn *txn)
+{
+	int err;
+
+	if (fdt_active_txn != txn)
+		return -FDT_ERR_BADSTATE;
+
+	err = _fdt_txn_flush(txn->fdt);
+	fdt_active_txn = NULL;
+	txn->fdt = NULL;
+
+	return err;
+}
@@ -30,6 +30,9 @@ int fdt_setprop_inplace_namelen_partial(void *fdt, int nodeoffset,
 	if (proplen < (len + idx))
 		return -FDT_ERR_NOSPACE;
 
+	/* The index cannot follow a write to part of the value */
+	_fdt_index_prop_changed(fdt, nodeoffset, name, namelen, val,
+				idx || len != proplen ? -1 : len);
 	memcpy((char *)propval + idx, val, len);
 	return 0;
 }
@@ -52,10 +55,14 @@ int fdt_setprop_inplace(void *fdt, int nodeoffset, const char *name,
 						   val, len);
 }
 
-static void _fdt_nop_region(void *start, int len)
+static void _fdt_nop_region(void *fdt, void *start, int len)
 {
+	int offset = (char *)start - (char *)_fdt_offset_ptr(fdt, 0);
 	fdt32_t *p;
 
+	_fdt_index_adjust(fdt, offset, len, len, FDT_TXN_SPLICE_DATA);
+	_fdt_txn_adjust(fdt, offset, len, len, FDT_TXN_SPLICE_DATA);
+
 	for (p = start; (char *)p < ((char *)start + len); p++)
 		*p = cpu_to_fdt32(FDT_NOP);
 }
@@ -63,13 +70,18 @@ static void _fdt_nop_region(void *start, int len)
 int fdt_nop_property(void *fdt, int nodeoffset, const char *name)
 {
 	struct fdt_property *prop;
-	int len;
+	int len, err;
+
+	err = _fdt_txn_write_prop(fdt, nodeoffset, name);
+	if (err)
+		return err;
 
 	prop = fdt_get_property_w(fdt, nodeoffset, name, &len);
 	if (!prop)
 		return len;
 
-	_fdt_nop_region(prop, len + sizeof(*prop));
+	_fdt_index_prop_changed(fdt, nodeoffset, name, strlen(name), NULL, 0);
+	_fdt_nop_region(fdt, prop, len + sizeof(*prop));
 
 	return 0;
 }
@@ -86,13 +98,17 @@ int _fdt_node_end_offset(void *fdt, int offset)
 
 int fdt_nop_node(void *fdt, int nodeoffset)
 {
-	int endoffset;
+	int endoffset, err;
 
 	endoffset = _fdt_node_end_offset(fdt, nodeoffset);
 	if (endoffset < 0)
 		return endoffset;
 
-	_fdt_nop_region(fdt_offset_ptr_w(fdt, nodeoffset, 0),
+	err = _fdt_txn_nop_node(fdt, nodeoffset, &endoffset);
+	if (err)
+		return err;
+
+	_fdt_nop_region(fdt, fdt_offset_ptr_w(fdt, nodeoffset, 0),
 			endoffset - nodeoffset);
 	return 0;
 }
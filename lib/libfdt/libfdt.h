@@ -998,6 +998,109 @@ const char *fdt_stringlist_get(const void *fdt, int nodeoffset,
 			       const char *property, int index,
 			       int *lenp);
 
+/**********************************************************************/
+/* Lookup index                                                       */
+/**********************************************************************/
+
+struct fdt_index_node;
+struct fdt_index_phandle;
+struct fdt_index_compat;
+
+/**
+ * struct fdt_index - lookup tables for a device tree which is mostly read
+ *
+ * Built by fdt_index_build() in a buffer provided by the caller. While an
+ * index is active, fdt_path_offset(), fdt_node_offset_by_phandle() and
+ * fdt_node_offset_by_compatible() use it instead of scanning the blob.
+ *
+ * The read-write functions keep the index in step with the blob where
+ * they can, moving its offsets along with the struct block and dropping
+ * the entries of deleted or nopped nodes. Once a node has been added, path
+ * and compatible lookups go back to scanning; once a phandle has changed,
+ * so do lookups of phandles in the range of those changed. Renaming a
+ * node, changing a compatible string or writing part of a phandle in place
+ * drops the index; it must then be rebuilt if still wanted.
+ *
+ * @fdt:		Blob described by this index, NULL if not valid
+ * @nodes_added:	Non-zero if nodes have been added since it was built
+ * @phandle_lo:		Lowest phandle which may have changed since it was
+ *			built
+ * @phandle_hi:		Highest phandle which may have changed, less than
+ *			@phandle_lo if none has
+ * @num_nodes:		Number of nodes in the tree
+ * @num_phandles:	Number of nodes with a phandle
+ * @num_compats:	Total number of compatible strings in the tree
+ * @hash_mask:		Number of @path_hash buckets minus one
+ * @nodes:		One entry per node, in tree order
+ * @phandles:		Nodes with a phandle, sorted by phandle
+ * @compats:		One entry per compatible string
+ * @path_hash:		Hash buckets for @nodes, keyed by path
+ * @compat_hash:	Hash buckets for @compats, keyed by string
+ */
+struct fdt_index {
+	const void *fdt;
+	int nodes_added;
+	uint32_t phandle_lo;
+	uint32_t phandle_hi;
+	int num_nodes;
+	int num_phandles;
+	int num_compats;
+	int hash_mask;
+	struct fdt_index_node *nodes;
+	struct fdt_index_phandle *phandles;
+	struct fdt_index_compat *compats;
+	int *path_hash;
+	int *compat_hash;
+};
+
+/**
+ * fdt_index_size() - get the buffer size needed to index a tree
+ *
+ * @fdt:	Device tree to index
+ * @return number of bytes the caller must supply to fdt_index_build(), or
+ *	-FDT_ERR_... on error
+ */
+int fdt_index_size(const void *fdt);
+
+/**
+ * fdt_index_build() - build and activate a lookup index for a tree
+ *
+ * Only one index is active at a time; building a new one replaces any
+ * previous index. The buffer must stay valid (and untouched) until the
+ * index is released or invalidated.
+ *
+ * @idx:	Index to fill in
+ * @fdt:	Device tree to index
+ * @buf:	Buffer for the tables, must be at least fdt_index_size() bytes
+ *		and aligned to 4 bytes
+ * @bufsize:	Size of @buf in bytes
+ * @return 0 if OK, -FDT_ERR_NOSPACE if @buf is too small, other -FDT_ERR_...
+ *	on error
+ */
+int fdt_index_build(struct fdt_index *idx, const void *fdt, void *buf,
+		    int bufsize);
+
+/**
+ * fdt_index_release() - stop using an index
+ *
+ * After this the caller may free the buffer passed to fdt_index_build().
+ *
+ * @idx:	Index to release
+ */
+void fdt_index_release(struct fdt_index *idx);
+
+/**
+ * fdt_index_invalidate() - drop the index for a tree which has changed
+ *
+ * libfdt looks after the index itself for the modifications it makes.
+ * Callers which write to the blob directly (e.g. through fdt_getprop_w()) in
+ * a way that changes phandles, compatible strings or node names must call
+ * this.
+ *
+ * @fdt:	Device tree which was modified
+ */
+void fdt_index_invalidate(const void *fdt);
+
 /**********************************************************************/
 /* Read-only functions (addressing related)                           */
 /**********************************************************************/
@@ -1784,6 +1887,77 @@ int fdt_add_subnode(void *fdt, int parentoffset, const char *name);
  */
 int fdt_del_node(void *fdt, int nodeoffset);
 
+/**
+ * struct fdt_txn - a batch of property edits not yet written to the blob
+ *
+ * Each fdt_setprop(), fdt_appendprop() or fdt_delprop() normally moves the
+ * rest of the blob to make or reclaim room. While a transaction is open on
+ * a blob these edits are recorded in a log instead, and all of them are
+ * written out with a single pass over the blob when the transaction is
+ * committed. The result is the same blob that the individual edits would
+ * have produced.
+ *
+ * Recorded edits do not move anything, so offsets stay valid at least as
+ * long as they would without a transaction. fdt_getprop() and friends
+ * return the pending values, and iterating over properties gives the same
+ * properties in the same order as without a transaction. Properties added
+ * in the transaction have offsets past the end of the blob until it is
+ * committed, so they may only be passed to fdt_next_property_offset() and
+ * fdt_get[prop|property]_by_offset(). Other edits (adding, deleting or
+ * renaming nodes, nop-ing, memory reservations) change the blob directly
+ * and the log is updated to match; fdt_nop_node() records the size the
+ * pending edits within the node would have given it, and only writes them
+ * out when the log is full. If the log fills up, the property being edited is
+ * written out and edited directly, so a small log is never an error.
+ * fdt_pack() and fdt_open_into() write out the whole log first.
+ *
+ * @fdt:	Blob being edited, NULL if the transaction is not open
+ * @buf:	Buffer holding the log
+ * @size:	Size of @buf in bytes
+ * @used:	Bytes of log entries at the start of @buf
+ * @count:	Number of log entries
+ * @seq:	Sequence number for the next property added
+ * @delta:	Growth of the struct block once the log is written out
+ * @filter:	Bitmap hashed by offset of the blob properties which have an
+ *		entry, so that reading the others need not search the log
+ */
+#define FDT_TXN_FILTER_WORDS	32
+
+struct fdt_txn {
+	void *fdt;
+	char *buf;
+	int size;
+	int used;
+	int count;
+	int seq;
+	int delta;
+	uint32_t filter[FDT_TXN_FILTER_WORDS];
+};
+
+/**
+ * fdt_txn_begin() - start recording property edits for a blob
+ *
+ * Only one transaction may be open at a time.
+ *
+ * @txn:	Transaction to set up
+ * @fdt:	Blob to edit
+ * @buf:	Buffer for the log, aligned to 4 bytes. It must remain valid
+ *		until fdt_txn_commit() returns
+ * @bufsize:	Size of @buf in bytes
+ * @return 0 if OK, -FDT_ERR_BADSTATE if another transaction is open,
+ *	other -FDT_ERR_... if the blob is not suitable for editing
+ */
+int fdt_txn_begin(struct fdt_txn *txn, void *fdt, void *buf, int bufsize);
+
+/**
+ * fdt_txn_commit() - write out all recorded edits and end a transaction
+ *
+ * @txn:	Transaction to commit
+ * @return 0 if OK, -FDT_ERR_... on error. The transaction is closed in any
+ *	case
+ */
+int fdt_txn_commit(struct fdt_txn *txn);
+
 /**
  * fdt_overlay_apply - Applies a DT overlay on a base DT
  * @fdt: pointer to the base device tree blob
@@ -1815,6 +1989,36 @@ int fdt_del_node(void *fdt, int nodeoffset);
  */
 int fdt_overlay_apply(void *fdt, void *fdto);
 
+/**
+ * fdt_overlay_apply_list - Applies several DT overlays on a base DT
+ * @fdt: pointer to the base device tree blob
+ * @fdtos: pointers to the device tree overlay blobs, in order
+ * @count: number of overlays in @fdtos
+ * @buf: scratch buffer, aligned to 4 bytes
+ * @bufsize: size of @buf in bytes
+ *
+ * fdt_overlay_apply_list() gives the same result as calling
+ * fdt_overlay_apply() for each overlay in turn, but records the
+ * property changes in an edit transaction (see struct fdt_txn) and
+ * looks up labels, paths and phandles in the base device tree through
+ * an index (see struct fdt_index), so the time taken grows linearly
+ * with the number of overlays instead of with the number of
+ * properties times the size of the base. Half of @buf holds the
+ * transaction log and the other half the index; if the index does
+ * not fit, lookups scan the tree as fdt_overlay_apply() does.
+ *
+ * No transaction may be open when this is called. The overlays that
+ * have been applied have their magic erased. Expect the base device
+ * tree to be modified, even if the function returns an error.
+ *
+ * returns:
+ *	0, on success
+ *	-FDT_ERR_BADSTATE, another transaction is open
+ *	other negative values as for fdt_overlay_apply()
+ */
+int fdt_overlay_apply_list(void *fdt, void * const fdtos[], int count,
+			   void *buf, int bufsize);
+
 /**********************************************************************/
 /* Debugging / informational functions                                */
 /**********************************************************************/
@@ -22,6 +22,46 @@ int _fdt_check_prop_offset(const void *fdt, int offset);
 const char *_fdt_find_string(const char *strtab, int tabsize, const char *s);
 int _fdt_node_end_offset(void *fdt, int nodeoffset);
 
+/*
+ * What a splice of the struct block inserts, for _fdt_index_adjust() and
+ * _fdt_txn_adjust(): the sequence number of a new property, or one of these
+ */
+#define FDT_TXN_SPLICE_DATA	-1	/* Part of an existing tag */
+#define FDT_TXN_SPLICE_NODE	-2	/* A new subnode */
+
+const struct fdt_index *_fdt_index_get(const void *fdt);
+struct fdt_index *_fdt_index_active(void);
+void _fdt_index_activate(struct fdt_index *idx);
+int _fdt_index_phandle(const struct fdt_index *idx, uint32_t phandle);
+int _fdt_index_compatible(const struct fdt_index *idx, int startoffset,
+			  const char *compatible);
+int _fdt_index_path(const struct fdt_index *idx, const char *path, int len);
+uint32_t _fdt_index_max_phandle(const struct fdt_index *idx);
+void _fdt_index_adjust(const void *fdt, int start, int oldlen, int newlen,
+		       int seq);
+void _fdt_index_prop_changed(const void *fdt, int node, const char *name,
+			     int namelen, const void *val, int len);
+
+int _fdt_rw_find_add_string(void *fdt, const char *s);
+int _fdt_rw_splice_struct(void *fdt, void *p, int oldlen, int newlen, int seq);
+struct fdt_txn *_fdt_txn_get(const void *fdt);
+int _fdt_txn_delta(const void *fdt);
+int _fdt_txn_next_seq(const void *fdt);
+void _fdt_txn_adjust(const void *fdt, int start, int oldlen, int newlen,
+		     int seq);
+int _fdt_txn_write_prop(void *fdt, int node, const char *name);
+int _fdt_txn_nop_node(void *fdt, int node, int *endp);
+int _fdt_txn_flush(const void *fdt);
+int _fdt_txn_getprop(const void *fdt, int node, const char *name,
+		     int namelen, const struct fdt_property **propp, int *lenp);
+const struct fdt_property *_fdt_txn_prop_at(const void *fdt, int offset);
+int _fdt_txn_new_prop_at(const void *fdt, int offset, int *posp, int *seqp);
+int _fdt_txn_next_new_prop(const void *fdt, int pos, int seq, int end);
+int _fdt_txn_deleted_at(const void *fdt, int offset);
+int _fdt_txn_setprop(void *fdt, int node, const char *name, const void *val,
+		     int len, int append);
+int _fdt_txn_delprop(void *fdt, int node, const char *name);
+
 static inline const void *_fdt_offset_ptr(const void *fdt, int offset)
 {
 	return (const char *)fdt + fdt_off_dt_struct(fdt) + offset;
@@ -0,0 +1,473 @@
+/*
+ * Two-Level Segregated Fit memory allocator
+ *
+ * Free blocks are kept in lists indexed by two levels of size class. The
+ * first level splits sizes at powers of two and the second divides each of
+ * those ranges into TLSF_SL_COUNT equal parts. A bitmap for each level
+ * records which lists are non-empty, so finding a block which fits, and
+ * freeing one, take constant time however many blocks the pool holds.
+ *
+ * Each block starts with a header holding its size and two flags, and the
+ * size of the previous block when that one is free. Used blocks overlap
+ * the next block's prev_size field, so their overhead is a single word.
+ * Free blocks are merged with free neighbours immediately, so no two free
+ * blocks are ever adjacent. A zero-sized used block ends the pool.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <tlsf.h>
+#include <linux/bitops.h>
+
+/* Blocks, and the memory returned, are aligned like dlmalloc's */
+#define TLSF_ALIGN		(2 * sizeof(size_t))
+#define TLSF_ALIGN_LOG2		(sizeof(size_t) == 8 ? 4 : 3)
+
+/* Each power of two is divided into 32 size classes */
+#define TLSF_SL_LOG2		5
+#define TLSF_SL_COUNT		(1 << TLSF_SL_LOG2)
+
+/*
+ * Sizes below TLSF_SMALL all go in the first first-level list, which is
+ * divided linearly in steps of TLSF_ALIGN. Blocks must be smaller than
+ * 1 << TLSF_FL_MAX.
+ */
+#define TLSF_FL_SHIFT		(TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL		((size_t)1 << TLSF_FL_SHIFT)
+#define TLSF_FL_MAX		(sizeof(size_t) == 8 ? 38 : 31)
+#define TLSF_FL_COUNT		(TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+
+/* Flags kept in the low bits of the block size */
+#define TLSF_BLOCK_FREE		1
+#define TLSF_PREV_FREE		2
+#define TLSF_SIZE_MASK		(~(size_t)(TLSF_ALIGN - 1))
+
+/**
+ * struct tlsf_block - header of a block in a pool
+ *
+ * @prev_size:	Size of the previous block; only valid when that is free
+ * @size:	Size of this block including the header, with flags
+ * @next_free:	Next block in the same free list (free blocks only)
+ * @prev_free:	Previous block in the same free list (free blocks only)
+ */
+struct tlsf_block {
+	size_t prev_size;
+	size_t size;
+	struct tlsf_block *next_free;
+	struct tlsf_block *prev_free;
+};
+
+#define TLSF_HDR_SIZE		offsetof(struct tlsf_block, next_free)
+#define TLSF_MIN_BLOCK		sizeof(struct tlsf_block)
+
+struct tlsf {
+	u32 fl_bitmap;
+	u32 sl_bitmap[TLSF_FL_COUNT];
+	struct tlsf_block *heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+	struct tlsf_block *first;
+	size_t size;
+	size_t used;
+	size_t peak;
+	size_t top;
+};
+
+static inline size_t block_size(const struct tlsf_block *block)
+{
+	return block->size & TLSF_SIZE_MASK;
+}
+
+static inline struct tlsf_block *block_next(struct tlsf_block *block)
+{
+	return (void *)block + block_size(block);
+}
+
+static inline void *block_to_ptr(struct tlsf_block *block)
+{
+	return (void *)block + TLSF_HDR_SIZE;
+}
+
+static inline struct tlsf_block *ptr_to_block(void *ptr)
+{
+	return ptr - TLSF_HDR_SIZE;
+}
+
+/* Mark a block free and record its size in the block which follows */
+static void block_set_free(struct tlsf_block *block)
+{
+	struct tlsf_block *next = block_next(block);
+
+	block->size |= TLSF_BLOCK_FREE;
+	next->prev_size = block_size(block);
+	next->size |= TLSF_PREV_FREE;
+}
+
+static void block_set_used(struct tlsf_block *block)
+{
+	block->size &= ~(size_t)TLSF_BLOCK_FREE;
+	block_next(block)->size &= ~(size_t)TLSF_PREV_FREE;
+}
+
+static void tlsf_mapping(size_t size, int *flp, int *slp)
+{
+	int fl, sl;
+
+	if (size < TLSF_SMALL) {
+		fl = 0;
+		sl = size >> TLSF_ALIGN_LOG2;
+	} else {
+		fl = fls_long(size) - 1;
+		sl = (size >> (fl - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+		fl -= TLSF_FL_SHIFT - 1;
+	}
+	*flp = fl;
+	*slp = sl;
+}
+
+static void tlsf_insert(struct tlsf *tlsf, struct tlsf_block *block)
+{
+	struct tlsf_block **head;
+	int fl, sl;
+
+	tlsf_mapping(block_size(block), &fl, &sl);
+	head = &tlsf->heads[fl][sl];
+	block->prev_free = NULL;
+	block->next_free = *head;
+	if (*head)
+		(*head)->prev_free = block;
+	*head = block;
+	tlsf->fl_bitmap |= 1U << fl;
+	tlsf->sl_bitmap[fl] |= 1U << sl;
+}
+
+static void tlsf_remove(struct tlsf *tlsf, struct tlsf_block *block)
+{
+	int fl, sl;
+
+	if (block->next_free)
+		block->next_free->prev_free = block->prev_free;
+	if (block->prev_free) {
+		block->prev_free->next_free = block->next_free;
+		return;
+	}
+
+	tlsf_mapping(block_size(block), &fl, &sl);
+	tlsf->heads[fl][sl] = block->next_free;
+	if (!block->next_free) {
+		tlsf->sl_bitmap[fl] &= ~(1U << sl);
+		if (!tlsf->sl_bitmap[fl])
+			tlsf->fl_bitmap &= ~(1U << fl);
+	}
+}
+
+/*
+ * Find a free block of at least @size bytes. The size is rounded up to the
+ * next size class, so that any block in the list found is large enough.
+ */
+static struct tlsf_block *tlsf_find(struct tlsf *tlsf, size_t size)
+{
+	int fl, sl;
+	u32 map;
+
+	if (size >= TLSF_SMALL)
+		size += ((size_t)1 << (fls_long(size) - 1 - TLSF_SL_LOG2)) - 1;
+	tlsf_mapping(size, &fl, &sl);
+	if (fl >= TLSF_FL_COUNT)
+		return NULL;
+
+	map = tlsf->sl_bitmap[fl] & (~0U << sl);
+	if (!map) {
+		map = tlsf->fl_bitmap & (~0U << (fl + 1));
+		if (!map)
+			return NULL;
+		fl = ffs(map) - 1;
+		map = tlsf->sl_bitmap[fl];
+	}
+	sl = ffs(map) - 1;
+
+	return tlsf->heads[fl][sl];
+}
+
+/* Convert a request to a block size, or 0 if it is too large */
+static size_t tlsf_block_size(size_t bytes)
+{
+	size_t size;
+
+	if (bytes >= ((size_t)1 << TLSF_FL_MAX))
+		return 0;
+	size = ALIGN(bytes + sizeof(size_t), TLSF_ALIGN);
+
+	return max(size, TLSF_MIN_BLOCK);
+}
+
+/* Merge a free block with the block after it, if that one is free too */
+static void tlsf_merge_next(struct tlsf *tlsf, struct tlsf_block *block)
+{
+	struct tlsf_block *next = block_next(block);
+
+	if (next->size & TLSF_BLOCK_FREE) {
+		tlsf_remove(tlsf, next);
+		block->size += block_size(next);
+	}
+}
+
+/* Return the part of a used block beyond @size to the pool */
+static void tlsf_trim(struct tlsf *tlsf, struct tlsf_block *block,
+		      size_t size)
+{
+	size_t rest = block_size(block) - size;
+	struct tlsf_block *tail;
+
+	if (rest < TLSF_MIN_BLOCK)
+		return;
+
+	tail = (void *)block + size;
+	tail->size = rest;
+	block->size = size | (block->size & TLSF_PREV_FREE);
+	tlsf_merge_next(tlsf, tail);
+	block_set_free(tail);
+	tlsf_insert(tlsf, tail);
+}
+
+/* Hand out a block which has been taken off its free list */
+static void *tlsf_use(struct tlsf *tlsf, struct tlsf_block *block,
+		      size_t size)
+{
+	size_t top;
+
+	block_set_used(block);
+	tlsf_trim(tlsf, block, size);
+
+	tlsf->used += block_size(block);
+	if (tlsf->used > tlsf->peak)
+		tlsf->peak = tlsf->used;
+	top = (void *)block_next(block) - (void *)tlsf->first;
+	if (top > tlsf->top)
+		tlsf->top = top;
+
+	return block_to_ptr(block);
+}
+
+struct tlsf *tlsf_create(void *mem, size_t size)
+{
+	ulong start = ALIGN((ulong)mem, sizeof(void *));
+	ulong base = ALIGN(start + sizeof(struct tlsf), TLSF_ALIGN);
+	ulong end = ((ulong)mem + size) & ~(TLSF_ALIGN - 1);
+	struct tlsf_block *block;
+	struct tlsf *tlsf;
+
+	if (end < base || end - base < TLSF_MIN_BLOCK + TLSF_HDR_SIZE)
+		return NULL;
+	size = min_t(size_t, end - base - TLSF_HDR_SIZE,
+		     ((size_t)1 << TLSF_FL_MAX) - TLSF_ALIGN);
+
+	tlsf = (struct tlsf *)start;
+	memset(tlsf, '\0', sizeof(*tlsf));
+	block = (struct tlsf_block *)base;
+	block->size = size;
+	block_next(block)->size = 0;
+	block_set_free(block);
+	tlsf_insert(tlsf, block);
+	tlsf->first = block;
+	tlsf->size = size;
+
+	return tlsf;
+}
+
+void *tlsf_malloc(struct tlsf *tlsf, size_t bytes)
+{
+	struct tlsf_block *block;
+	size_t size;
+
+	size = tlsf_block_size(bytes);
+	if (!size)
+		return NULL;
+	block = tlsf_find(tlsf, size);
+	if (!block)
+		return NULL;
+	tlsf_remove(tlsf, block);
+
+	return tlsf_use(tlsf, block, size);
+}
+
+void *tlsf_memalign(struct tlsf *tlsf, size_t align, size_t bytes)
+{
+	struct tlsf_block *block, *lead;
+	size_t size, gap;
+	void *ptr;
+
+	if (align <= TLSF_ALIGN)
+		return tlsf_malloc(tlsf, bytes);
+	if (align & (align - 1))
+		align = (size_t)1 << fls_long(align);
+
+	size = tlsf_block_size(bytes);
+	if (!size || size + align + TLSF_MIN_BLOCK < size)
+		return NULL;
+
+	/* Leave room for a leading gap which is large enough to be a block */
+	block = tlsf_find(tlsf, size + align + TLSF_MIN_BLOCK);
+	if (!block)
+		return NULL;
+	tlsf_remove(tlsf, block);
+
+	ptr = PTR_ALIGN(block_to_ptr(block), align);
+	gap = ptr - block_to_ptr(block);
+	if (gap && gap < TLSF_MIN_BLOCK)
+		gap += align;
+	if (gap) {
+		lead = block;
+		block = (void *)lead + gap;
+		block->size = block_size(lead) - gap;
+		lead->size = gap | (lead->size & TLSF_PREV_FREE);
+		block_set_free(lead);
+		tlsf_insert(tlsf, lead);
+	}
+
+	return tlsf_use(tlsf, block, size);
+}
+
+void *tlsf_realloc(struct tlsf *tlsf, void *ptr, size_t bytes)
+{
+	struct tlsf_block *block, *next;
+	size_t size, avail;
+	void *new;
+
+	if (!ptr)
+		return tlsf_malloc(tlsf, bytes);
+
+	size = tlsf_block_size(bytes);
+	if (!size)
+		return NULL;
+	block = ptr_to_block(ptr);
+	next = block_next(block);
+	avail = block_size(block);
+	if (size > avail && (next->size & TLSF_BLOCK_FREE))
+		avail += block_size(next);
+
+	if (size <= avail) {
+		tlsf->used -= block_size(block);
+		if (avail > block_size(block)) {
+			tlsf_remove(tlsf, next);
+			block->size += block_size(next);
+		}
+		return tlsf_use(tlsf, block, size);
+	}
+
+	new = tlsf_malloc(tlsf, bytes);
+	if (new) {
+		memcpy(new, ptr, tlsf_usable_size(ptr));
+		tlsf_free(tlsf, ptr);
+	}
+
+	return new;
+}
+
+void tlsf_free(struct tlsf *tlsf, void *ptr)
+{
+	struct tlsf_block *block, *prev;
+
+	if (!ptr)
+		return;
+
+	block = ptr_to_block(ptr);
+	tlsf->used -= block_size(block);
+	if (block->size & TLSF_PREV_FREE) {
+		prev = (void *)block - block->prev_size;
+		tlsf_remove(tlsf, prev);
+		prev->size += block_size(block);
+		block = prev;
+	}
+	tlsf_merge_next(tlsf, block);
+	block_set_free(block);
+	tlsf_insert(tlsf, block);
+}
+
+size_t tlsf_usable_size(void *ptr)
+{
+	return block_size(ptr_to_block(ptr)) - sizeof(size_t);
+}
+
+void tlsf_get_info(struct tlsf *tlsf, struct tlsf_info *info)
+{
+	struct tlsf_block *block;
+	int fl, sl;
+
+	memset(info, '\0', sizeof(*info));
+	info->size = tlsf->size;
+	info->used = tlsf->used;
+	info->peak = tlsf->peak;
+	info->top = tlsf->top;
+
+	for (fl = 0; fl < TLSF_FL_COUNT; fl++) {
+		for (sl = 0; sl < TLSF_SL_COUNT; sl++) {
+			for (block = tlsf->heads[fl][sl]; block;
+			     block = block->next_free) {
+				info->free_blocks++;
+				info->largest = max(info->largest,
+						    block_size(block));
+			}
+		}
+	}
+}
+
+int tlsf_check(struct tlsf *tlsf)
+{
+	struct tlsf_block *block, *next;
+	size_t total = 0, free = 0;
+	int nfree = 0, prev_free = 0;
+	int fl, sl;
+
+	for (block = tlsf->first; block_size(block); block = next) {
+		next = block_next(block);
+		if (block_size(block) < TLSF_MIN_BLOCK ||
+		    !!(block->size & TLSF_PREV_FREE) != prev_free) {
+			debug("%s: bad block header at %p\n", __func__, block);
+			return -EINVAL;
+		}
+		prev_free = !!(block->size & TLSF_BLOCK_FREE);
+		if (prev_free) {
+			if (next->size & TLSF_BLOCK_FREE ||
+			    next->prev_size != block_size(block)) {
+				debug("%s: bad free block at %p\n", __func__,
+				      block);
+				return -EINVAL;
+			}
+			free += block_size(block);
+			nfree++;
+		}
+		total += block_size(block);
+		if (total > tlsf->size)
+			break;
+	}
+	if (total != tlsf->size || tlsf->size - free != tlsf->used ||
+	    !!(block->size & TLSF_PREV_FREE) != prev_free) {
+		debug("%s: bad block chain\n", __func__);
+		return -EINVAL;
+	}
+
+	for (fl = 0; fl < TLSF_FL_COUNT; fl++) {
+		if (!tlsf->sl_bitmap[fl] != !(tlsf->fl_bitmap & (1U << fl)))
+			return -EINVAL;
+		for (sl = 0; sl < TLSF_SL_COUNT; sl++) {
+			block = tlsf->heads[fl][sl];
+			if (!block != !(tlsf->sl_bitmap[fl] & (1U << sl)))
+				return -EINVAL;
+			for (; block; block = block->next_free) {
+				int bfl, bsl;
+
+				tlsf_mapping(block_size(block), &bfl, &bsl);
+				if (!(block->size & TLSF_BLOCK_FREE) ||
+				    bfl != fl || bsl != sl) {
+					debug("%s: bad free list entry at %p\n",
+					      __func__, block);
+					return -EINVAL;
+				}
+				nfree--;
+			}
+		}
+	}
+
+	return nfree ? -EINVAL : 0;
+}
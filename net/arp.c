@@ -38,6 +38,21 @@ int		arp_wait_try;
 static uchar   *arp_tx_packet;	/* THE ARP transmit packet */
 static uchar	arp_tx_packet_buf[PKTSIZE_ALIGN + PKTALIGN];
 
+#ifdef CONFIG_NET_ARP_CACHE
+/*
+ * Neighbours whose MAC address we know. This is kept across network
+ * commands, so that only the first packet to a host has to wait for ARP.
+ */
+struct arp_entry {
+	struct in_addr ip;		/* 0 if the entry is free */
+	uchar ethaddr[ARP_HLEN];
+	ulong updated;			/* Time the address was confirmed */
+	ulong used;			/* Time the entry was last looked up */
+};
+
+static struct arp_entry arp_cache[CONFIG_NET_ARP_CACHE_SIZE];
+#endif
+
 void arp_init(void)
 {
 	/* XXX problem with bss workaround */
@@ -79,22 +94,114 @@ void arp_raw_request(struct in_addr source_ip, const uchar *target_ethaddr,
 	net_send_packet(arp_tx_packet, eth_hdr_size + ARP_HDR_SIZE);
 }
 
+static int arp_on_link(struct in_addr ip)
+{
+	return (ip.s_addr & net_netmask.s_addr) ==
+		(net_ip.s_addr & net_netmask.s_addr);
+}
+
+/* Get the address to ARP for, to send a packet to @dest */
+static struct in_addr arp_next_hop(struct in_addr dest)
+{
+	if (!arp_on_link(dest) && net_gateway.s_addr)
+		return net_gateway;
+
+	return dest;
+}
+
 void arp_request(void)
 {
-	if ((net_arp_wait_packet_ip.s_addr & net_netmask.s_addr) !=
-	    (net_ip.s_addr & net_netmask.s_addr)) {
-		if (net_gateway.s_addr == 0) {
-			puts("## Warning: gatewayip needed but not set\n");
-			net_arp_wait_reply_ip = net_arp_wait_packet_ip;
-		} else {
-			net_arp_wait_reply_ip = net_gateway;
+	if (!arp_on_link(net_arp_wait_packet_ip) && net_gateway.s_addr == 0)
+		puts("## Warning: gatewayip needed but not set\n");
+	net_arp_wait_reply_ip = arp_next_hop(net_arp_wait_packet_ip);
+
+	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
+}
+
+#ifdef CONFIG_NET_ARP_CACHE
+static struct arp_entry *arp_cache_find(struct in_addr ip)
+{
+	struct arp_entry *entry;
+
+	for (entry = arp_cache; entry < arp_cache + ARRAY_SIZE(arp_cache);
+	     entry++) {
+		if (entry->ip.s_addr && entry->ip.s_addr == ip.s_addr)
+			return entry;
+	}
+
+	return NULL;
+}
+
+int arp_cache_lookup(struct in_addr dest, uchar *ethaddr)
+{
+	struct arp_entry *entry;
+	ulong now = get_timer(0);
+
+	entry = arp_cache_find(arp_next_hop(dest));
+	if (!entry)
+		return -ENOENT;
+	if (now - entry->updated > CONFIG_NET_ARP_CACHE_LIFETIME) {
+		entry->ip.s_addr = 0;
+		return -ENOENT;
+	}
+	entry->used = now;
+	memcpy(ethaddr, entry->ethaddr, ARP_HLEN);
+
+	return 0;
+}
+
+void arp_cache_update(struct in_addr ip, const uchar *ethaddr)
+{
+	struct arp_entry *entry, *oldest;
+	ulong now = get_timer(0);
+
+	if (!ip.s_addr || !net_ip.s_addr || !arp_on_link(ip))
+		return;
+	if (!is_valid_ethaddr(ethaddr))
+		return;
+
+	entry = arp_cache_find(ip);
+	if (!entry) {
+		/* Use a free entry, else the one used least recently */
+		oldest = arp_cache;
+		for (entry = arp_cache;
+		     entry < arp_cache + ARRAY_SIZE(arp_cache); entry++) {
+			if (!entry->ip.s_addr)
+				break;
+			if (now - entry->used > now - oldest->used)
+				oldest = entry;
 		}
-	} else {
-		net_arp_wait_reply_ip = net_arp_wait_packet_ip;
+		if (entry == arp_cache + ARRAY_SIZE(arp_cache))
+			entry = oldest;
+		entry->ip = ip;
+		entry->used = now;
 	}
+	memcpy(entry->ethaddr, ethaddr, ARP_HLEN);
+	entry->updated = now;
+}
 
-	arp_raw_request(net_ip, net_null_ethaddr, net_arp_wait_reply_ip);
+void arp_cache_flush(void)
+{
+	memset(arp_cache, '\0', sizeof(arp_cache));
+}
+
+void arp_cache_show(void)
+{
+	struct arp_entry *entry;
+	ulong now = get_timer(0);
+
+	printf("%-15s  %-17s  %s\n", "IP address", "MAC address", "age");
+	for (entry = arp_cache; entry < arp_cache + ARRAY_SIZE(arp_cache);
+	     entry++) {
+		if (!entry->ip.s_addr)
+			continue;
+		if (now - entry->updated > CONFIG_NET_ARP_CACHE_LIFETIME)
+			continue;
+		printf("%-15pI4  %pM  %lus\n", &entry->ip, entry->ethaddr,
+		       (now - entry->updated) / 1000);
+	}
 }
+#endif
 
 int arp_timeout_check(void)
 {
@@ -158,6 +265,9 @@ void arp_receive(struct ethernet_hdr *et, struct ip_udp_hdr *ip, int len)
 	if (net_read_ip(&arp->ar_tpa).s_addr != net_ip.s_addr)
 		return;
 
+	/* The sender is talking to us, so we will probably talk back */
+	arp_cache_update(net_read_ip(&arp->ar_spa), &arp->ar_sha);
+
 	switch (ntohs(arp->ar_op)) {
 	case ARPOP_REQUEST:
 		/* reply with our IP address */
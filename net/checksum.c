@@ -11,27 +11,154 @@
 #include <common.h>
 #include <net.h>
 
-unsigned compute_ip_checksum(const void *vptr, unsigned nbytes)
+/* Fold a one's complement sum down to 16 bits, without complementing it */
+static unsigned csum_fold(u64 sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return sum;
+}
+
+/*
+ * One's complement sum of a buffer, as 16-bit words in memory order,
+ * optionally copying it to @dst on the way. The words are added in native
+ * byte order, which gives the same checksum on either endianness.
+ *
+ * The sum is accumulated in 64 bits, so that carries need only be folded
+ * in at the end, and the main loop is unrolled to add four aligned 32-bit
+ * words at a time. If @wide is false, @dst is only 16-bit aligned relative
+ * to @src, so the data is stored 16 bits at a time.
+ *
+ * An odd start address is handled by adding the first byte as the low half
+ * of a word in memory and byte-swapping the result, which is the same as
+ * shifting every word by one byte.
+ */
+static __always_inline unsigned csum_do(void *vdst, const void *vsrc,
+					unsigned nbytes, bool copy, bool wide)
 {
-	int sum, oddbyte;
-	const unsigned short *ptr = vptr;
+	const u8 *src = vsrc;
+	u8 *dst = vdst;
+	union {
+		u8 b[2];
+		u16 w;
+	} edge;
+	u64 sum = 0;
+	unsigned result;
+	int odd;
 
-	sum = 0;
-	while (nbytes > 1) {
-		sum += *ptr++;
+	if (!nbytes)
+		return 0;
+	odd = (ulong)src & 1;
+	if (odd) {
+		edge.b[0] = 0;
+		edge.b[1] = *src;
+		sum = edge.w;
+		if (copy)
+			*dst++ = *src;
+		src++;
+		nbytes--;
+	}
+	if (nbytes >= 2 && ((ulong)src & 2)) {
+		sum += *(const u16 *)src;
+		if (copy) {
+			*(u16 *)dst = *(const u16 *)src;
+			dst += 2;
+		}
+		src += 2;
 		nbytes -= 2;
 	}
-	if (nbytes == 1) {
-		oddbyte = 0;
-		((u8 *)&oddbyte)[0] = *(u8 *)ptr;
-		((u8 *)&oddbyte)[1] = 0;
-		sum += oddbyte;
+	for (; nbytes >= 16; nbytes -= 16, src += 16) {
+		const u32 *s = (const u32 *)src;
+		u32 a = s[0], b = s[1], c = s[2], d = s[3];
+
+		sum += (u64)a + b + c + d;
+		if (copy && wide) {
+			u32 *o = (u32 *)dst;
+
+			o[0] = a;
+			o[1] = b;
+			o[2] = c;
+			o[3] = d;
+		} else if (copy) {
+			const u16 *h = (const u16 *)src;
+			u16 *o = (u16 *)dst;
+			int i;
+
+			for (i = 0; i < 8; i++)
+				o[i] = h[i];
+		}
+		if (copy)
+			dst += 16;
 	}
-	sum = (sum >> 16) + (sum & 0xffff);
-	sum += (sum >> 16);
-	sum = ~sum & 0xffff;
+	for (; nbytes >= 4; nbytes -= 4, src += 4) {
+		u32 a = *(const u32 *)src;
 
-	return sum;
+		sum += a;
+		if (copy && wide) {
+			*(u32 *)dst = a;
+		} else if (copy) {
+			((u16 *)dst)[0] = ((const u16 *)src)[0];
+			((u16 *)dst)[1] = ((const u16 *)src)[1];
+		}
+		if (copy)
+			dst += 4;
+	}
+	for (; nbytes >= 2; nbytes -= 2, src += 2) {
+		sum += *(const u16 *)src;
+		if (copy) {
+			*(u16 *)dst = *(const u16 *)src;
+			dst += 2;
+		}
+	}
+	if (nbytes) {
+		edge.b[0] = *src;
+		edge.b[1] = 0;
+		sum += edge.w;
+		if (copy)
+			*dst = *src;
+	}
+
+	result = csum_fold(sum);
+	if (odd)
+		result = ((result >> 8) | (result << 8)) & 0xffff;
+
+	return result;
+}
+
+unsigned ip_checksum_partial(const void *addr, unsigned nbytes, unsigned sum)
+{
+	return csum_fold((u64)sum + csum_do(NULL, addr, nbytes, false, true));
+}
+
+unsigned ip_checksum_copy(void *dst, const void *src, unsigned nbytes,
+			  unsigned sum)
+{
+	unsigned part;
+
+	if (!(((ulong)dst ^ (ulong)src) & 3)) {
+		part = csum_do(dst, src, nbytes, true, true);
+	} else if (!(((ulong)dst ^ (ulong)src) & 1)) {
+		part = csum_do(dst, src, nbytes, true, false);
+	} else {
+		memcpy(dst, src, nbytes);
+		part = csum_do(NULL, src, nbytes, false, true);
+	}
+
+	return csum_fold((u64)sum + part);
+}
+
+unsigned ip_checksum_fold(unsigned sum)
+{
+	return ~csum_fold(sum) & 0xffff;
+}
+
+unsigned compute_ip_checksum(const void *vptr, unsigned nbytes)
+{
+	return ip_checksum_fold(ip_checksum_partial(vptr, nbytes, 0));
 }
 
 unsigned add_ip_checksums(unsigned offset, unsigned sum, unsigned new)
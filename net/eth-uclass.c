@@ -20,9 +20,14 @@ DECLARE_GLOBAL_DATA_PTR;
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @started: true if the driver has been started and not stopped since
+ * @halt_after_use: true to stop the driver after each network command, even
+ *	with CONFIG_NET_PERSISTENT_LINK
  */
 struct eth_device_priv {
 	enum eth_state_t state;
+	bool started;
+	bool halt_after_use;
 };
 
 /**
@@ -46,6 +51,51 @@ static struct eth_uclass_priv *eth_get_uclass_priv(void)
 	return uc->priv;
 }
 
+/* Check whether a started device should be left running when not in use */
+static bool eth_keep_started(struct udevice *dev)
+{
+#ifdef CONFIG_NET_PERSISTENT_LINK
+	struct eth_device_priv *priv = dev->uclass_priv;
+
+	return !priv->halt_after_use;
+#else
+	return false;
+#endif
+}
+
+static int eth_start(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev->uclass_priv;
+	int ret;
+
+	/* A running device keeps its link */
+	if (!priv->started || !eth_keep_started(dev)) {
+		ret = eth_get_ops(dev)->start(dev);
+		if (ret < 0)
+			return ret;
+	}
+	priv->started = true;
+	priv->state = ETH_STATE_ACTIVE;
+
+	return 0;
+}
+
+static void eth_stop(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev->uclass_priv;
+
+	eth_get_ops(dev)->stop(dev);
+	priv->started = false;
+	priv->state = ETH_STATE_PASSIVE;
+}
+
+void eth_disable_persistent_link(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	priv->halt_after_use = true;
+}
+
 void eth_set_current_to_next(void)
 {
 	struct eth_uclass_priv *uc_priv;
@@ -81,6 +131,16 @@ struct udevice *eth_get_dev(void)
  */
 void eth_set_dev(struct udevice *dev)
 {
+	struct udevice *old = eth_get_uclass_priv()->current;
+	struct eth_device_priv *priv;
+
+	/* Only the current device is left running between commands */
+	if (old && old != dev && device_active(old)) {
+		priv = old->uclass_priv;
+		if (priv->started && eth_keep_started(old))
+			eth_stop(old);
+	}
+
 	if (dev && !device_active(dev)) {
 		eth_errno = device_probe(dev);
 		if (eth_errno)
@@ -229,6 +289,13 @@ static int on_ethaddr(const char *name, const char *value, enum env_op op,
 		case env_op_overwrite:
 			eth_parse_enetaddr(value, pdata->enetaddr);
 			eth_write_hwaddr(dev);
+			/* Restart a running device with the new address */
+			if (device_active(dev) && eth_keep_started(dev)) {
+				struct eth_device_priv *priv = dev->uclass_priv;
+
+				if (priv->started)
+					eth_stop(dev);
+			}
 			break;
 		case env_op_delete:
 			memset(pdata->enetaddr, 0, ARP_HLEN);
@@ -273,14 +340,9 @@ int eth_init(void)
 			debug("Trying %s\n", current->name);
 
 			if (device_active(current)) {
-				ret = eth_get_ops(current)->start(current);
-				if (ret >= 0) {
-					struct eth_device_priv *priv =
-						current->uclass_priv;
-
-					priv->state = ETH_STATE_ACTIVE;
+				ret = eth_start(current);
+				if (ret >= 0)
 					return 0;
-				}
 			} else {
 				ret = eth_errno;
 			}
@@ -303,6 +365,17 @@ int eth_init(void)
 }
 
 void eth_halt(void)
+{
+	struct udevice *current;
+
+	current = eth_get_dev();
+	if (!current || !device_active(current))
+		return;
+
+	eth_stop(current);
+}
+
+void eth_release(void)
 {
 	struct udevice *current;
 	struct eth_device_priv *priv;
@@ -311,7 +384,10 @@ void eth_halt(void)
 	if (!current || !device_active(current))
 		return;
 
-	eth_get_ops(current)->stop(current);
+	if (!eth_keep_started(current)) {
+		eth_stop(current);
+		return;
+	}
 	priv = current->uclass_priv;
 	priv->state = ETH_STATE_PASSIVE;
 }
@@ -347,33 +423,76 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
-int eth_rx(void)
+/*
+ * Receive packets from a driver which hands over several at once, giving
+ * the buffers back after each group has been processed
+ */
+static int eth_rx_batch(struct udevice *dev)
 {
-	struct udevice *current;
-	uchar *packet;
-	int flags;
+	const struct eth_ops *ops = eth_get_ops(dev);
+	uchar *packets[CONFIG_NET_RX_BATCH];
+	int lengths[CONFIG_NET_RX_BATCH];
+	int flags = ETH_RECV_CHECK_DEVICE;
+	int count = 0;
 	int ret;
 	int i;
 
-	current = eth_get_dev();
-	if (!current)
-		return -ENODEV;
+	do {
+		ret = ops->recv_batch(dev, flags, packets, lengths,
+				      CONFIG_NET_RX_BATCH - count);
+		flags = 0;
+		for (i = 0; i < ret; i++)
+			net_process_received_packet(packets[i], lengths[i]);
+		for (i = 0; i < ret && ops->free_pkt; i++)
+			ops->free_pkt(dev, packets[i], lengths[i]);
+		if (ret > 0)
+			count += ret;
+	} while (ret > 0 && count < CONFIG_NET_RX_BATCH);
 
-	if (!device_active(current))
-		return -EINVAL;
+	return ret < 0 ? ret : count;
+}
+
+/* Receive packets one at a time from a driver without recv_batch() */
+static int eth_rx_packets(struct udevice *dev)
+{
+	const struct eth_ops *ops = eth_get_ops(dev);
+	uchar *packet;
+	int flags;
+	int ret;
+	int i;
 
-	/* Process up to 32 packets at one time */
+	/* Process up to CONFIG_NET_RX_BATCH packets at one time */
 	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < 32; i++) {
-		ret = eth_get_ops(current)->recv(current, flags, &packet);
+	for (i = 0; i < CONFIG_NET_RX_BATCH; i++) {
+		ret = ops->recv(dev, flags, &packet);
 		flags = 0;
 		if (ret > 0)
 			net_process_received_packet(packet, ret);
-		if (ret >= 0 && eth_get_ops(current)->free_pkt)
-			eth_get_ops(current)->free_pkt(current, packet, ret);
+		if (ret >= 0 && ops->free_pkt)
+			ops->free_pkt(dev, packet, ret);
 		if (ret <= 0)
 			break;
 	}
+
+	return ret;
+}
+
+int eth_rx(void)
+{
+	struct udevice *current;
+	int ret;
+
+	current = eth_get_dev();
+	if (!current)
+		return -ENODEV;
+
+	if (!device_active(current))
+		return -EINVAL;
+
+	if (eth_get_ops(current)->recv_batch)
+		ret = eth_rx_batch(current);
+	else
+		ret = eth_rx_packets(current);
 	if (ret == -EAGAIN)
 		ret = 0;
 	if (ret < 0) {
@@ -472,6 +591,8 @@ static int eth_post_probe(struct udevice *dev)
 			ops->send += gd->reloc_off;
 		if (ops->recv)
 			ops->recv += gd->reloc_off;
+		if (ops->recv_batch)
+			ops->recv_batch += gd->reloc_off;
 		if (ops->free_pkt)
 			ops->free_pkt += gd->reloc_off;
 		if (ops->stop)
@@ -533,7 +654,7 @@ static int eth_pre_remove(struct udevice *dev)
 {
 	struct eth_pdata *pdata = dev->platdata;
 
-	eth_get_ops(dev)->stop(dev);
+	eth_stop(dev);
 
 	/* clear the MAC address */
 	memset(pdata->enetaddr, 0, ARP_HLEN);
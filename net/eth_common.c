@@ -167,3 +167,13 @@ const char *eth_get_name(void)
 {
 	return eth_get_dev() ? eth_get_dev()->name : "unknown";
 }
+
+#if defined(CONFIG_NETCONSOLE) || defined(CONFIG_NET_PERSISTENT_LINK)
+void eth_halt_before_boot(void)
+{
+	eth_halt();
+#ifndef CONFIG_DM_ETH
+	eth_unregister(eth_get_dev());
+#endif
+}
+#endif
@@ -374,6 +374,11 @@ void eth_halt(void)
 	eth_current->state = ETH_STATE_PASSIVE;
 }
 
+void eth_release(void)
+{
+	eth_halt();
+}
+
 int eth_is_active(struct eth_device *dev)
 {
 	return dev && dev->state == ETH_STATE_ACTIVE;
@@ -0,0 +1,411 @@
+/*
+ * Fastboot over UDP
+ *
+ * The host sends every packet, and sends it again until U-Boot replies.
+ * A command is acknowledged with an empty reply and run when the host sends
+ * an empty packet to ask for its response. Downloaded data is checked and
+ * copied into the buffer as it arrives.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <fastboot.h>
+#include <mapmem.h>
+#include <net.h>
+#include <net/fastboot.h>
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+#include <fb_mmc.h>
+#endif
+#ifdef CONFIG_FASTBOOT_FLASH_NAND_DEV
+#include <fb_nand.h>
+#endif
+
+/* Version of the UDP protocol */
+#define FASTBOOT_UDP_VERSION	1
+/* Largest packet, so that each one fits in an Ethernet frame */
+#define FASTBOOT_PACKET_SIZE	(1500 - IP_UDP_HDR_SIZE)
+/* How often to tell the host that a command is still running */
+#define FASTBOOT_KEEPALIVE_MS	5000
+
+#define BYTES_PER_DOT		0x20000
+
+/* Packet types */
+enum {
+	FASTBOOT_ERROR,
+	FASTBOOT_QUERY,
+	FASTBOOT_INIT,
+	FASTBOOT_FASTBOOT,
+};
+
+struct fastboot_header {
+	uchar id;
+	uchar flags;
+	u16 seq;
+} __packed;
+
+#define FASTBOOT_HEADER_SIZE	(sizeof(struct fastboot_header))
+
+static struct in_addr fastboot_remote_ip;
+static int fastboot_remote_port;
+static uchar fastboot_remote_ethaddr[6];
+/* Sequence number of the next packet expected from the host */
+static u16 fastboot_seq;
+/* Last reply sent, to send again if the host did not get it */
+static uchar fastboot_last[FASTBOOT_PACKET_SIZE];
+static int fastboot_last_len;
+/* Command to run when the host asks for its response, if any */
+static char fastboot_command[FASTBOOT_COMMAND_LEN];
+/* Response waiting for the host to ask for it, if any */
+static char fastboot_response[FASTBOOT_RESPONSE_LEN];
+/* What to do once the response has been sent */
+static void (*fastboot_then)(void);
+static ulong fastboot_keepalive_start;
+static unsigned int download_size;
+static unsigned int download_bytes;
+
+static void fastboot_send(uchar id, u16 seq, const void *data, int len)
+{
+	struct fastboot_header *hdr;
+	uchar *pkt;
+
+	pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	hdr = (struct fastboot_header *)pkt;
+	hdr->id = id;
+	hdr->flags = 0;
+	hdr->seq = htons(seq);
+	memcpy(pkt + FASTBOOT_HEADER_SIZE, data, len);
+	len += FASTBOOT_HEADER_SIZE;
+
+	if (id == FASTBOOT_INIT || id == FASTBOOT_FASTBOOT) {
+		memcpy(fastboot_last, pkt, len);
+		fastboot_last_len = len;
+	}
+	net_send_udp_packet(fastboot_remote_ethaddr, fastboot_remote_ip,
+			    fastboot_remote_port, FASTBOOT_UDP_PORT, len);
+}
+
+static void fastboot_resend(void)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+
+	memcpy(pkt, fastboot_last, fastboot_last_len);
+	net_send_udp_packet(fastboot_remote_ethaddr, fastboot_remote_ip,
+			    fastboot_remote_port, FASTBOOT_UDP_PORT,
+			    fastboot_last_len);
+}
+
+/* Reply to the packet with sequence number fastboot_seq */
+static void fastboot_reply(const char *data, int len)
+{
+	fastboot_send(FASTBOOT_FASTBOOT, fastboot_seq++, data, len);
+}
+
+/*
+ * Called regularly while a command is running. The host is waiting for the
+ * response, so send it an INFO message instead every few seconds. It then
+ * asks again with the next sequence number.
+ */
+static void fastboot_keepalive(void)
+{
+	static const char info[] = "INFOstill working";
+
+	if (get_timer(fastboot_keepalive_start) < FASTBOOT_KEEPALIVE_MS)
+		return;
+	fastboot_reply(info, strlen(info));
+	fastboot_keepalive_start = get_timer(0);
+}
+
+static void fastboot_do_continue(void)
+{
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void fastboot_do_reset(void)
+{
+	do_reset(NULL, 0, 0, NULL);
+}
+
+static void fastboot_do_boot(void)
+{
+	char boot_addr_start[12];
+	char *bootm_args[] = { "bootm", boot_addr_start, NULL };
+
+	puts("Booting kernel..\n");
+
+	sprintf(boot_addr_start, "0x%lx", (ulong)CONFIG_FASTBOOT_BUF_ADDR);
+	do_bootm(NULL, 0, 2, bootm_args);
+
+	/* This only happens if image is somehow faulty so we start over */
+	do_reset(NULL, 0, 0, NULL);
+}
+
+static void fb_getvar(char *cmd)
+{
+	fastboot_getvar(cmd);
+}
+
+static void fb_download(char *cmd)
+{
+	download_size = simple_strtoul(cmd, NULL, 16);
+	download_bytes = 0;
+
+	printf("Starting download of %d bytes\n", download_size);
+
+	if (!download_size) {
+		fastboot_fail("data invalid size");
+	} else if (download_size > CONFIG_FASTBOOT_BUF_SIZE) {
+		download_size = 0;
+		fastboot_fail("data too large");
+	} else {
+		sprintf(fb_response_str, "DATA%08x", download_size);
+	}
+}
+
+#ifdef CONFIG_FASTBOOT_FLASH
+static void fb_flash(char *cmd)
+{
+	void *buf = map_sysmem(CONFIG_FASTBOOT_BUF_ADDR, download_bytes);
+
+	fastboot_fail("no flash device defined");
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+	fb_mmc_flash_write(cmd, buf, download_bytes);
+#endif
+#ifdef CONFIG_FASTBOOT_FLASH_NAND_DEV
+	fb_nand_flash_write(cmd, buf, download_bytes);
+#endif
+	unmap_sysmem(buf);
+}
+
+static void fb_erase(char *cmd)
+{
+	fastboot_fail("no flash device defined");
+#ifdef CONFIG_FASTBOOT_FLASH_MMC_DEV
+	fb_mmc_erase(cmd);
+#endif
+#ifdef CONFIG_FASTBOOT_FLASH_NAND_DEV
+	fb_nand_erase(cmd);
+#endif
+}
+#endif
+
+static void fb_boot(char *cmd)
+{
+	fastboot_okay("");
+	fastboot_then = fastboot_do_boot;
+}
+
+static void fb_continue(char *cmd)
+{
+	fastboot_okay("");
+	fastboot_then = fastboot_do_continue;
+}
+
+static void fb_reboot(char *cmd)
+{
+	if (!strcmp(cmd, "-bootloader") && fb_set_reboot_flag()) {
+		fastboot_fail("Cannot set reboot flag");
+		return;
+	}
+	fastboot_okay("");
+	fastboot_then = fastboot_do_reset;
+}
+
+static const struct {
+	const char *cmd;
+	void (*cb)(char *cmd);
+} fastboot_commands[] = {
+	{ "getvar:", fb_getvar },
+	{ "download:", fb_download },
+#ifdef CONFIG_FASTBOOT_FLASH
+	{ "flash:", fb_flash },
+	{ "erase:", fb_erase },
+#endif
+	{ "boot", fb_boot },
+	{ "continue", fb_continue },
+	{ "reboot", fb_reboot },
+};
+
+/* Run the command received, writing its response to fastboot_response */
+static void fastboot_run(void)
+{
+	const char *name;
+	int i, len;
+
+	fb_response_str = fastboot_response;
+	fastboot_fail("unknown command");
+	for (i = 0; i < ARRAY_SIZE(fastboot_commands); i++) {
+		name = fastboot_commands[i].cmd;
+		len = strlen(name);
+		if (!strncmp(name, fastboot_command, len)) {
+			fastboot_keepalive_start = get_timer(0);
+			fastboot_set_progress_callback(fastboot_keepalive);
+			fastboot_commands[i].cb(fastboot_command + len);
+			fastboot_set_progress_callback(NULL);
+			break;
+		}
+	}
+	if (i == ARRAY_SIZE(fastboot_commands))
+		error("unknown command: %s", fastboot_command);
+	fastboot_command[0] = '\0';
+}
+
+/*
+ * Copy downloaded data into the buffer, checking it on the way. Returns
+ * false if it is corrupt, so that the host sends it again.
+ */
+static bool fastboot_download(const uchar *data, unsigned int len)
+{
+	unsigned int pre_dot_num, now_dot_num;
+	void *buf;
+	bool ok;
+
+	len = min(len, download_size - download_bytes);
+	buf = map_sysmem(CONFIG_FASTBOOT_BUF_ADDR + download_bytes, len);
+	ok = net_udp_csum_copy(buf, data, len);
+	unmap_sysmem(buf);
+	if (!ok)
+		return false;
+
+	pre_dot_num = download_bytes / BYTES_PER_DOT;
+	download_bytes += len;
+	now_dot_num = download_bytes / BYTES_PER_DOT;
+
+	if (pre_dot_num != now_dot_num) {
+		putc('.');
+		if (!(now_dot_num % 74))
+			putc('\n');
+	}
+
+	if (download_bytes == download_size) {
+		/* Keep download_bytes for the flash command */
+		download_size = 0;
+		strcpy(fastboot_response, "OKAY");
+		printf("\ndownloading of %d bytes finished\n", download_bytes);
+	}
+
+	return true;
+}
+
+static void fastboot_receive(const uchar *data, unsigned int len)
+{
+	void (*then)(void);
+
+	if (len && download_bytes < download_size) {
+		if (!fastboot_download(data, len))
+			return;
+		fastboot_reply(NULL, 0);
+	} else if (len) {
+		if (len < sizeof(fastboot_command)) {
+			memcpy(fastboot_command, data, len);
+			fastboot_command[len] = '\0';
+		} else {
+			strcpy(fastboot_response, "FAILcommand too long");
+		}
+		fastboot_reply(NULL, 0);
+	} else {
+		/* The host is asking for the response */
+		if (fastboot_command[0])
+			fastboot_run();
+		fastboot_reply(fastboot_response, strlen(fastboot_response));
+		fastboot_response[0] = '\0';
+
+		then = fastboot_then;
+		fastboot_then = NULL;
+		if (then)
+			then();
+	}
+}
+
+/*
+ * Check the sequence number of a packet from the host, sending the last
+ * reply again if the host did not get it. Returns true if this is the
+ * next packet.
+ */
+static bool fastboot_next(struct in_addr sip, unsigned src, u16 seq)
+{
+	if (sip.s_addr != fastboot_remote_ip.s_addr ||
+	    src != fastboot_remote_port)
+		return false;
+	if (seq == (u16)(fastboot_seq - 1) && fastboot_last_len)
+		fastboot_resend();
+
+	return seq == fastboot_seq;
+}
+
+static void fastboot_handler(uchar *pkt, unsigned dest, struct in_addr sip,
+			     unsigned src, unsigned len)
+{
+	struct fastboot_header hdr;
+	u16 seq, reply[2];
+	bool data;
+
+	if (dest != FASTBOOT_UDP_PORT || len < FASTBOOT_HEADER_SIZE)
+		return;
+	memcpy(&hdr, pkt, FASTBOOT_HEADER_SIZE);
+	seq = ntohs(hdr.seq);
+	pkt += FASTBOOT_HEADER_SIZE;
+	len -= FASTBOOT_HEADER_SIZE;
+
+	/* Downloaded data is checked as it is copied into place */
+	data = hdr.id == FASTBOOT_FASTBOOT && len &&
+		download_bytes < download_size && seq == fastboot_seq;
+	if (!data && !net_udp_csum_copy(NULL, NULL, 0))
+		return;
+
+	switch (hdr.id) {
+	case FASTBOOT_QUERY:
+		if (sip.s_addr != fastboot_remote_ip.s_addr ||
+		    src != fastboot_remote_port) {
+			fastboot_remote_ip = sip;
+			fastboot_remote_port = src;
+			memset(fastboot_remote_ethaddr, 0, 6);
+			fastboot_last_len = 0;
+		}
+		reply[0] = htons(fastboot_seq);
+		fastboot_send(FASTBOOT_QUERY, seq, reply, sizeof(reply[0]));
+		break;
+
+	case FASTBOOT_INIT:
+		if (!fastboot_next(sip, src, seq))
+			break;
+		fastboot_command[0] = '\0';
+		fastboot_response[0] = '\0';
+		download_size = 0;
+		reply[0] = htons(FASTBOOT_UDP_VERSION);
+		reply[1] = htons(FASTBOOT_PACKET_SIZE);
+		fastboot_send(FASTBOOT_INIT, fastboot_seq++, reply,
+			      sizeof(reply));
+		break;
+
+	case FASTBOOT_FASTBOOT:
+		if (fastboot_next(sip, src, seq))
+			fastboot_receive(pkt, len);
+		break;
+
+	default:
+		error("unknown packet type %d", hdr.id);
+		if (sip.s_addr == fastboot_remote_ip.s_addr &&
+		    src == fastboot_remote_port)
+			fastboot_send(FASTBOOT_ERROR, seq,
+				      "unknown packet type", 19);
+		break;
+	}
+}
+
+void fastboot_start_server(void)
+{
+	printf("Using %s device\n", eth_get_name());
+	printf("Listening for fastboot commands on %pI4\n", &net_ip);
+
+	fastboot_remote_ip.s_addr = 0;
+	fastboot_remote_port = 0;
+	fastboot_last_len = 0;
+	fastboot_command[0] = '\0';
+	fastboot_response[0] = '\0';
+	fastboot_then = NULL;
+	download_size = 0;
+
+	net_set_udp_handler_csum(fastboot_handler);
+}
@@ -87,6 +87,7 @@
 #include <environment.h>
 #include <errno.h>
 #include <net.h>
+#include <net/fastboot.h>
 #include <net/tftp.h>
 #if defined(CONFIG_LED_STATUS)
 #include <miiphy.h>
@@ -107,6 +108,12 @@
 #if defined(CONFIG_CMD_SNTP)
 #include "sntp.h"
 #endif
+#if defined(CONFIG_PROT_TCP)
+#include "tcp.h"
+#endif
+#if defined(CONFIG_CMD_WGET)
+#include "wget.h"
+#endif
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -183,6 +190,12 @@ static uchar net_pkt_buf[(PKTBUFSRX+1) * PKTSIZE_ALIGN + PKTALIGN];
 uchar *net_rx_packets[PKTBUFSRX];
 /* Current UDP RX packet handler */
 static rxhand_f *udp_packet_handler;
+#ifdef CONFIG_UDP_CHECKSUM
+/* Current UDP handler checks checksums with net_udp_csum_copy() */
+static bool udp_csum_on_copy;
+/* Packet being handled whose UDP checksum has not been checked yet */
+static struct ip_udp_hdr *udp_csum_pkt;
+#endif
 /* Current ARP RX packet handler */
 static rxhand_f *arp_packet_handler;
 #ifdef CONFIG_CMD_TFTPPUT
@@ -342,8 +355,12 @@ void net_auto_load(void)
 
 static void net_init_loop(void)
 {
-	if (eth_get_dev())
+	if (eth_get_dev()) {
+		/* neighbours seen through another interface may not be here */
+		if (memcmp(net_ethaddr, eth_get_ethaddr(), 6))
+			arp_cache_flush();
 		memcpy(net_ethaddr, eth_get_ethaddr(), 6);
+	}
 
 	return;
 }
@@ -358,6 +375,9 @@ static void net_clear_handlers(void)
 static void net_cleanup_loop(void)
 {
 	net_clear_handlers();
+#if defined(CONFIG_PROT_TCP)
+	tcp_stop();
+#endif
 }
 
 void net_init(void)
@@ -403,7 +423,7 @@ int net_loop(enum proto_t protocol)
 	bootstage_mark_name(BOOTSTAGE_ID_ETH_START, "eth_start");
 	net_init();
 	if (eth_is_on_demand_init() || protocol != NETCONS) {
-		eth_halt();
+		eth_release();
 		eth_set_current();
 		ret = eth_init();
 		if (ret < 0) {
@@ -430,7 +450,7 @@ restart:
 	switch (net_check_prereq(protocol)) {
 	case 1:
 		/* network not configured */
-		eth_halt();
+		eth_release();
 		return -ENODEV;
 
 	case 2:
@@ -453,6 +473,11 @@ restart:
 			tftp_start_server();
 			break;
 #endif
+#ifdef CONFIG_UDP_FUNCTION_FASTBOOT
+		case FASTBOOT:
+			fastboot_start_server();
+			break;
+#endif
 #if defined(CONFIG_CMD_DHCP)
 		case DHCP:
 			bootp_reset();
@@ -508,6 +533,11 @@ restart:
 		case LINKLOCAL:
 			link_local_start();
 			break;
+#endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
 #endif
 		default:
 			break;
@@ -561,7 +591,7 @@ restart:
 			net_arp_wait_packet_ip.s_addr = 0;
 
 			net_cleanup_loop();
-			eth_halt();
+			eth_release();
 			/* Invalidate the last protocol */
 			eth_set_last_protocol(BOOTP);
 
@@ -620,7 +650,7 @@ restart:
 				setenv_hex("fileaddr", load_addr);
 			}
 			if (protocol != NETCONS)
-				eth_halt();
+				eth_release();
 			else
 				eth_halt_state_only();
 
@@ -684,7 +714,7 @@ int net_start_again(void)
 	}
 
 	if ((!retry_forever) && (net_try_count >= retrycnt)) {
-		eth_halt();
+		eth_release();
 		net_set_state(NETLOOP_FAIL);
 		/*
 		 * We don't provide a way for the protocol to return an error,
@@ -738,6 +768,70 @@ void net_set_udp_handler(rxhand_f *f)
 		udp_packet_handler = dummy_handler;
 	else
 		udp_packet_handler = f;
+#ifdef CONFIG_UDP_CHECKSUM
+	udp_csum_on_copy = false;
+#endif
+}
+
+void net_set_udp_handler_csum(rxhand_f *f)
+{
+	net_set_udp_handler(f);
+#ifdef CONFIG_UDP_CHECKSUM
+	udp_csum_on_copy = true;
+#endif
+}
+
+#ifdef CONFIG_UDP_CHECKSUM
+/* Add the sum of a piece at @offset in the checksummed data */
+static unsigned udp_csum_add(unsigned sum, unsigned offset, unsigned part)
+{
+	if (offset & 1)
+		part = ((part >> 8) | (part << 8)) & 0xffff;
+
+	return sum + part;
+}
+#endif
+
+bool net_udp_csum_copy(void *dst, const uchar *src, unsigned int len)
+{
+#ifdef CONFIG_UDP_CHECKSUM
+	struct ip_udp_hdr *ip = udp_csum_pkt;
+	const uchar *start, *end;
+	unsigned sum;
+
+	if (ip) {
+		start = (uchar *)&ip->udp_src;
+		end = start + ntohs(ip->udp_len);
+		if (!dst) {
+			src = end;
+			len = 0;
+		}
+
+		/* Pseudo-header, then the packet around and including @src */
+		sum = ip_checksum_partial(&ip->ip_src, 2 * sizeof(ip->ip_src),
+					  htons(IPPROTO_UDP) + ip->udp_len);
+		sum = ip_checksum_partial(start, src - start, sum);
+		if (len)
+			sum = udp_csum_add(sum, src - start,
+					   ip_checksum_copy(dst, src, len, 0));
+		sum = udp_csum_add(sum, src + len - start,
+				   ip_checksum_partial(src + len,
+						       end - src - len, 0));
+
+		sum = ip_checksum_fold(sum);
+		if (sum != 0 && sum != 0xffff) {
+			printf(" UDP wrong checksum %04x %04x\n", sum,
+			       ntohs(ip->udp_xsum));
+			return false;
+		}
+		udp_csum_pkt = NULL;
+		return true;
+	}
+#endif
+	if (dst)
+		memcpy(dst, src, len);
+
+	return true;
 }
 
 rxhand_f *net_get_arp_handler(void)
@@ -779,10 +873,6 @@ void net_set_timeout_handler(ulong iv, thand_f *f)
 int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		int payload_len)
 {
-	uchar *pkt;
-	int eth_hdr_size;
-	int pkt_hdr_size;
-
 	/* make sure the net_tx_packet is initialized (net_init() was called) */
 	assert(net_tx_packet != NULL);
 	if (net_tx_packet == NULL)
@@ -796,12 +886,21 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 	if (dest.s_addr == 0xFFFFFFFF)
 		ether = (uchar *)net_bcast_ethaddr;
 
-	pkt = (uchar *)net_tx_packet;
+	net_set_udp_header((uchar *)net_tx_packet + net_eth_hdr_size(), dest,
+			   dport, sport, payload_len);
+
+	return net_send_ip_packet(ether, dest, IP_UDP_HDR_SIZE + payload_len);
+}
+
+int net_send_ip_packet(uchar *ether, struct in_addr dest, int len)
+{
+	int eth_hdr_size;
+
+	/* the MAC address may be known from an earlier command */
+	if (memcmp(ether, net_null_ethaddr, 6) == 0)
+		arp_cache_lookup(dest, ether);
 
-	eth_hdr_size = net_set_ether(pkt, ether, PROT_IP);
-	pkt += eth_hdr_size;
-	net_set_udp_header(pkt, dest, dport, sport, payload_len);
-	pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
+	eth_hdr_size = net_set_ether(net_tx_packet, ether, PROT_IP);
 
 	/* if MAC address was not discovered yet, do an ARP request */
 	if (memcmp(ether, net_null_ethaddr, 6) == 0) {
@@ -812,7 +911,7 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		arp_wait_packet_ethaddr = ether;
 
 		/* size of the waiting packet */
-		arp_wait_tx_packet_size = pkt_hdr_size + payload_len;
+		arp_wait_tx_packet_size = eth_hdr_size + len;
 
 		/* and do the ARP request */
 		arp_wait_try = 1;
@@ -820,9 +919,9 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 		arp_request();
 		return 1;	/* waiting */
 	} else {
-		debug_cond(DEBUG_DEV_PKT, "sending UDP to %pI4/%pM\n",
+		debug_cond(DEBUG_DEV_PKT, "sending IP to %pI4/%pM\n",
 			   &dest, ether);
-		net_send_packet(net_tx_packet, pkt_hdr_size + payload_len);
+		net_send_packet(net_tx_packet, eth_hdr_size + len);
 		return 0;	/* transmitted */
 	}
 }
@@ -1176,6 +1275,9 @@ void net_process_received_packet(uchar *in_packet, int len)
 		}
 		/* Read source IP address for later use */
 		src_ip = net_read_ip(&ip->ip_src);
+		/* Remember the sender of unicast traffic, for replies */
+		if (dst_ip.s_addr == net_ip.s_addr)
+			arp_cache_update(src_ip, et->et_src);
 		/*
 		 * The function returns the unchanged packet if it's not
 		 * a fragment, and either the complete packet or NULL if
@@ -1208,6 +1310,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_PROT_TCP)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive((struct ip_hdr *)ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1217,44 +1324,16 @@ void net_process_received_packet(uchar *in_packet, int len)
 			   &dst_ip, &src_ip, len);
 
 #ifdef CONFIG_UDP_CHECKSUM
+		udp_csum_pkt = NULL;
 		if (ip->udp_xsum != 0) {
-			ulong   xsum;
-			ushort *sumptr;
-			ushort  sumlen;
-
-			xsum  = ip->ip_p;
-			xsum += (ntohs(ip->udp_len));
-			xsum += (ntohl(ip->ip_src.s_addr) >> 16) & 0x0000ffff;
-			xsum += (ntohl(ip->ip_src.s_addr) >>  0) & 0x0000ffff;
-			xsum += (ntohl(ip->ip_dst.s_addr) >> 16) & 0x0000ffff;
-			xsum += (ntohl(ip->ip_dst.s_addr) >>  0) & 0x0000ffff;
-
-			sumlen = ntohs(ip->udp_len);
-			sumptr = (ushort *)&(ip->udp_src);
-
-			while (sumlen > 1) {
-				ushort sumdata;
-
-				sumdata = *sumptr++;
-				xsum += ntohs(sumdata);
-				sumlen -= 2;
-			}
-			if (sumlen > 0) {
-				ushort sumdata;
-
-				sumdata = *(unsigned char *)sumptr;
-				sumdata = (sumdata << 8) & 0xff00;
-				xsum += sumdata;
-			}
-			while ((xsum >> 16) != 0) {
-				xsum = (xsum & 0x0000ffff) +
-				       ((xsum >> 16) & 0x0000ffff);
-			}
-			if ((xsum != 0x00000000) && (xsum != 0x0000ffff)) {
-				printf(" UDP wrong checksum %08lx %08x\n",
-				       xsum, ntohs(ip->udp_xsum));
+			if (ntohs(ip->udp_len) < UDP_HDR_SIZE ||
+			    ntohs(ip->udp_len) > len - IP_HDR_SIZE)
+				return;
+			udp_csum_pkt = ip;
+			/* Otherwise the handler checks it as it copies */
+			if (!udp_csum_on_copy &&
+			    !net_udp_csum_copy(NULL, NULL, 0))
 				return;
-			}
 		}
 #endif
 
@@ -1273,6 +1352,9 @@ void net_process_received_packet(uchar *in_packet, int len)
 				      src_ip,
 				      ntohs(ip->udp_src),
 				      ntohs(ip->udp_len) - UDP_HDR_SIZE);
+#ifdef CONFIG_UDP_CHECKSUM
+		udp_csum_pkt = NULL;
+#endif
 		break;
 	}
 }
@@ -1309,6 +1391,9 @@ static int net_check_prereq(enum proto_t protocol)
 #endif
 #if defined(CONFIG_CMD_NFS)
 	case NFS:
+#endif
+#if defined(CONFIG_CMD_WGET)
+	case WGET:
 #endif
 		/* Fall through */
 	case TFTPGET:
@@ -1324,6 +1409,7 @@ common:
 		/* Fall through */
 
 	case NETCONS:
+	case FASTBOOT:
 	case TFTPSRV:
 		if (net_ip.s_addr == 0) {
 			puts("*** ERROR: `ipaddr' not set\n");
@@ -45,12 +45,60 @@
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
+/*
+ * Largest NFSv3 read to ask for. The reply must fit in one UDP datagram,
+ * so anything bigger than an ethernet frame needs CONFIG_IP_DEFRAG and a
+ * large enough CONFIG_NET_MAXDEFRAG.
+ */
+#define NFS3_READ_SIZE_MAX	32768
+/* Bytes in an NFSv3 read reply before the data, including attributes */
+#define NFS3_READ_REPLY_HDR	128
+#ifdef CONFIG_IP_DEFRAG
+#ifndef CONFIG_NET_MAXDEFRAG
+#define CONFIG_NET_MAXDEFRAG	16384
+#endif
+#define NFS_UDP_MAX	(CONFIG_NET_MAXDEFRAG - IP_UDP_HDR_SIZE)
+#else
+#define NFS_UDP_MAX	(PKTSIZE - ETHER_HDR_SIZE - IP_UDP_HDR_SIZE)
+#endif
+
+/*
+ * Reads are pipelined: up to NFS_READ_WINDOW requests are in flight at
+ * once, each in its own slot, and replies are matched to slots by XID so
+ * they can be stored in whatever order they arrive.
+ */
+#ifdef CONFIG_NFS_READ_WINDOW
+#define NFS_READ_WINDOW		CONFIG_NFS_READ_WINDOW
+#else
+#define NFS_READ_WINDOW		1
+#endif
+
+struct nfs_read_slot {
+	unsigned long id;	/* XID of the request, 0 if the slot is free */
+	unsigned int offset;
+	unsigned int len;
+	ulong sent;		/* get_timer() when the request was sent */
+	int passed;		/* Later requests answered since it was sent */
+};
+
+/*
+ * Replies normally come back in the order the requests were sent, so a
+ * request overtaken by this many later replies is taken to be lost
+ */
+#define NFS_READ_REORDER	3
+
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
+static struct nfs_read_slot nfs_read_slots[NFS_READ_WINDOW];
+static unsigned int nfs_read_size;	/* Bytes to ask for in each read */
+static unsigned int nfs_read_next;	/* Next offset to request */
+static unsigned int nfs_read_end;	/* Size of the file, once known */
+static int nfs_read_eof;		/* The end of the file has been seen */
+static ulong nfs_read_bytes;		/* Bytes received so far */
+static int nfs_read_hashes;
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -69,6 +117,7 @@ static int nfs_state;
 #define STATE_LOOKUP_REQ		5
 #define STATE_READ_REQ			6
 #define STATE_READLINK_REQ		7
+#define STATE_FSINFO_REQ		8
 
 static char *nfs_filename;
 static char *nfs_path;
@@ -353,6 +402,27 @@ static void nfs_lookup_req(char *fname)
 	}
 }
 
+/**************************************************************************
+NFS_FSINFO - Get the preferred read size (NFSv3 only)
+**************************************************************************/
+static void nfs_fsinfo_req(void)
+{
+	uint32_t data[1024];
+	uint32_t *p;
+	int len;
+
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	*p++ = htonl(filefh3_length);
+	memcpy(p, filefh, filefh3_length);
+	p += (filefh3_length / 4);
+
+	len = (uint32_t *)p - (uint32_t *)&(data[0]);
+
+	rpc_req(PROG_NFS, NFS3PROC_FSINFO, data, len);
+}
+
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
@@ -386,6 +456,81 @@ static void nfs_read_req(int offset, int readlen)
 	rpc_req(PROG_NFS, NFS_READ, data, len);
 }
 
+static void nfs_read_slot_send(struct nfs_read_slot *slot)
+{
+	nfs_read_req(slot->offset, slot->len);
+	slot->id = rpc_id;
+	slot->sent = get_timer(0);
+	slot->passed = 0;
+}
+
+/*
+ * Start reads in any free slots, and send again any which look lost
+ * because later replies have overtaken them
+ */
+static void nfs_read_fill(void)
+{
+	struct nfs_read_slot *slot;
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		slot = &nfs_read_slots[i];
+		if (slot->id && nfs_read_eof && slot->offset >= nfs_read_end)
+			slot->id = 0;
+		if (slot->id) {
+			if (slot->passed >= NFS_READ_REORDER ||
+			    get_timer(slot->sent) > nfs_timeout)
+				nfs_read_slot_send(slot);
+			continue;
+		}
+		if (nfs_read_eof && nfs_read_next >= nfs_read_end)
+			continue;
+		slot->offset = nfs_read_next;
+		slot->len = nfs_read_size;
+		nfs_read_next += nfs_read_size;
+		nfs_read_slot_send(slot);
+	}
+}
+
+/* Send every outstanding read again, after a timeout */
+static void nfs_read_resend(void)
+{
+	int i;
+
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_read_slots[i].id)
+			nfs_read_slot_send(&nfs_read_slots[i]);
+	}
+	nfs_read_fill();
+}
+
+static void nfs_read_start(void)
+{
+	memset(nfs_read_slots, '\0', sizeof(nfs_read_slots));
+	nfs_read_next = 0;
+	nfs_read_end = 0;
+	nfs_read_eof = 0;
+	nfs_read_bytes = 0;
+	nfs_read_hashes = 0;
+	nfs_read_fill();
+}
+
+/* Check whether every read up to the end of the file has completed */
+static int nfs_read_done(void)
+{
+	int i;
+
+	if (!nfs_read_eof)
+		return 0;
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_read_slots[i].id &&
+		    nfs_read_slots[i].offset < nfs_read_end)
+			return 0;
+	}
+
+	return 1;
+}
+
 /**************************************************************************
 RPC request dispatcher
 **************************************************************************/
@@ -415,8 +560,11 @@ static void nfs_send(void)
 	case STATE_LOOKUP_REQ:
 		nfs_lookup_req(nfs_filename);
 		break;
+	case STATE_FSINFO_REQ:
+		nfs_fsinfo_req();
+		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_resend();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
@@ -652,21 +800,83 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned len)
+static int nfs_fsinfo_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
-	uchar *data_ptr;
+	unsigned int size, max;
+	int offset;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	memcpy(&rpc_pkt.u.data[0], pkt, min_t(unsigned, len, sizeof(rpc_pkt)));
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
 	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
 		return -NFS_RPC_DROP;
 
+	/* Without a good answer, just keep the default read size */
+	if (rpc_pkt.u.reply.rstatus  ||
+	    rpc_pkt.u.reply.verifier ||
+	    rpc_pkt.u.reply.astatus  ||
+	    rpc_pkt.u.reply.data[0])
+		return 0;
+
+	/* rtmax is followed by rtpref, the preferred read size */
+	offset = nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
+	size = ntohl(rpc_pkt.u.reply.data[2 + offset]);
+
+	/* Use the largest power of two which fits in one datagram */
+	max = NFS3_READ_SIZE_MAX;
+	while (max > NFS_READ_SIZE && max + NFS3_READ_REPLY_HDR > NFS_UDP_MAX)
+		max /= 2;
+	while (max > NFS_READ_SIZE && max > size)
+		max /= 2;
+	nfs_read_size = max;
+	debug("NFS read size %u (server prefers %u)\n", max, size);
+
+	return 0;
+}
+
+static void nfs_show_progress(void)
+{
+	while (nfs_read_hashes < nfs_read_bytes / (NFS_READ_SIZE / 2 * 10)) {
+		putc('#');
+		if (!(++nfs_read_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+}
+
+static int nfs_read_reply(uchar *pkt, unsigned len)
+{
+	struct rpc_t rpc_pkt;
+	struct nfs_read_slot *slot = NULL;
+	unsigned long id;
+	unsigned int hdr_len;
+	int rlen, eof, i;
+	uint32_t *data_ptr;
+
+	debug("%s\n", __func__);
+
+	/* Only copy the header: the data is stored straight from the packet */
+	hdr_len = (uchar *)rpc_pkt.u.reply.data - rpc_pkt.u.data +
+		NFS3_READ_REPLY_HDR;
+	memcpy(&rpc_pkt.u.data[0], pkt, min(len, hdr_len));
+
+	id = ntohl(rpc_pkt.u.reply.id);
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_read_slots[i].id == id) {
+			slot = &nfs_read_slots[i];
+			break;
+		}
+	}
+	if (!slot)
+		return -NFS_RPC_DROP;
+	for (i = 0; i < NFS_READ_WINDOW; i++) {
+		if (nfs_read_slots[i].id && nfs_read_slots[i].id < id)
+			nfs_read_slots[i].passed++;
+	}
+
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
 	    rpc_pkt.u.reply.astatus  ||
@@ -678,31 +888,48 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (supported_nfs_versions & NFSV2_FLAG) {
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
-		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		data_ptr = &rpc_pkt.u.reply.data[19];
+		eof = rlen < slot->len;
 	} else {  /* NFSV3_FLAG */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		eof = ntohl(rpc_pkt.u.reply.data[2 + nfsv3_data_offset]) ||
+			!rlen;
 		/* Skip unused values :
 			EOF:		32 bits value,
 			data_size:	32 bits value,
 		*/
-		data_ptr = (uchar *)
-			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
+		data_ptr = &rpc_pkt.u.reply.data[4 + nfsv3_data_offset];
 	}
 
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
+	/* Find the data in the packet itself */
+	i = (uchar *)data_ptr - rpc_pkt.u.data;
+	if (i > len || rlen < 0 || rlen > len - i || rlen > slot->len)
+		return -9999;
+
+	if (rlen && store_block(pkt + i, slot->offset, rlen))
+		return -9999;
+	nfs_read_bytes += rlen;
+	nfs_show_progress();
+
+	if (eof) {
+		if (!nfs_read_eof || slot->offset + rlen < nfs_read_end)
+			nfs_read_end = slot->offset + rlen;
+		nfs_read_eof = 1;
+		slot->id = 0;
+	} else if (rlen < slot->len) {
+		/* A short read: ask for the rest */
+		slot->offset += rlen;
+		slot->len -= rlen;
+		nfs_read_slot_send(slot);
+	} else {
+		slot->id = 0;
+	}
 
 	return rlen;
 }
@@ -794,14 +1021,26 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			/* And retry with another supported version */
 			nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 			nfs_send();
-		} else {
+		} else if (supported_nfs_versions & NFSV2_FLAG) {
 			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+			nfs_read_size = NFS_READ_SIZE;
+			nfs_read_start();
+		} else {
+			/* NFSv3: find out how much can be read at once */
+			nfs_state = STATE_FSINFO_REQ;
+			nfs_read_size = NFS_READ_SIZE;
 			nfs_send();
 		}
 		break;
 
+	case STATE_FSINFO_REQ:
+		reply = nfs_fsinfo_reply(pkt, len);
+		if (reply == -NFS_RPC_DROP)
+			break;
+		nfs_state = STATE_READ_REQ;
+		nfs_read_start();
+		break;
+
 	case STATE_READLINK_REQ:
 		reply = nfs_readlink_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP) {
@@ -822,16 +1061,17 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 	case STATE_READ_REQ:
 		rlen = nfs_read_reply(pkt, len);
+		if (rlen == -NFS_RPC_DROP)
+			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
-			nfs_send();
+		if (rlen >= 0 && !nfs_read_done()) {
+			nfs_read_fill();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
+			if (rlen >= 0)
 				nfs_download_state = NETLOOP_SUCCESS;
 			if (rlen < 0)
 				debug("NFS READ error (%d)\n", rlen);
@@ -10,10 +10,12 @@
  */
 
 #include "ping.h"
-#include "arp.h"
 
 static ushort ping_seq_number;
 
+/* MAC address of the host being pinged */
+static uchar ping_ethaddr[ARP_HLEN];
+
 /* The ip address to ping */
 struct in_addr net_ping_ip;
 
@@ -42,32 +44,17 @@ static void set_icmp_header(uchar *pkt, struct in_addr dest)
 static int ping_send(void)
 {
 	uchar *pkt;
-	int eth_hdr_size;
-
-	/* XXX always send arp request */
-
-	debug_cond(DEBUG_DEV_PKT, "sending ARP for %pI4\n", &net_ping_ip);
-
-	net_arp_wait_packet_ip = net_ping_ip;
-
-	eth_hdr_size = net_set_ether(net_tx_packet, net_null_ethaddr, PROT_IP);
-	pkt = (uchar *)net_tx_packet + eth_hdr_size;
 
+	pkt = (uchar *)net_tx_packet + net_eth_hdr_size();
 	set_icmp_header(pkt, net_ping_ip);
 
-	/* size of the waiting packet */
-	arp_wait_tx_packet_size = eth_hdr_size + IP_ICMP_HDR_SIZE;
-
-	/* and do the ARP request */
-	arp_wait_try = 1;
-	arp_wait_timer_start = get_timer(0);
-	arp_request();
-	return 1;	/* waiting */
+	/* this does an ARP request unless the address is in the ARP cache */
+	return net_send_ip_packet(ping_ethaddr, net_ping_ip, IP_ICMP_HDR_SIZE);
 }
 
 static void ping_timeout_handler(void)
 {
-	eth_halt();
+	eth_release();
 	net_set_state(NETLOOP_FAIL);	/* we did not get the reply */
 }
 
@@ -76,6 +63,7 @@ void ping_start(void)
 	printf("Using %s device\n", eth_get_name());
 	net_set_timeout_handler(10000UL, ping_timeout_handler);
 
+	memset(ping_ethaddr, '\0', ARP_HLEN);
 	ping_send();
 }
 
@@ -0,0 +1,743 @@
+/*
+ * Minimal TCP client
+ *
+ * This supports one connection at a time, opened by a client such as wget
+ * to fetch a file. It is built for receiving bulk data quickly: the receive
+ * window is large and scaled, received data is passed straight to the
+ * client even when it arrives out of order, and any holes are reported to
+ * the sender with selective acknowledgments (SACK), so that a lost segment
+ * costs one retransmission rather than a stall. Sending is only meant for
+ * short requests.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <net.h>
+#include <asm/unaligned.h>
+#include "tcp.h"
+
+/* Receive window; received data is not buffered so this can be large */
+#define TCP_RCV_WND		(256 * 1024)
+#define TCP_WSCALE		3
+/* Largest segment that fits in an ethernet frame */
+#define TCP_MSS			1460
+/* Segment size to use if the other end does not say */
+#define TCP_DEFAULT_MSS		536
+/* Space for data sent but not yet acknowledged */
+#define TCP_TX_SIZE		1024
+/* Number of out-of-order ranges tracked, and how many are reported */
+#define TCP_OOO_MAX		16
+#define TCP_SACK_MAX		4
+
+/* Timeouts in milliseconds */
+#define TCP_RTO			1000
+#define TCP_RTO_MAX		16000
+#define TCP_DELACK		20
+#define TCP_IDLE		5000
+#define TCP_RETRIES		6
+
+#define TCP_PORT_BASE		49152
+
+/* Options */
+#define TCPOPT_EOL		0
+#define TCPOPT_NOP		1
+#define TCPOPT_MSS		2
+#define TCPOPT_WSCALE		3
+#define TCPOPT_SACK_PERM	4
+#define TCPOPT_SACK		5
+
+#define tcp_before(a, b)	((s32)((a) - (b)) < 0)
+
+struct tcp_pseudo_hdr {
+	struct in_addr	src;
+	struct in_addr	dst;
+	u8		zero;
+	u8		proto;
+	u16		len;
+};
+
+/* A range of the received stream, as offsets from its start */
+struct tcp_range {
+	u32 start;
+	u32 end;
+};
+
+static struct tcp_conn {
+	enum tcp_state state;
+	struct in_addr dest;
+	uchar ethaddr[6];
+	int sport;
+	int dport;
+	tcp_rx_f *rx;
+	tcp_event_f *event;
+
+	/* Sending: offsets are from the start of the stream we send */
+	u32 iss;		/* Initial sequence number */
+	u32 snd_base;		/* Offset of tx_buf[0], all acknowledged */
+	u32 snd_max;		/* Highest offset sent, including our FIN */
+	unsigned int tx_len;	/* Bytes in tx_buf */
+	unsigned int tx_sent;	/* Bytes of tx_buf sent */
+	uchar tx_buf[TCP_TX_SIZE];
+	u32 snd_wnd;		/* Window offered by the other end */
+	int snd_wscale;
+	unsigned int peer_mss;
+	int fin_queued;		/* tcp_close() was called */
+	int fin_sent;
+	int fin_acked;
+	int dup_acks;
+
+	/* Receiving: offsets are from the start of the stream received */
+	u32 irs;		/* Initial sequence number of the other end */
+	u32 rcv_off;		/* Bytes received in order */
+	int rcv_wscale;
+	int sack_ok;
+	struct tcp_range ooo[TCP_OOO_MAX];	/* Oldest first */
+	int ooo_count;
+	int fin_seen;
+	u32 fin_off;
+	int fin_done;		/* FIN received and acknowledged */
+	int segs_unacked;
+
+	/* Timers */
+	unsigned int rto;
+	int retries;
+	ulong rtx_due;
+	int ack_pending;
+	ulong ack_due;
+	ulong idle_due;
+} conn;
+
+static u32 tcp_rcv_nxt(void)
+{
+	return conn.irs + 1 + conn.rcv_off + conn.fin_done;
+}
+
+static u32 tcp_rcv_wnd(void)
+{
+	return conn.rcv_wscale ? TCP_RCV_WND : min(TCP_RCV_WND, 0xffff);
+}
+
+/* Check whether there is anything sent which is not yet acknowledged */
+static int tcp_outstanding(void)
+{
+	return conn.state == TCP_SYN_SENT || conn.tx_sent ||
+		(conn.fin_sent && !conn.fin_acked);
+}
+
+/* Check whether more data is expected from the other end */
+static int tcp_receiving(void)
+{
+	return conn.state != TCP_CLOSED && conn.state != TCP_SYN_SENT &&
+		!conn.fin_done;
+}
+
+static unsigned tcp_checksum(struct in_addr src, struct in_addr dst,
+			     const void *tcp, unsigned int len)
+{
+	struct tcp_pseudo_hdr ph;
+
+	ph.src = src;
+	ph.dst = dst;
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(len);
+
+	return add_ip_checksums(sizeof(ph),
+				compute_ip_checksum(&ph, sizeof(ph)),
+				compute_ip_checksum(tcp, len));
+}
+
+static int tcp_set_options(uchar *opt, u8 flags)
+{
+	uchar *p = opt;
+	int i;
+
+	if (flags & TCP_SYN) {
+		*p++ = TCPOPT_MSS;
+		*p++ = 4;
+		put_unaligned_be16(TCP_MSS, p);
+		p += 2;
+		*p++ = TCPOPT_NOP;
+		*p++ = TCPOPT_WSCALE;
+		*p++ = 3;
+		*p++ = TCP_WSCALE;
+		*p++ = TCPOPT_NOP;
+		*p++ = TCPOPT_NOP;
+		*p++ = TCPOPT_SACK_PERM;
+		*p++ = 2;
+	} else if ((flags & TCP_ACK) && conn.sack_ok && conn.ooo_count) {
+		int count = min(conn.ooo_count, TCP_SACK_MAX);
+
+		*p++ = TCPOPT_NOP;
+		*p++ = TCPOPT_NOP;
+		*p++ = TCPOPT_SACK;
+		*p++ = 2 + count * 8;
+		/* The most recently changed range goes first */
+		for (i = conn.ooo_count - 1; count--; i--) {
+			u32 start = conn.irs + 1 + conn.ooo[i].start;
+
+			put_unaligned_be32(start, p);
+			put_unaligned_be32(start + conn.ooo[i].end -
+					   conn.ooo[i].start, p + 4);
+			p += 8;
+		}
+	}
+
+	return p - opt;
+}
+
+static void tcp_send_segment(u8 flags, u32 seq, const uchar *data,
+			     unsigned int len)
+{
+	uchar *pkt = (uchar *)net_tx_packet + net_eth_hdr_size();
+	struct ip_hdr *ip = (struct ip_hdr *)pkt;
+	struct tcp_hdr *tcp = (struct tcp_hdr *)(pkt + IP_HDR_SIZE);
+	uchar *opt = (uchar *)(tcp + 1);
+	unsigned int hdr_len, tcp_len;
+
+	hdr_len = TCP_HDR_SIZE + tcp_set_options(opt, flags);
+	tcp_len = hdr_len + len;
+	if (len)
+		memcpy((uchar *)tcp + hdr_len, data, len);
+
+	net_set_ip_header(pkt, conn.dest, net_ip);
+	ip->ip_len = htons(IP_HDR_SIZE + tcp_len);
+	ip->ip_p = IPPROTO_TCP;
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+
+	tcp->tcp_src = htons(conn.sport);
+	tcp->tcp_dst = htons(conn.dport);
+	put_unaligned_be32(seq, &tcp->tcp_seq);
+	put_unaligned_be32(flags & TCP_ACK ? tcp_rcv_nxt() : 0, &tcp->tcp_ack);
+	tcp->tcp_off = hdr_len << 2;
+	tcp->tcp_flags = flags;
+	tcp->tcp_win = htons(tcp_rcv_wnd() >> conn.rcv_wscale);
+	tcp->tcp_sum = 0;
+	tcp->tcp_urg = 0;
+	tcp->tcp_sum = tcp_checksum(net_ip, conn.dest, tcp, tcp_len);
+
+	if (flags & TCP_ACK) {
+		conn.ack_pending = 0;
+		conn.segs_unacked = 0;
+	}
+	net_send_ip_packet(conn.ethaddr, conn.dest, IP_HDR_SIZE + tcp_len);
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, conn.iss + 1 + conn.snd_max, NULL, 0);
+}
+
+/* Send whatever is queued and allowed by the window, then any FIN */
+static void tcp_output(void)
+{
+	u32 seq;
+	int sent = 0;
+
+	while (conn.tx_sent < conn.tx_len && conn.tx_sent < conn.snd_wnd) {
+		unsigned int len = conn.tx_len - conn.tx_sent;
+
+		len = min(len, conn.peer_mss);
+		len = min(len, conn.snd_wnd - conn.tx_sent);
+		seq = conn.iss + 1 + conn.snd_base + conn.tx_sent;
+		tcp_send_segment(TCP_ACK | TCP_PSH, seq,
+				 conn.tx_buf + conn.tx_sent, len);
+		conn.tx_sent += len;
+		sent = 1;
+	}
+	if (conn.fin_queued && !conn.fin_sent && conn.tx_sent == conn.tx_len) {
+		seq = conn.iss + 1 + conn.snd_base + conn.tx_len;
+		tcp_send_segment(TCP_FIN | TCP_ACK, seq, NULL, 0);
+		conn.fin_sent = 1;
+		sent = 1;
+	}
+	if (sent) {
+		u32 end = conn.snd_base + conn.tx_sent + conn.fin_sent;
+
+		if (tcp_before(conn.snd_max, end))
+			conn.snd_max = end;
+		conn.rtx_due = get_timer(0) + conn.rto;
+	}
+}
+
+/* Send everything unacknowledged again */
+static void tcp_retransmit(void)
+{
+	if (conn.state == TCP_SYN_SENT) {
+		tcp_send_segment(TCP_SYN, conn.iss, NULL, 0);
+		return;
+	}
+	conn.tx_sent = 0;
+	if (!conn.fin_acked)
+		conn.fin_sent = 0;
+	tcp_output();
+}
+
+static void tcp_timeout(void);
+
+/* Set the network timeout for whichever timer is due first */
+static void tcp_schedule(void)
+{
+	ulong now = get_timer(0);
+	ulong due;
+
+	if (conn.state == TCP_CLOSED) {
+		net_set_timeout_handler(0, NULL);
+		return;
+	}
+	due = now + TCP_RTO_MAX;
+	if (tcp_receiving())
+		due = conn.idle_due;
+	if (tcp_outstanding() && (long)(conn.rtx_due - due) < 0)
+		due = conn.rtx_due;
+	if (conn.ack_pending && (long)(conn.ack_due - due) < 0)
+		due = conn.ack_due;
+	net_set_timeout_handler(max((long)(due - now), 1L), tcp_timeout);
+}
+
+static void tcp_fail(enum tcp_event event)
+{
+	conn.state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+	conn.event(event);
+}
+
+static void tcp_timeout(void)
+{
+	ulong now = get_timer(0);
+
+	if (conn.ack_pending && (long)(now - conn.ack_due) >= 0)
+		tcp_send_ack();
+	if (tcp_outstanding() && (long)(now - conn.rtx_due) >= 0) {
+		if (++conn.retries > TCP_RETRIES) {
+			tcp_fail(TCP_EVENT_TIMEOUT);
+			return;
+		}
+		conn.rto = min_t(unsigned int, conn.rto * 2, TCP_RTO_MAX);
+		conn.rtx_due = now + conn.rto;
+		debug("TCP: retransmit, rto %u\n", conn.rto);
+		tcp_retransmit();
+	} else if (tcp_receiving() && (long)(now - conn.idle_due) >= 0) {
+		if (++conn.retries > TCP_RETRIES) {
+			tcp_fail(TCP_EVENT_TIMEOUT);
+			return;
+		}
+		/* Repeat our ACK, in case it (and the SACK list) was lost */
+		debug("TCP: idle at %u\n", conn.rcv_off);
+		conn.idle_due = now + TCP_IDLE;
+		tcp_send_ack();
+	}
+	tcp_schedule();
+}
+
+static void tcp_parse_options(const uchar *opt, int len)
+{
+	unsigned int mss;
+
+	while (len > 0) {
+		if (opt[0] == TCPOPT_EOL)
+			break;
+		if (opt[0] == TCPOPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		if (len < 2 || opt[1] < 2 || opt[1] > len)
+			break;
+		switch (opt[0]) {
+		case TCPOPT_MSS:
+			mss = get_unaligned_be16(opt + 2);
+			if (opt[1] == 4 && mss)
+				conn.peer_mss = min(mss, (unsigned int)TCP_MSS);
+			break;
+		case TCPOPT_WSCALE:
+			if (opt[1] == 3) {
+				conn.snd_wscale = min(opt[2], (uchar)14);
+				conn.rcv_wscale = TCP_WSCALE;
+			}
+			break;
+		case TCPOPT_SACK_PERM:
+			conn.sack_ok = 1;
+			break;
+		}
+		len -= opt[1];
+		opt += opt[1];
+	}
+}
+
+/* Check whether [start, end) has already been received out of order */
+static int tcp_ooo_has(u32 start, u32 end)
+{
+	int i;
+
+	for (i = 0; i < conn.ooo_count; i++) {
+		if (!tcp_before(start, conn.ooo[i].start) &&
+		    !tcp_before(conn.ooo[i].end, end))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Check whether [start, end) can be recorded */
+static int tcp_ooo_room(u32 start, u32 end)
+{
+	int i;
+
+	if (conn.ooo_count < TCP_OOO_MAX)
+		return 1;
+	for (i = 0; i < conn.ooo_count; i++) {
+		if (!tcp_before(end, conn.ooo[i].start) &&
+		    !tcp_before(conn.ooo[i].end, start))
+			return 1;
+	}
+
+	return 0;
+}
+
+static void tcp_ooo_remove(int i)
+{
+	conn.ooo_count--;
+	memmove(&conn.ooo[i], &conn.ooo[i + 1],
+		(conn.ooo_count - i) * sizeof(conn.ooo[0]));
+}
+
+/* Record [start, end), merging it with any ranges it overlaps or touches */
+static void tcp_ooo_add(u32 start, u32 end)
+{
+	struct tcp_range *r;
+	int i;
+
+	for (i = 0; i < conn.ooo_count;) {
+		r = &conn.ooo[i];
+		if (tcp_before(end, r->start) || tcp_before(r->end, start)) {
+			i++;
+			continue;
+		}
+		if (tcp_before(r->start, start))
+			start = r->start;
+		if (tcp_before(end, r->end))
+			end = r->end;
+		tcp_ooo_remove(i);
+	}
+	r = &conn.ooo[conn.ooo_count++];
+	r->start = start;
+	r->end = end;
+}
+
+/* Move rcv_off past any ranges which are now in order */
+static int tcp_ooo_advance(void)
+{
+	struct tcp_range *r;
+	int filled = 0;
+	int i;
+
+	for (i = 0; i < conn.ooo_count;) {
+		r = &conn.ooo[i];
+		if (tcp_before(conn.rcv_off, r->start)) {
+			i++;
+			continue;
+		}
+		if (tcp_before(conn.rcv_off, r->end))
+			conn.rcv_off = r->end;
+		tcp_ooo_remove(i);
+		filled = 1;
+		i = 0;
+	}
+
+	return filled;
+}
+
+static void tcp_rcv_ack(u32 ack, unsigned int win, unsigned int len)
+{
+	u32 acked = ack - (conn.iss + 1);
+	unsigned int count, old_wnd = conn.snd_wnd;
+
+	/* Ignore old ACKs and anything for data not sent yet */
+	if (tcp_before(acked, conn.snd_base) || tcp_before(conn.snd_max, acked))
+		return;
+	conn.snd_wnd = win << conn.snd_wscale;
+
+	if (acked == conn.snd_base) {
+		if (tcp_outstanding() && !len && conn.snd_wnd == old_wnd &&
+		    ++conn.dup_acks == 3) {
+			debug("TCP: fast retransmit\n");
+			tcp_retransmit();
+		}
+		return;
+	}
+
+	count = min(acked - conn.snd_base, conn.tx_len);
+	conn.tx_len -= count;
+	conn.tx_sent = conn.tx_sent > count ? conn.tx_sent - count : 0;
+	memmove(conn.tx_buf, conn.tx_buf + count, conn.tx_len);
+	conn.snd_base += count;
+	conn.dup_acks = 0;
+	conn.retries = 0;
+	conn.rto = TCP_RTO;
+	conn.rtx_due = get_timer(0) + conn.rto;
+
+	if (acked != conn.snd_base) {
+		conn.fin_sent = 1;
+		conn.fin_acked = 1;
+		if (conn.state == TCP_FIN_WAIT_1)
+			conn.state = TCP_FIN_WAIT_2;
+		else if (conn.state == TCP_LAST_ACK)
+			conn.state = TCP_CLOSED;
+	}
+}
+
+static void tcp_rcv_data(u32 seq, const uchar *data, unsigned int len,
+			 int fin)
+{
+	u32 off = seq - (conn.irs + 1);
+	u32 wnd_end = conn.rcv_off + tcp_rcv_wnd();
+	u32 old_off = conn.rcv_off;
+	int ack_now = 0;
+	int closed = 0;
+
+	if (conn.fin_done) {
+		tcp_send_ack();
+		return;
+	}
+
+	/* Drop whatever has been received already */
+	if (tcp_before(off, conn.rcv_off)) {
+		u32 skip = conn.rcv_off - off;
+
+		if (skip > len || (skip == len && !fin)) {
+			tcp_send_ack();
+			return;
+		}
+		data += skip;
+		len -= skip;
+		off = conn.rcv_off;
+	}
+	/* ...and whatever does not fit in the window */
+	if (tcp_before(wnd_end, off + len)) {
+		len = tcp_before(off, wnd_end) ? wnd_end - off : 0;
+		fin = 0;
+	}
+
+	if (len) {
+		if (off != conn.rcv_off &&
+		    (tcp_ooo_has(off, off + len) ||
+		     !tcp_ooo_room(off, off + len))) {
+			tcp_send_ack();
+			return;
+		}
+		if (conn.rx(off, data, len)) {
+			tcp_send_ack();
+			return;
+		}
+		if (off == conn.rcv_off) {
+			conn.rcv_off += len;
+			if (tcp_ooo_advance() || conn.ooo_count)
+				ack_now = 1;
+			conn.retries = 0;
+		} else {
+			tcp_ooo_add(off, off + len);
+			ack_now = 1;
+		}
+	}
+
+	if (fin) {
+		conn.fin_seen = 1;
+		conn.fin_off = off + len;
+	}
+	if (conn.fin_seen && conn.rcv_off == conn.fin_off) {
+		conn.fin_done = 1;
+		if (conn.state == TCP_ESTABLISHED)
+			conn.state = TCP_CLOSE_WAIT;
+		else if (conn.state == TCP_FIN_WAIT_1)
+			conn.state = TCP_LAST_ACK;
+		else if (conn.state == TCP_FIN_WAIT_2)
+			conn.state = TCP_CLOSED;
+		ack_now = 1;
+		closed = 1;
+	}
+
+	if (ack_now || ++conn.segs_unacked >= 2) {
+		tcp_send_ack();
+	} else if (!conn.ack_pending) {
+		conn.ack_pending = 1;
+		conn.ack_due = get_timer(0) + TCP_DELACK;
+	}
+
+	if (conn.rcv_off != old_off)
+		conn.event(TCP_EVENT_RECEIVED);
+	if (closed)
+		conn.event(TCP_EVENT_CLOSED);
+}
+
+static void tcp_rcv_syn_sent(struct tcp_hdr *tcp, unsigned int hdr_len)
+{
+	u32 seq = get_unaligned_be32(&tcp->tcp_seq);
+	u32 ack = get_unaligned_be32(&tcp->tcp_ack);
+	u8 flags = tcp->tcp_flags;
+
+	if ((flags & TCP_ACK) && ack != conn.iss + 1) {
+		if (!(flags & TCP_RST))
+			tcp_send_segment(TCP_RST, ack, NULL, 0);
+		return;
+	}
+	if (flags & TCP_RST) {
+		if (flags & TCP_ACK)
+			tcp_fail(TCP_EVENT_RESET);
+		return;
+	}
+	/* Simultaneous open is not supported */
+	if (!(flags & TCP_SYN) || !(flags & TCP_ACK))
+		return;
+
+	conn.irs = seq;
+	tcp_parse_options((uchar *)(tcp + 1), hdr_len - TCP_HDR_SIZE);
+	conn.snd_wnd = ntohs(tcp->tcp_win);
+	conn.state = TCP_ESTABLISHED;
+	conn.retries = 0;
+	conn.rto = TCP_RTO;
+	conn.idle_due = get_timer(0) + TCP_IDLE;
+	tcp_send_ack();
+	conn.event(TCP_EVENT_CONNECTED);
+}
+
+void tcp_receive(struct ip_hdr *ip, unsigned int len)
+{
+	struct tcp_hdr *tcp = (struct tcp_hdr *)((uchar *)ip + IP_HDR_SIZE);
+	struct in_addr src, dst;
+	unsigned int tcp_len, hdr_len;
+	unsigned sum;
+	u32 seq;
+	u8 flags;
+
+	if (conn.state == TCP_CLOSED || len < IP_HDR_SIZE + TCP_HDR_SIZE)
+		return;
+	tcp_len = len - IP_HDR_SIZE;
+	hdr_len = (tcp->tcp_off >> 4) * 4;
+	if (hdr_len < TCP_HDR_SIZE || hdr_len > tcp_len)
+		return;
+
+	src = net_read_ip(&ip->ip_src);
+	dst = net_read_ip(&ip->ip_dst);
+	if (src.s_addr != conn.dest.s_addr ||
+	    ntohs(tcp->tcp_src) != conn.dport ||
+	    ntohs(tcp->tcp_dst) != conn.sport)
+		return;
+	sum = tcp_checksum(src, dst, tcp, tcp_len);
+	if (sum && sum != 0xffff) {
+		debug("TCP: checksum bad\n");
+		return;
+	}
+
+	if (conn.state == TCP_SYN_SENT) {
+		tcp_rcv_syn_sent(tcp, hdr_len);
+		tcp_schedule();
+		return;
+	}
+
+	flags = tcp->tcp_flags;
+	seq = get_unaligned_be32(&tcp->tcp_seq);
+	if (flags & TCP_RST) {
+		/* Only believe a reset which is within the window */
+		if (!tcp_before(seq, tcp_rcv_nxt()) &&
+		    tcp_before(seq, tcp_rcv_nxt() + tcp_rcv_wnd()))
+			tcp_fail(TCP_EVENT_RESET);
+		return;
+	}
+	if (flags & TCP_SYN) {
+		/* Our ACK of the SYN was lost */
+		tcp_send_ack();
+		return;
+	}
+	if (!(flags & TCP_ACK))
+		return;
+
+	conn.idle_due = get_timer(0) + TCP_IDLE;
+	tcp_rcv_ack(get_unaligned_be32(&tcp->tcp_ack), ntohs(tcp->tcp_win),
+		    tcp_len - hdr_len);
+	if (conn.state == TCP_CLOSED) {
+		net_set_timeout_handler(0, NULL);
+		return;
+	}
+	if (tcp_len > hdr_len || (flags & TCP_FIN))
+		tcp_rcv_data(seq, (uchar *)tcp + hdr_len, tcp_len - hdr_len,
+			     flags & TCP_FIN);
+	tcp_output();
+	tcp_schedule();
+}
+
+void tcp_connect(struct in_addr dest, int dport, tcp_rx_f *rx,
+		 tcp_event_f *event)
+{
+	static int last_port;
+
+	memset(&conn, '\0', sizeof(conn));
+	conn.dest = dest;
+	conn.dport = dport;
+	last_port = (last_port + 1 + get_timer(0)) & 0x3fff;
+	conn.sport = TCP_PORT_BASE + last_port;
+	conn.rx = rx;
+	conn.event = event;
+	conn.iss = timer_get_us();
+	conn.peer_mss = TCP_DEFAULT_MSS;
+	conn.rto = TCP_RTO;
+	conn.rtx_due = get_timer(0) + conn.rto;
+	conn.state = TCP_SYN_SENT;
+
+	debug("TCP: connect to %pI4:%d from port %d\n", &dest, dport,
+	      conn.sport);
+	tcp_send_segment(TCP_SYN, conn.iss, NULL, 0);
+	tcp_schedule();
+}
+
+int tcp_send(const void *data, unsigned int len)
+{
+	if (conn.state != TCP_ESTABLISHED && conn.state != TCP_CLOSE_WAIT)
+		return -ENOTCONN;
+	if (conn.tx_len + len > TCP_TX_SIZE)
+		return -E2BIG;
+
+	memcpy(conn.tx_buf + conn.tx_len, data, len);
+	conn.tx_len += len;
+	tcp_output();
+	tcp_schedule();
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	switch (conn.state) {
+	case TCP_SYN_SENT:
+		conn.state = TCP_CLOSED;
+		net_set_timeout_handler(0, NULL);
+		return;
+	case TCP_ESTABLISHED:
+		conn.state = TCP_FIN_WAIT_1;
+		break;
+	case TCP_CLOSE_WAIT:
+		conn.state = TCP_LAST_ACK;
+		break;
+	default:
+		return;
+	}
+	conn.fin_queued = 1;
+	tcp_output();
+	tcp_schedule();
+}
+
+enum tcp_state tcp_get_state(void)
+{
+	return conn.state;
+}
+
+u32 tcp_get_received(void)
+{
+	return conn.rcv_off;
+}
+
+void tcp_stop(void)
+{
+	conn.state = TCP_CLOSED;
+}
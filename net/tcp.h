@@ -0,0 +1,124 @@
+/*
+ * Minimal TCP client
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#include <common.h>
+#include <net.h>
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_FIN_WAIT_1,
+	TCP_FIN_WAIT_2,
+	TCP_CLOSE_WAIT,
+	TCP_LAST_ACK,
+};
+
+enum tcp_event {
+	TCP_EVENT_CONNECTED,	/* The connection is established */
+	TCP_EVENT_CLOSED,	/* The other end has sent all its data */
+	TCP_EVENT_RESET,	/* The connection was refused or reset */
+	TCP_EVENT_TIMEOUT,	/* The other end stopped responding */
+	TCP_EVENT_RECEIVED,	/* More data has been received in order */
+};
+
+/**
+ * tcp_rx_f - handler for data received on the connection
+ *
+ * This is called for each new piece of data as it arrives, which is not
+ * always in order: after a lost segment, later data is passed on before
+ * the missing part is retransmitted, so that it can be written straight
+ * to its destination.
+ *
+ * @offset:	Offset of the data in the stream received
+ * @data:	Data received
+ * @len:	Number of bytes received
+ * @return 0 if the data was accepted, or -ve to drop the segment, so that
+ * the other end sends it again
+ */
+typedef int tcp_rx_f(u32 offset, const uchar *data, unsigned int len);
+
+/**
+ * tcp_event_f - handler for changes in the state of the connection
+ *
+ * @event:	What has happened
+ */
+typedef void tcp_event_f(enum tcp_event event);
+
+/**
+ * tcp_connect() - open a connection
+ *
+ * This sends a SYN and returns; @event is called with TCP_EVENT_CONNECTED
+ * once the connection is established. There is one connection at a time,
+ * which takes over the network timeout handler while it is open. Any
+ * previous connection is forgotten.
+ *
+ * @dest:	IP address to connect to
+ * @dport:	TCP port to connect to
+ * @rx:		Handler for received data
+ * @event:	Handler for connection events
+ */
+void tcp_connect(struct in_addr dest, int dport, tcp_rx_f *rx,
+		 tcp_event_f *event);
+
+/**
+ * tcp_send() - send data on the connection
+ *
+ * The data is copied and kept until it is acknowledged. Only a small
+ * amount (such as a request) can be outstanding at once.
+ *
+ * @data:	Data to send
+ * @len:	Number of bytes to send
+ * @return 0 if OK, -ENOTCONN if the connection is not established, -E2BIG
+ * if there is not enough room for the data
+ */
+int tcp_send(const void *data, unsigned int len);
+
+/**
+ * tcp_close() - close the connection
+ *
+ * A FIN is sent after any outstanding data. Data received afterwards is
+ * still passed to the receive handler.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_get_state() - get the state of the connection
+ *
+ * @return state, TCP_CLOSED if there is no connection
+ */
+enum tcp_state tcp_get_state(void);
+
+/**
+ * tcp_get_received() - get the amount of data received in order
+ *
+ * @return number of bytes received with no gaps, from the start of the
+ * stream
+ */
+u32 tcp_get_received(void);
+
+/**
+ * tcp_stop() - forget the connection
+ *
+ * This is called when the network loop finishes. Nothing is sent to the
+ * other end.
+ */
+void tcp_stop(void);
+
+/**
+ * tcp_receive() - handle a TCP segment
+ *
+ * This is called by net_process_received_packet() for each TCP packet.
+ *
+ * @ip:		IP header of the packet, followed by the TCP header
+ * @len:	Length of the IP packet, including the header
+ */
+void tcp_receive(struct ip_hdr *ip, unsigned int len);
+
+#endif /* __TCP_H__ */
@@ -103,6 +103,7 @@ static int	tftp_put_final_block_sent;
 #define STATE_OACK	5
 #define STATE_RECV_WRQ	6
 #define STATE_SEND_WRQ	7
+#define STATE_PROBE	8
 
 /* default TFTP block size */
 #define TFTP_BLOCK_SIZE		512
@@ -134,6 +135,17 @@ static char tftp_filename[MAX_LEN];
 static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = TFTP_MTU_BLOCKSIZE;
 
+/*
+ * Number of blocks the server may send before waiting for an ACK (RFC 7440).
+ * A window of 1 is the lock-step transfer of RFC 1350.
+ */
+static unsigned short tftp_windowsize = 1;
+static unsigned short tftp_windowsize_option = CONFIG_TFTP_WINDOWSIZE;
+/* block number whose arrival completes the window, so must be ACKed */
+static ulong	tftp_next_ack;
+/* 1 if we have ACKed an earlier block since the last one in sequence */
+static int	tftp_nack_sent;
+
 #ifdef CONFIG_MCAST_TFTP
 #include <malloc.h>
 #define MTFTP_BITMAPSIZE	0x1000
@@ -164,7 +176,36 @@ static void mcast_cleanup(void)
 
 #endif	/* CONFIG_MCAST_TFTP */
 
-static inline void store_block(int block, uchar *src, unsigned len)
+#ifdef CONFIG_CMD_PXE
+/* What the server said about each file in tftp_probe() */
+enum {
+	PROBE_WAITING,
+	PROBE_MISSING,
+	PROBE_FOUND,
+};
+
+static const char *const *tftp_probe_names;
+/* Number of files to probe for, 0 for a normal transfer */
+static int tftp_probe_count;
+/* Number of read requests sent so far */
+static int tftp_probe_sent;
+static u8 tftp_probe_state[TFTP_PROBE_MAX];
+/* Port the request for the first file is sent from */
+static int tftp_probe_port;
+/* Most preferred file found so far, or -1, with the server's first reply */
+static int tftp_probe_best;
+static int tftp_probe_best_port;
+static uchar tftp_probe_reply[TFTP_BLOCK_SIZE + 4];
+static int tftp_probe_reply_len;
+/* File being loaded */
+static int tftp_probe_found;
+#endif
+
+/*
+ * Store a block of received data, checking the UDP checksum of the packet
+ * as it is copied into memory. Returns -EBADMSG if the packet is corrupt.
+ */
+static inline int store_block(int block, uchar *src, unsigned len)
 {
 	ulong offset = block * tftp_block_size + tftp_block_wrap_offset;
 	ulong newsize = offset + len;
@@ -182,19 +223,24 @@ static inline void store_block(int block, uchar *src, unsigned len)
 	}
 
 	if (rc) { /* Flash is destination for this packet */
+		if (!net_udp_csum_copy(NULL, src, len))
+			return -EBADMSG;
 		rc = flash_write((char *)src, (ulong)(load_addr+offset), len);
 		if (rc) {
 			flash_perror(rc);
 			net_set_state(NETLOOP_FAIL);
-			return;
+			return 0;
 		}
 	} else
 #endif /* CONFIG_SYS_DIRECT_FLASH_TFTP */
 	{
 		void *ptr = map_sysmem(load_addr + offset, len);
+		bool ok;
 
-		memcpy(ptr, src, len);
+		ok = net_udp_csum_copy(ptr, src, len);
 		unmap_sysmem(ptr);
+		if (!ok)
+			return -EBADMSG;
 	}
 #ifdef CONFIG_MCAST_TFTP
 	if (tftp_mcast_active)
@@ -203,6 +249,8 @@ static inline void store_block(int block, uchar *src, unsigned len)
 
 	if (net_boot_file_size < newsize)
 		net_boot_file_size = newsize;
+
+	return 0;
 }
 
 /* Clear our state ready for a new transfer */
@@ -211,6 +259,7 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	tftp_nack_sent = 0;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -241,6 +290,22 @@ static int load_block(unsigned block, uchar *dst, unsigned len)
 
 static void tftp_send(void);
 static void tftp_timeout_handler(void);
+static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
+			 unsigned src, unsigned len);
+
+/* Set the file to ask for, and the server if the name starts with one */
+static void tftp_set_filename(const char *name)
+{
+	char *p = strchr(name, ':');
+
+	if (p == NULL) {
+		strncpy(tftp_filename, name, MAX_LEN);
+	} else {
+		tftp_remote_ip = string_to_ip(name);
+		strncpy(tftp_filename, p + 1, MAX_LEN);
+	}
+	tftp_filename[MAX_LEN - 1] = 0;
+}
 
 /**********************************************************************/
 
@@ -372,6 +437,10 @@ static void tftp_send(void)
 		/* try for more effic. blk size */
 		pkt += sprintf((char *)pkt, "blksize%c%d%c",
 				0, tftp_block_size_option, 0);
+		/* and for several blocks in flight */
+		if (tftp_windowsize_option > 1)
+			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
+					0, tftp_windowsize_option, 0);
 #ifdef CONFIG_MCAST_TFTP
 		/* Check all preconditions before even trying the option */
 		if (!tftp_mcast_disabled) {
@@ -404,6 +473,8 @@ static void tftp_send(void)
 		s[0] = htons(TFTP_ACK);
 		s[1] = htons(tftp_cur_block);
 		pkt = (uchar *)(s + 2);
+		/* The server sends a new window after each ACK */
+		tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
 #ifdef CONFIG_CMD_TFTPPUT
 		if (tftp_put_active) {
 			int toload = tftp_block_size;
@@ -457,13 +528,202 @@ static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 }
 #endif
 
+/*
+ * Handle a data block which is not the next one in sequence. Such blocks
+ * are dropped, since the server resends its window starting from the block
+ * after the one we last ACKed. With a window of several blocks, a lost
+ * block makes every later block in the window arrive out of order, so
+ * only ACK the last block in sequence for the first of them; further ACKs
+ * would make the server send the window again for each one.
+ *
+ * In lock-step transfers this is a duplicate of the last block, which is
+ * ignored as RFC 1350 requires.
+ */
+static void tftp_data_out_of_order(ulong block)
+{
+	debug("Unexpected block %lu after %lu\n", block, tftp_cur_block);
+	if (tftp_windowsize == 1 || tftp_nack_sent)
+		return;
+
+	tftp_nack_sent = 1;
+	tftp_send();
+}
+
+#ifdef CONFIG_CMD_PXE
+/*
+ * Send read requests for the files not asked for yet, or with @again also
+ * for those still unanswered. Only one packet can wait for the server's MAC
+ * address to be found with ARP, so the rest are sent once it has replied.
+ */
+static void tftp_probe_send(bool again)
+{
+	int i;
+
+	tftp_state = STATE_SEND_RRQ;
+	for (i = again ? 0 : tftp_probe_sent; i < tftp_probe_count; i++) {
+		if (tftp_probe_state[i] != PROBE_WAITING)
+			continue;
+		tftp_set_filename(tftp_probe_names[i]);
+		tftp_our_port = tftp_probe_port + i;
+		tftp_send();
+		tftp_probe_sent = max(tftp_probe_sent, i + 1);
+		if (is_zero_ethaddr(net_server_ethaddr))
+			break;
+	}
+	tftp_state = STATE_PROBE;
+}
+
+/* Tell the server to stop sending a file we do not want */
+static void tftp_probe_abort(int i, struct in_addr sip, int port)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	__be16 *s = (__be16 *)pkt;
+
+	s[0] = htons(TFTP_ERROR);
+	s[1] = htons(TFTP_ERR_UNDEFINED);
+	strcpy((char *)(s + 2), "Not needed");
+	net_send_udp_packet(net_server_ethaddr, sip, port, tftp_probe_port + i,
+			    4 + 10 + 1);
+}
+
+static void tftp_probe_start(void)
+{
+	memset(tftp_probe_state, PROBE_WAITING, sizeof(tftp_probe_state));
+	tftp_probe_port = tftp_our_port;
+	tftp_probe_sent = 0;
+	tftp_probe_best = -1;
+	tftp_probe_send(false);
+}
+
+/*
+ * Once the server has answered for every file more preferred than the best
+ * one found, continue with the transfer of that file as if it was the only
+ * one asked for, by handling the reply saved for it.
+ */
+static void tftp_probe_decide(void)
+{
+	int i;
+
+	for (i = 0; i < tftp_probe_count; i++) {
+		if (tftp_probe_state[i] == PROBE_WAITING)
+			return;
+		if (tftp_probe_state[i] == PROBE_FOUND)
+			break;
+	}
+	if (i == tftp_probe_count) {
+		puts("\nTFTP error: none of the files found\n");
+		eth_release();
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	tftp_probe_found = i;
+	tftp_set_filename(tftp_probe_names[i]);
+	tftp_our_port = tftp_probe_port + i;
+	tftp_state = STATE_SEND_RRQ;
+	printf("\nFilename '%s'.\n\t ", tftp_filename);
+	efi_set_bootdev("Net", "", tftp_filename);
+
+	timeout_count = 0;
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+	tftp_handler(tftp_probe_reply, tftp_our_port, tftp_remote_ip,
+		     tftp_probe_best_port, tftp_probe_reply_len);
+}
+
+static void tftp_probe_handler(uchar *pkt, unsigned dest, struct in_addr sip,
+			       unsigned src, unsigned len)
+{
+	int i = dest - tftp_probe_port;
+
+	if (i < 0 || i >= tftp_probe_sent ||
+	    tftp_probe_state[i] != PROBE_WAITING || len < 4)
+		return;
+	if (!net_udp_csum_copy(NULL, NULL, 0))
+		return;
+
+	switch (ntohs(*(__be16 *)pkt)) {
+	case TFTP_ERROR:
+		debug("TFTP probe: no '%s'\n", tftp_probe_names[i]);
+		tftp_probe_state[i] = PROBE_MISSING;
+		break;
+	case TFTP_OACK:
+	case TFTP_DATA:
+		if (len > sizeof(tftp_probe_reply))
+			return;
+		tftp_probe_state[i] = PROBE_FOUND;
+		if (tftp_probe_best >= 0 && tftp_probe_best < i) {
+			tftp_probe_abort(i, sip, src);
+			break;
+		}
+		if (tftp_probe_best >= 0)
+			tftp_probe_abort(tftp_probe_best, sip,
+					 tftp_probe_best_port);
+		tftp_probe_best = i;
+		tftp_probe_best_port = src;
+		memcpy(tftp_probe_reply, pkt, len);
+		tftp_probe_reply_len = len;
+		break;
+	default:
+		return;
+	}
+
+	tftp_probe_send(false);
+	tftp_probe_decide();
+}
+
+/* Ask again for the files not answered, or give up on them */
+static void tftp_probe_timeout(void)
+{
+	int i;
+
+	if (++timeout_count > timeout_count_max) {
+		for (i = 0; i < tftp_probe_count; i++) {
+			if (tftp_probe_state[i] == PROBE_WAITING)
+				tftp_probe_state[i] = PROBE_MISSING;
+		}
+		tftp_probe_decide();
+		return;
+	}
+
+	puts("T ");
+	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+	tftp_probe_send(true);
+}
+
+int tftp_probe(const char *const names[], int count, ulong addr)
+{
+	int ret;
+
+	if (count > TFTP_PROBE_MAX)
+		count = TFTP_PROBE_MAX;
+
+	tftp_probe_names = names;
+	tftp_probe_count = count;
+	load_addr = addr;
+	ret = net_loop(TFTPGET);
+	tftp_probe_count = 0;
+	if (ret < 0)
+		return -ENOENT;
+
+	return tftp_probe_found;
+}
+#endif /* CONFIG_CMD_PXE */
+
 static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
 	__be16 proto;
 	__be16 *s;
+	ulong block;
+	bool next;
 	int i;
 
+#ifdef CONFIG_CMD_PXE
+	if (tftp_state == STATE_PROBE) {
+		tftp_probe_handler(pkt, dest, sip, src, len);
+		return;
+	}
+#endif
 	if (dest != tftp_our_port) {
 #ifdef CONFIG_MCAST_TFTP
 		if (tftp_mcast_active &&
@@ -482,6 +742,11 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	s = (__be16 *)pkt;
 	proto = *s++;
 	pkt = (uchar *)s;
+
+	/* Data is checked in the TFTP_DATA case, anything else here */
+	if (ntohs(proto) != TFTP_DATA && !net_udp_csum_copy(NULL, NULL, 0))
+		return;
+
 	switch (ntohs(proto)) {
 	case TFTP_RRQ:
 		break;
@@ -540,6 +805,17 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				debug("Blocksize ack: %s, %d\n",
 				      (char *)pkt + i + 8, tftp_block_size);
 			}
+			if (strcmp((char *)pkt + i, "windowsize") == 0) {
+				tftp_windowsize = simple_strtoul((char *)pkt +
+								 i + 11, NULL,
+								 10);
+				/* The server may only reduce the window */
+				if (!tftp_windowsize ||
+				    tftp_windowsize > tftp_windowsize_option)
+					tftp_windowsize = 1;
+				debug("Windowsize ack: %s, %d\n",
+				      (char *)pkt + i + 11, tftp_windowsize);
+			}
 #ifdef CONFIG_TFTP_TSIZE
 			if (strcmp((char *)pkt+i, "tsize") == 0) {
 				tftp_tsize = simple_strtoul((char *)pkt + i + 6,
@@ -568,9 +844,28 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (len < 2)
 			return;
 		len -= 2;
-		tftp_cur_block = ntohs(*(__be16 *)pkt);
+		block = ntohs(*(__be16 *)pkt);
 
-		update_block_number();
+		/*
+		 * The next block of the transfer is checked as it is copied
+		 * into place by store_block(). Anything else is checked before
+		 * it is acted on.
+		 */
+		next = tftp_state == STATE_DATA &&
+			block == (ushort)(tftp_prev_block + 1);
+		if (!next && !net_udp_csum_copy(NULL, NULL, 0))
+			return;
+
+		/* Only accept the next block; the first one must be 1 */
+#ifdef CONFIG_MCAST_TFTP
+		if (!tftp_mcast_active)
+#endif
+		if ((tftp_state == STATE_DATA && !next) ||
+		    (tftp_state == STATE_OACK && block != 1 &&
+		     tftp_windowsize > 1)) {
+			tftp_data_out_of_order(block);
+			break;
+		}
 
 		if (tftp_state == STATE_SEND_RRQ)
 			debug("Server did not acknowledge timeout option!\n");
@@ -584,30 +879,41 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 #ifdef CONFIG_MCAST_TFTP
 			if (tftp_mcast_active) { /* start!=1 common if mcast */
-				tftp_prev_block = tftp_cur_block - 1;
+				tftp_prev_block = block - 1;
 			} else
 #endif
-			if (tftp_cur_block != 1) {	/* Assertion */
+			if (block != 1) {	/* Assertion */
 				puts("\nTFTP error: ");
 				printf("First block is not block 1 (%ld)\n",
-				       tftp_cur_block);
+				       block);
 				puts("Starting again\n\n");
 				net_start_again();
 				break;
 			}
 		}
 
-		if (tftp_cur_block == tftp_prev_block) {
+		if (block == tftp_prev_block) {
 			/* Same block again; ignore it. */
 			break;
 		}
 
+		/*
+		 * A corrupt block is dropped without changing any state, so
+		 * that it is accepted when the server sends it again. When
+		 * the block number wraps, update_block_number() moves the
+		 * offset on, so it is only called once the block is stored.
+		 */
+		if (store_block((ushort)(block - 1), pkt + 2, len))
+			return;
+
+		tftp_nack_sent = 0;
+		tftp_cur_block = block;
+		update_block_number();
+
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-		store_block(tftp_cur_block - 1, pkt + 2, len);
-
 		/*
 		 *	Acknowledge the block just received, which will prompt
 		 *	the remote for the next one.
@@ -636,9 +942,12 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 				}
 				tftp_prev_block = tftp_cur_block;
 			}
-		}
+			tftp_send();
+		} else
 #endif
-		tftp_send();
+		/* ACK at the end of each window, and at the end of the file */
+		if (tftp_cur_block == tftp_next_ack || len < tftp_block_size)
+			tftp_send();
 
 #ifdef CONFIG_MCAST_TFTP
 		if (tftp_mcast_active) {
@@ -662,7 +971,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		case TFTP_ERR_FILE_NOT_FOUND:
 		case TFTP_ERR_ACCESS_DENIED:
 			puts("Not retrying...\n");
-			eth_halt();
+			eth_release();
 			net_set_state(NETLOOP_FAIL);
 			break;
 		case TFTP_ERR_UNDEFINED:
@@ -685,6 +994,12 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+#ifdef CONFIG_CMD_PXE
+	if (tftp_state == STATE_PROBE) {
+		tftp_probe_timeout();
+		return;
+	}
+#endif
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
@@ -710,6 +1025,10 @@ void tftp_start(enum proto_t protocol)
 	if (ep != NULL)
 		tftp_block_size_option = simple_strtol(ep, NULL, 10);
 
+	ep = getenv("tftpwindowsize");
+	if (ep != NULL)
+		tftp_windowsize_option = simple_strtol(ep, NULL, 10);
+
 	ep = getenv("tftptimeout");
 	if (ep != NULL)
 		timeout_ms = simple_strtol(ep, NULL, 10);
@@ -731,10 +1050,15 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
-	debug("TFTP blocksize = %i, timeout = %ld ms\n",
-	      tftp_block_size_option, timeout_ms);
+	debug("TFTP blocksize = %i, windowsize = %i, timeout = %ld ms\n",
+	      tftp_block_size_option, tftp_windowsize_option, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
+#ifdef CONFIG_CMD_PXE
+	if (tftp_probe_count) {
+		tftp_set_filename(tftp_probe_names[0]);
+	} else
+#endif
 	if (net_boot_file_name[0] == '\0') {
 		sprintf(default_filename, "%02X%02X%02X%02X.img",
 			net_ip.s_addr & 0xFF,
@@ -748,16 +1072,7 @@ void tftp_start(enum proto_t protocol)
 		printf("*** Warning: no boot file name; using '%s'\n",
 		       tftp_filename);
 	} else {
-		char *p = strchr(net_boot_file_name, ':');
-
-		if (p == NULL) {
-			strncpy(tftp_filename, net_boot_file_name, MAX_LEN);
-			tftp_filename[MAX_LEN - 1] = 0;
-		} else {
-			tftp_remote_ip = string_to_ip(net_boot_file_name);
-			strncpy(tftp_filename, p + 1, MAX_LEN);
-			tftp_filename[MAX_LEN - 1] = 0;
-		}
+		tftp_set_filename(net_boot_file_name);
 	}
 
 	printf("Using %s device\n", eth_get_name());
@@ -781,6 +1096,11 @@ void tftp_start(enum proto_t protocol)
 	}
 	putc('\n');
 
+#ifdef CONFIG_CMD_PXE
+	if (tftp_probe_count)
+		printf("Probing for %d files.", tftp_probe_count);
+	else
+#endif
 	printf("Filename '%s'.", tftp_filename);
 
 	if (net_boot_file_expected_size_in_blocks) {
@@ -812,7 +1132,7 @@ void tftp_start(enum proto_t protocol)
 	timeout_count_max = tftp_timeout_count_max;
 
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
-	net_set_udp_handler(tftp_handler);
+	net_set_udp_handler_csum(tftp_handler);
 #ifdef CONFIG_CMD_TFTPPUT
 	net_set_icmp_handler(icmp_handler);
 #endif
@@ -830,11 +1150,13 @@ void tftp_start(enum proto_t protocol)
 		tftp_our_port = simple_strtol(ep, NULL, 10);
 #endif
 	tftp_cur_block = 0;
+	tftp_next_ack = 1;
 
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
 #ifdef CONFIG_MCAST_TFTP
 	mcast_cleanup();
 #endif
@@ -843,6 +1165,12 @@ void tftp_start(enum proto_t protocol)
 	tftp_tsize_num_hash = 0;
 #endif
 
+#ifdef CONFIG_CMD_PXE
+	if (tftp_probe_count) {
+		tftp_probe_start();
+		return;
+	}
+#endif
 	tftp_send();
 }
 
@@ -862,9 +1190,11 @@ void tftp_start_server(void)
 	timeout_ms = TIMEOUT;
 	net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
 
-	/* Revert tftp_block_size to dflt */
+	/* Revert tftp_block_size and tftp_windowsize to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
+	tftp_windowsize = 1;
 	tftp_cur_block = 0;
+	tftp_next_ack = 1;
 	tftp_our_port = WELL_KNOWN_PORT;
 
 #ifdef CONFIG_TFTP_TSIZE
@@ -873,7 +1203,7 @@ void tftp_start_server(void)
 #endif
 
 	tftp_state = STATE_RECV_WRQ;
-	net_set_udp_handler(tftp_handler);
+	net_set_udp_handler_csum(tftp_handler);
 
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
@@ -0,0 +1,302 @@
+/*
+ * HTTP download over TCP
+ *
+ * The file named by net_boot_file_name is fetched with an HTTP/1.1 GET
+ * request and written to load_addr as it arrives. The Content-Length of
+ * the reply is checked against the memory available before anything is
+ * written; without one, each segment is checked as it arrives. Data
+ * received out of order is written straight to its place in memory, so the
+ * transfer does not stall while a lost segment is sent again.
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <image.h>
+#include <lmb.h>
+#include <mapmem.h>
+#include <net.h>
+#include "tcp.h"
+#include "wget.h"
+
+#define HTTP_PORT		80
+#define HTTP_HDR_MAX		2048
+#define HTTP_REQ_MAX		1024
+
+/* One hash mark for each 64KiB received */
+#define HASH_BYTES		(64 * 1024)
+#define HASHES_PER_LINE		65
+
+static struct in_addr wget_server_ip;
+static char wget_req[HTTP_REQ_MAX];
+static int wget_req_len;
+static char wget_hdr[HTTP_HDR_MAX + 1];
+static unsigned int wget_hdr_len;
+static int wget_hdr_done;
+static u32 wget_body_start;	/* Offset of the body in the stream */
+static int wget_have_len;
+static ulong wget_content_len;
+static ulong wget_load_space;	/* Bytes which may be written at load_addr */
+static int wget_done;
+static int wget_hashes;
+static ulong wget_time_start;
+
+static void wget_fail(const char *msg)
+{
+	printf("\nHTTP error: %s\n", msg);
+	wget_done = 1;
+	tcp_close();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void wget_complete(ulong size)
+{
+	ulong time = get_timer(wget_time_start);
+
+	net_boot_file_size = size;
+	if (time > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(size / time * 1000, "/s");
+	}
+	puts("\ndone\n");
+	wget_done = 1;
+	tcp_close();
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+#ifdef CONFIG_LMB
+/* Work out how much can be written at load_addr without overwriting U-Boot */
+static ulong wget_get_load_space(void)
+{
+	struct lmb lmb;
+	struct lmb_property *mem = &lmb.memory.region[0];
+	ulong space;
+	int i;
+
+	lmb_init(&lmb);
+	lmb_add(&lmb, getenv_bootm_low(), getenv_bootm_size());
+	arch_lmb_reserve(&lmb);
+	board_lmb_reserve(&lmb);
+
+	if (load_addr < mem->base || load_addr - mem->base >= mem->size)
+		return 0;
+	space = mem->size - (load_addr - mem->base);
+	for (i = 0; i < lmb.reserved.cnt; i++) {
+		struct lmb_property *r = &lmb.reserved.region[i];
+
+		if (load_addr >= r->base + r->size)
+			continue;
+		if (r->base <= load_addr)
+			return 0;
+		space = min(space, (ulong)(r->base - load_addr));
+	}
+
+	return space;
+}
+#else
+static inline ulong wget_get_load_space(void)
+{
+	return ~0UL;
+}
+#endif
+
+/* Check the status and pick out the length, once the header is complete */
+static int wget_parse_header(void)
+{
+	char *line, *next, *p;
+	int status;
+
+	line = wget_hdr;
+	next = strstr(line, "\r\n");
+	*next = '\0';
+	p = strchr(line, ' ');
+	if (strncmp(line, "HTTP/1.", 7) || !p) {
+		wget_fail("bad response");
+		return -EPROTO;
+	}
+	status = simple_strtoul(p + 1, NULL, 10);
+	if (status != 200) {
+		wget_fail(p + 1);
+		return -ENOENT;
+	}
+
+	for (line = next + 2; *line != '\r'; line = next + 2) {
+		next = strstr(line, "\r\n");
+		*next = '\0';
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			wget_content_len = simple_strtoul(line + 15 +
+					strspn(line + 15, " \t"), NULL, 10);
+			wget_have_len = 1;
+		} else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+			   strstr(line, "chunked")) {
+			wget_fail("chunked transfer encoding is not supported");
+			return -EPROTONOSUPPORT;
+		}
+	}
+	if (wget_have_len && wget_content_len > wget_load_space) {
+		wget_fail("file too large for the memory at the load address");
+		return -E2BIG;
+	}
+
+	return 0;
+}
+
+static int wget_rx(u32 offset, const uchar *data, unsigned int len)
+{
+	ulong pos;
+	void *ptr;
+
+	if (wget_done)
+		return 0;
+
+	if (!wget_hdr_done) {
+		unsigned int count, from;
+		char *end;
+
+		/* Collect the header in order; anything later must wait */
+		if (offset != wget_hdr_len)
+			return -EAGAIN;
+		count = min(len, HTTP_HDR_MAX - wget_hdr_len);
+		from = wget_hdr_len > 3 ? wget_hdr_len - 3 : 0;
+		memcpy(wget_hdr + wget_hdr_len, data, count);
+		wget_hdr_len += count;
+		wget_hdr[wget_hdr_len] = '\0';
+
+		end = strstr(wget_hdr + from, "\r\n\r\n");
+		if (!end) {
+			if (wget_hdr_len == HTTP_HDR_MAX)
+				wget_fail("header too long");
+			return 0;
+		}
+		wget_body_start = end + 4 - wget_hdr;
+		wget_hdr_done = 1;
+		if (wget_parse_header())
+			return 0;
+
+		if (offset + len <= wget_body_start)
+			return 0;
+		data += wget_body_start - offset;
+		len -= wget_body_start - offset;
+		offset = wget_body_start;
+	}
+
+	pos = offset - wget_body_start;
+	if (wget_have_len) {
+		if (pos >= wget_content_len)
+			return 0;
+		len = min((ulong)len, wget_content_len - pos);
+	}
+	if (len > wget_load_space || pos > wget_load_space - len) {
+		wget_fail("file too large for the memory at the load address");
+		return 0;
+	}
+	ptr = map_sysmem(load_addr + pos, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+
+	return 0;
+}
+
+static void wget_show_progress(ulong got)
+{
+	while (wget_hashes < got / HASH_BYTES) {
+		putc('#');
+		if (++wget_hashes % HASHES_PER_LINE == 0)
+			puts("\n\t ");
+	}
+}
+
+static void wget_event(enum tcp_event event)
+{
+	ulong got;
+
+	if (wget_done)
+		return;
+
+	switch (event) {
+	case TCP_EVENT_CONNECTED:
+		if (tcp_send(wget_req, wget_req_len))
+			wget_fail("cannot send request");
+		break;
+	case TCP_EVENT_RECEIVED:
+		if (!wget_hdr_done)
+			break;
+		got = tcp_get_received() - wget_body_start;
+		if (wget_have_len && got >= wget_content_len) {
+			wget_show_progress(wget_content_len);
+			wget_complete(wget_content_len);
+		} else {
+			wget_show_progress(got);
+		}
+		break;
+	case TCP_EVENT_CLOSED:
+		if (!wget_hdr_done)
+			wget_fail("connection closed");
+		else if (wget_have_len)
+			wget_fail("connection closed early");
+		else
+			wget_complete(tcp_get_received() - wget_body_start);
+		break;
+	case TCP_EVENT_RESET:
+		wget_fail("connection refused or reset");
+		break;
+	case TCP_EVENT_TIMEOUT:
+		wget_fail("timed out");
+		break;
+	}
+}
+
+void wget_start(void)
+{
+	const char *path;
+	char *p;
+	int port = HTTP_PORT;
+
+	wget_server_ip = net_server_ip;
+	p = strchr(net_boot_file_name, ':');
+	if (p) {
+		wget_server_ip = string_to_ip(net_boot_file_name);
+		path = p + 1;
+	} else {
+		path = net_boot_file_name;
+	}
+	if (!*path) {
+		puts("*** ERROR: no file name given\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	p = getenv("httpdstp");
+	if (p)
+		port = simple_strtoul(p, NULL, 10);
+
+	wget_req_len = snprintf(wget_req, sizeof(wget_req),
+				"GET %s%s HTTP/1.1\r\n"
+				"Host: %pI4\r\n"
+				"User-Agent: U-Boot\r\n"
+				"Connection: close\r\n\r\n",
+				*path == '/' ? "" : "/", path, &wget_server_ip);
+	if (wget_req_len >= sizeof(wget_req)) {
+		puts("*** ERROR: file name too long\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+
+	printf("Using %s device\n", eth_get_name());
+	printf("HTTP from server %pI4 port %d; our IP address is %pI4\n",
+	       &wget_server_ip, port, &net_ip);
+	printf("Filename '%s'.\n", path);
+	printf("Load address: 0x%lx\n", load_addr);
+	puts("Loading: *\b");
+
+	wget_hdr_len = 0;
+	wget_hdr_done = 0;
+	wget_have_len = 0;
+	wget_done = 0;
+	wget_hashes = 0;
+	wget_load_space = wget_get_load_space();
+	net_boot_file_size = 0;
+	wget_time_start = get_timer(0);
+
+	tcp_connect(wget_server_ip, port, wget_rx, wget_event);
+}
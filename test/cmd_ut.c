@@ -13,12 +13,28 @@ static int do_ut_all(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[]);
 
 static cmd_tbl_t cmd_ut_sub[] = {
 	U_BOOT_CMD_MKENT(all, CONFIG_SYS_MAXARGS, 1, do_ut_all, "", ""),
+#ifdef CONFIG_UT_CSUM
+	U_BOOT_CMD_MKENT(csum, CONFIG_SYS_MAXARGS, 1, do_ut_csum, "", ""),
+#endif
+#ifdef CONFIG_UT_DFU
+	U_BOOT_CMD_MKENT(dfu, CONFIG_SYS_MAXARGS, 1, do_ut_dfu, "", ""),
+#endif
 #if defined(CONFIG_UT_DM)
 	U_BOOT_CMD_MKENT(dm, CONFIG_SYS_MAXARGS, 1, do_ut_dm, "", ""),
 #endif
 #if defined(CONFIG_UT_ENV)
 	U_BOOT_CMD_MKENT(env, CONFIG_SYS_MAXARGS, 1, do_ut_env, "", ""),
 #endif
+#ifdef CONFIG_UT_FDT
+	U_BOOT_CMD_MKENT(fdt, CONFIG_SYS_MAXARGS, 1, do_ut_fdt, "", ""),
+#endif
+#ifdef CONFIG_UT_FDT_INDEX
+	U_BOOT_CMD_MKENT(fdt_index, CONFIG_SYS_MAXARGS, 1, do_ut_fdt_index, "",
+			 ""),
+#endif
+#ifdef CONFIG_UT_MALLOC
+	U_BOOT_CMD_MKENT(malloc, CONFIG_SYS_MAXARGS, 1, do_ut_malloc, "", ""),
+#endif
 #ifdef CONFIG_UT_OVERLAY
 	U_BOOT_CMD_MKENT(overlay, CONFIG_SYS_MAXARGS, 1, do_ut_overlay, "", ""),
 #endif
@@ -65,12 +81,27 @@ static int do_ut(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 #ifdef CONFIG_SYS_LONGHELP
 static char ut_help_text[] =
 	"all - execute all enabled tests\n"
+#ifdef CONFIG_UT_CSUM
+	"ut csum - Benchmark the IP checksum against a 16-bit version\n"
+#endif
+#ifdef CONFIG_UT_DFU
+	"ut dfu [test-name]\n"
+#endif
 #ifdef CONFIG_UT_DM
 	"ut dm [test-name]\n"
 #endif
 #ifdef CONFIG_UT_ENV
 	"ut env [test-name]\n"
 #endif
+#ifdef CONFIG_UT_FDT
+	"ut fdt [test-name]\n"
+#endif
+#ifdef CONFIG_UT_FDT_INDEX
+	"ut fdt_index [test-name]\n"
+#endif
+#ifdef CONFIG_UT_MALLOC
+	"ut malloc - Benchmark the malloc() heap against a TLSF pool\n"
+#endif
 #ifdef CONFIG_UT_OVERLAY
 	"ut overlay [test-name]\n"
 #endif
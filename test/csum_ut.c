@@ -0,0 +1,245 @@
+/*
+ * Benchmark of the IP checksum against a 16-bit reference implementation
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <errno.h>
+#include <malloc.h>
+#include <net.h>
+#include <linux/sizes.h>
+
+#define CSUM_UT_BUF_SIZE	SZ_64K
+#define CSUM_UT_CHECKS		5000
+#define CSUM_UT_PKT_LOOPS	20000
+#define CSUM_UT_BUF_LOOPS	200
+
+static u32 csum_ut_rand(u32 *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return *seed;
+}
+
+/* The checksum as it was computed before, one 16-bit word at a time */
+static unsigned csum_ut_ref(const void *vptr, unsigned nbytes)
+{
+	const u16 *ptr = vptr;
+	int sum = 0, oddbyte;
+
+	while (nbytes > 1) {
+		sum += *ptr++;
+		nbytes -= 2;
+	}
+	if (nbytes == 1) {
+		oddbyte = 0;
+		((u8 *)&oddbyte)[0] = *(u8 *)ptr;
+		((u8 *)&oddbyte)[1] = 0;
+		sum += oddbyte;
+	}
+	sum = (sum >> 16) + (sum & 0xffff);
+	sum += (sum >> 16);
+
+	return ~sum & 0xffff;
+}
+
+/*
+ * Check compute_ip_checksum(), ip_checksum_copy() and a checksum made of two
+ * pieces against the reference, with random alignments and lengths
+ */
+static int csum_ut_check(u8 *buf, u8 *copy)
+{
+	unsigned len, ref, sum, split;
+	int i, src_off, dst_off;
+	u32 seed = 1;
+
+	for (i = 0; i < CSUM_UT_CHECKS; i++) {
+		src_off = csum_ut_rand(&seed) % 8;
+		dst_off = csum_ut_rand(&seed) % 8;
+		len = csum_ut_rand(&seed) % 1600;
+		split = (csum_ut_rand(&seed) % (len + 1)) & ~1;
+		ref = csum_ut_ref(buf + src_off, len);
+
+		sum = compute_ip_checksum(buf + src_off, len);
+		if (sum != ref) {
+			printf("%s: offset %d, length %u: %04x, expected %04x\n",
+			       __func__, src_off, len, sum, ref);
+			return -EINVAL;
+		}
+
+		memset(copy, 0, len + 8);
+		sum = ip_checksum_copy(copy + dst_off, buf + src_off, len, 0);
+		if (ip_checksum_fold(sum) != ref ||
+		    memcmp(copy + dst_off, buf + src_off, len)) {
+			printf("%s: copy from offset %d to %d, length %u failed\n",
+			       __func__, src_off, dst_off, len);
+			return -EINVAL;
+		}
+
+		sum = ip_checksum_partial(buf + src_off, split, 0);
+		sum = ip_checksum_partial(buf + src_off + split, len - split,
+					  sum);
+		if (ip_checksum_fold(sum) != ref) {
+			printf("%s: offset %d, length %u split at %u failed\n",
+			       __func__, src_off, len, split);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_UDP_CHECKSUM
+#define CSUM_UT_UDP_LEN		64
+
+static u8 csum_ut_udp_data[CSUM_UT_UDP_LEN];
+static int csum_ut_udp_result;
+
+static void csum_ut_udp_handler(uchar *pkt, unsigned dport,
+				struct in_addr sip, unsigned sport,
+				unsigned len)
+{
+	csum_ut_udp_result = net_udp_csum_copy(csum_ut_udp_data, pkt, len);
+}
+
+/*
+ * Send a UDP packet with a correct checksum through
+ * net_process_received_packet(), with bit 0 of payload byte @flip cleared if
+ * @flip is not -1. Returns 1 if net_udp_csum_copy() accepted it, 0 if it
+ * rejected it and -1 if the handler was not called.
+ */
+static int csum_ut_udp_send(u8 *pkt, int flip)
+{
+	struct ip_udp_hdr *ip = (struct ip_udp_hdr *)(pkt + ETHER_HDR_SIZE);
+	u8 *data = (u8 *)ip + IP_UDP_HDR_SIZE;
+	unsigned sum;
+
+	net_set_ether(pkt, net_bcast_ethaddr, PROT_IP);
+	net_set_udp_header((uchar *)ip, string_to_ip("255.255.255.255"),
+			   1234, 4321, CSUM_UT_UDP_LEN);
+	/* Payload words of 0x0101, so a single bit can take 1 from the sum */
+	memset(data, 0x01, CSUM_UT_UDP_LEN);
+
+	sum = ip_checksum_partial(&ip->ip_src, 2 * sizeof(ip->ip_src),
+				  htons(IPPROTO_UDP) + ip->udp_len);
+	sum = ip_checksum_fold(ip_checksum_partial(&ip->udp_src,
+						   ntohs(ip->udp_len), sum));
+	ip->udp_xsum = sum ? sum : 0xffff;
+	if (flip != -1)
+		data[flip] &= ~1;
+
+	csum_ut_udp_result = -1;
+	net_set_udp_handler_csum(csum_ut_udp_handler);
+	net_process_received_packet(pkt, ETHER_HDR_SIZE + IP_UDP_HDR_SIZE +
+				    CSUM_UT_UDP_LEN);
+	net_set_udp_handler(NULL);
+
+	return csum_ut_udp_result;
+}
+
+/* Check that net_udp_csum_copy() accepts good packets and rejects bad ones */
+static int csum_ut_udp(u8 *pkt)
+{
+	int flip;
+
+	if (csum_ut_udp_send(pkt, -1) != 1) {
+		printf("%s: good packet rejected\n", __func__);
+		return -EINVAL;
+	}
+
+	/* One of these changes the folded sum by 1 on either endianness */
+	for (flip = 0; flip < 2; flip++) {
+		if (csum_ut_udp_send(pkt, flip) != 0) {
+			printf("%s: packet with bit flipped in byte %d accepted\n",
+			       __func__, flip);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+/* Time the reference and compute_ip_checksum() on the same data */
+static void csum_ut_time(const char *what, const u8 *data, unsigned len,
+			 int loops)
+{
+	ulong start, ref_us, new_us;
+	unsigned sum = 0;
+	int i;
+
+	start = timer_get_us();
+	for (i = 0; i < loops; i++) {
+		sum += csum_ut_ref(data, len);
+		barrier();
+	}
+	ref_us = timer_get_us() - start;
+
+	start = timer_get_us();
+	for (i = 0; i < loops; i++) {
+		sum += compute_ip_checksum(data, len);
+		barrier();
+	}
+	new_us = timer_get_us() - start;
+
+	printf("%d x %-22s 16-bit %6lu us, wide %6lu us (%x)\n", loops, what,
+	       ref_us, new_us, sum & 0xf);
+}
+
+int do_ut_csum(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	ulong start, copy_us, sum_us;
+	u8 *buf, *copy;
+	u32 seed = 1;
+	int ret, i;
+
+	buf = malloc(CSUM_UT_BUF_SIZE);
+	copy = malloc(CSUM_UT_BUF_SIZE);
+	if (!buf || !copy) {
+		printf("%s: out of memory\n", __func__);
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < CSUM_UT_BUF_SIZE; i++)
+		buf[i] = csum_ut_rand(&seed);
+
+	ret = csum_ut_check(buf, copy);
+	if (ret)
+		goto out;
+#ifdef CONFIG_UDP_CHECKSUM
+	ret = csum_ut_udp(copy);
+	if (ret)
+		goto out;
+#endif
+
+	/* A full-sized UDP packet after a 14-byte Ethernet header */
+	csum_ut_time("1472-byte packet:", buf + 42, 1472, CSUM_UT_PKT_LOOPS);
+	csum_ut_time("64KiB buffer:", buf, CSUM_UT_BUF_SIZE, CSUM_UT_BUF_LOOPS);
+
+	/* Copying packet data to a word-aligned load address */
+	start = timer_get_us();
+	for (i = 0; i < CSUM_UT_PKT_LOOPS; i++) {
+		memcpy(copy, buf + 46, 1468);
+		compute_ip_checksum(buf + 42, 1472);
+	}
+	sum_us = timer_get_us() - start;
+	start = timer_get_us();
+	for (i = 0; i < CSUM_UT_PKT_LOOPS; i++) {
+		ip_checksum_copy(copy, buf + 46, 1468,
+				 ip_checksum_partial(buf + 42, 4, 0));
+	}
+	copy_us = timer_get_us() - start;
+	printf("%d x copy of packet:      checksum then copy %6lu us, checksum and copy %6lu us\n",
+	       CSUM_UT_PKT_LOOPS, sum_us, copy_us);
+
+out:
+	free(copy);
+	free(buf);
+	printf("Test %s\n", ret ? "failed" : "passed");
+
+	return ret ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
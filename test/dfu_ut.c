@@ -0,0 +1,189 @@
+/*
+ * Tests of buffered DFU writes, using the RAM back end
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dfu.h>
+#include <errno.h>
+#include <test/suites.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <linux/sizes.h>
+
+/* Declare a new DFU test */
+#define DFU_TEST(_name)		UNIT_TEST(_name, 0, dfu_test)
+
+/*
+ * The buffer is split into two parts of 4KiB, and the medium is written in
+ * units of 512 bytes
+ */
+#define DFU_UT_BUF_SIZE		SZ_8K
+#define DFU_UT_ALIGN		512
+#define DFU_UT_SIZE		SZ_64K
+
+static u8 dfu_ut_src[DFU_UT_SIZE];
+static u8 dfu_ut_mem[DFU_UT_SIZE];
+
+static struct {
+	int (*write_ram)(struct dfu_entity *dfu, u64 offset, void *buf,
+			 long *len);
+	u64 next;	/* Offset which the next write should start at */
+	int writes;	/* Number of writes to the medium */
+	int bad;	/* Writes out of order, or not from a unit boundary */
+	int fail_at;	/* Write which fails with -EIO, or 0 */
+} dfu_ut;
+
+/* Record each write to the medium before passing it on to RAM */
+static int dfu_ut_write_medium(struct dfu_entity *dfu, u64 offset, void *buf,
+			       long *len)
+{
+	if (++dfu_ut.writes == dfu_ut.fail_at)
+		return -EIO;
+	if (offset != dfu_ut.next || offset % DFU_UT_ALIGN)
+		dfu_ut.bad++;
+	dfu_ut.next = offset + *len;
+
+	return dfu_ut.write_ram(dfu, offset, buf, len);
+}
+
+/* Set up a RAM entity over dfu_ut_mem which records its writes */
+static struct dfu_entity *dfu_ut_setup(void)
+{
+	struct dfu_entity *dfu;
+	char alt_info[64];
+	int i;
+
+	for (i = 0; i < DFU_UT_SIZE; i++)
+		dfu_ut_src[i] = i * 7 + (i >> 9);
+	memset(dfu_ut_mem, '\0', DFU_UT_SIZE);
+
+	snprintf(alt_info, sizeof(alt_info), "%#x", DFU_UT_BUF_SIZE);
+	setenv("dfu_bufsiz", alt_info);
+	snprintf(alt_info, sizeof(alt_info), "img ram %lx %x",
+		 (ulong)dfu_ut_mem, DFU_UT_SIZE);
+	if (dfu_config_entities(alt_info, "ram", "0"))
+		return NULL;
+	dfu = dfu_get_entity(0);
+	if (!dfu)
+		return NULL;
+
+	memset(&dfu_ut, '\0', sizeof(dfu_ut));
+	dfu_ut.write_ram = dfu->write_medium;
+	dfu->write_medium = dfu_ut_write_medium;
+	dfu->write_align = DFU_UT_ALIGN;
+
+	return dfu;
+}
+
+/* Start a new transfer, in which the given write to the medium fails */
+static void dfu_ut_fail_at(int write)
+{
+	dfu_ut.next = 0;
+	dfu_ut.writes = 0;
+	dfu_ut.fail_at = write;
+}
+
+/*
+ * Blocks which straddle parts, fill them exactly, or are larger than a part
+ * reach the medium in order, in whole units, whether or not the writes are
+ * made from dfu_write_poll()
+ */
+static int dfu_test_write_order(struct unit_test_state *uts)
+{
+	static const int sizes[] = { 1000, 3000, 4096, 700, 9000, 512, 5000 };
+	const int total = DFU_UT_SIZE - 1001;
+	struct dfu_entity *dfu;
+	int pos, size, i;
+
+	dfu = dfu_ut_setup();
+	ut_assertnonnull(dfu);
+
+	for (i = 0, pos = 0; pos < total; i++) {
+		size = min(sizes[i % ARRAY_SIZE(sizes)], total - pos);
+		ut_assertok(dfu_write(dfu, dfu_ut_src + pos, size, i));
+		if (i & 1)
+			dfu_write_poll();
+		pos += size;
+	}
+	ut_assertok(dfu_flush(dfu, NULL, 0, i));
+
+	ut_asserteq(0, dfu_ut.bad);
+	ut_asserteq(total, dfu_ut.next);
+	ut_assertok(memcmp(dfu_ut_src, dfu_ut_mem, total));
+	ut_asserteq(0, dfu_ut_mem[total]);
+
+	return 0;
+}
+DFU_TEST(dfu_test_write_order);
+
+/* A failed write is returned by whichever call comes next */
+static int dfu_test_write_error(struct unit_test_state *uts)
+{
+	struct dfu_entity *dfu;
+
+	dfu = dfu_ut_setup();
+	ut_assertnonnull(dfu);
+
+	/* Written from dfu_write_poll(), returned by dfu_write() */
+	dfu_ut_fail_at(1);
+	ut_assertok(dfu_write(dfu, dfu_ut_src, SZ_4K, 0));
+	dfu_write_poll();
+	ut_asserteq(-EIO, dfu_write(dfu, dfu_ut_src, SZ_4K, 1));
+
+	/* Written by dfu_write() once every part is full */
+	dfu_ut_fail_at(1);
+	ut_assertok(dfu_write(dfu, dfu_ut_src, SZ_4K, 0));
+	ut_asserteq(-EIO, dfu_write(dfu, dfu_ut_src, SZ_4K, 1));
+
+	/* Written straight from a large block */
+	dfu_ut_fail_at(1);
+	ut_asserteq(-EIO, dfu_write(dfu, dfu_ut_src, 9000, 0));
+
+	/* Written by dfu_flush() */
+	dfu_ut_fail_at(2);
+	ut_assertok(dfu_write(dfu, dfu_ut_src, SZ_4K, 0));
+	ut_assertok(dfu_write(dfu, dfu_ut_src, 100, 1));
+	dfu_write_poll();
+	ut_asserteq(-EIO, dfu_flush(dfu, NULL, 0, 2));
+
+	/* Each failure ends the transfer, so the next one starts afresh */
+	dfu_ut_fail_at(0);
+	ut_assertok(dfu_write(dfu, dfu_ut_src, 9000, 0));
+	ut_assertok(dfu_flush(dfu, NULL, 0, 1));
+	ut_asserteq(0, dfu_ut.bad);
+	ut_assertok(memcmp(dfu_ut_src, dfu_ut_mem, 9000));
+
+	return 0;
+}
+DFU_TEST(dfu_test_write_error);
+
+int do_ut_dfu(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	struct unit_test *tests = ll_entry_start(struct unit_test, dfu_test);
+	const int n_ents = ll_entry_count(struct unit_test, dfu_test);
+	struct unit_test_state uts = { .fail_count = 0 };
+	struct unit_test *test;
+
+	if (argc == 1)
+		printf("Running %d DFU tests\n", n_ents);
+
+	for (test = tests; test < tests + n_ents; test++) {
+		if (argc > 1 && strcmp(argv[1], test->name))
+			continue;
+		printf("Test: %s\n", test->name);
+
+		uts.start = mallinfo();
+
+		test->func(&uts);
+
+		dfu_free_entities();
+		setenv("dfu_bufsiz", NULL);
+	}
+
+	printf("Failures: %d\n", uts.fail_count);
+
+	return uts.fail_count ? CMD_RET_FAILURE : 0;
+}
@@ -6,8 +6,14 @@
 
 #include <common.h>
 #include <dm.h>
+#include <fastboot.h>
+#include <image-sparse.h>
+#include <os.h>
+#include <sandboxblockdev.h>
+#include <sparse_format.h>
 #include <usb.h>
 #include <asm/state.h>
+#include <asm/unaligned.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -168,3 +174,314 @@ static int dm_test_blk_get_from_parent(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_get_from_parent, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Test that erasing a host block device leaves zeroes */
+static int dm_test_blk_host_erase(struct unit_test_state *uts)
+{
+	const char *fname = "blk_erase.img";
+	struct blk_desc *desc;
+	u8 buf[4 * 512];
+	int fd, i;
+
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT);
+	ut_assert(fd >= 0);
+	memset(buf, 0xa5, sizeof(buf));
+	for (i = 0; i < 8; i++)
+		ut_asserteq(sizeof(buf), os_write(fd, buf, sizeof(buf)));
+	os_close(fd);
+
+	ut_assertok(host_dev_bind(0, (char *)fname));
+	ut_assertok(blk_get_device_by_str("host", "0", &desc));
+	ut_asserteq(1, desc->erase_grp);
+	ut_asserteq(0, desc->erase_val);
+
+	ut_asserteq(4, blk_derase(desc, 2, 4));
+	ut_asserteq(4, blk_dread(desc, 0, 4, buf));
+	for (i = 0; i < sizeof(buf); i++)
+		ut_asserteq(i < 2 * 512 ? 0xa5 : 0, buf[i]);
+	ut_asserteq(4, blk_dread(desc, 4, 4, buf));
+	for (i = 0; i < sizeof(buf); i++)
+		ut_asserteq(i < 2 * 512 ? 0 : 0xa5, buf[i]);
+
+	ut_assertok(host_dev_bind(0, NULL));
+	os_unlink(fname);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_host_erase, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_FASTBOOT_FLASH
+#define BLK_TEST_SPARSE_FILE	"blk_sparse.img"
+
+/* Host device behind the sparse storage, and how it has been erased */
+struct blk_test_sparse {
+	struct blk_desc *desc;
+	bool fail_erase;
+	int erases;
+	lbaint_t erased;
+};
+
+static lbaint_t blk_test_sparse_write(struct sparse_storage *info,
+				      lbaint_t blk, lbaint_t blkcnt,
+				      const void *buffer)
+{
+	struct blk_test_sparse *priv = info->priv;
+
+	return blk_dwrite(priv->desc, blk, blkcnt, buffer);
+}
+
+static lbaint_t blk_test_sparse_reserve(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt)
+{
+	return blkcnt;
+}
+
+static lbaint_t blk_test_sparse_erase(struct sparse_storage *info,
+				      lbaint_t blk, lbaint_t blkcnt)
+{
+	struct blk_test_sparse *priv = info->priv;
+	lbaint_t blks;
+
+	priv->erases++;
+	if (priv->fail_erase)
+		return 0;
+	blks = blk_derase(priv->desc, blk, blkcnt);
+	priv->erased += blks;
+
+	return blks;
+}
+
+/* Add a chunk of @blocks 512-byte blocks to a sparse image */
+static void *blk_test_sparse_chunk(void *ptr, int type, int blocks,
+				   int data_len)
+{
+	chunk_header_t *chunk = ptr;
+
+	chunk->chunk_type = cpu_to_le16(type);
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = cpu_to_le32(blocks);
+	chunk->total_sz = cpu_to_le32(sizeof(*chunk) + data_len);
+
+	return chunk + 1;
+}
+
+/*
+ * Build a sparse image of 3 raw blocks, 10 zero-filled blocks, 2 blocks
+ * filled with another value and 1 raw block, returning its size
+ */
+static int blk_test_sparse_image(void *image)
+{
+	sparse_header_t *hdr = image;
+	void *ptr;
+
+	hdr->magic = cpu_to_le32(SPARSE_HEADER_MAGIC);
+	hdr->major_version = cpu_to_le16(1);
+	hdr->minor_version = 0;
+	hdr->file_hdr_sz = cpu_to_le16(sizeof(*hdr));
+	hdr->chunk_hdr_sz = cpu_to_le16(sizeof(chunk_header_t));
+	hdr->blk_sz = cpu_to_le32(512);
+	hdr->total_blks = cpu_to_le32(16);
+	hdr->total_chunks = cpu_to_le32(4);
+	hdr->image_checksum = 0;
+	ptr = blk_test_sparse_chunk(hdr + 1, CHUNK_TYPE_RAW, 3, 3 * 512);
+	memset(ptr, 0x11, 3 * 512);
+	ptr = blk_test_sparse_chunk(ptr + 3 * 512, CHUNK_TYPE_FILL, 10, 4);
+	put_unaligned_le32(0, ptr);
+	ptr = blk_test_sparse_chunk(ptr + 4, CHUNK_TYPE_FILL, 2, 4);
+	put_unaligned_le32(0x12121212, ptr);
+	ptr = blk_test_sparse_chunk(ptr + 4, CHUNK_TYPE_RAW, 1, 512);
+	memset(ptr, 0x22, 512);
+
+	return ptr + 512 - image;
+}
+
+/* Fill the device with 0xa5, before an image is written over it */
+static int blk_test_sparse_clear(struct unit_test_state *uts,
+				 struct blk_test_sparse *priv)
+{
+	u8 buf[512 * 16];
+
+	memset(buf, 0xa5, sizeof(buf));
+	ut_asserteq(16, blk_dwrite(priv->desc, 0, 16, buf));
+
+	return 0;
+}
+
+/* Check that the image from blk_test_sparse_image() was written */
+static int blk_test_sparse_check(struct unit_test_state *uts,
+				 struct blk_test_sparse *priv)
+{
+	u8 buf[512 * 16];
+	int i;
+
+	ut_asserteq_str("OKAY", fb_response_str);
+	ut_asserteq(16, blk_dread(priv->desc, 0, 16, buf));
+	for (i = 0; i < sizeof(buf); i++) {
+		int blk = i / 512;
+
+		ut_asserteq(blk < 3 ? 0x11 : blk < 13 ? 0 :
+			    blk < 15 ? 0x12 : 0x22, buf[i]);
+	}
+
+	return 0;
+}
+
+/* Write the image from blk_test_sparse_image() in one piece and check it */
+static int blk_test_sparse_write_image(struct unit_test_state *uts,
+				       struct sparse_storage *info,
+				       struct blk_test_sparse *priv)
+{
+	u32 image[512 * 2];
+	int len;
+
+	ut_assertok(blk_test_sparse_clear(uts, priv));
+	len = blk_test_sparse_image(image);
+	write_sparse_image(info, "test", image, len);
+
+	return blk_test_sparse_check(uts, priv);
+}
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_blk_sparse_erase(struct unit_test_state *uts,
+				     struct sparse_storage *info)
+{
+	struct blk_test_sparse *priv = info->priv;
+
+	/* Blocks 3 and 12 are written, 4 to 11 erased in one go */
+	ut_assertok(blk_test_sparse_write_image(uts, info, priv));
+	ut_asserteq(1, priv->erases);
+	ut_asserteq(8, priv->erased);
+
+	/* If the erase fails, the zeroes are written instead */
+	priv->erases = 0;
+	priv->erased = 0;
+	priv->fail_erase = true;
+	ut_assertok(blk_test_sparse_write_image(uts, info, priv));
+	ut_asserteq(1, priv->erases);
+	ut_asserteq(0, priv->erased);
+
+	/* Nothing is erased when the fill value is not what erasing leaves */
+	priv->erases = 0;
+	priv->fail_erase = false;
+	info->erase_val = 0xff;
+	ut_assertok(blk_test_sparse_write_image(uts, info, priv));
+	ut_asserteq(0, priv->erases);
+
+	return 0;
+}
+
+/* Set up a host device of 16 blocks to write sparse images to */
+static int blk_test_sparse_setup(struct unit_test_state *uts,
+				 struct sparse_storage *info,
+				 struct blk_test_sparse *priv)
+{
+	u8 buf[512];
+	int fd, i;
+
+	fd = os_open(BLK_TEST_SPARSE_FILE, OS_O_RDWR | OS_O_CREAT);
+	ut_assert(fd >= 0);
+	memset(buf, '\0', sizeof(buf));
+	for (i = 0; i < 16; i++)
+		ut_asserteq(sizeof(buf), os_write(fd, buf, sizeof(buf)));
+	os_close(fd);
+
+	ut_assertok(host_dev_bind(0, (char *)BLK_TEST_SPARSE_FILE));
+	memset(priv, '\0', sizeof(*priv));
+	ut_assertok(blk_get_device_by_str("host", "0", &priv->desc));
+	info->blksz = 512;
+	info->start = 0;
+	info->size = 16;
+	info->write = blk_test_sparse_write;
+	info->reserve = blk_test_sparse_reserve;
+	info->erase = blk_test_sparse_erase;
+	info->erase_grp = 4;
+	info->erase_val = 0;
+	info->priv = priv;
+
+	return 0;
+}
+
+static void blk_test_sparse_cleanup(void)
+{
+	host_dev_bind(0, NULL);
+	os_unlink(BLK_TEST_SPARSE_FILE);
+}
+
+/* Test that zero-filled blocks of a sparse image are erased, not written */
+static int dm_test_blk_sparse_erase(struct unit_test_state *uts)
+{
+	char response[FASTBOOT_RESPONSE_LEN];
+	char *old_response = fb_response_str;
+	struct blk_test_sparse priv;
+	struct sparse_storage info;
+	int ret;
+
+	fb_response_str = response;
+	ret = blk_test_sparse_setup(uts, &info, &priv);
+	if (!ret)
+		ret = _dm_test_blk_sparse_erase(uts, &info);
+
+	fb_response_str = old_response;
+	blk_test_sparse_cleanup();
+
+	return ret;
+}
+DM_TEST(dm_test_blk_sparse_erase, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_blk_sparse_stream(struct unit_test_state *uts,
+				      struct sparse_storage *info)
+{
+	/* Sizes which split headers, fill values and blocks differently */
+	static const unsigned int piece_sizes[] = {
+		1, 5, 12, 28, 100, 511, 512, 513, 1500, 4096,
+	};
+	struct blk_test_sparse *priv = info->priv;
+	struct sparse_stream ss;
+	u32 image[512 * 2];
+	u8 buf[1024];
+	int len, pos, piece, i;
+
+	len = blk_test_sparse_image(image);
+	for (i = 0; i < ARRAY_SIZE(piece_sizes); i++) {
+		ut_assertok(blk_test_sparse_clear(uts, priv));
+		sparse_stream_start(&ss, info, "test", buf, sizeof(buf));
+		for (pos = 0; pos < len; pos += piece) {
+			piece = min_t(int, piece_sizes[i], len - pos);
+			ut_assertok(sparse_stream_write(&ss, (u8 *)image + pos,
+							piece));
+		}
+		sparse_stream_finish(&ss);
+		ut_assertok(blk_test_sparse_check(uts, priv));
+	}
+
+	/* An image which stops part of the way through is reported */
+	sparse_stream_start(&ss, info, "test", buf, sizeof(buf));
+	ut_assertok(sparse_stream_write(&ss, image, len - 100));
+	sparse_stream_finish(&ss);
+	ut_asserteq_str("FAILsparse image is truncated", fb_response_str);
+
+	return 0;
+}
+
+/* Test writing a sparse image which arrives in pieces of various sizes */
+static int dm_test_blk_sparse_stream(struct unit_test_state *uts)
+{
+	char response[FASTBOOT_RESPONSE_LEN];
+	char *old_response = fb_response_str;
+	struct blk_test_sparse priv;
+	struct sparse_storage info;
+	int ret;
+
+	fb_response_str = response;
+	ret = blk_test_sparse_setup(uts, &info, &priv);
+	if (!ret)
+		ret = _dm_test_blk_sparse_stream(uts, &info);
+
+	fb_response_str = old_response;
+	blk_test_sparse_cleanup();
+
+	return ret;
+}
+DM_TEST(dm_test_blk_sparse_stream, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+#endif
@@ -8,10 +8,14 @@
  */
 
 #include <common.h>
+#include <command.h>
 #include <dm.h>
+#include <fastboot.h>
 #include <fdtdec.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
+#include <net/tftp.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
@@ -22,6 +26,11 @@ DECLARE_GLOBAL_DATA_PTR;
 
 #define DM_TEST_ETH_NUM		4
 
+/* File served by the mock TFTP server, and the round-trip time it has */
+#define DM_TEST_TFTP_SIZE	(1 << 20)
+#define DM_TEST_TFTP_RTT_MS	2
+#define DM_TEST_TFTP_ADDR	0x1000000
+
 static int dm_test_eth(struct unit_test_state *uts)
 {
 	net_ping_ip = string_to_ip("1.1.2.2");
@@ -42,6 +51,84 @@ static int dm_test_eth(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_eth, DM_TESTF_SCAN_FDT);
 
+#ifdef CONFIG_NET_PERSISTENT_LINK
+/* Check that the device is only started again when it must be */
+static int dm_test_eth_persistent(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	int starts;
+
+	net_ping_ip = string_to_ip("1.1.2.2");
+	setenv("ethact", "eth@10002000");
+	eth_halt();
+
+	starts = sandbox_eth_starts();
+	ut_assertok(net_loop(PING));
+	ut_assertok(net_loop(PING));
+	ut_asserteq(starts + 1, sandbox_eth_starts());
+
+	/* 'eth stop' halts it */
+	ut_assertok(run_command("eth stop", 0));
+	ut_assertok(net_loop(PING));
+	ut_asserteq(starts + 2, sandbox_eth_starts());
+
+	/* So does every boot command before it jumps */
+	eth_halt_before_boot();
+	ut_assertok(net_loop(PING));
+	ut_asserteq(starts + 3, sandbox_eth_starts());
+
+	/* Switching devices starts the new one */
+	setenv("ethact", "eth@10003000");
+	ut_assertok(net_loop(PING));
+	ut_asserteq(starts + 4, sandbox_eth_starts());
+
+	/* A driver can opt out */
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10003000",
+					      &dev));
+	eth_disable_persistent_link(dev);
+	ut_assertok(net_loop(PING));
+	ut_assertok(net_loop(PING));
+	ut_asserteq(starts + 6, sandbox_eth_starts());
+
+	return 0;
+}
+DM_TEST(dm_test_eth_persistent, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_NET_ARP_CACHE
+/* Check that a second ping does not need ARP */
+static int dm_test_eth_arp_cache(struct unit_test_state *uts)
+{
+	const uchar fake_host_hwaddr[] = {0x00, 0x00, 0x66, 0x44, 0x22, 0x00};
+	uchar ethaddr[ARP_HLEN];
+	int arp_requests;
+
+	net_ping_ip = string_to_ip("1.1.2.2");
+	setenv("ethact", "eth@10002000");
+	arp_cache_flush();
+
+	arp_requests = sandbox_eth_arp_requests();
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arp_requests + 1, sandbox_eth_arp_requests());
+	ut_assertok(arp_cache_lookup(net_ping_ip, ethaddr));
+	ut_assertok(memcmp(fake_host_hwaddr, ethaddr, ARP_HLEN));
+
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arp_requests + 1, sandbox_eth_arp_requests());
+
+	/* Another interface starts with an empty cache */
+	setenv("ethact", "eth@10003000");
+	ut_assertok(net_loop(PING));
+	ut_asserteq(arp_requests + 2, sandbox_eth_arp_requests());
+
+	arp_cache_flush();
+	ut_asserteq(-ENOENT, arp_cache_lookup(net_ping_ip, ethaddr));
+
+	return 0;
+}
+DM_TEST(dm_test_eth_arp_cache, DM_TESTF_SCAN_FDT);
+#endif
+
 static int dm_test_eth_alias(struct unit_test_state *uts)
 {
 	net_ping_ip = string_to_ip("1.1.2.2");
@@ -259,3 +346,287 @@ static int dm_test_net_retry(struct unit_test_state *uts)
 	return retval;
 }
 DM_TEST(dm_test_net_retry, DM_TESTF_SCAN_FDT);
+
+/* Fill a file for the mock servers with a pattern which does not repeat */
+static void dm_test_eth_fill(uchar *data, int size)
+{
+	int i;
+
+	for (i = 0; i < size; i++)
+		data[i] = i * 7 + (i >> 11);
+}
+
+/*
+ * Run @test with a file of @size bytes for the mock servers, with
+ * eth@10002000 set up to load it from the mock host to DM_TEST_TFTP_ADDR.
+ * Afterwards the mock servers are disabled and the env is restored.
+ */
+static int dm_test_eth_xfer(struct unit_test_state *uts, int size,
+			    int (*test)(struct unit_test_state *uts,
+					const uchar *data))
+{
+	uchar *data;
+	int retval;
+
+	data = malloc(size);
+	ut_assertnonnull(data);
+	dm_test_eth_fill(data, size);
+
+	setenv("ethact", "eth@10002000");
+	net_server_ip = string_to_ip("1.1.2.2");
+	copy_filename(net_boot_file_name, "test.bin",
+		      sizeof(net_boot_file_name));
+	load_addr = DM_TEST_TFTP_ADDR;
+
+	retval = test(uts, data);
+
+	/* Restore the env */
+	sandbox_eth_tftp_set_file(NULL, 0, 0);
+	sandbox_eth_http_set_file(NULL, 0, false);
+	sandbox_eth_fastboot_start(NULL, NULL, 0, -1);
+	sandbox_eth_set_rx_batch(0);
+	setenv("tftpwindowsize", NULL);
+	setenv("bootm_size", NULL);
+	free(data);
+
+	return retval;
+}
+
+/* Download the mock TFTP file and check it */
+static int dm_test_eth_tftp_get(struct unit_test_state *uts, const uchar *data,
+				const char *windowsize)
+{
+	void *buf = map_sysmem(DM_TEST_TFTP_ADDR, DM_TEST_TFTP_SIZE);
+
+	memset(buf, '\0', DM_TEST_TFTP_SIZE);
+	setenv("tftpwindowsize", windowsize);
+	ut_asserteq(DM_TEST_TFTP_SIZE, net_loop(TFTPGET));
+	ut_assertok(memcmp(data, buf, DM_TEST_TFTP_SIZE));
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+/* ACKs for a transfer: one for the OACK, then one at the end of each window */
+#define DM_TEST_TFTP_ACKS(window) \
+	(1 + DIV_ROUND_UP(DIV_ROUND_UP(DM_TEST_TFTP_SIZE, 1468), window))
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_tftp_window(struct unit_test_state *uts,
+				    const uchar *data)
+{
+	/* One ACK per block */
+	sandbox_eth_tftp_set_file(data, DM_TEST_TFTP_SIZE, DM_TEST_TFTP_RTT_MS);
+	ut_assertok(dm_test_eth_tftp_get(uts, data, "1"));
+	ut_asserteq(1, sandbox_eth_tftp_window());
+	ut_asserteq(DM_TEST_TFTP_ACKS(1), sandbox_eth_tftp_acks());
+
+	/* One ACK per window of 16 blocks */
+	sandbox_eth_tftp_set_file(data, DM_TEST_TFTP_SIZE, DM_TEST_TFTP_RTT_MS);
+	ut_assertok(dm_test_eth_tftp_get(uts, data, "16"));
+	ut_asserteq(16, sandbox_eth_tftp_window());
+	ut_asserteq(DM_TEST_TFTP_ACKS(16), sandbox_eth_tftp_acks());
+
+	/* A server may offer a smaller window, which is then used */
+	sandbox_eth_tftp_set_file(data, DM_TEST_TFTP_SIZE, DM_TEST_TFTP_RTT_MS);
+	sandbox_eth_tftp_set_max_window(8);
+	ut_assertok(dm_test_eth_tftp_get(uts, data, "16"));
+	ut_asserteq(8, sandbox_eth_tftp_window());
+	ut_asserteq(DM_TEST_TFTP_ACKS(8), sandbox_eth_tftp_acks());
+
+	/*
+	 * A lost block must be ACKed once, not for each later block in the
+	 * window, and the server then resends the window from that block
+	 */
+	sandbox_eth_tftp_set_file(data, DM_TEST_TFTP_SIZE, DM_TEST_TFTP_RTT_MS);
+	sandbox_eth_tftp_drop_block(20);
+	ut_assertok(dm_test_eth_tftp_get(uts, data, "16"));
+	ut_asserteq(DM_TEST_TFTP_ACKS(16) + 1, sandbox_eth_tftp_acks());
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_window(struct unit_test_state *uts)
+{
+	return dm_test_eth_xfer(uts, DM_TEST_TFTP_SIZE,
+				_dm_test_eth_tftp_window);
+}
+DM_TEST(dm_test_eth_tftp_window, DM_TESTF_SCAN_FDT);
+
+#ifdef CONFIG_CMD_PXE
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_tftp_probe(struct unit_test_state *uts,
+				   const uchar *data)
+{
+	static const char *const names[] = {
+		"uuid", "01-mac", "0A000001", "0A00000", "default",
+	};
+	void *buf = map_sysmem(DM_TEST_TFTP_ADDR, DM_TEST_TFTP_SIZE);
+
+	sandbox_eth_tftp_set_file(data, DM_TEST_TFTP_SIZE, 0);
+
+	/*
+	 * The requests for all the files go out together, and the first one
+	 * the server has is loaded without asking for it again
+	 */
+	memset(buf, '\0', DM_TEST_TFTP_SIZE);
+	sandbox_eth_tftp_set_name("0A00000");
+	ut_asserteq(3, tftp_probe(names, ARRAY_SIZE(names),
+				  DM_TEST_TFTP_ADDR));
+	ut_asserteq(ARRAY_SIZE(names), sandbox_eth_tftp_requests());
+	ut_assertok(memcmp(data, buf, DM_TEST_TFTP_SIZE));
+
+	/* None of them */
+	sandbox_eth_tftp_set_file(data, DM_TEST_TFTP_SIZE, 0);
+	sandbox_eth_tftp_set_name("other");
+	ut_asserteq(-ENOENT, tftp_probe(names, ARRAY_SIZE(names),
+					DM_TEST_TFTP_ADDR));
+	ut_asserteq(ARRAY_SIZE(names), sandbox_eth_tftp_requests());
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_tftp_probe(struct unit_test_state *uts)
+{
+	return dm_test_eth_xfer(uts, DM_TEST_TFTP_SIZE,
+				_dm_test_eth_tftp_probe);
+}
+DM_TEST(dm_test_eth_tftp_probe, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_CMD_WGET
+/* File served by the mock HTTP server */
+#define DM_TEST_HTTP_SIZE	100000
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_wget(struct unit_test_state *uts, const uchar *data)
+{
+	uchar *buf = map_sysmem(DM_TEST_TFTP_ADDR, DM_TEST_HTTP_SIZE);
+	int i;
+
+	/* With a Content-Length */
+	sandbox_eth_http_set_file(data, DM_TEST_HTTP_SIZE, true);
+	memset(buf, '\0', DM_TEST_HTTP_SIZE);
+	ut_asserteq(DM_TEST_HTTP_SIZE, net_loop(WGET));
+	ut_asserteq(1, sandbox_eth_http_requests());
+	ut_assertok(memcmp(data, buf, DM_TEST_HTTP_SIZE));
+
+	/* Without one, the file ends when the server closes the connection */
+	memset(buf, '\0', DM_TEST_HTTP_SIZE);
+	sandbox_eth_http_set_file(data, DM_TEST_HTTP_SIZE, false);
+	ut_asserteq(DM_TEST_HTTP_SIZE, net_loop(WGET));
+	ut_assertok(memcmp(data, buf, DM_TEST_HTTP_SIZE));
+
+	/* With room for only half the file, it is refused before any is read */
+	setenv_hex("bootm_size", DM_TEST_TFTP_ADDR + DM_TEST_HTTP_SIZE / 2);
+	memset(buf, '\0', DM_TEST_HTTP_SIZE);
+	sandbox_eth_http_set_file(data, DM_TEST_HTTP_SIZE, true);
+	ut_assert(net_loop(WGET) < 0);
+	ut_asserteq(1, sandbox_eth_http_requests());
+	for (i = 0; i < DM_TEST_HTTP_SIZE; i++)
+		ut_asserteq(0, buf[i]);
+
+	/* Without a length, it is stopped before anything past the end */
+	sandbox_eth_http_set_file(data, DM_TEST_HTTP_SIZE, false);
+	ut_assert(net_loop(WGET) < 0);
+	ut_asserteq(1, sandbox_eth_http_requests());
+	ut_assertok(memcmp(data, buf, 1000));
+	for (i = DM_TEST_HTTP_SIZE / 2; i < DM_TEST_HTTP_SIZE; i++)
+		ut_asserteq(0, buf[i]);
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_wget(struct unit_test_state *uts)
+{
+	return dm_test_eth_xfer(uts, DM_TEST_HTTP_SIZE,
+				_dm_test_eth_wget);
+}
+DM_TEST(dm_test_eth_wget, DM_TESTF_SCAN_FDT);
+
+/* Packets the driver hands over at once, fewer than PKTBUFSRX */
+#define DM_TEST_RX_BATCH	4
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_rx_batch(struct unit_test_state *uts,
+				 const uchar *data)
+{
+	uchar *buf = map_sysmem(DM_TEST_TFTP_ADDR, DM_TEST_HTTP_SIZE);
+
+	/* One at a time, each packet is given back before the next */
+	ut_assert(DM_TEST_RX_BATCH < PKTBUFSRX);
+	sandbox_eth_http_set_file(data, DM_TEST_HTTP_SIZE, true);
+	memset(buf, '\0', DM_TEST_HTTP_SIZE);
+	ut_asserteq(DM_TEST_HTTP_SIZE, net_loop(WGET));
+	ut_assertok(memcmp(data, buf, DM_TEST_HTTP_SIZE));
+	ut_asserteq(1, sandbox_eth_rx_held_max());
+	ut_asserteq(0, sandbox_eth_rx_held());
+
+	/*
+	 * In batches, the stack holds a whole batch in separate buffers and
+	 * gives them all back
+	 */
+	sandbox_eth_set_rx_batch(DM_TEST_RX_BATCH);
+	sandbox_eth_http_set_file(data, DM_TEST_HTTP_SIZE, true);
+	memset(buf, '\0', DM_TEST_HTTP_SIZE);
+	ut_asserteq(DM_TEST_HTTP_SIZE, net_loop(WGET));
+	ut_assertok(memcmp(data, buf, DM_TEST_HTTP_SIZE));
+	ut_asserteq(DM_TEST_RX_BATCH, sandbox_eth_rx_held_max());
+	ut_asserteq(0, sandbox_eth_rx_held());
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_rx_batch(struct unit_test_state *uts)
+{
+	return dm_test_eth_xfer(uts, DM_TEST_HTTP_SIZE,
+				_dm_test_eth_rx_batch);
+}
+DM_TEST(dm_test_eth_rx_batch, DM_TESTF_SCAN_FDT);
+#endif
+
+#ifdef CONFIG_UDP_FUNCTION_FASTBOOT
+/* Size of the download, and the data packet which is corrupted once */
+#define DM_TEST_FB_SIZE		10000
+#define DM_TEST_FB_CORRUPT	2
+
+/* The asserts include a return on fail; cleanup in the caller */
+static int _dm_test_eth_fastboot(struct unit_test_state *uts,
+				 const uchar *data)
+{
+	uchar *buf = map_sysmem(CONFIG_FASTBOOT_BUF_ADDR, DM_TEST_FB_SIZE);
+	char download[FASTBOOT_COMMAND_LEN];
+	const char *cmds[] = { "getvar:version", download, "continue", NULL };
+	char expect[FASTBOOT_RESPONSE_LEN];
+
+	sprintf(download, "download:%08x", DM_TEST_FB_SIZE);
+	sandbox_eth_fastboot_start(cmds, data, DM_TEST_FB_SIZE,
+				   DM_TEST_FB_CORRUPT);
+	memset(buf, '\0', DM_TEST_FB_SIZE);
+	ut_assert(net_loop(FASTBOOT) >= 0);
+
+	ut_asserteq_str("OKAY0.4", sandbox_eth_fastboot_response(0));
+	sprintf(expect, "DATA%08x", DM_TEST_FB_SIZE);
+	ut_asserteq_str(expect, sandbox_eth_fastboot_response(1));
+	ut_asserteq_str("OKAY", sandbox_eth_fastboot_response(2));
+	ut_asserteq_str("OKAY", sandbox_eth_fastboot_response(3));
+	ut_asserteq_str("", sandbox_eth_fastboot_response(4));
+
+	/* Only the corrupted packet was dropped, and it was sent again */
+	ut_asserteq(1, sandbox_eth_fastboot_resends());
+	ut_assertok(memcmp(data, buf, DM_TEST_FB_SIZE));
+	unmap_sysmem(buf);
+
+	return 0;
+}
+
+static int dm_test_eth_fastboot(struct unit_test_state *uts)
+{
+	return dm_test_eth_xfer(uts, DM_TEST_FB_SIZE,
+				_dm_test_eth_fastboot);
+}
+DM_TEST(dm_test_eth_fastboot, DM_TESTF_SCAN_FDT);
+#endif
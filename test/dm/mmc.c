@@ -6,7 +6,9 @@
 
 #include <common.h>
 #include <dm.h>
+#include <malloc.h>
 #include <mmc.h>
+#include <asm/test.h>
 #include <dm/test.h>
 #include <test/ut.h>
 
@@ -44,3 +46,221 @@ static int dm_test_mmc_blk(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_mmc_blk, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Multiple-block transfers set their length first, rather than being stopped */
+static int dm_test_mmc_cmd23(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct blk_desc *dev_desc;
+	char write[1024], read[1024];
+	int sbc, stop, i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	dev = dev_get_parent(dev_desc->bdev);
+	sbc = sandbox_mmc_get_cmd_count(dev, MMC_CMD_SET_BLOCK_COUNT);
+	stop = sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION);
+
+	for (i = 0; i < sizeof(write); i++)
+		write[i] = i;
+	ut_asserteq(2, blk_dwrite(dev_desc, 10, 2, write));
+	memset(read, '\0', sizeof(read));
+	ut_asserteq(2, blk_dread(dev_desc, 10, 2, read));
+	ut_assertok(memcmp(write, read, sizeof(write)));
+
+	ut_asserteq(sbc + 2,
+		    sandbox_mmc_get_cmd_count(dev, MMC_CMD_SET_BLOCK_COUNT));
+	ut_asserteq(stop,
+		    sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_cmd23, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Size of the sandbox card, and of each transfer in the benchmark */
+#define DM_TEST_MMC_SIZE	(1 << 20)
+#define DM_TEST_MMC_CHUNK	(64 << 10)
+
+/*
+ * Write and read back the whole card in chunks, returning the time taken in
+ * microseconds, or 0 on failure
+ */
+static ulong dm_test_mmc_xfer(struct blk_desc *dev_desc, char *write,
+			      char *read)
+{
+	lbaint_t blks = DM_TEST_MMC_CHUNK / dev_desc->blksz;
+	lbaint_t start;
+	ulong base;
+
+	base = timer_get_us();
+	for (start = 0; start < DM_TEST_MMC_SIZE / dev_desc->blksz;
+	     start += blks) {
+		if (blk_dwrite(dev_desc, start, blks,
+			       write + start * dev_desc->blksz) != blks)
+			return 0;
+	}
+	for (start = 0; start < DM_TEST_MMC_SIZE / dev_desc->blksz;
+	     start += blks) {
+		if (blk_dread(dev_desc, start, blks,
+			      read + start * dev_desc->blksz) != blks)
+			return 0;
+	}
+
+	return timer_get_us() - base + 1;
+}
+
+/* Compare block throughput with and without SET_BLOCK_COUNT */
+static int dm_test_mmc_throughput(struct unit_test_state *uts)
+{
+	int chunks = DM_TEST_MMC_SIZE / DM_TEST_MMC_CHUNK;
+	struct blk_desc *dev_desc;
+	char *write, *read;
+	struct udevice *dev;
+	struct mmc *mmc;
+	ulong us_sbc, us_stop;
+	int stop, i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &dev_desc));
+	dev = dev_get_parent(dev_desc->bdev);
+	mmc = mmc_get_mmc_dev(dev);
+	ut_assert(mmc->card_caps & MMC_CAP_CMD23);
+	write = malloc(DM_TEST_MMC_SIZE);
+	ut_assertnonnull(write);
+	read = malloc(DM_TEST_MMC_SIZE);
+	ut_assertnonnull(read);
+	for (i = 0; i < DM_TEST_MMC_SIZE; i++)
+		write[i] = i * 7 + (i >> 9);
+
+	stop = sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION);
+	memset(read, '\0', DM_TEST_MMC_SIZE);
+	us_sbc = dm_test_mmc_xfer(dev_desc, write, read);
+	ut_assert(us_sbc);
+	ut_assertok(memcmp(write, read, DM_TEST_MMC_SIZE));
+	ut_asserteq(stop,
+		    sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION));
+
+	/* Without it, each transfer needs a STOP_TRANSMISSION */
+	mmc->card_caps &= ~MMC_CAP_CMD23;
+	memset(read, '\0', DM_TEST_MMC_SIZE);
+	us_stop = dm_test_mmc_xfer(dev_desc, write, read);
+	mmc->card_caps |= MMC_CAP_CMD23;
+	ut_assert(us_stop);
+	ut_assertok(memcmp(write, read, DM_TEST_MMC_SIZE));
+	ut_asserteq(stop + chunks * 2,
+		    sandbox_mmc_get_cmd_count(dev, MMC_CMD_STOP_TRANSMISSION));
+
+	printf("%d KiB in %d KiB transfers: SET_BLOCK_COUNT %lu KiB/s, STOP_TRANSMISSION %lu KiB/s\n",
+	       DM_TEST_MMC_SIZE >> 10, DM_TEST_MMC_CHUNK >> 10,
+	       (ulong)(2ULL * (DM_TEST_MMC_SIZE >> 10) * 1000000 / us_sbc),
+	       (ulong)(2ULL * (DM_TEST_MMC_SIZE >> 10) * 1000000 / us_stop));
+
+	free(read);
+	free(write);
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_throughput, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* The fastest bus mode both sides support is used, unless tuning fails */
+static int dm_test_mmc_bus_mode(struct unit_test_state *uts)
+{
+	struct blk_desc *dev_desc;
+	struct udevice *dev;
+	struct mmc *mmc;
+	char cmp[1024];
+
+	/* The SD card switches to 1.8V and SDR104 */
+	ut_assertok(uclass_get_device_by_name(UCLASS_MMC, "mmc0", &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_asserteq(MMC_TIMING_UHS_SDR104, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(4, mmc->bus_width);
+	ut_asserteq(208000000, mmc->clock);
+
+	/* Without tuning it runs at SDR25 */
+	sandbox_mmc_set_fail_tuning(dev, true);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_HS, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(50000000, mmc->clock);
+	dev_desc = mmc_get_blk_desc(mmc);
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	/* The eMMC goes through HS200 to HS400 */
+	ut_assertok(uclass_get_device_by_name(UCLASS_MMC, "mmc3", &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_asserteq(MMC_TIMING_MMC_HS400, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_180, mmc->signal_voltage);
+	ut_asserteq(8, mmc->bus_width);
+	ut_asserteq(1, mmc->ddr_mode);
+	ut_asserteq(200000000, mmc->clock);
+	dev_desc = mmc_get_blk_desc(mmc);
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	/* Without tuning it falls back to DDR52 at 3.3V */
+	sandbox_mmc_set_fail_tuning(dev, true);
+	mmc->has_init = 0;
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(MMC_TIMING_MMC_DDR52, mmc->timing);
+	ut_asserteq(MMC_SIGNAL_VOLTAGE_330, mmc->signal_voltage);
+	ut_asserteq(8, mmc->bus_width);
+	ut_asserteq(52000000, mmc->clock);
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_bus_mode, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/* Initialisation can be started, then moved on while the card powers up */
+static int dm_test_mmc_init_poll(struct unit_test_state *uts)
+{
+	struct udevice *dev;
+	struct mmc *mmc;
+	char cmp[1024];
+	int op_cond, ret, i;
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_MMC, "mmc0", &dev));
+	mmc = mmc_get_mmc_dev(dev);
+	ut_assertok(mmc_init_poll(mmc));
+
+	mmc->has_init = 0;
+	ut_asserteq(-ENODEV, mmc_init_poll(mmc));
+	op_cond = sandbox_mmc_get_cmd_count(dev, SD_CMD_APP_SEND_OP_COND);
+	ut_assertok(mmc_start_init(mmc));
+	ut_asserteq(0, mmc->has_init);
+	ut_asserteq(op_cond + 1,
+		    sandbox_mmc_get_cmd_count(dev, SD_CMD_APP_SEND_OP_COND));
+
+	/* Each poll sends one command, and no more than one a millisecond */
+	for (i = 0; i < 100; i++) {
+		ret = mmc_init_poll(mmc);
+		if (ret != -EAGAIN)
+			break;
+		mdelay(1);
+	}
+	ut_assertok(ret);
+	ut_asserteq(op_cond + 1 + SANDBOX_MMC_POWERUP_POLLS,
+		    sandbox_mmc_get_cmd_count(dev, SD_CMD_APP_SEND_OP_COND));
+
+	/* The startup is left to mmc_init(), which need not poll again */
+	ut_asserteq(0, mmc->has_init);
+	ut_assertok(mmc_init_poll(mmc));
+	ut_assertok(mmc_init(mmc));
+	ut_asserteq(1, mmc->has_init);
+	ut_asserteq(op_cond + 1 + SANDBOX_MMC_POWERUP_POLLS,
+		    sandbox_mmc_get_cmd_count(dev, SD_CMD_APP_SEND_OP_COND));
+	ut_asserteq(MMC_TIMING_UHS_SDR104, mmc->timing);
+
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(mmc_get_blk_desc(mmc), 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	return 0;
+}
+DM_TEST(dm_test_mmc_init_poll, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
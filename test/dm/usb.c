@@ -7,11 +7,13 @@
 #include <common.h>
 #include <console.h>
 #include <dm.h>
+#include <malloc.h>
 #include <usb.h>
 #include <asm/io.h>
 #include <asm/state.h>
 #include <asm/test.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/test.h>
 #include <dm/uclass-internal.h>
 #include <test/ut.h>
@@ -58,6 +60,89 @@ static int dm_test_usb_flash(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_flash, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
 
+/*
+ * Bind the controller with the flash sticks which only some tests use, and
+ * scan the bus. Then find the block device of the stick called @name.
+ */
+static int usb_init_with_stick(struct unit_test_state *uts, const char *name,
+			       struct blk_desc **descp)
+{
+	struct udevice *bus, *dev, *emul, *blk;
+
+	ut_assertok(lists_bind_fdt(gd->dm_root, ofnode_path("/usb@3"), &bus));
+	state_set_skip_delays(true);
+	ut_assertok(usb_init());
+
+	for (uclass_first_device(UCLASS_MASS_STORAGE, &dev);
+	     dev;
+	     uclass_next_device(&dev)) {
+		if (usb_emul_find_for_dev(dev, &emul) ||
+		    strcmp(emul->name, name))
+			continue;
+		ut_assertok(device_find_first_child(dev, &blk));
+		ut_assertnonnull(blk);
+		*descp = dev_get_uclass_platdata(blk);
+		return 0;
+	}
+	ut_assert(false);
+
+	return 0;
+}
+
+/*
+ * Test reading from a flash stick which offers USB Attached SCSI. The read
+ * needs several commands, which are queued together.
+ */
+static int dm_test_usb_flash_uas(struct unit_test_state *uts)
+{
+	struct blk_desc *dev_desc;
+	char *cmp;
+
+	ut_assertok(usb_init_with_stick(uts, "uas-stick@0", &dev_desc));
+	ut_asserteq(512, dev_desc->blksz);
+	cmp = calloc(100, dev_desc->blksz);
+	ut_assertnonnull(cmp);
+	ut_asserteq(100, blk_dread(dev_desc, 0, 100, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+	free(cmp);
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_flash_uas, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
+/*
+ * Test a Bulk-Only flash stick with more than 2^32 blocks, which needs
+ * READ CAPACITY(16) and READ(16)
+ */
+static int dm_test_usb_flash_read16(struct unit_test_state *uts)
+{
+	struct blk_desc *dev_desc;
+	char cmp[1024];
+
+	ut_assertok(usb_init_with_stick(uts, "large-stick@1", &dev_desc));
+	ut_asserteq(512, dev_desc->blksz);
+	ut_assert(dev_desc->lba == 0x100000010ULL);
+
+	/* READ(10) still reads the start */
+	memset(cmp, '\0', sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0, 2, cmp));
+	ut_assertok(strcmp(cmp, "this is a test"));
+
+	/* The last blocks, past the end of the file, read as zeroes */
+	memset(cmp, 0xff, sizeof(cmp));
+	ut_asserteq(2, blk_dread(dev_desc, 0x10000000eULL, 2, cmp));
+	ut_asserteq(0, cmp[0]);
+	ut_asserteq(0, cmp[sizeof(cmp) - 1]);
+
+	/* A read which crosses the 2^32-block boundary */
+	ut_asserteq(2, blk_dread(dev_desc, 0xffffffffULL, 2, cmp));
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_flash_read16, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
 /* test that we can handle multiple storage devices */
 static int dm_test_usb_multi(struct unit_test_state *uts)
 {
@@ -138,6 +223,33 @@ static int dm_test_usb_remove(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_remove, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
 
+/*
+ * Test scanning with real delays, with the controller with the flash sticks
+ * which only some tests use. The ports of both controllers wait for power
+ * together, but each controller resets only one port at a time.
+ */
+static int dm_test_usb_scan_delays(struct unit_test_state *uts)
+{
+	struct udevice *bus, *bus3;
+	int overlaps;
+
+	ut_assertok(lists_bind_fdt(gd->dm_root, ofnode_path("/usb@3"), &bus3));
+	state_set_skip_delays(false);
+	ut_assertok(usb_init());
+	ut_asserteq(10, count_usb_devices());
+
+	/* Each device is reset once, without another reset going on */
+	ut_assertok(uclass_get_device_by_name(UCLASS_USB, "usb@1", &bus));
+	ut_asserteq(4, sandbox_usb_hub_get_resets(bus, &overlaps));
+	ut_asserteq(0, overlaps);
+	ut_asserteq(2, sandbox_usb_hub_get_resets(bus3, &overlaps));
+	ut_asserteq(0, overlaps);
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_scan_delays, DM_TESTF_SCAN_PDATA | DM_TESTF_SCAN_FDT);
+
 const char usb_tree_base[] =
 "  1  Hub (12 Mb/s, 100mA)\n"
 "  |  sandbox hub 2345\n"
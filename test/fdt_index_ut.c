@@ -0,0 +1,322 @@
+/*
+ * Tests of the libfdt lookup index, checking each lookup against a scan of
+ * the same blob without an index
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <errno.h>
+#include <libfdt.h>
+#include <test/suites.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <linux/sizes.h>
+
+/* Declare a new index test */
+#define FDT_INDEX_TEST(_name)	UNIT_TEST(_name, 0, fdt_index_test)
+
+#define FDT_INDEX_UT_SIZE	SZ_4K
+#define FDT_INDEX_UT_PHANDLES	10
+
+static char fdt_index_ut_blob[FDT_INDEX_UT_SIZE];
+static char fdt_index_ut_copy[FDT_INDEX_UT_SIZE];
+static char fdt_index_ut_buf[FDT_INDEX_UT_SIZE];
+static struct fdt_index fdt_index_ut_idx;
+
+static const char * const fdt_index_ut_paths[] = {
+	"/", "/cpus", "/cpus/cpu", "/cpus/cpu@1", "/cpus/cpu@2",
+	"/soc", "/soc/", "//soc//serial", "/soc/serial", "/soc/serial@1000",
+	"/soc/serial@2000", "/soc/serial@3000", "/soc/serial@4000",
+	"/soc/i2c", "/soc/i2c@5000/eeprom", "/soc/i2c/eeprom@50",
+	"/soc/i2c@5000/eeprom@50/missing", "/soc/gpio", "/soc/gpio@2000",
+	"/missing",
+};
+
+static const char * const fdt_index_ut_compats[] = {
+	"vendor,board", "vendor,serial", "vendor,uart", "vendor,i2c",
+	"atmel,eeprom", "vendor,gpio", "missing",
+};
+
+static int fdt_index_ut_node(void *fdt, const char *name, const char *compat,
+			     int compat_len, uint32_t phandle)
+{
+	int ret;
+
+	ret = fdt_begin_node(fdt, name);
+	if (!ret && compat)
+		ret = fdt_property(fdt, "compatible", compat, compat_len);
+	if (!ret && phandle)
+		ret = fdt_property_u32(fdt, "phandle", phandle);
+	if (!ret)
+		ret = fdt_property_string(fdt, "status", "okay");
+
+	return ret;
+}
+
+#define FDT_INDEX_UT_NODE(fdt, name, compat, phandle) \
+	fdt_index_ut_node(fdt, name, compat, sizeof(compat), phandle)
+
+/*
+ * Create a tree with duplicate node names apart from the unit address, a
+ * duplicate phandle, a phandle given only by linux,phandle, and compatible
+ * strings which appear in several nodes and several times in one node
+ */
+static int fdt_index_ut_create(void *fdt)
+{
+	int ret;
+
+	ret = fdt_create(fdt, FDT_INDEX_UT_SIZE);
+	if (!ret)
+		ret = fdt_finish_reservemap(fdt);
+	if (!ret)
+		ret = FDT_INDEX_UT_NODE(fdt, "", "vendor,board", 0);
+	if (!ret)
+		ret = fdt_index_ut_node(fdt, "cpus", NULL, 0, 0);
+	if (!ret)
+		ret = fdt_index_ut_node(fdt, "cpu@1", NULL, 0, 1);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = fdt_index_ut_node(fdt, "cpu@2", NULL, 0, 2);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = fdt_index_ut_node(fdt, "soc", NULL, 0, 0);
+	if (!ret)
+		ret = FDT_INDEX_UT_NODE(fdt, "serial@1000",
+					"vendor,serial\0vendor,uart", 3);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = FDT_INDEX_UT_NODE(fdt, "serial@2000", "vendor,serial", 3);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = FDT_INDEX_UT_NODE(fdt, "serial@3000", "vendor,uart", 0);
+	if (!ret)
+		ret = fdt_property_u32(fdt, "linux,phandle", 5);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = FDT_INDEX_UT_NODE(fdt, "i2c@5000", "vendor,i2c", 6);
+	if (!ret)
+		ret = FDT_INDEX_UT_NODE(fdt, "eeprom@50",
+					"atmel,eeprom\0vendor,serial", 8);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = fdt_end_node(fdt);
+	if (!ret)
+		ret = fdt_finish(fdt);
+	if (!ret)
+		ret = fdt_open_into(fdt, fdt, FDT_INDEX_UT_SIZE);
+
+	return ret;
+}
+
+static int fdt_index_ut_build(void *fdt)
+{
+	return fdt_index_build(&fdt_index_ut_idx, fdt, fdt_index_ut_buf,
+			       sizeof(fdt_index_ut_buf));
+}
+
+/*
+ * Check that every lookup gives the same result as on a copy of the blob,
+ * which has no index and so is scanned
+ */
+static int fdt_index_ut_check(struct unit_test_state *uts, void *fdt)
+{
+	void *copy = fdt_index_ut_copy;
+	uint32_t phandle;
+	int offset, i;
+
+	memcpy(copy, fdt, fdt_totalsize(fdt));
+
+	for (i = 0; i < ARRAY_SIZE(fdt_index_ut_paths); i++) {
+		const char *path = fdt_index_ut_paths[i];
+
+		ut_asserteq(fdt_path_offset(copy, path),
+			    fdt_path_offset(fdt, path));
+	}
+
+	for (phandle = 1; phandle <= FDT_INDEX_UT_PHANDLES; phandle++) {
+		ut_asserteq(fdt_node_offset_by_phandle(copy, phandle),
+			    fdt_node_offset_by_phandle(fdt, phandle));
+	}
+	ut_asserteq(fdt_get_max_phandle(copy), fdt_get_max_phandle(fdt));
+
+	/* Start from every node, not just from the previous match */
+	for (i = 0; i < ARRAY_SIZE(fdt_index_ut_compats); i++) {
+		const char *compat = fdt_index_ut_compats[i];
+
+		offset = -1;
+		do {
+			ut_asserteq(fdt_node_offset_by_compatible(copy, offset,
+								  compat),
+				    fdt_node_offset_by_compatible(fdt, offset,
+								  compat));
+			offset = fdt_next_node(copy, offset, NULL);
+		} while (offset >= 0);
+	}
+
+	return 0;
+}
+
+/* Lookups in an unchanged tree */
+static int fdt_index_test_lookup(struct unit_test_state *uts)
+{
+	void *fdt = fdt_index_ut_blob;
+
+	ut_assertok(fdt_index_ut_create(fdt));
+	ut_assertok(fdt_index_ut_build(fdt));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+
+	/* A sanity check that lookups find what the tree was built with */
+	ut_asserteq(fdt_path_offset(fdt, "/soc/serial@1000"),
+		    fdt_path_offset(fdt, "/soc/serial"));
+	ut_asserteq(fdt_path_offset(fdt, "/soc/serial@1000"),
+		    fdt_node_offset_by_phandle(fdt, 3));
+	ut_asserteq(fdt_path_offset(fdt, "/soc/serial@3000"),
+		    fdt_node_offset_by_phandle(fdt, 5));
+	ut_asserteq(-FDT_ERR_NOTFOUND, fdt_node_offset_by_phandle(fdt, 4));
+	ut_asserteq(8, fdt_get_max_phandle(fdt));
+	ut_asserteq_ptr(fdt, fdt_index_ut_idx.fdt);
+
+	return 0;
+}
+FDT_INDEX_TEST(fdt_index_test_lookup);
+
+/*
+ * Make each kind of change to an indexed tree, checking the lookups after
+ * each one and whether the index is still in use
+ */
+static int fdt_index_test_edit(struct unit_test_state *uts)
+{
+	fdt32_t phandle_7 = cpu_to_fdt32(7);
+	void *fdt = fdt_index_ut_blob;
+	struct fdt_index *idx = &fdt_index_ut_idx;
+	int node, ret;
+
+	ut_assertok(fdt_index_ut_create(fdt));
+	ut_assertok(fdt_index_ut_build(fdt));
+
+	/* These keep the index, so each is made on top of the one before */
+	node = fdt_path_offset(fdt, "/soc/serial@1000");
+	ut_assertok(fdt_setprop_u32(fdt, node, "clock-frequency", 115200));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	/* Deleted nodes no longer match, so the duplicate phandle is found */
+	node = fdt_path_offset(fdt, "/soc/serial@1000");
+	ut_assertok(fdt_nop_node(fdt, node));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	node = fdt_path_offset(fdt, "/cpus/cpu@1");
+	ut_assertok(fdt_del_node(fdt, node));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	node = fdt_path_offset(fdt, "/cpus/cpu@2");
+	ut_assertok(fdt_setprop_u32(fdt, node, "phandle", 4));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	ut_assertok(fdt_appendprop_string(fdt, node, "status", "!"));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	node = fdt_path_offset(fdt, "/soc/i2c@5000");
+	ut_assertok(fdt_delprop(fdt, node, "phandle"));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	node = fdt_path_offset(fdt, "/soc/serial@3000");
+	ut_assertok(fdt_nop_property(fdt, node, "status"));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	ut_assertok(fdt_setprop_inplace_u32(fdt, node, "linux,phandle", 9));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	node = fdt_path_offset(fdt, "/soc/serial@2000");
+	ut_assertok(fdt_setprop_inplace(fdt, node, "status", "fail", 5));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+
+	/* Path and compatible lookups scan once a node has been added */
+	node = fdt_path_offset(fdt, "/soc");
+	ut_assert(fdt_add_subnode(fdt, node, "gpio") >= 0);
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(fdt, idx->fdt);
+	ut_assert(idx->nodes_added);
+
+	/* These drop the index, so rebuild it before each */
+	ut_assertok(fdt_index_ut_build(fdt));
+	node = fdt_path_offset(fdt, "/soc/serial@3000");
+	ut_assertok(fdt_appendprop(fdt, node, "linux,phandle", &phandle_7,
+				   sizeof(phandle_7)));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(NULL, idx->fdt);
+
+	ut_assertok(fdt_index_ut_build(fdt));
+	node = fdt_path_offset(fdt, "/soc/serial@2000");
+	ret = fdt_setprop_inplace_namelen_partial(fdt, node, "phandle", 7, 2,
+						  (char *)&phandle_7 + 2, 2);
+	ut_assertok(ret);
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(NULL, idx->fdt);
+
+	ut_assertok(fdt_index_ut_build(fdt));
+	node = fdt_path_offset(fdt, "/soc/i2c@5000/eeprom@50");
+	ut_assertok(fdt_setprop_string(fdt, node, "compatible",
+				       "vendor,gpio"));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(NULL, idx->fdt);
+
+	ut_assertok(fdt_index_ut_build(fdt));
+	node = fdt_path_offset(fdt, "/soc/serial@2000");
+	ut_assertok(fdt_set_name(fdt, node, "gpio@2000"));
+	ut_assertok(fdt_index_ut_check(uts, fdt));
+	ut_asserteq_ptr(NULL, idx->fdt);
+
+	return 0;
+}
+FDT_INDEX_TEST(fdt_index_test_edit);
+
+int do_ut_fdt_index(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	struct unit_test *tests = ll_entry_start(struct unit_test,
+						 fdt_index_test);
+	const int n_ents = ll_entry_count(struct unit_test, fdt_index_test);
+	struct unit_test_state uts = { .fail_count = 0 };
+	struct unit_test *test;
+
+	if (argc == 1)
+		printf("Running %d FDT index tests\n", n_ents);
+
+	for (test = tests; test < tests + n_ents; test++) {
+		if (argc > 1 && strcmp(argv[1], test->name))
+			continue;
+		printf("Test: %s\n", test->name);
+
+		uts.start = mallinfo();
+
+		test->func(&uts);
+
+		fdt_index_release(&fdt_index_ut_idx);
+	}
+
+	printf("Failures: %d\n", uts.fail_count);
+
+	return uts.fail_count ? CMD_RET_FAILURE : 0;
+}
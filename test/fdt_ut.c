@@ -0,0 +1,512 @@
+/*
+ * Tests of device tree edit transactions, and a benchmark of the fixups
+ * made before booting an OS with and without one
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <errno.h>
+#include <fdt_support.h>
+#include <malloc.h>
+#include <test/suites.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <linux/sizes.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Declare a new FDT test */
+#define FDT_TEST(_name)		UNIT_TEST(_name, 0, fdt_test)
+
+/* Room left in each copy of the control FDT for the fixups */
+#define FDT_UT_EXTRA		SZ_64K
+#define FDT_UT_LOG_SIZE		SZ_16K
+#define FDT_UT_LOOPS		20
+
+/* Size of the test tree, and of the record of its properties */
+#define FDT_UT_SIZE		SZ_4K
+#define FDT_UT_TRACE_SIZE	SZ_4K
+
+static char fdt_ut_direct[FDT_UT_SIZE];
+static char fdt_ut_batched[FDT_UT_SIZE];
+static char fdt_ut_log[FDT_UT_LOG_SIZE];
+static char fdt_ut_traces[2][FDT_UT_TRACE_SIZE];
+static char *fdt_ut_trace;
+
+/*
+ * Create a small tree. /empty has no properties, so that properties added
+ * to it go where its subnode starts.
+ */
+static int fdt_ut_create(void *blob)
+{
+	int ret;
+
+	ret = fdt_create(blob, FDT_UT_SIZE);
+	if (!ret)
+		ret = fdt_finish_reservemap(blob);
+	if (!ret)
+		ret = fdt_begin_node(blob, "");
+	if (!ret)
+		ret = fdt_property_string(blob, "compatible", "vendor,board");
+	if (!ret)
+		ret = fdt_property_string(blob, "model", "Test board");
+	if (!ret)
+		ret = fdt_begin_node(blob, "chosen");
+	if (!ret)
+		ret = fdt_end_node(blob);
+	if (!ret)
+		ret = fdt_begin_node(blob, "empty");
+	if (!ret)
+		ret = fdt_begin_node(blob, "child");
+	if (!ret)
+		ret = fdt_property_u32(blob, "value", 1);
+	if (!ret)
+		ret = fdt_end_node(blob);
+	if (!ret)
+		ret = fdt_end_node(blob);
+	if (!ret)
+		ret = fdt_begin_node(blob, "soc");
+	if (!ret)
+		ret = fdt_property_u32(blob, "#address-cells", 1);
+	if (!ret)
+		ret = fdt_begin_node(blob, "serial@1000");
+	if (!ret)
+		ret = fdt_property_string(blob, "compatible", "vendor,serial");
+	if (!ret)
+		ret = fdt_property_u32(blob, "reg", 0x1000);
+	if (!ret)
+		ret = fdt_property_string(blob, "status", "disabled");
+	if (!ret)
+		ret = fdt_end_node(blob);
+	if (!ret)
+		ret = fdt_begin_node(blob, "serial@2000");
+	if (!ret)
+		ret = fdt_property_string(blob, "compatible", "vendor,serial");
+	if (!ret)
+		ret = fdt_property_u32(blob, "reg", 0x2000);
+	if (!ret)
+		ret = fdt_property_string(blob, "status", "disabled");
+	if (!ret)
+		ret = fdt_end_node(blob);
+	if (!ret)
+		ret = fdt_end_node(blob);
+	if (!ret)
+		ret = fdt_end_node(blob);
+	if (!ret)
+		ret = fdt_finish(blob);
+	if (!ret)
+		ret = fdt_open_into(blob, blob, FDT_UT_SIZE);
+
+	return ret;
+}
+
+/* Size of a blob up to the end of its strings */
+static int fdt_ut_used(const void *blob)
+{
+	return fdt_off_dt_strings(blob) + fdt_size_dt_strings(blob);
+}
+
+/*
+ * Record the properties of every node as iteration finds them, checking
+ * that each can also be found by name
+ */
+static int fdt_ut_list(struct unit_test_state *uts, void *blob)
+{
+	const char *name;
+	const u8 *val;
+	int node, offset, len;
+	uint sum;
+	int i;
+
+	for (node = 0; node >= 0; node = fdt_next_node(blob, node, NULL)) {
+		fdt_ut_trace += sprintf(fdt_ut_trace, "%s:",
+					fdt_get_name(blob, node, NULL));
+		fdt_for_each_property_offset(offset, blob, node) {
+			val = fdt_getprop_by_offset(blob, offset, &name, &len);
+			ut_assertnonnull(val);
+			ut_asserteq_ptr(val, fdt_getprop(blob, node, name,
+							 NULL));
+			for (i = 0, sum = 0; i < len; i++)
+				sum = sum * 31 + val[i];
+			fdt_ut_trace += sprintf(fdt_ut_trace, " %s/%d/%x",
+						name, len, sum);
+		}
+		ut_asserteq(-FDT_ERR_NOTFOUND, offset);
+		fdt_ut_trace += sprintf(fdt_ut_trace, "\n");
+	}
+	ut_asserteq(-FDT_ERR_NOTFOUND, node);
+
+	return 0;
+}
+
+/*
+ * Make the same edits to two copies of the test tree, one directly and the
+ * other in a transaction with a log of @logsize bytes. Check that the edits
+ * see the same properties and that the blobs are identical afterwards.
+ */
+static int fdt_ut_check_txn(struct unit_test_state *uts,
+			    int (*edit)(struct unit_test_state *uts,
+					void *blob),
+			    int logsize)
+{
+	struct fdt_txn txn;
+	int ret, err;
+
+	ut_assertok(fdt_ut_create(fdt_ut_direct));
+	ut_assertok(fdt_ut_create(fdt_ut_batched));
+
+	fdt_ut_trace = fdt_ut_traces[0];
+	ut_assertok(edit(uts, fdt_ut_direct));
+
+	fdt_ut_trace = fdt_ut_traces[1];
+	ut_assertok(fdt_txn_begin(&txn, fdt_ut_batched, fdt_ut_log, logsize));
+	ret = edit(uts, fdt_ut_batched);
+	err = fdt_txn_commit(&txn);
+	ut_assertok(ret);
+	ut_assertok(err);
+
+	ut_asserteq_str(fdt_ut_traces[0], fdt_ut_traces[1]);
+	ut_asserteq(fdt_ut_used(fdt_ut_direct), fdt_ut_used(fdt_ut_batched));
+	ut_assertok(memcmp(fdt_ut_direct, fdt_ut_batched,
+			   fdt_ut_used(fdt_ut_direct)));
+
+	return 0;
+}
+
+/* Add properties, including to a node with none, and change others */
+static int fdt_ut_edit_setprop(struct unit_test_state *uts, void *blob)
+{
+	int node;
+
+	node = fdt_path_offset(blob, "/chosen");
+	ut_assertok(fdt_setprop_string(blob, node, "bootargs", "quiet"));
+	ut_assertok(fdt_setprop_string(blob, node, "bootargs",
+				       "console=ttyS0,115200 root=/dev/sda"));
+	ut_assertok(fdt_setprop_u32(blob, node, "linux,initrd-start",
+				    0x1000));
+
+	node = fdt_path_offset(blob, "/soc/serial@1000");
+	ut_assertok(fdt_setprop_string(blob, node, "status", "okay"));
+	ut_assertok(fdt_setprop_u64(blob, node, "reg", 0x1000));
+	ut_assertok(fdt_setprop_string(blob, node, "label", "uart0"));
+	ut_assertok(fdt_setprop_empty(blob, node, "u-boot,dm-pre-reloc"));
+	ut_assertok(fdt_setprop_string(blob, node, "status", "fail"));
+
+	node = fdt_path_offset(blob, "/empty");
+	ut_assertok(fdt_setprop_u32(blob, node, "first", 1));
+	ut_assertok(fdt_setprop_u32(blob, node, "second", 2));
+
+	ut_assertok(fdt_setprop_string(blob, 0, "model", "Test board, rev 2"));
+	ut_assertok(fdt_setprop_u32(blob, 0, "serial-number", 42));
+
+	return fdt_ut_list(uts, blob);
+}
+
+/* Delete properties from the blob and ones added or changed in between */
+static int fdt_ut_edit_delprop(struct unit_test_state *uts, void *blob)
+{
+	int node;
+
+	node = fdt_path_offset(blob, "/soc/serial@2000");
+	ut_assertok(fdt_delprop(blob, node, "status"));
+	ut_asserteq(-FDT_ERR_NOTFOUND, fdt_delprop(blob, node, "status"));
+	ut_assertok(fdt_setprop_string(blob, node, "label", "uart1"));
+	ut_assertok(fdt_delprop(blob, node, "label"));
+	ut_asserteq(-FDT_ERR_NOTFOUND, fdt_delprop(blob, node, "label"));
+
+	/* Deleted and added again goes to the start of the node */
+	node = fdt_path_offset(blob, "/soc/serial@1000");
+	ut_assertok(fdt_delprop(blob, node, "reg"));
+	ut_assertok(fdt_setprop_u32(blob, node, "reg", 0x1800));
+	ut_assertok(fdt_setprop_string(blob, node, "compatible",
+				       "vendor,uart"));
+	ut_assertok(fdt_delprop(blob, node, "compatible"));
+
+	ut_assertok(fdt_delprop(blob, 0, "model"));
+
+	return fdt_ut_list(uts, blob);
+}
+
+/* Append to properties in the blob, to new ones and to missing ones */
+static int fdt_ut_edit_appendprop(struct unit_test_state *uts, void *blob)
+{
+	int node;
+
+	node = fdt_path_offset(blob, "/soc/serial@1000");
+	ut_assertok(fdt_appendprop_string(blob, node, "compatible",
+					  "vendor,uart"));
+	ut_assertok(fdt_appendprop_u32(blob, node, "interrupts", 5));
+	ut_assertok(fdt_appendprop_u32(blob, node, "interrupts", 4));
+
+	node = fdt_path_offset(blob, "/soc/serial@2000");
+	ut_assertok(fdt_setprop_string(blob, node, "status", "okay"));
+	ut_assertok(fdt_appendprop_string(blob, node, "status", "ish"));
+	ut_assertok(fdt_appendprop(blob, node, "reg", "", 0));
+
+	ut_assertok(fdt_appendprop_string(blob, 0, "compatible",
+					  "vendor,family"));
+
+	return fdt_ut_list(uts, blob);
+}
+
+/* Add, rename and delete nodes around pending property edits */
+static int fdt_ut_edit_subnode(struct unit_test_state *uts, void *blob)
+{
+	int node, sub;
+
+	/* A property added before a subnode stays in front of it */
+	node = fdt_path_offset(blob, "/empty");
+	ut_assertok(fdt_setprop_u32(blob, node, "before", 1));
+	sub = fdt_add_subnode(blob, node, "first");
+	ut_assert(sub >= 0);
+	ut_assertok(fdt_setprop_u32(blob, sub, "value", 2));
+	node = fdt_path_offset(blob, "/empty");
+	ut_assertok(fdt_setprop_u32(blob, node, "after", 3));
+	sub = fdt_add_subnode(blob, node, "second");
+	ut_assert(sub >= 0);
+
+	node = fdt_path_offset(blob, "/soc/serial@1000");
+	ut_assertok(fdt_setprop_string(blob, node, "label", "uart0"));
+	ut_assertok(fdt_setprop_string(blob, node, "status", "okay"));
+	ut_assertok(fdt_del_node(blob, node));
+
+	node = fdt_path_offset(blob, "/soc/serial@2000");
+	ut_assertok(fdt_setprop_string(blob, node, "status", "okay"));
+	ut_assertok(fdt_set_name(blob, node, "uart@2000"));
+	ut_assertok(fdt_setprop_string(blob, node, "label", "uart1"));
+
+	node = fdt_path_offset(blob, "/chosen");
+	ut_assertok(fdt_setprop_string(blob, node, "bootargs", "quiet"));
+
+	return fdt_ut_list(uts, blob);
+}
+
+/* Nop nodes and properties with edits pending within them */
+static int fdt_ut_edit_nop(struct unit_test_state *uts, void *blob)
+{
+	int node;
+
+	node = fdt_path_offset(blob, "/soc/serial@1000");
+	ut_assertok(fdt_setprop_string(blob, node, "label", "uart0"));
+	ut_assertok(fdt_setprop_string(blob, node, "status", "okay"));
+	ut_assertok(fdt_delprop(blob, node, "reg"));
+	ut_assertok(fdt_nop_node(blob, node));
+
+	/* The parent's new property goes where the child starts */
+	node = fdt_path_offset(blob, "/empty");
+	ut_assertok(fdt_setprop_u32(blob, node, "before", 1));
+	node = fdt_path_offset(blob, "/empty/child");
+	ut_assertok(fdt_setprop_u64(blob, node, "value", 1));
+	ut_assertok(fdt_nop_node(blob, node));
+	node = fdt_path_offset(blob, "/empty");
+	ut_assert(fdt_add_subnode(blob, node, "later") >= 0);
+	ut_assertok(fdt_setprop_u32(blob, node, "after", 2));
+
+	node = fdt_path_offset(blob, "/soc/serial@2000");
+	ut_assertok(fdt_setprop_string(blob, node, "label", "uart1"));
+	ut_assertok(fdt_setprop_string(blob, node, "status", "okay"));
+	ut_assertok(fdt_nop_property(blob, node, "label"));
+	ut_assertok(fdt_nop_property(blob, node, "status"));
+
+	ut_assertok(fdt_nop_node(blob, fdt_path_offset(blob, "/chosen")));
+	ut_assertok(fdt_ut_list(uts, blob));
+
+	/* Nop a node holding a nopped node with edits still pending */
+	node = fdt_path_offset(blob, "/soc");
+	ut_assertok(fdt_setprop_u32(blob, node, "#size-cells", 0));
+	ut_assertok(fdt_nop_node(blob, node));
+
+	return fdt_ut_list(uts, blob);
+}
+
+static int (*const fdt_ut_edits[])(struct unit_test_state *uts,
+				   void *blob) = {
+	fdt_ut_edit_setprop,
+	fdt_ut_edit_delprop,
+	fdt_ut_edit_appendprop,
+	fdt_ut_edit_subnode,
+	fdt_ut_edit_nop,
+};
+
+static int fdt_test_txn_setprop(struct unit_test_state *uts)
+{
+	return fdt_ut_check_txn(uts, fdt_ut_edit_setprop, FDT_UT_LOG_SIZE);
+}
+FDT_TEST(fdt_test_txn_setprop);
+
+static int fdt_test_txn_delprop(struct unit_test_state *uts)
+{
+	return fdt_ut_check_txn(uts, fdt_ut_edit_delprop, FDT_UT_LOG_SIZE);
+}
+FDT_TEST(fdt_test_txn_delprop);
+
+static int fdt_test_txn_appendprop(struct unit_test_state *uts)
+{
+	return fdt_ut_check_txn(uts, fdt_ut_edit_appendprop, FDT_UT_LOG_SIZE);
+}
+FDT_TEST(fdt_test_txn_appendprop);
+
+static int fdt_test_txn_subnode(struct unit_test_state *uts)
+{
+	return fdt_ut_check_txn(uts, fdt_ut_edit_subnode, FDT_UT_LOG_SIZE);
+}
+FDT_TEST(fdt_test_txn_subnode);
+
+static int fdt_test_txn_nop(struct unit_test_state *uts)
+{
+	return fdt_ut_check_txn(uts, fdt_ut_edit_nop, FDT_UT_LOG_SIZE);
+}
+FDT_TEST(fdt_test_txn_nop);
+
+/*
+ * With a log too small for all the edits, some are written out as they are
+ * made. The result must not change.
+ */
+static int fdt_test_txn_log_full(struct unit_test_state *uts)
+{
+	static const int sizes[] = { 0, 64, 128, 256 };
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		for (j = 0; j < ARRAY_SIZE(fdt_ut_edits); j++)
+			ut_assertok(fdt_ut_check_txn(uts, fdt_ut_edits[j],
+						     sizes[i]));
+	}
+
+	return 0;
+}
+FDT_TEST(fdt_test_txn_log_full);
+
+/*
+ * The fixups image_setup_libfdt() applies on sandbox, followed by a status
+ * property on every node as board code does when enabling devices
+ */
+static int fdt_ut_fixup(void *blob)
+{
+	bd_t *bd = gd->bd;
+	int node, depth = 0;
+	int ret;
+
+	ret = fdt_root(blob);
+	if (!ret)
+		ret = fdt_chosen(blob);
+	if (ret)
+		return ret;
+	fdt_fixup_ethernet(blob);
+	ret = fdt_fixup_memory(blob, bd->bi_dram[0].start,
+			       bd->bi_dram[0].size);
+	if (ret)
+		return ret;
+
+	for (node = fdt_next_node(blob, 0, &depth);
+	     node >= 0 && depth > 0;
+	     node = fdt_next_node(blob, node, &depth)) {
+		ret = fdt_setprop_string(blob, node, "status", "okay");
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int fdt_ut_run(void *blob, int size, void *log, ulong *usp)
+{
+	struct fdt_txn txn;
+	ulong start;
+	int ret, err;
+
+	ret = fdt_open_into(gd->fdt_blob, blob, size);
+	if (ret)
+		return ret;
+
+	start = timer_get_us();
+	if (log) {
+		ret = fdt_txn_begin(&txn, blob, log, FDT_UT_LOG_SIZE);
+		if (ret)
+			return ret;
+	}
+	ret = fdt_ut_fixup(blob);
+	if (log) {
+		err = fdt_txn_commit(&txn);
+		if (!ret)
+			ret = err;
+	}
+	*usp += timer_get_us() - start;
+
+	return ret;
+}
+
+/*
+ * Apply the fixups to copies of the control FDT, directly and in a
+ * transaction, checking that the results agree and printing the time each
+ * took
+ */
+static int fdt_test_txn_fixups(struct unit_test_state *uts)
+{
+	ulong direct_us = 0, txn_us = 0;
+	void *direct, *batched, *log;
+	int size, used;
+	int ret = 0;
+	int i;
+
+	size = fdt_totalsize(gd->fdt_blob) + FDT_UT_EXTRA;
+	direct = malloc(size);
+	batched = malloc(size);
+	log = malloc(FDT_UT_LOG_SIZE);
+	if (!direct || !batched || !log) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < FDT_UT_LOOPS && !ret; i++) {
+		ret = fdt_ut_run(direct, size, NULL, &direct_us);
+		if (!ret)
+			ret = fdt_ut_run(batched, size, log, &txn_us);
+	}
+	if (ret)
+		goto out;
+
+	used = fdt_ut_used(direct);
+	if (fdt_ut_used(batched) != used || memcmp(direct, batched, used))
+		ret = -EINVAL;
+	else
+		printf("%d x fixups of %d-byte blob: direct %lu us, transaction %lu us\n",
+		       FDT_UT_LOOPS, fdt_totalsize(gd->fdt_blob), direct_us,
+		       txn_us);
+
+out:
+	free(log);
+	free(batched);
+	free(direct);
+	ut_assertok(ret);
+
+	return 0;
+}
+FDT_TEST(fdt_test_txn_fixups);
+
+int do_ut_fdt(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	struct unit_test *tests = ll_entry_start(struct unit_test, fdt_test);
+	const int n_ents = ll_entry_count(struct unit_test, fdt_test);
+	struct unit_test_state uts = { .fail_count = 0 };
+	struct unit_test *test;
+
+	if (argc == 1)
+		printf("Running %d FDT tests\n", n_ents);
+
+	for (test = tests; test < tests + n_ents; test++) {
+		if (argc > 1 && strcmp(argv[1], test->name))
+			continue;
+		printf("Test: %s\n", test->name);
+
+		uts.start = mallinfo();
+
+		test->func(&uts);
+	}
+
+	printf("Failures: %d\n", uts.fail_count);
+
+	return uts.fail_count ? CMD_RET_FAILURE : 0;
+}
@@ -0,0 +1,240 @@
+/*
+ * Benchmark of the malloc() heap against a private TLSF pool
+ *
+ * SPDX-License-Identifier:	GPL-2.0+
+ */
+
+#include <common.h>
+#include <command.h>
+#include <errno.h>
+#include <malloc.h>
+#include <tlsf.h>
+#include <linux/sizes.h>
+
+/* Allocations alive at once, the cap on their total size, and pool size */
+#define MALLOC_UT_SLOTS		512
+#define MALLOC_UT_LIVE		SZ_4M
+#define MALLOC_UT_POOL		SZ_8M
+#define MALLOC_UT_OPS		50000
+
+/**
+ * struct malloc_ut_heap - a heap under test and its results
+ *
+ * @name:	Name to print
+ * @pool:	TLSF pool to use, or NULL for malloc()
+ * @total_us:	Time spent in the allocator
+ * @max_us:	Time taken by the slowest call
+ * @failed:	Number of calls which returned NULL
+ * @footprint:	Growth of the heap's used area during the run
+ */
+struct malloc_ut_heap {
+	const char *name;
+	struct tlsf *pool;
+	ulong total_us;
+	ulong max_us;
+	int failed;
+	size_t footprint;
+};
+
+struct malloc_ut_slot {
+	void *ptr;
+	size_t size;
+};
+
+static u32 malloc_ut_rand(u32 *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+
+	return *seed;
+}
+
+/* Mostly small blocks, with a few buffers of the size used for downloads */
+static size_t malloc_ut_size(u32 *seed)
+{
+	u32 pick = malloc_ut_rand(seed) % 100;
+	u32 r = malloc_ut_rand(seed);
+
+	if (pick < 60)
+		return 8 + r % 248;
+	if (pick < 90)
+		return 256 + r % (SZ_8K - 256);
+	if (pick < 99)
+		return SZ_8K + r % (SZ_128K - SZ_8K);
+
+	return SZ_256K + r % (SZ_1M - SZ_256K);
+}
+
+static void *malloc_ut_alloc(struct malloc_ut_heap *heap, size_t align,
+			     size_t size)
+{
+	if (heap->pool)
+		return align ? tlsf_memalign(heap->pool, align, size) :
+			tlsf_malloc(heap->pool, size);
+
+	return align ? memalign(align, size) : malloc(size);
+}
+
+static void *malloc_ut_realloc(struct malloc_ut_heap *heap, void *ptr,
+			       size_t size)
+{
+	if (heap->pool)
+		return tlsf_realloc(heap->pool, ptr, size);
+
+	return realloc(ptr, size);
+}
+
+static void malloc_ut_free(struct malloc_ut_heap *heap, void *ptr)
+{
+	if (heap->pool)
+		tlsf_free(heap->pool, ptr);
+	else
+		free(ptr);
+}
+
+static size_t malloc_ut_used_area(struct malloc_ut_heap *heap)
+{
+	struct tlsf_info info;
+
+	if (!heap->pool)
+		return mallinfo().arena;
+	tlsf_get_info(heap->pool, &info);
+
+	return info.top;
+}
+
+/*
+ * Run the same sequence of calls on a heap, timing each one. Returns the
+ * peak number of bytes allocated, which is the same for every heap.
+ */
+static size_t malloc_ut_run(struct malloc_ut_heap *heap,
+			    struct malloc_ut_slot *slots)
+{
+	size_t live = 0, peak = 0, start_area, size, align;
+	struct malloc_ut_slot *slot;
+	u32 seed = 1, r;
+	ulong start, us;
+	void *ptr;
+	int i;
+
+	start_area = malloc_ut_used_area(heap);
+	for (i = 0; i < MALLOC_UT_OPS; i++) {
+		slot = &slots[malloc_ut_rand(&seed) % MALLOC_UT_SLOTS];
+		r = malloc_ut_rand(&seed);
+		size = malloc_ut_size(&seed);
+		align = r % 8 ? 0 : 64 << ((r >> 8) % 7);
+
+		if (slot->ptr && (r & 3)) {
+			start = timer_get_us();
+			malloc_ut_free(heap, slot->ptr);
+			us = timer_get_us() - start;
+			live -= slot->size;
+			slot->ptr = NULL;
+		} else if (slot->ptr) {
+			if (live - slot->size + size > MALLOC_UT_LIVE)
+				continue;
+			start = timer_get_us();
+			ptr = malloc_ut_realloc(heap, slot->ptr, size);
+			us = timer_get_us() - start;
+			if (!ptr) {
+				heap->failed++;
+				continue;
+			}
+			live += size - slot->size;
+			slot->ptr = ptr;
+			slot->size = size;
+		} else {
+			if (live + size > MALLOC_UT_LIVE)
+				continue;
+			start = timer_get_us();
+			ptr = malloc_ut_alloc(heap, align, size);
+			us = timer_get_us() - start;
+			if (!ptr) {
+				heap->failed++;
+				continue;
+			}
+			live += size;
+			slot->ptr = ptr;
+			slot->size = size;
+		}
+		heap->total_us += us;
+		heap->max_us = max(heap->max_us, us);
+		peak = max(peak, live);
+	}
+	heap->footprint = malloc_ut_used_area(heap) - start_area;
+
+	for (i = 0; i < MALLOC_UT_SLOTS; i++) {
+		malloc_ut_free(heap, slots[i].ptr);
+		slots[i].ptr = NULL;
+	}
+
+	return peak;
+}
+
+static void malloc_ut_show(struct malloc_ut_heap *heap, size_t peak)
+{
+	printf("%-18s %7lu us, slowest %4lu us, footprint %5lu KiB (%lu%% of peak), %d failed\n",
+	       heap->name, heap->total_us, heap->max_us,
+	       (ulong)heap->footprint / 1024,
+	       (ulong)(heap->footprint * 100 / peak), heap->failed);
+}
+
+int do_ut_malloc(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
+{
+	struct malloc_ut_heap sys = {
+#ifdef CONFIG_SYS_MALLOC_TLSF
+		.name = "malloc (TLSF)",
+#else
+		.name = "malloc (dlmalloc)",
+#endif
+	};
+	struct malloc_ut_heap pool = { .name = "TLSF pool" };
+	struct malloc_ut_slot *slots;
+	struct mallinfo before;
+	struct tlsf_info info;
+	void *mem = NULL;
+	size_t peak;
+	int ret = 0;
+
+	slots = calloc(MALLOC_UT_SLOTS, sizeof(*slots));
+	if (!slots) {
+		printf("%s: out of memory\n", __func__);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	before = mallinfo();
+	peak = malloc_ut_run(&sys, slots);
+	if (mallinfo().uordblks != before.uordblks) {
+		printf("%s: malloc() heap leaked %d bytes\n", __func__,
+		       mallinfo().uordblks - before.uordblks);
+		ret = -EINVAL;
+	}
+
+	mem = malloc(MALLOC_UT_POOL);
+	pool.pool = mem ? tlsf_create(mem, MALLOC_UT_POOL) : NULL;
+	if (!pool.pool) {
+		printf("%s: cannot create pool\n", __func__);
+		ret = -ENOMEM;
+		goto out;
+	}
+	malloc_ut_run(&pool, slots);
+	tlsf_get_info(pool.pool, &info);
+	if (info.used || tlsf_check(pool.pool)) {
+		printf("%s: TLSF pool is inconsistent\n", __func__);
+		ret = -EINVAL;
+	}
+
+	printf("%d calls, peak %lu KiB allocated:\n", MALLOC_UT_OPS,
+	       (ulong)peak / 1024);
+	malloc_ut_show(&sys, peak);
+	malloc_ut_show(&pool, peak);
+
+out:
+	free(mem);
+	free(slots);
+	printf("Test %s\n", ret ? "failed" : "passed");
+
+	return ret ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
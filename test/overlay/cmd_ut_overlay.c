@@ -18,6 +18,10 @@
 /* 4k ought to be enough for anybody */
 #define FDT_COPY_SIZE	(4 * SZ_1K)
 
+/* Largest number of overlays applied at once by the scaling benchmark */
+#define FDT_LIST_MAX	16
+#define FDT_LIST_BUF	(16 * SZ_1K)
+
 extern u32 __dtb_test_fdt_base_begin;
 extern u32 __dtb_test_fdt_overlay_begin;
 
@@ -201,6 +205,83 @@ static int fdt_overlay_local_phandles(struct unit_test_state *uts)
 }
 OVERLAY_TEST(fdt_overlay_local_phandles, 0);
 
+/*
+ * Apply @count copies of the test overlay to a fresh base, either one at a
+ * time or as a list, and add the time taken to @usp
+ */
+static int fdt_overlay_apply_copies(struct unit_test_state *uts, void *base,
+				    int size, void **overlays, int count,
+				    void *buf, ulong *usp)
+{
+	void *fdt_base = &__dtb_test_fdt_base_begin;
+	void *fdt_overlay = &__dtb_test_fdt_overlay_begin;
+	ulong start;
+	int i;
+
+	ut_assertok(fdt_open_into(fdt_base, base, size));
+	for (i = 0; i < count; i++)
+		ut_assertok(fdt_open_into(fdt_overlay, overlays[i],
+					  FDT_COPY_SIZE));
+
+	start = timer_get_us();
+	if (buf) {
+		ut_assertok(fdt_overlay_apply_list(base, overlays, count, buf,
+						   FDT_LIST_BUF));
+	} else {
+		for (i = 0; i < count; i++)
+			ut_assertok(fdt_overlay_apply(base, overlays[i]));
+	}
+	*usp += timer_get_us() - start;
+
+	return 0;
+}
+
+static int fdt_overlay_apply_list_scaling(struct unit_test_state *uts)
+{
+	void *overlays[FDT_LIST_MAX];
+	void *single, *list, *buf;
+	int count, size, used;
+	int i;
+
+	size = (FDT_LIST_MAX + 1) * FDT_COPY_SIZE;
+	single = malloc(size);
+	list = malloc(size);
+	buf = malloc(FDT_LIST_BUF);
+	ut_assert(single && list && buf);
+	for (i = 0; i < FDT_LIST_MAX; i++) {
+		overlays[i] = malloc(FDT_COPY_SIZE);
+		ut_assert(overlays[i]);
+	}
+
+	for (count = 1; count <= FDT_LIST_MAX; count *= 2) {
+		ulong single_us = 0, list_us = 0;
+
+		ut_assertok(fdt_overlay_apply_copies(uts, single, size,
+						     overlays, count, NULL,
+						     &single_us));
+		ut_assertok(fdt_overlay_apply_copies(uts, list, size,
+						     overlays, count, buf,
+						     &list_us));
+
+		used = fdt_off_dt_strings(single) + fdt_size_dt_strings(single);
+		ut_asserteq(used,
+			    fdt_off_dt_strings(list) + fdt_size_dt_strings(list));
+		ut_assertok(memcmp(single, list, used));
+
+		printf("%2d overlays: one at a time %lu us, as a list %lu us\n",
+		       count, single_us, list_us);
+	}
+
+	for (i = 0; i < FDT_LIST_MAX; i++)
+		free(overlays[i]);
+	free(buf);
+	free(list);
+	free(single);
+
+	return CMD_RET_SUCCESS;
+}
+OVERLAY_TEST(fdt_overlay_apply_list_scaling, 0);
+
 int do_ut_overlay(cmd_tbl_t *cmdtp, int flag, int argc, char * const argv[])
 {
 	struct unit_test *tests = ll_entry_start(struct unit_test,
@@ -0,0 +1,55 @@
+# SPDX-License-Identifier: GPL-2.0
+
+import pytest
+import re
+
+@pytest.mark.buildconfigspec('cmd_malloc')
+def test_malloc_info(u_boot_console):
+    """Test that 'malloc info' reports heap usage and a peak at least as
+    large as the current usage."""
+
+    response = u_boot_console.run_command('malloc info')
+    m = re.search(r'in use\s+(\d+) bytes in (\d+) allocations', response)
+    assert(m)
+    in_use = int(m.group(1))
+    m = re.search(r'peak\s+(\d+) bytes', response)
+    assert(m)
+    assert(int(m.group(1)) >= in_use)
+
+@pytest.mark.buildconfigspec('cmd_malloc')
+def test_malloc_sites(u_boot_console):
+    """Test that 'malloc sites' lists the call sites used during boot."""
+
+    response = u_boot_console.run_command('malloc sites')
+    lines = response.splitlines()
+    assert(lines[0].startswith('caller'))
+    assert(len(lines) > 1)
+
+@pytest.mark.buildconfigspec('cmd_malloc')
+def test_malloc_leak_none(u_boot_console):
+    """Test that a command which frees what it allocates is not reported."""
+
+    response = u_boot_console.run_command('malloc leak echo hello')
+    assert('hello' in response)
+    assert('0 allocations, 0 bytes' in response)
+
+@pytest.mark.buildconfigspec('cmd_malloc')
+def test_malloc_leak_env(u_boot_console):
+    """Test that allocations kept by a command are reported, using a new
+    environment variable, which stays allocated until it is deleted."""
+
+    u_boot_console.run_command('setenv test_malloc_leak')
+    response = u_boot_console.run_command(
+        'malloc leak setenv test_malloc_leak 0123456789abcdef')
+    assert('allocations above are still live' in response)
+    u_boot_console.run_command('setenv test_malloc_leak')
+
+@pytest.mark.buildconfigspec('cmd_malloc')
+def test_malloc_reset(u_boot_console):
+    """Test that 'malloc reset' brings the peak down to the current usage."""
+
+    u_boot_console.run_command('malloc reset')
+    response = u_boot_console.run_command('malloc info')
+    in_use = int(re.search(r'in use\s+(\d+) bytes', response).group(1))
+    peak = int(re.search(r'peak\s+(\d+) bytes', response).group(1))
+    assert(peak == in_use)
@@ -2,8 +2,8 @@
 #
 # SPDX-License-Identifier: GPL-2.0
 
-# Test various network-related functionality, such as the dhcp, ping, and
-# tftpboot commands.
+# Test various network-related functionality, such as the dhcp, ping,
+# tftpboot and wget commands.
 
 import pytest
 import u_boot_utils
@@ -56,6 +56,16 @@ env__net_nfs_readable_file = {
     "size": 5058624,
     "crc32": "c2244b26",
 }
+
+# Details regarding a file that may be read from an HTTP server (on port 80
+# of serverip unless "port" is given). This variable may be omitted or set to
+# None if HTTP testing is not possible or desired.
+env__net_http_readable_file = {
+    "fn": "ubtest-readable.bin",
+    "addr": 0x10000000,
+    "size": 5058624,
+    "crc32": "c2244b26",
+}
 """
 
 net_set_up = False
@@ -206,3 +216,49 @@ def test_net_nfs(u_boot_console):
 
     output = u_boot_console.run_command('crc32 %x $filesize' % addr)
     assert expected_crc in output
+
+@pytest.mark.buildconfigspec('cmd_wget')
+def test_net_wget(u_boot_console):
+    """Test the wget command.
+
+    A file is downloaded from the HTTP server, its size and optionally its
+    CRC32 are validated.
+
+    The details of the file to download are provided by the boardenv_* file;
+    see the comment at the beginning of this file.
+    """
+
+    if not net_set_up:
+        pytest.skip('Network not initialized')
+
+    f = u_boot_console.config.env.get('env__net_http_readable_file', None)
+    if not f:
+        pytest.skip('No HTTP readable file to read')
+
+    addr = f.get('addr', None)
+    if not addr:
+        addr = u_boot_utils.find_ram_base(u_boot_console) + (1024 * 1024 * 4)
+
+    port = f.get('port', None)
+    if port:
+        u_boot_console.run_command('setenv httpdstp %d' % port)
+
+    fn = f['fn']
+    output = u_boot_console.run_command('wget %x %s' % (addr, fn))
+    if port:
+        u_boot_console.run_command('setenv httpdstp')
+    expected_text = 'Bytes transferred = '
+    sz = f.get('size', None)
+    if sz:
+        expected_text += '%d' % sz
+    assert expected_text in output
+
+    expected_crc = f.get('crc32', None)
+    if not expected_crc:
+        return
+
+    if u_boot_console.config.buildconfig.get('config_cmd_crc32', 'n') != 'y':
+        return
+
+    output = u_boot_console.run_command('crc32 %x $filesize' % addr)
+    assert expected_crc in output
@@ -9,12 +9,13 @@ import pytest
 def test_ut_dm_init(u_boot_console):
     """Initialize data for ut dm tests."""
 
-    fn = u_boot_console.config.source_dir + '/testflash.bin'
-    if not os.path.exists(fn):
-        data = 'this is a test'
-        data += '\x00' * ((4 * 1024 * 1024) - len(data))
-        with open(fn, 'wb') as fh:
-            fh.write(data)
+    for name in ['testflash.bin', 'testflash2.bin']:
+        fn = u_boot_console.config.source_dir + '/' + name
+        if not os.path.exists(fn):
+            data = 'this is a test'
+            data += '\x00' * ((4 * 1024 * 1024) - len(data))
+            with open(fn, 'wb') as fh:
+                fh.write(data)
 
     fn = u_boot_console.config.source_dir + '/spi.bin'
     if not os.path.exists(fn):